@@ -6,6 +6,11 @@ struct VertexToPixel
 	float2 uv           : TEXCOORD0;
 };
 
+cbuffer Data : register (b0)
+{
+	float bloomStrength; //the mip chain sums several levels, so scale it back down
+}
+
 Texture2D Original     :   register(t0);
 Texture2D Blurred      :   register(t1);
 SamplerState Sampler   :   register(s0);
@@ -14,6 +19,8 @@ float4 main(VertexToPixel input) : SV_TARGET
 {
 	float4 color = float4(0,0,0,1);
 	color = Original.Sample(Sampler, input.uv);
-	color += Blurred.Sample(Sampler, input.uv);
+	float4 bloom = Blurred.Sample(Sampler, input.uv);
+	color.rgb += bloom.rgb * bloomStrength;
+	color.a = saturate(color.a + bloom.a);
 	return color;
-}
\ No newline at end of file
+}
@@ -0,0 +1,234 @@
+#include "Bloom.h"
+#include "BlurKernel.h"
+#include "Profiler.h"
+#include <cstdio>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Loads the bloom shaders and sets up the additive blend state.
+// The levels themselves come from the render graph.
+// --------------------------------------------------------
+Bloom::Bloom(ID3D11Device* device, ID3D11DeviceContext* context, SimpleVertexShader* fullscreenVS)
+{
+	this->device = device;
+	this->context = context;
+	this->fullscreenVS = fullscreenVS;
+
+	extractPS = new SimplePixelShader(device, context);
+	extractPS->LoadShaderFile(L"ExtractBrightPS.cso");
+
+	downsamplePS = new SimplePixelShader(device, context);
+	downsamplePS->LoadShaderFile(L"BloomDownsamplePS.cso");
+
+	upsamplePS = new SimplePixelShader(device, context);
+	upsamplePS->LoadShaderFile(L"BloomUpsamplePS.cso");
+
+	// Upsampled levels are added onto what's already there
+	D3D11_BLEND_DESC bd = {};
+	bd.RenderTarget[0].BlendEnable = true;
+	bd.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	bd.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+	bd.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	bd.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	bd.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+	bd.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	bd.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	device->CreateBlendState(&bd, &additiveBlend);
+
+	graph = 0;
+	sampler = 0;
+}
+
+Bloom::~Bloom()
+{
+	delete extractPS;
+	delete downsamplePS;
+	delete upsamplePS;
+	additiveBlend->Release();
+}
+
+void Bloom::SetViewport(RGHandle texture)
+{
+	const RTDesc& desc = graph->GetDesc(texture);
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)desc.Width;
+	viewport.Height = (float)desc.Height;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+}
+
+void Bloom::DrawFullscreen()
+{
+	//unbind vert/index buffer
+	UINT stride = 0;
+	UINT offset = 0;
+	ID3D11Buffer* nothing = 0;
+	context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
+	context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+
+	// Draw a triangle that will hopefully fill the screen
+	context->Draw(3, 0);
+}
+
+// --------------------------------------------------------
+// Extract -> downsample chain -> upsample chain
+//
+// The levels are half float so the upsample can keep summing
+// them without clipping.
+// --------------------------------------------------------
+RGHandle Bloom::AddPasses(RenderGraph* graph, RGHandle scene, ID3D11SamplerState* sampler)
+{
+	this->graph = graph;
+	this->sampler = sampler;
+	this->scene = scene;
+
+	RTDesc desc = graph->GetDesc(scene);
+	desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	// Bright pass straight into half res
+	graph->AddPass("Bloom Extract",
+		[&](RGPassBuilder& builder)
+		{
+			desc.Width = max(desc.Width / 2, 1u);
+			desc.Height = max(desc.Height / 2, 1u);
+			builder.Read(scene);
+			mips[0] = builder.Write(builder.Create("Bloom Mip", desc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this]()
+		{
+			fullscreenVS->SetShader();
+			SetViewport(mips[0]);
+			ID3D11RenderTargetView* rtv = this->graph->GetRTV(mips[0]);
+			context->OMSetRenderTargets(1, &rtv, 0);
+			const RTDesc& source = this->graph->GetDesc(this->scene);
+			extractPS->SetShader();
+			extractPS->SetFloat2("texelSize", XMFLOAT2(1.0f / source.Width, 1.0f / source.Height));
+			extractPS->SetShaderResourceView("Pixels", this->graph->GetSRV(this->scene));
+			extractPS->SetSamplerState("Sampler", this->sampler);
+			extractPS->CopyAllBufferData();
+			DrawFullscreen();
+			extractPS->SetShaderResourceView("Pixels", 0);
+		});
+
+	// Walk down the chain
+	graph->AddPass("Bloom Downsample",
+		[&](RGPassBuilder& builder)
+		{
+			for (int i = 1; i < BLOOM_MIP_COUNT; i++)
+			{
+				desc.Width = max(desc.Width / 2, 1u);
+				desc.Height = max(desc.Height / 2, 1u);
+				builder.Read(mips[i - 1]);
+				mips[i] = builder.Write(builder.Create("Bloom Mip", desc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+			}
+		},
+		[this]()
+		{
+			fullscreenVS->SetShader();
+			downsamplePS->SetShader();
+			downsamplePS->SetSamplerState("Sampler", this->sampler);
+			for (int i = 1; i < BLOOM_MIP_COUNT; i++)
+			{
+				const RTDesc& source = this->graph->GetDesc(mips[i - 1]);
+				ID3D11RenderTargetView* rtv = this->graph->GetRTV(mips[i]);
+				SetViewport(mips[i]);
+				context->OMSetRenderTargets(1, &rtv, 0);
+				downsamplePS->SetFloat2("texelSize", XMFLOAT2(1.0f / source.Width, 1.0f / source.Height));
+				downsamplePS->CopyAllBufferData();
+				downsamplePS->SetShaderResourceView("Pixels", this->graph->GetSRV(mips[i - 1]));
+				DrawFullscreen();
+				downsamplePS->SetShaderResourceView("Pixels", 0);
+			}
+		});
+
+	// And back up, adding each level onto the next larger one
+	graph->AddPass("Bloom Upsample",
+		[&](RGPassBuilder& builder)
+		{
+			for (int i = BLOOM_MIP_COUNT - 1; i > 0; i--)
+			{
+				builder.Read(mips[i]);
+				builder.Write(mips[i - 1], RG_LOAD_PRESERVE, RG_COVER_FULL);
+			}
+		},
+		[this]()
+		{
+			fullscreenVS->SetShader();
+			upsamplePS->SetShader();
+			upsamplePS->SetSamplerState("Sampler", this->sampler);
+			upsamplePS->SetFloat("radius", 1.0f);
+			context->OMSetBlendState(additiveBlend, 0, 0xFFFFFFFF);
+			for (int i = BLOOM_MIP_COUNT - 1; i > 0; i--)
+			{
+				const RTDesc& source = this->graph->GetDesc(mips[i]);
+				ID3D11RenderTargetView* rtv = this->graph->GetRTV(mips[i - 1]);
+				SetViewport(mips[i - 1]);
+				context->OMSetRenderTargets(1, &rtv, 0);
+				upsamplePS->SetFloat2("texelSize", XMFLOAT2(1.0f / source.Width, 1.0f / source.Height));
+				upsamplePS->CopyAllBufferData();
+				upsamplePS->SetShaderResourceView("Pixels", this->graph->GetSRV(mips[i]));
+				DrawFullscreen();
+				upsamplePS->SetShaderResourceView("Pixels", 0);
+			}
+			context->OMSetBlendState(0, 0, 0xFFFFFFFF);
+			SetViewport(this->scene);
+		});
+
+	return mips[0];
+}
+
+// --------------------------------------------------------
+// Rough per-frame cost of the chain compared to the previous
+// full res extract + separable blur (radius 15, 9 bilinear
+// taps per direction) into RGBA8 targets.
+//
+// Counts texture fetches and bytes read/written, assuming
+// every fetch misses (so it's an upper bound on bandwidth).
+// --------------------------------------------------------
+void Bloom::PrintCostModel(unsigned int width, unsigned int height)
+{
+	const double rgba8 = 4.0;
+	const double rgba16f = 8.0;
+	double fullPixels = (double)width * height;
+
+	unsigned int mipWidth[BLOOM_MIP_COUNT];
+	unsigned int mipHeight[BLOOM_MIP_COUNT];
+	for (int i = 0; i < BLOOM_MIP_COUNT; i++)
+	{
+		mipWidth[i] = max((i == 0 ? width : mipWidth[i - 1]) / 2, 1u);
+		mipHeight[i] = max((i == 0 ? height : mipHeight[i - 1]) / 2, 1u);
+	}
+
+	// Old: extract (1 tap), then the separable blur at radius 15
+	// horizontally and vertically, all full res
+	BlurTap taps[BLUR_MAX_TAPS];
+	int blurFetches = 2 * ComputeLinearBlurTaps(15, 7.5f, taps) - 1;
+	double oldTaps = fullPixels * (1 + 2 * blurFetches);
+	double oldBytes = oldTaps * rgba8 + fullPixels * 3 * rgba8;
+
+	// New: 13 tap extract at half res, 13 tap downsamples, 9 tap upsamples
+	double newTaps = 0.0;
+	double newBytes = 0.0;
+	double p0 = (double)mipWidth[0] * mipHeight[0];
+	newTaps += p0 * 13;
+	newBytes += p0 * 13 * rgba8 + p0 * rgba16f;
+	for (int i = 1; i < BLOOM_MIP_COUNT; i++)
+	{
+		double p = (double)mipWidth[i] * mipHeight[i];
+		newTaps += p * 13;
+		newBytes += p * 13 * rgba16f + p * rgba16f;
+	}
+	for (int i = BLOOM_MIP_COUNT - 1; i > 0; i--)
+	{
+		double p = (double)mipWidth[i - 1] * mipHeight[i - 1];
+		newTaps += p * 9;
+		// Tent reads + blend read/modify/write of the target
+		newBytes += p * 9 * rgba16f + p * 2 * rgba16f;
+	}
+
+	printf("\nBloom cost at %ux%u\n", width, height);
+	printf("  full res separable: %8.2f M taps  %8.2f MB\n", oldTaps / 1e6, oldBytes / (1024 * 1024));
+	printf("  %d level mip chain:  %8.2f M taps  %8.2f MB\n", BLOOM_MIP_COUNT, newTaps / 1e6, newBytes / (1024 * 1024));
+}
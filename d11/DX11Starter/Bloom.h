@@ -0,0 +1,56 @@
+#pragma once
+#include <d3d11.h>
+#include "SimpleShader.h"
+#include "RenderGraph.h"
+#include "BloomKernel.h"
+
+// --------------------------------------------------------
+// Progressive (mip chain) bloom
+//
+// - Bright pixels are extracted straight into a half res target,
+//   through the 13 tap filter with the Karis average
+// - Each level is downsampled from the one above with a 13 tap filter
+// - The chain is walked back up with a tent filter, adding each
+//   level onto the next larger one
+// - Level 0 ends up holding the wide, soft bloom, ready for
+//   AdditiveBlend.hlsl to combine with the scene
+// - The levels are render graph transients, so they're sized
+//   off the scene texture and shared with later passes
+// - BloomKernel has the CPU reference of every stage
+// --------------------------------------------------------
+class Bloom
+{
+public:
+	Bloom(ID3D11Device* device, ID3D11DeviceContext* context, SimpleVertexShader* fullscreenVS);
+	~Bloom();
+
+	// Adds the extract/downsample/upsample passes and returns
+	// the final (half res) bloom texture
+	// - Passes leave the viewport set back to the scene size
+	RGHandle AddPasses(RenderGraph* graph, RGHandle scene, ID3D11SamplerState* sampler);
+
+	// Scale for AdditiveBlend, since the upsample sums every level
+	float GetStrength() { return 1.0f / BLOOM_MIP_COUNT; }
+
+	// Prints sample and bandwidth estimates vs. the old full res blur
+	void PrintCostModel(unsigned int width, unsigned int height);
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+
+	SimpleVertexShader* fullscreenVS;
+	SimplePixelShader* extractPS;
+	SimplePixelShader* downsamplePS;
+	SimplePixelShader* upsamplePS;
+	ID3D11BlendState* additiveBlend;
+
+	// This frame's graph handles (valid while it executes)
+	RenderGraph* graph;
+	ID3D11SamplerState* sampler;
+	RGHandle scene;
+	RGHandle mips[BLOOM_MIP_COUNT];
+
+	void SetViewport(RGHandle texture);
+	void DrawFullscreen();
+};
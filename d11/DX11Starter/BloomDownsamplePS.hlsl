@@ -0,0 +1,45 @@
+//13 tap downsample for the bloom mip chain
+//(Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare")
+//five overlapping 2x2 boxes, weighted so the center box counts the most,
+//which avoids the flickering a plain 4 tap box gives on small bright spots
+cbuffer Data : register (b0)
+{
+	float2 texelSize; //one texel of the SOURCE mip
+}
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD0;
+};
+
+Texture2D Pixels       :   register(t0);
+SamplerState Sampler   :   register(s0);
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float2 uv = input.uv;
+	float2 t = texelSize;
+
+	float4 a = Pixels.Sample(Sampler, uv + t * float2(-2, -2));
+	float4 b = Pixels.Sample(Sampler, uv + t * float2( 0, -2));
+	float4 c = Pixels.Sample(Sampler, uv + t * float2( 2, -2));
+	float4 d = Pixels.Sample(Sampler, uv + t * float2(-1, -1));
+	float4 e = Pixels.Sample(Sampler, uv + t * float2( 1, -1));
+	float4 f = Pixels.Sample(Sampler, uv + t * float2(-2,  0));
+	float4 g = Pixels.Sample(Sampler, uv);
+	float4 h = Pixels.Sample(Sampler, uv + t * float2( 2,  0));
+	float4 i = Pixels.Sample(Sampler, uv + t * float2(-1,  1));
+	float4 j = Pixels.Sample(Sampler, uv + t * float2( 1,  1));
+	float4 k = Pixels.Sample(Sampler, uv + t * float2(-2,  2));
+	float4 l = Pixels.Sample(Sampler, uv + t * float2( 0,  2));
+	float4 m = Pixels.Sample(Sampler, uv + t * float2( 2,  2));
+
+	//center box gets half the weight, the four corner boxes share the rest
+	float4 color = (d + e + i + j) * 0.125f;
+	color += (a + b + f + g) * 0.03125f;
+	color += (b + c + g + h) * 0.03125f;
+	color += (f + g + k + l) * 0.03125f;
+	color += (g + h + l + m) * 0.03125f;
+	return color;
+}
@@ -0,0 +1,177 @@
+#include "BloomKernel.h"
+#include <cmath>
+#include <vector>
+
+void BloomLevelSize(int width, int height, int level, int* levelWidth, int* levelHeight)
+{
+	for (int i = 0; i <= level; i++)
+	{
+		width = width / 2 > 1 ? width / 2 : 1;
+		height = height / 2 > 1 ? height / 2 : 1;
+	}
+	*levelWidth = width;
+	*levelHeight = height;
+}
+
+// Same weights as the brightness in ExtractBrightPS
+static float Luma(const float* c)
+{
+	return 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+}
+
+void BloomBright(const float in[4], float out[4])
+{
+	for (int i = 0; i < 4; i++) out[i] = in[i];
+
+	float brightness = Luma(in);
+	bool black;
+	if (in[3] == 0) black = false;                 // light object, always bloom
+	else if (in[3] == 1) black = brightness <= 0.72f;
+	else black = brightness <= 0.75f;               // sky, dimmed
+
+	if (black)
+		out[0] = out[1] = out[2] = 0;
+	else if (in[3] != 0 && in[3] != 1)
+		for (int i = 0; i < 3; i++) out[i] /= 5.0f;
+}
+
+static const float* Texel(const float* img, int width, int height, int x, int y)
+{
+	static const float border[4] = { 0, 0, 0, 0 };
+	if (x < 0 || y < 0 || x >= width || y >= height) return border;
+	return img + ((size_t)y * width + x) * 4;
+}
+
+void BloomSample(const float* img, int width, int height, float u, float v, float out[4])
+{
+	float x = u * width - 0.5f;
+	float y = v * height - 0.5f;
+	int x0 = (int)floorf(x);
+	int y0 = (int)floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	const float* a = Texel(img, width, height, x0, y0);
+	const float* b = Texel(img, width, height, x0 + 1, y0);
+	const float* c = Texel(img, width, height, x0, y0 + 1);
+	const float* d = Texel(img, width, height, x0 + 1, y0 + 1);
+	for (int i = 0; i < 4; i++)
+	{
+		float top = a[i] + (b[i] - a[i]) * fx;
+		float bottom = c[i] + (d[i] - c[i]) * fx;
+		out[i] = top + (bottom - top) * fy;
+	}
+}
+
+// --------------------------------------------------------
+// The 13 taps of BloomDownsamplePS / ExtractBrightPS, in
+// texels of the source, a..m row by row
+// --------------------------------------------------------
+static const float tapOffsets[13][2] =
+{
+	{ -2, -2 }, { 0, -2 }, { 2, -2 },
+	{ -1, -1 }, { 1, -1 },
+	{ -2, 0 }, { 0, 0 }, { 2, 0 },
+	{ -1, 1 }, { 1, 1 },
+	{ -2, 2 }, { 0, 2 }, { 2, 2 },
+};
+
+// The five 2x2 boxes as tap indices: the center one (d e i j)
+// gets half the weight, the corner ones an eighth each
+static const int boxTaps[5][4] =
+{
+	{ 3, 4, 8, 9 },
+	{ 0, 1, 5, 6 },
+	{ 1, 2, 6, 7 },
+	{ 5, 6, 10, 11 },
+	{ 6, 7, 11, 12 },
+};
+static const float boxWeights[5] = { 0.5f, 0.125f, 0.125f, 0.125f, 0.125f };
+
+static void Filter13(const float* src, int srcWidth, int srcHeight, float u, float v, bool bright, bool karis,
+	float out[4])
+{
+	float taps[13][4];
+	for (int t = 0; t < 13; t++)
+	{
+		BloomSample(src, srcWidth, srcHeight, u + tapOffsets[t][0] / srcWidth, v + tapOffsets[t][1] / srcHeight,
+			taps[t]);
+		if (bright) BloomBright(taps[t], taps[t]);
+	}
+
+	float sum[4] = { 0, 0, 0, 0 };
+	float weights = 0;
+	for (int b = 0; b < 5; b++)
+	{
+		float box[4];
+		for (int i = 0; i < 4; i++)
+			box[i] = (taps[boxTaps[b][0]][i] + taps[boxTaps[b][1]][i] + taps[boxTaps[b][2]][i] + taps[boxTaps[b][3]][i])
+				* 0.25f;
+		float w = boxWeights[b];
+		if (karis) w /= 1.0f + Luma(box);
+		for (int i = 0; i < 4; i++) sum[i] += box[i] * w;
+		weights += w;
+	}
+	for (int i = 0; i < 4; i++) out[i] = sum[i] / weights;
+}
+
+void BloomReferenceExtract(const float* scene, int width, int height, float* dst, bool karis)
+{
+	int dstWidth, dstHeight;
+	BloomLevelSize(width, height, 0, &dstWidth, &dstHeight);
+	for (int y = 0; y < dstHeight; y++)
+		for (int x = 0; x < dstWidth; x++)
+			Filter13(scene, width, height, (x + 0.5f) / dstWidth, (y + 0.5f) / dstHeight, true, karis,
+				dst + ((size_t)y * dstWidth + x) * 4);
+}
+
+void BloomReferenceDownsample(const float* src, int srcWidth, int srcHeight, float* dst, int dstWidth, int dstHeight)
+{
+	for (int y = 0; y < dstHeight; y++)
+		for (int x = 0; x < dstWidth; x++)
+			Filter13(src, srcWidth, srcHeight, (x + 0.5f) / dstWidth, (y + 0.5f) / dstHeight, false, false,
+				dst + ((size_t)y * dstWidth + x) * 4);
+}
+
+void BloomReferenceUpsample(const float* src, int srcWidth, int srcHeight, float* dst, int dstWidth, int dstHeight,
+	float radius)
+{
+	// 1 2 1 / 2 4 2 / 1 2 1, over 16
+	static const float tent[3] = { 1, 2, 1 };
+	for (int y = 0; y < dstHeight; y++)
+		for (int x = 0; x < dstWidth; x++)
+		{
+			float u = (x + 0.5f) / dstWidth;
+			float v = (y + 0.5f) / dstHeight;
+			float sum[4] = { 0, 0, 0, 0 };
+			for (int j = -1; j <= 1; j++)
+				for (int i = -1; i <= 1; i++)
+				{
+					float tap[4];
+					BloomSample(src, srcWidth, srcHeight, u + i * radius / srcWidth, v + j * radius / srcHeight, tap);
+					float w = tent[i + 1] * tent[j + 1];
+					for (int c = 0; c < 4; c++) sum[c] += tap[c] * w;
+				}
+			float* out = dst + ((size_t)y * dstWidth + x) * 4;
+			for (int c = 0; c < 4; c++) out[c] += sum[c] / 16.0f;
+		}
+}
+
+void BloomReference(const float* scene, int width, int height, float* dst)
+{
+	int w[BLOOM_MIP_COUNT], h[BLOOM_MIP_COUNT];
+	std::vector<float> levels[BLOOM_MIP_COUNT];
+	for (int i = 0; i < BLOOM_MIP_COUNT; i++)
+	{
+		BloomLevelSize(width, height, i, &w[i], &h[i]);
+		levels[i].resize((size_t)w[i] * h[i] * 4);
+	}
+
+	BloomReferenceExtract(scene, width, height, levels[0].data());
+	for (int i = 1; i < BLOOM_MIP_COUNT; i++)
+		BloomReferenceDownsample(levels[i - 1].data(), w[i - 1], h[i - 1], levels[i].data(), w[i], h[i]);
+	for (int i = BLOOM_MIP_COUNT - 1; i > 0; i--)
+		BloomReferenceUpsample(levels[i].data(), w[i], h[i], levels[i - 1].data(), w[i - 1], h[i - 1], 1.0f);
+
+	for (size_t i = 0; i < levels[0].size(); i++) dst[i] = levels[0][i];
+}
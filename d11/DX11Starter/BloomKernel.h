@@ -0,0 +1,52 @@
+#pragma once
+
+// --------------------------------------------------------
+// Bloom helpers
+//
+// The GPU path (see Bloom.cpp) runs as:
+//   1. Extract    - full res scene -> half res bright pass,
+//                   13 taps (five 2x2 boxes) with each box
+//                   weighted by 1 / (1 + luma), the Karis
+//                   average, so one bright pixel can't flicker
+//                   the whole chain
+//   2. Downsample - 13 tap filter, level by level
+//   3. Upsample   - 3x3 tent from each level, added onto the
+//                   next larger one, back up to level 0
+//
+// The functions below are the CPU reference for every stage.
+// They use the same math and fetch pattern as the shaders
+// (linear filtering, border addressing with a black border,
+// like Game's bloom sampler), so their output can be compared
+// against a GPU readback or a stored image.  Images are RGBA
+// floats, rows top to bottom.
+// --------------------------------------------------------
+
+// How many half-size levels the bloom chain has (level 0 is half res)
+#define BLOOM_MIP_COUNT 6
+
+// Size of a level: each is half the one above, at least 1x1
+void BloomLevelSize(int width, int height, int level, int* levelWidth, int* levelHeight);
+
+// What the bright pass keeps of one (filtered) scene fetch.
+// Alpha says what the pixel is: 0 lights (always kept), 1
+// geometry, anything else the sky (dimmed).
+void BloomBright(const float in[4], float out[4]);
+
+// Bilinear RGBA fetch at uv with border addressing (black, 0 alpha)
+void BloomSample(const float* img, int width, int height, float u, float v, float out[4]);
+
+// Full res scene -> half res bright pass (level 0's size).
+// karis = false averages the boxes plainly, for comparison.
+void BloomReferenceExtract(const float* scene, int width, int height, float* dst, bool karis = true);
+
+// One level -> the next smaller one
+void BloomReferenceDownsample(const float* src, int srcWidth, int srcHeight, float* dst, int dstWidth, int dstHeight);
+
+// Tent filtered src ADDED onto dst (one size up), like the
+// additive blend state
+void BloomReferenceUpsample(const float* src, int srcWidth, int srcHeight, float* dst, int dstWidth, int dstHeight,
+	float radius);
+
+// Runs the whole chain on a full res scene, writing level 0
+// (BloomLevelSize(width, height, 0)) into dst
+void BloomReference(const float* scene, int width, int height, float* dst);
@@ -0,0 +1,36 @@
+//3x3 tent filter upsample for the bloom mip chain
+//the result is ADDED (blend state) onto the next larger mip
+cbuffer Data : register (b0)
+{
+	float2 texelSize; //one texel of the SOURCE (smaller) mip
+	float radius;     //spreads the tent, in source texels
+}
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD0;
+};
+
+Texture2D Pixels       :   register(t0);
+SamplerState Sampler   :   register(s0);
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float2 uv = input.uv;
+	float2 t = texelSize * radius;
+
+	//1 2 1
+	//2 4 2  / 16
+	//1 2 1
+	float4 color = Pixels.Sample(Sampler, uv) * 4.0f;
+	color += Pixels.Sample(Sampler, uv + t * float2(-1,  0)) * 2.0f;
+	color += Pixels.Sample(Sampler, uv + t * float2( 1,  0)) * 2.0f;
+	color += Pixels.Sample(Sampler, uv + t * float2( 0, -1)) * 2.0f;
+	color += Pixels.Sample(Sampler, uv + t * float2( 0,  1)) * 2.0f;
+	color += Pixels.Sample(Sampler, uv + t * float2(-1, -1));
+	color += Pixels.Sample(Sampler, uv + t * float2( 1, -1));
+	color += Pixels.Sample(Sampler, uv + t * float2(-1,  1));
+	color += Pixels.Sample(Sampler, uv + t * float2( 1,  1));
+	return color / 16.0f;
+}
@@ -0,0 +1,195 @@
+#include "BlurKernel.h"
+#include "Profiler.h"
+#include <cmath>
+#include <cstdio>
+
+// --------------------------------------------------------
+// Weights for offsets 0..radius, normalized so the full
+// (two-sided) kernel sums to one
+// --------------------------------------------------------
+void ComputeGaussianWeights(int radius, float sigma, std::vector<float>& weights)
+{
+	weights.resize(radius + 1);
+
+	float total = 0.0f;
+	for (int i = 0; i <= radius; i++)
+	{
+		weights[i] = expf(-(float)(i * i) / (2.0f * sigma * sigma));
+		total += (i == 0) ? weights[i] : 2.0f * weights[i];
+	}
+
+	for (int i = 0; i <= radius; i++)
+		weights[i] /= total;
+}
+
+// --------------------------------------------------------
+// Pairs up texels (1,2), (3,4), ... on each side.  Sampling at
+//   (o1*w1 + o2*w2) / (w1 + w2)
+// with bilinear filtering returns (w1*t1 + w2*t2) / (w1 + w2),
+// so scaling that fetch by (w1 + w2) gives both taps at once.
+// --------------------------------------------------------
+int ComputeLinearBlurTaps(int radius, float sigma, BlurTap taps[BLUR_MAX_TAPS])
+{
+	if (radius > BLUR_MAX_RADIUS) radius = BLUR_MAX_RADIUS;
+
+	std::vector<float> weights;
+	ComputeGaussianWeights(radius, sigma, weights);
+
+	taps[0].Offset = 0.0f;
+	taps[0].Weight = weights[0];
+
+	int count = 1;
+	for (int i = 1; i <= radius; i += 2)
+	{
+		float w1 = weights[i];
+		float w2 = (i + 1 <= radius) ? weights[i + 1] : 0.0f;
+		float w = w1 + w2;
+
+		taps[count].Offset = (i * w1 + (i + 1) * w2) / w;
+		taps[count].Weight = w;
+		count++;
+	}
+	return count;
+}
+
+// Clamped RGBA fetch helper
+static inline const float* Texel(const float* img, int width, int height, int x, int y)
+{
+	x = x < 0 ? 0 : (x >= width ? width - 1 : x);
+	y = y < 0 ? 0 : (y >= height ? height - 1 : y);
+	return img + (y * width + x) * 4;
+}
+
+void BlurReferenceDiscrete(const float* src, float* dst, int width, int height, int radius, float sigma, bool horizontal)
+{
+	std::vector<float> weights;
+	ComputeGaussianWeights(radius, sigma, weights);
+	int dx = horizontal ? 1 : 0;
+	int dy = horizontal ? 0 : 1;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float sum[4] = { 0, 0, 0, 0 };
+			for (int i = -radius; i <= radius; i++)
+			{
+				const float* t = Texel(src, width, height, x + i * dx, y + i * dy);
+				float w = weights[i < 0 ? -i : i];
+				for (int c = 0; c < 4; c++) sum[c] += t[c] * w;
+			}
+			for (int c = 0; c < 4; c++) dst[(y * width + x) * 4 + c] = sum[c];
+		}
+	}
+}
+
+void BlurReferenceLinear(const float* src, float* dst, int width, int height, int radius, float sigma, bool horizontal)
+{
+	BlurTap taps[BLUR_MAX_TAPS];
+	int tapCount = ComputeLinearBlurTaps(radius, sigma, taps);
+	int dx = horizontal ? 1 : 0;
+	int dy = horizontal ? 0 : 1;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float sum[4] = { 0, 0, 0, 0 };
+			for (int t = 0; t < tapCount; t++)
+			{
+				// Emulate a bilinear fetch along the blur axis
+				int sides = (t == 0) ? 1 : 2;
+				for (int side = 0; side < sides; side++)
+				{
+					float o = (side == 0) ? taps[t].Offset : -taps[t].Offset;
+					int i0 = (int)floorf(o);
+					float f = o - i0;
+					const float* a = Texel(src, width, height, x + i0 * dx, y + i0 * dy);
+					const float* b = Texel(src, width, height, x + (i0 + 1) * dx, y + (i0 + 1) * dy);
+					for (int c = 0; c < 4; c++)
+						sum[c] += (a[c] * (1.0f - f) + b[c] * f) * taps[t].Weight;
+				}
+			}
+			for (int c = 0; c < 4; c++) dst[(y * width + x) * 4 + c] = sum[c];
+		}
+	}
+}
+
+void BlurReference2D(const float* src, float* dst, int width, int height, int radius, float sigma)
+{
+	std::vector<float> weights;
+	ComputeGaussianWeights(radius, sigma, weights);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float sum[4] = { 0, 0, 0, 0 };
+			for (int j = -radius; j <= radius; j++)
+				for (int i = -radius; i <= radius; i++)
+				{
+					const float* t = Texel(src, width, height, x + i, y + j);
+					float w = weights[i < 0 ? -i : i] * weights[j < 0 ? -j : j];
+					for (int c = 0; c < 4; c++) sum[c] += t[c] * w;
+				}
+			for (int c = 0; c < 4; c++) dst[(y * width + x) * 4 + c] = sum[c];
+		}
+	}
+}
+
+void BlurReferenceBox(const float* src, float* dst, int width, int height, int radius)
+{
+	float w = 1.0f / ((2 * radius + 1) * (2 * radius + 1));
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float sum[4] = { 0, 0, 0, 0 };
+			for (int j = -radius; j <= radius; j++)
+				for (int i = -radius; i <= radius; i++)
+				{
+					const float* t = Texel(src, width, height, x + i, y + j);
+					for (int c = 0; c < 4; c++) sum[c] += t[c];
+				}
+			for (int c = 0; c < 4; c++) dst[(y * width + x) * 4 + c] = sum[c] * w;
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// Benchmark
+// --------------------------------------------------------
+
+void BlurBenchmark(int width, int height, int radius)
+{
+	float sigma = radius * 0.5f;
+	BlurTap taps[BLUR_MAX_TAPS];
+	int mergedFetches = 2 * ComputeLinearBlurTaps(radius, sigma, taps) - 1;
+	int discreteFetches = 2 * radius + 1;
+	int boxFetches = discreteFetches * discreteFetches;
+
+	// The passes ping-pong between two images, as the GPU does
+	std::vector<float> a((size_t)width * height * 4), b(a.size());
+	for (size_t i = 0; i < a.size(); i++)
+		a[i] = (float)((unsigned int)(i * 2654435761u) >> 24) / 255.0f;
+
+	printf("\nSeparable blur CPU reference at %dx%d, radius %d (1 thread)\n", width, height, radius);
+	printf("  %-22s %14s %12s\n", "kernel", "fetches/pixel", "both passes");
+	printf("  %-22s %14d %12s\n", "old 2D box", boxFetches, "-");
+
+	unsigned __int64 start = Profiler::Now();
+	BlurReferenceDiscrete(a.data(), b.data(), width, height, radius, sigma, true);
+	BlurReferenceDiscrete(b.data(), a.data(), width, height, radius, sigma, false);
+	double discreteMs = Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+	printf("  %-22s %14d %10.1fms\n", "separable, discrete", 2 * discreteFetches, discreteMs);
+
+	// The CPU has no bilinear filter, so the merged reference
+	// reads both texels of every fetch and comes out slower here
+	start = Profiler::Now();
+	BlurReferenceLinear(a.data(), b.data(), width, height, radius, sigma, true);
+	BlurReferenceLinear(b.data(), a.data(), width, height, radius, sigma, false);
+	double mergedMs = Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+	printf("  %-22s %14d %10.1fms\n", "separable, bilinear", 2 * mergedFetches, mergedMs);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+
+// --------------------------------------------------------
+// Separable Gaussian blur helpers
+//
+// The GPU blur runs as two 1D passes (horizontal, then vertical).
+// Neighbouring taps are merged into a single bilinear fetch by
+// sampling between the two texels at the point where the hardware
+// filter reproduces their weighted sum, which halves the fetches.
+// --------------------------------------------------------
+
+// Largest radius the shader's tap array can hold
+#define BLUR_MAX_RADIUS 30
+#define BLUR_MAX_TAPS 16
+
+// One bilinear fetch: sampled at +offset and -offset texels
+// (the center tap is only sampled once)
+struct BlurTap
+{
+	float Offset;
+	float Weight;
+	float pad[2]; // Keeps each tap on a float4 boundary for HLSL
+};
+
+// Normalized 1D Gaussian weights for offsets 0..radius
+void ComputeGaussianWeights(int radius, float sigma, std::vector<float>& weights);
+
+// Merges the discrete weights into bilinear taps.  Returns the tap
+// count, with taps[0] always being the center.
+int ComputeLinearBlurTaps(int radius, float sigma, BlurTap taps[BLUR_MAX_TAPS]);
+
+// --------------------------------------------------------
+// CPU reference versions of one 1D pass over an RGBA float
+// image, clamping at the edges.  Used to check the shader's
+// output against the plain discrete kernel.
+// --------------------------------------------------------
+void BlurReferenceDiscrete(const float* src, float* dst, int width, int height, int radius, float sigma, bool horizontal);
+void BlurReferenceLinear(const float* src, float* dst, int width, int height, int radius, float sigma, bool horizontal);
+
+// The same blur done the slow way, every tap of the (2r+1)^2
+// square weighted by the 2D gaussian - what the two 1D passes
+// have to add up to
+void BlurReference2D(const float* src, float* dst, int width, int height, int radius, float sigma);
+
+// The kernel the separable blur replaced: an unweighted
+// (2r+1)^2 box, as the old GaussianBlur.hlsl sampled it
+void BlurReferenceBox(const float* src, float* dst, int width, int height, int radius);
+
+// Times both passes of the discrete and merged references on
+// a width x height image, and prints the fetches per pixel of
+// each kernel next to the old box
+void BlurBenchmark(int width, int height, int radius);
@@ -11,18 +11,22 @@ Camera::~Camera()
 {
 }
 
-Camera::Camera(int w, int h, float n, float f)
+Camera::Camera(int w, int h, float n, float f, CameraDepthMode mode)
 {
 	width = w;
 	height = h;
 	zNear = n;
 	zFar = f;
+	depthMode = mode;
 	xRot = 0;
 	yRot = 0;
+	prevXRot = 0;
+	prevYRot = 0;
 	XMStoreFloat4(&rotQuat, XMQuaternionIdentity());
 
 	//set up camera
 	camPos = XMFLOAT3(0, 0, -15);
+	prevCamPos = camPos;
 	dir = XMFLOAT3(0, 0, 1);
 	up = XMFLOAT3(0, 1, 0);
 	angle = 0.25 * M_PI;
@@ -39,13 +43,7 @@ void Camera::OnResize(int x, int y)
 	width = x;
 	height = y;
 	//set up projection matrix
-	XMMATRIX P = XMMatrixPerspectiveFovLH(
-		angle,
-		(float)width / height,
-		zNear,
-		zFar
-	);
-	XMStoreFloat4x4(&projMat, XMMatrixTranspose(P));
+	XMStoreFloat4x4(&projMat, XMMatrixTranspose(BuildProj()));
 }
 
 void Camera::Start()
@@ -59,13 +57,32 @@ void Camera::Start()
 	XMStoreFloat4x4(&viewMat, XMMatrixTranspose(V));
 
 	//set up projection matrix
-	XMMATRIX P = XMMatrixPerspectiveFovLH(
-		angle,
-		(float)width / height,
-		zNear,
-		zFar
-	);
-	XMStoreFloat4x4(&projMat, XMMatrixTranspose(P));
+	XMStoreFloat4x4(&projMat, XMMatrixTranspose(BuildProj()));
+}
+
+XMMATRIX Camera::BuildProj()
+{
+	if (depthMode == CAMERA_DEPTH_STANDARD)
+		return XMMatrixPerspectiveFovLH(angle, (float)width / height, zNear, zFar);
+
+	//reversed z with the far plane at infinity: clip z = zNear,
+	//clip w = view z, so depth = zNear / z: 1 at the near plane,
+	//heading to 0 far away.  float depth keeps its precision near
+	//0, which is exactly where the far distances end up
+	float yScale = 1.0f / tanf(angle * 0.5f);
+	float xScale = yScale * height / width;
+	return XMMatrixSet(
+		xScale, 0, 0, 0,
+		0, yScale, 0, 0,
+		0, 0, 0, 1,
+		0, 0, zNear, 0);
+}
+
+XMFLOAT2 Camera::getDepthParams()
+{
+	if (depthMode == CAMERA_DEPTH_STANDARD)
+		return XMFLOAT2(-zNear * zFar / (zFar - zNear), -zFar / (zFar - zNear));
+	return XMFLOAT2(zNear, 0);
 }
 
 void Camera::Move(float x, float y, float z)
@@ -96,3 +113,37 @@ void Camera::Update()
 	XMStoreFloat4x4(&viewMat, XMMatrixTranspose(newView));
 }
 
+void Camera::Simulate(const SimInput& input, float dt, float moveSpeed, float climbSpeed)
+{
+	Turn(input.TurnX, input.TurnY);
+	Update();
+
+	float move = moveSpeed * dt;
+	float climb = climbSpeed * dt;
+	if (input.Buttons & SIM_FORWARD) Move(0, 0, move);
+	if (input.Buttons & SIM_BACK) Move(0, 0, -move);
+	if (input.Buttons & SIM_LEFT) Move(move, 0, 0);
+	if (input.Buttons & SIM_RIGHT) Move(-move, 0, 0);
+	if (input.Buttons & SIM_UP) MoveUpDown(climb);
+	if (input.Buttons & SIM_DOWN) MoveUpDown(-climb);
+	Update();
+}
+
+void Camera::SaveState()
+{
+	prevCamPos = camPos;
+	prevXRot = xRot;
+	prevYRot = yRot;
+}
+
+void Camera::Interpolate(float alpha)
+{
+	//blend position and rotation between the last two sim ticks
+	//(the mouse turns the camera in ticks too)
+	XMVECTOR pos = XMVectorLerp(XMLoadFloat3(&prevCamPos), XMLoadFloat3(&camPos), alpha);
+	float x = prevXRot + (xRot - prevXRot) * alpha;
+	float y = prevYRot + (yRot - prevYRot) * alpha;
+	XMVECTOR newDir = XMVector3Rotate(XMVectorSet(0, 0, 1, 0), XMQuaternionRotationRollPitchYaw(x, y, 0));
+	XMMATRIX newView = XMMatrixLookToLH(pos, newDir, XMLoadFloat3(&up));
+	XMStoreFloat4x4(&viewMat, XMMatrixTranspose(newView));
+}
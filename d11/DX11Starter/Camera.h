@@ -2,6 +2,7 @@
 #include <DirectXMath.h>
 #include <d3d11.h>
 #include "DXCore.h"
+#include "SimInput.h"
 #include  <Windows.h>
 #define M_PI 3.141592653589
 
@@ -27,6 +28,13 @@ inline XMMATRIX mathFM(XMFLOAT4X4& val)
 	return XMLoadFloat4x4(&val);
 }
 
+//how view depth lands in the depth buffer
+enum CameraDepthMode
+{
+	CAMERA_DEPTH_STANDARD,			//near -> 0, far -> 1, zFar clips
+	CAMERA_DEPTH_REVERSED_INFINITE	//near -> 1, infinity -> 0, nothing clips far
+};
+
 //behave as fps camera
 //updates view & projection matrces
 //pitch - around x    yaw -  around y
@@ -35,26 +43,35 @@ class Camera
 	XMFLOAT4X4 viewMat, projMat; //view matrix and projection matrix
 	//for lookto view matrix
 	XMFLOAT3 camPos, dir, up;
+	XMFLOAT3 prevCamPos; //position at the start of the current sim tick
 	XMFLOAT4 rotQuat;
 	float xRot, yRot;
+	float prevXRot, prevYRot; //rotation at the start of the current sim tick
 	
 	//need the window info for perspective matrix
 	int width, height;  //window width, height
 	float angle,		//field of view
 		  zNear,	//near clip
-		  zFar;		//far clip
-	
+		  zFar;		//far clip (standard mode only)
+	CameraDepthMode depthMode;
+
+	XMMATRIX BuildProj();
 
 public:
 	Camera();
 	~Camera();
 	//customized constructor
-	Camera(int w, int h, float n, float f);
+	Camera(int w, int h, float n, float f, CameraDepthMode mode = CAMERA_DEPTH_STANDARD);
 
 	//getter
 	float getAngle() { return angle; }
 	float getNear() { return zNear; }
 	float getFar() { return zFar; }
+	CameraDepthMode getDepthMode() { return depthMode; }
+	//what the depth buffer clears to (the furthest depth)
+	float getFarDepth() { return depthMode == CAMERA_DEPTH_STANDARD ? 1.0f : 0.0f; }
+	//view space distance from depth buffer d is x / (d + y)
+	XMFLOAT2 getDepthParams();
 	XMFLOAT3& getCamPos() { return camPos; }
 	XMFLOAT3 getUp() { return mathVF(mathFV(up) - mathFV(camPos)); }
 	XMFLOAT4X4 getView() { return viewMat; }
@@ -70,6 +87,15 @@ public:
 	void Move(float x, float y, float z);
 	void Turn(float x, float y);
 	void Update();
+
+	//one sim tick of fps controls: turn, then move along the new
+	//facing (speeds in units per second)
+	void Simulate(const SimInput& input, float dt, float moveSpeed, float climbSpeed);
+
+	//fixed timestep helpers
+	//SaveState() at the start of a tick, Interpolate() before drawing
+	void SaveState();
+	void Interpolate(float alpha);
 	
 };
 
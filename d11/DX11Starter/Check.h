@@ -0,0 +1,21 @@
+#pragma once
+
+// --------------------------------------------------------
+// Pass / fail marks for the self-check reports
+//
+// Reports print "ok" or "FAILED" after each thing they check
+// through CheckResult, which also counts the failures, so
+// Tools/Checks can exit with an error when any check fails.
+// --------------------------------------------------------
+
+inline unsigned int& CheckFailureCount()
+{
+	static unsigned int failures = 0;
+	return failures;
+}
+
+inline const char* CheckResult(bool ok)
+{
+	if (!ok) CheckFailureCount()++;
+	return ok ? "ok" : "FAILED";
+}
@@ -0,0 +1,90 @@
+#include "ClusteredLighting.h"
+#include "Profiler.h"
+#include <cstring>
+
+ClusteredLighting::ClusteredLighting(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->context = context;
+	fovY = 0;
+	width = height = 0;
+	zNear = zFar = 0;
+
+	CreateBuffer(device, sizeof(LocalLight), CLUSTER_MAX_LIGHTS, &lightBuffer, &lightSRV);
+	CreateBuffer(device, sizeof(ClusterRange), CLUSTER_COUNT, &rangeBuffer, &rangeSRV);
+	CreateBuffer(device, sizeof(unsigned int), CLUSTER_MAX_INDICES, &indexBuffer, &indexSRV);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	lightSRV->Release();
+	rangeSRV->Release();
+	indexSRV->Release();
+	lightBuffer->Release();
+	rangeBuffer->Release();
+	indexBuffer->Release();
+}
+
+// Dynamic structured buffer, rewritten every frame
+void ClusteredLighting::CreateBuffer(ID3D11Device* device, unsigned int stride, unsigned int count,
+	ID3D11Buffer** buffer, ID3D11ShaderResourceView** srv)
+{
+	D3D11_BUFFER_DESC bd = {};
+	bd.ByteWidth = stride * count;
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bd.StructureByteStride = stride;
+	device->CreateBuffer(&bd, 0, buffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(*buffer, &srvDesc, srv);
+}
+
+void ClusteredLighting::Upload(ID3D11Buffer* buffer, const void* data, unsigned int bytes)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	if (bytes > 0) memcpy(mapped.pData, data, bytes);
+	context->Unmap(buffer, 0);
+}
+
+void ClusteredLighting::Update(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view,
+	float fovY, unsigned int width, unsigned int height, float zNear, float zFar)
+{
+	PROFILE_ZONE("ClusteredLighting::Update");
+
+	// Cluster boxes only change with the projection
+	if (fovY != this->fovY || width != this->width || height != this->height ||
+		zNear != this->zNear || zFar != this->zFar)
+	{
+		this->fovY = fovY;
+		this->width = width;
+		this->height = height;
+		this->zNear = zNear;
+		this->zFar = zFar;
+		grid.SetProjection(fovY, (float)width / height, zNear, zFar);
+	}
+
+	if (lightCount > CLUSTER_MAX_LIGHTS) lightCount = CLUSTER_MAX_LIGHTS;
+	grid.Assign(lights, lightCount, view);
+
+	Upload(lightBuffer, lights, lightCount * sizeof(LocalLight));
+	Upload(rangeBuffer, grid.GetRanges(), CLUSTER_COUNT * sizeof(ClusterRange));
+	Upload(indexBuffer, grid.GetIndices(), grid.GetIndexCount() * sizeof(unsigned int));
+}
+
+void ClusteredLighting::Bind(SimplePixelShader* ps)
+{
+	ps->SetShaderResourceView("Lights", lightSRV);
+	ps->SetShaderResourceView("ClusterRanges", rangeSRV);
+	ps->SetShaderResourceView("LightIndices", indexSRV);
+	ps->SetFloat2("clusterTileScale", XMFLOAT2((float)CLUSTER_X / width, (float)CLUSTER_Y / height));
+	ps->SetFloat("clusterSliceScale", grid.GetSliceScale());
+	ps->SetFloat("clusterSliceBias", grid.GetSliceBias());
+}
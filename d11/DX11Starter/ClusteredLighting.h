@@ -0,0 +1,54 @@
+#pragma once
+#include <d3d11.h>
+#include "SimpleShader.h"
+#include "LightClusters.h"
+
+// --------------------------------------------------------
+// Clustered forward lighting
+//
+// Bins the point/spot lights into the cluster grid on the
+// CPU each frame and uploads three structured buffers:
+//   Lights        - every LocalLight
+//   ClusterRanges - (offset, count) per cluster
+//   LightIndices  - the per-cluster light lists, back to back
+// Lit pixel shaders include ClusteredLighting.hlsli and only
+// loop over the lights in their own cluster.
+// --------------------------------------------------------
+class ClusteredLighting
+{
+public:
+	ClusteredLighting(ID3D11Device* device, ID3D11DeviceContext* context);
+	~ClusteredLighting();
+
+	// Bins the lights for this frame's camera and uploads the lists
+	// - view is the world -> view matrix (not transposed)
+	void Update(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view,
+		float fovY, unsigned int width, unsigned int height, float zNear, float zFar);
+
+	// Binds the buffers and sets the cluster constants on a lit
+	// pixel shader (copied by its next CopyAllBufferData)
+	void Bind(SimplePixelShader* ps);
+
+	ClusterGrid* GetGrid() { return &grid; }
+
+private:
+	ID3D11DeviceContext* context;
+
+	ClusterGrid grid;
+	float fovY;
+	unsigned int width;
+	unsigned int height;
+	float zNear;
+	float zFar;
+
+	ID3D11Buffer* lightBuffer;
+	ID3D11Buffer* rangeBuffer;
+	ID3D11Buffer* indexBuffer;
+	ID3D11ShaderResourceView* lightSRV;
+	ID3D11ShaderResourceView* rangeSRV;
+	ID3D11ShaderResourceView* indexSRV;
+
+	void CreateBuffer(ID3D11Device* device, unsigned int stride, unsigned int count,
+		ID3D11Buffer** buffer, ID3D11ShaderResourceView** srv);
+	void Upload(ID3D11Buffer* buffer, const void* data, unsigned int bytes);
+};
@@ -0,0 +1,86 @@
+//clustered point/spot lights
+//(see LightClusters.h for how the lists are built)
+#ifndef CLUSTERED_LIGHTING
+#define CLUSTERED_LIGHTING
+
+#include "LocalShadows.hlsli"
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+#define LIGHT_TYPE_POINT 0
+#define LIGHT_TYPE_SPOT 1
+
+struct LocalLight
+{
+	float4 AmbientColor;
+	float4 DiffuseColor;
+	float3 Direction;
+	float cone;
+	float3 LightPos;
+	float range;
+	int type;
+	int shadow;  //first LocalShadows entry, -1 = none
+	float2 pad;
+};
+
+cbuffer clusterData : register(b1)
+{
+	float2 clusterTileScale;  //clusters per pixel
+	float clusterSliceScale;  //slice = log(depth) * scale + bias
+	float clusterSliceBias;
+};
+
+StructuredBuffer<LocalLight> Lights : register(t2);
+StructuredBuffer<uint2> ClusterRanges : register(t3); //offset, count
+StructuredBuffer<uint> LightIndices : register(t4);
+
+//one point or spot light
+//specPower of 0 turns the highlight off
+float3 LocalLightColor(LocalLight l, float3 N, float3 worldPos, float3 toCam, float specPower)
+{
+	float3 toPixel = worldPos - l.LightPos;
+	float dist = length(toPixel);
+	float3 dir = toPixel / max(dist, 0.0001f);
+	float NdotL = saturate(dot(N, -dir));
+
+	float spec = 0;
+	if (specPower > 0)
+		spec = pow(max(dot(reflect(dir, N), toCam), 0), specPower);
+
+	//fade to zero at the range, so the cluster bounds are exact
+	float window = saturate(1.0 - dist * dist / (l.range * l.range));
+	window *= window;
+
+	//ambient is left unshadowed
+	float shadow = LocalShadowFactor(l.shadow, l.type == LIGHT_TYPE_POINT, l.LightPos, worldPos, N);
+
+	if (l.type == LIGHT_TYPE_POINT)
+	{
+		float attenuation = 1.0f / (1.0 + 0.1 * dist * dist);
+		return (l.DiffuseColor.rgb * NdotL + spec) * shadow * attenuation * window;
+	}
+
+	float angleFromCenter = max(dot(-dir, normalize(-l.Direction)), 0.0f);
+	float spotAmount = pow(angleFromCenter, 45.0f - l.cone);
+	return ((l.DiffuseColor.rgb * NdotL * spotAmount + spec) * shadow + l.AmbientColor.rgb) * window;
+}
+
+//sum of the lights in this pixel's cluster
+//pixelPos <-- SV_POSITION.xy, viewDepth <-- view space depth
+float3 ClusteredLights(float3 N, float3 worldPos, float3 camPos, float2 pixelPos, float viewDepth, float specPower)
+{
+	uint3 cluster;
+	cluster.xy = min(uint2(pixelPos * clusterTileScale), uint2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	cluster.z = (uint)clamp(floor(log(viewDepth) * clusterSliceScale + clusterSliceBias), 0, CLUSTER_Z - 1);
+	uint2 range = ClusterRanges[cluster.x + cluster.y * CLUSTER_X + cluster.z * CLUSTER_X * CLUSTER_Y];
+
+	float3 toCam = normalize(camPos - worldPos);
+	float3 total = 0;
+	for (uint i = 0; i < range.y; i++)
+		total += LocalLightColor(Lights[LightIndices[range.x + i]], N, worldPos, toCam, specPower);
+	return total;
+}
+
+#endif
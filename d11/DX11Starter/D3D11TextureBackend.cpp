@@ -0,0 +1,271 @@
+#include "TextureStreamer.h"
+#include "DDSTextureLoader.h"
+#include <wincodec.h>
+#include <fstream>
+#include <cstring>
+#pragma comment(lib, "windowscodecs.lib")
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// D3D11TextureBackend
+// --------------------------------------------------------
+D3D11TextureBackend::D3D11TextureBackend(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+D3D11TextureBackend::~D3D11TextureBackend()
+{
+	for (auto& srv : srvs)
+		if (srv) srv->Release();
+}
+
+// WIC needs COM on every thread that uses it
+void D3D11TextureBackend::WorkerStart()
+{
+	CoInitializeEx(0, COINIT_MULTITHREADED);
+}
+
+void D3D11TextureBackend::WorkerStop()
+{
+	CoUninitialize();
+}
+
+bool D3D11TextureBackend::ReadFile(const std::wstring& path, std::vector<unsigned char>* bytes)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::streamsize size = file.tellg();
+	if (size <= 0)
+		return false;
+	file.seekg(0);
+	bytes->resize((size_t)size);
+	return (bool)file.read((char*)bytes->data(), size);
+}
+
+static bool IsDDS(const std::wstring& path)
+{
+	if (path.size() < 4)
+		return false;
+	std::wstring ext = path.substr(path.size() - 4);
+	for (auto& c : ext) c = towlower(c);
+	return ext == L".dds";
+}
+
+// --------------------------------------------------------
+// DDS files are already GPU ready, so they're handed over
+// whole.  Everything else goes through WIC to RGBA8.
+// --------------------------------------------------------
+bool D3D11TextureBackend::Decode(const std::wstring& path, std::vector<unsigned char>& file, DecodedTexture* texture)
+{
+	texture->Width = texture->Height = 0;
+	if (IsDDS(path))
+	{
+		// Size from the header ("DDS ", then DDS_HEADER: size,
+		// flags, height, width), so the mips can stream
+		if (file.size() >= 20 && memcmp(file.data(), "DDS ", 4) == 0)
+		{
+			memcpy(&texture->Height, &file[12], 4);
+			memcpy(&texture->Width, &file[16], 4);
+		}
+		texture->Container = true;
+		texture->Data.swap(file);
+		return true;
+	}
+	texture->Container = false;
+
+	IWICImagingFactory* factory = 0;
+	if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))))
+		return false;
+
+	IWICStream* stream = 0;
+	IWICBitmapDecoder* decoder = 0;
+	IWICBitmapFrameDecode* frame = 0;
+	IWICFormatConverter* converter = 0;
+	bool ok =
+		SUCCEEDED(factory->CreateStream(&stream)) &&
+		SUCCEEDED(stream->InitializeFromMemory(file.data(), (DWORD)file.size())) &&
+		SUCCEEDED(factory->CreateDecoderFromStream(stream, 0, WICDecodeMetadataCacheOnDemand, &decoder)) &&
+		SUCCEEDED(decoder->GetFrame(0, &frame)) &&
+		SUCCEEDED(factory->CreateFormatConverter(&converter)) &&
+		SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0, WICBitmapPaletteTypeCustom)) &&
+		SUCCEEDED(converter->GetSize(&texture->Width, &texture->Height));
+
+	if (ok)
+	{
+		UINT stride = texture->Width * 4;
+		texture->Data.resize((size_t)stride * texture->Height);
+		ok = SUCCEEDED(converter->CopyPixels(0, stride, (UINT)texture->Data.size(), texture->Data.data()));
+	}
+
+	if (converter) converter->Release();
+	if (frame) frame->Release();
+	if (decoder) decoder->Release();
+	if (stream) stream->Release();
+	factory->Release();
+	return ok;
+}
+
+int D3D11TextureBackend::AddSRV(ID3D11ShaderResourceView* srv)
+{
+	if (!freeIDs.empty())
+	{
+		int id = freeIDs.back();
+		freeIDs.pop_back();
+		srvs[id] = srv;
+		return id;
+	}
+	srvs.push_back(srv);
+	return (int)srvs.size() - 1;
+}
+
+int D3D11TextureBackend::CreatePlaceholder(TexturePlaceholder kind)
+{
+	// RGBA8, red in the low byte
+	unsigned int pixel = 0xff808080;
+	if (kind == TEXTURE_PLACEHOLDER_NORMAL) pixel = 0xffff8080;
+	if (kind == TEXTURE_PLACEHOLDER_BLACK_CUBE) pixel = 0xff000000;
+	bool cube = kind == TEXTURE_PLACEHOLDER_BLACK_CUBE;
+
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = 1;
+	td.Height = 1;
+	td.MipLevels = 1;
+	td.ArraySize = cube ? 6 : 1;
+	td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_IMMUTABLE;
+	td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	td.MiscFlags = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+	D3D11_SUBRESOURCE_DATA data[6];
+	for (auto& d : data)
+	{
+		d.pSysMem = &pixel;
+		d.SysMemPitch = 4;
+		d.SysMemSlicePitch = 4;
+	}
+
+	ID3D11Texture2D* texture;
+	if (FAILED(device->CreateTexture2D(&td, data, &texture)))
+		return -1;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = td.Format;
+	if (cube)
+	{
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MipLevels = 1;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = 1;
+	}
+
+	ID3D11ShaderResourceView* srv = 0;
+	HRESULT hr = device->CreateShaderResourceView(texture, &srvDesc, &srv);
+	texture->Release();
+	return FAILED(hr) ? -1 : AddSRV(srv);
+}
+
+// --------------------------------------------------------
+// Box filters an RGBA8 image down firstMip levels in one go
+// --------------------------------------------------------
+static void Downsample(const DecodedTexture& texture, unsigned int firstMip, std::vector<unsigned char>* pixels,
+	unsigned int* width, unsigned int* height)
+{
+	unsigned int step = 1 << firstMip;
+	*width = texture.Width >> firstMip ? texture.Width >> firstMip : 1;
+	*height = texture.Height >> firstMip ? texture.Height >> firstMip : 1;
+	pixels->resize((size_t)*width * *height * 4);
+
+	for (unsigned int y = 0; y < *height; y++)
+		for (unsigned int x = 0; x < *width; x++)
+		{
+			unsigned int sum[4] = { 0, 0, 0, 0 }, count = 0;
+			for (unsigned int sy = y * step; sy < (y + 1) * step && sy < texture.Height; sy++)
+				for (unsigned int sx = x * step; sx < (x + 1) * step && sx < texture.Width; sx++)
+				{
+					const unsigned char* p = &texture.Data[((size_t)sy * texture.Width + sx) * 4];
+					for (int c = 0; c < 4; c++) sum[c] += p[c];
+					count++;
+				}
+			unsigned char* out = &(*pixels)[((size_t)y * *width + x) * 4];
+			for (int c = 0; c < 4; c++) out[c] = (unsigned char)((sum[c] + count / 2) / count);
+		}
+}
+
+// --------------------------------------------------------
+// Decoded images get a full mip chain built on the GPU, the
+// same as CreateWICTextureFromFile with a context.  Leaving
+// out the finest mips means a smaller texture - DDS files
+// skip them on load, decoded images are filtered down first.
+// --------------------------------------------------------
+int D3D11TextureBackend::Upload(const DecodedTexture& texture, unsigned int firstMip)
+{
+	ID3D11ShaderResourceView* srv = 0;
+	if (texture.Container)
+	{
+		// maxsize drops every mip bigger than it
+		unsigned int size = texture.Width > texture.Height ? texture.Width : texture.Height;
+		size_t maxSize = firstMip > 0 ? (size >> firstMip ? size >> firstMip : 1) : 0;
+		if (FAILED(CreateDDSTextureFromMemoryEx(device, texture.Data.data(), texture.Data.size(), maxSize,
+			D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, false, 0, &srv)))
+			return -1;
+		return AddSRV(srv);
+	}
+
+	const unsigned char* pixels = texture.Data.data();
+	unsigned int width = texture.Width, height = texture.Height;
+	std::vector<unsigned char> smaller;
+	if (firstMip > 0)
+	{
+		Downsample(texture, firstMip, &smaller, &width, &height);
+		pixels = smaller.data();
+	}
+
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = width;
+	td.Height = height;
+	td.MipLevels = 0;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	td.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+	ID3D11Texture2D* tex;
+	if (FAILED(device->CreateTexture2D(&td, 0, &tex)))
+		return -1;
+	context->UpdateSubresource(tex, 0, 0, pixels, width * 4, 0);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = td.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = (UINT)-1;
+	HRESULT hr = device->CreateShaderResourceView(tex, &srvDesc, &srv);
+	tex->Release();
+	if (FAILED(hr))
+		return -1;
+
+	context->GenerateMips(srv);
+	return AddSRV(srv);
+}
+
+void D3D11TextureBackend::DestroyTexture(int id)
+{
+	if (srvs[id]) srvs[id]->Release();
+	srvs[id] = 0;
+	freeIDs.push_back(id);
+}
+
+ID3D11ShaderResourceView* D3D11TextureBackend::GetSRV(int id)
+{
+	return id >= 0 ? srvs[id] : 0;
+}
@@ -1,4 +1,5 @@
 #include "DXCore.h"
+#include "Profiler.h"
 
 #include <WindowsX.h>
 #include <sstream>
@@ -33,6 +34,9 @@ DXCore::DXCore(
 	unsigned int windowWidth,	// Width of the window's client area
 	unsigned int windowHeight,	// Height of the window's client area
 	bool debugTitleBarStats)	// Show extra stats (fps) in title bar?
+	// Default to a 60hz simulation, and never run more than
+	// a handful of catch-up ticks in a single frame
+	: simClock(1.0f / 60.0f, 5)
 {
 	// Save a static reference to this object.
 	//  - Since the OS-level message function must be a non-member (global) function, 
@@ -50,12 +54,15 @@ DXCore::DXCore(
 	// Initialize fields
 	fpsFrameCount = 0;
 	fpsTimeElapsed = 0.0f;
+
+	interpolationAlpha = 0.0f;
 	
 	device = 0;
 	context = 0;
 	swapChain = 0;
 	backBufferRTV = 0;
 	depthStencilView = 0;
+	depthBufferSRV = 0;
 
 	// Query performance counter for accurate timing information
 	__int64 perfFreq;
@@ -70,6 +77,7 @@ DXCore::~DXCore()
 {
 	// Release all DirectX resources
 	if (depthStencilView) { depthStencilView->Release(); }
+	if (depthBufferSRV) { depthBufferSRV->Release(); }
 	if (backBufferRTV) { backBufferRTV->Release();}
 
 	if (swapChain) { swapChain->Release();}
@@ -234,9 +242,9 @@ HRESULT DXCore::InitDirectX()
 	depthStencilDesc.Height				= height;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
-	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilDesc.Format				= DXGI_FORMAT_R32_TYPELESS; // Typeless so it can also be read
 	depthStencilDesc.Usage				= D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL;
+	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	depthStencilDesc.CPUAccessFlags		= 0;
 	depthStencilDesc.MiscFlags			= 0;
 	depthStencilDesc.SampleDesc.Count	= 1;
@@ -246,7 +254,17 @@ HRESULT DXCore::InitDirectX()
 	// release our reference to the texture
 	ID3D11Texture2D* depthBufferTexture;
 	device->CreateTexture2D(&depthStencilDesc, 0, &depthBufferTexture);
-	device->CreateDepthStencilView(depthBufferTexture, 0, &depthStencilView);
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT; // Float for reversed z, no stencil
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(depthBufferTexture, &dsvDesc, &depthStencilView);
+
+	// Depth view for post processing
+	D3D11_SHADER_RESOURCE_VIEW_DESC depthSRVDesc = {};
+	depthSRVDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	depthSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	depthSRVDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(depthBufferTexture, &depthSRVDesc, &depthBufferSRV);
 	depthBufferTexture->Release();
 
 	// Bind the views to the pipeline, so rendering properly 
@@ -280,6 +298,7 @@ void DXCore::OnResize()
 {
 	// Release existing DirectX views and buffers
 	if (depthStencilView) { depthStencilView->Release(); }
+	if (depthBufferSRV) { depthBufferSRV->Release(); }
 	if (backBufferRTV) { backBufferRTV->Release(); }
 
 	// Resize the underlying swap chain buffers
@@ -303,9 +322,9 @@ void DXCore::OnResize()
 	depthStencilDesc.Height				= height;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
-	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilDesc.Format				= DXGI_FORMAT_R32_TYPELESS; // Typeless so it can also be read
 	depthStencilDesc.Usage				= D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL;
+	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	depthStencilDesc.CPUAccessFlags		= 0;
 	depthStencilDesc.MiscFlags			= 0;
 	depthStencilDesc.SampleDesc.Count	= 1;
@@ -315,7 +334,17 @@ void DXCore::OnResize()
 	// release our reference to the texture
 	ID3D11Texture2D* depthBufferTexture;
 	device->CreateTexture2D(&depthStencilDesc, 0, &depthBufferTexture);
-	device->CreateDepthStencilView(depthBufferTexture, 0, &depthStencilView);
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT; // Float for reversed z, no stencil
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(depthBufferTexture, &dsvDesc, &depthStencilView);
+
+	// Depth view for post processing
+	D3D11_SHADER_RESOURCE_VIEW_DESC depthSRVDesc = {};
+	depthSRVDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	depthSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	depthSRVDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(depthBufferTexture, &depthSRVDesc, &depthBufferSRV);
 	depthBufferTexture->Release();
 
 	// Bind the views to the pipeline, so rendering properly 
@@ -350,6 +379,9 @@ HRESULT DXCore::Run()
 	currentTime = now;
 	previousTime = now;
 
+	// Start up the profiler before anything worth timing happens
+	Profiler::Init();
+
 	// Give subclass a chance to initialize
 	Init();
 
@@ -373,11 +405,18 @@ HRESULT DXCore::Run()
 				UpdateTitleBarStats();
 
 			// The game loop
-			Update(deltaTime, totalTime);
+			//  - Simulation runs in fixed steps
+			//  - Drawing runs once per frame
+			TickSimulation();
 			Draw(deltaTime, totalTime);
+
+			// Collect this frame's profiler zones
+			Profiler::EndFrame();
 		}
 	}
 
+	Profiler::Shutdown();
+
 	// We'll end up here once we get a WM_QUIT message,
 	// which usually comes from the user closing the window
 	return (HRESULT)msg.wParam;
@@ -418,6 +457,31 @@ void DXCore::UpdateTimer()
 }
 
 
+// --------------------------------------------------------
+// Sets how many fixed simulation ticks happen per second
+// --------------------------------------------------------
+void DXCore::SetTickRate(float ticksPerSecond)
+{
+	simClock.SetStep(1.0f / ticksPerSecond);
+}
+
+
+// --------------------------------------------------------
+// Feeds this frame's delta time into the clock and calls
+// Update() once per whole fixed step that has built up, each
+// with its own input snapshot.  The clock drops time past a
+// few ticks a frame so a long frame can't snowball.
+// --------------------------------------------------------
+void DXCore::TickSimulation()
+{
+	simClock.Advance(deltaTime, this);
+
+	// Leftover time tells Draw() how far to blend between
+	// the previous and current simulation states
+	interpolationAlpha = simClock.GetAlpha();
+}
+
+
 // --------------------------------------------------------
 // Updates the window's title bar with several stats once
 // per second, including:
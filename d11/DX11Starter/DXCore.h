@@ -3,12 +3,13 @@
 #include <Windows.h>
 #include <d3d11.h>
 #include <string>
+#include "SimInput.h"
 
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d11.lib")
 
-class DXCore
+class DXCore : public ISimulation
 {
 public:
 	DXCore(
@@ -37,12 +38,19 @@ public:
 	HRESULT Run();				
 	void Quit();
 	virtual void OnResize();
+
+	// Fixed-timestep simulation settings
+	void SetTickRate(float ticksPerSecond);
+	float GetInterpolationAlpha() { return interpolationAlpha; }
 	
 	// Pure virtual methods for setup and game functionality
 	virtual void Init()										= 0;
-	virtual void Update(float deltaTime, float totalTime)	= 0;
+	virtual void Update(const SimInput& input, float deltaTime, double totalTime) = 0;
 	virtual void Draw(float deltaTime, float totalTime)		= 0;
 
+	// The input for the next Update() tick (nothing held by default)
+	virtual SimInput SampleInput() { SimInput none = {}; return none; }
+
 	// Convenience methods for handling mouse input, since we
 	// can easily grab mouse input from OS-level messages
 	virtual void OnMouseDown (WPARAM buttonState, int x, int y) { }
@@ -68,6 +76,14 @@ protected:
 
 	ID3D11RenderTargetView* backBufferRTV;
 	ID3D11DepthStencilView* depthStencilView;
+	ID3D11ShaderResourceView* depthBufferSRV; // Same depth buffer, readable in shaders
+
+	// Fixed-timestep simulation
+	//  - Update() is always called with the clock's step and
+	//    one SampleInput() snapshot
+	//  - Draw() runs once per loop iteration, uncapped
+	FixedStepClock simClock;
+	float interpolationAlpha;	// How far (0-1) we are between the last two ticks
 
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
@@ -86,6 +102,7 @@ private:
 	float fpsTimeElapsed;
 	
 	void UpdateTimer();			// Updates the timer for this frame
+	void TickSimulation();		// Runs as many fixed Update() ticks as needed
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
 };
 
@@ -0,0 +1,80 @@
+//input
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD0;
+};
+
+//direction light struct
+struct DirectionalLight
+{
+	float4 AmbientColor;
+	float4 DiffuseColor;
+	float3 Direction;
+	float pad;
+};
+
+#include "GBuffer.hlsli"
+#include "ClusteredLighting.hlsli"
+#include "Shadows.hlsli"
+#include "SkyLighting.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	DirectionalLight light;
+
+	//the camera
+	float3 camPos;
+	matrix invView;      //view --> world
+	float4 projParams;   //tan(fov x / 2), tan(fov y / 2), view depth = z / (depth + w)
+	float farDepth;      //what depth cleared to (0 with reversed z)
+};
+
+//g-buffer + depth (t2-t4 are the cluster buffers, t6 the shadow maps,
+//t7/t8 local shadows, t11/t12 the sky)
+Texture2D GBufferAlbedo : register(t0);
+Texture2D GBufferNormal : register(t1);
+Texture2D Depth         : register(t5);
+
+// --------------------------------------------------------
+// One full screen pass, every covered pixel lit exactly once.
+// Same lighting as MaterialPS, with the
+// position rebuilt from the depth buffer.
+// --------------------------------------------------------
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	int3 pixel = int3(input.position.xy, 0);
+
+	//nothing drawn here, the sky fills it in afterwards
+	float depth = Depth.Load(pixel).r;
+	if (depth == farDepth)
+		discard;
+
+	GBufferSurface s = UnpackGBuffer(GBufferAlbedo.Load(pixel), GBufferNormal.Load(pixel));
+
+	//light markers, alpha 0 so they always bloom
+	if (s.material == GBUFFER_MATERIAL_UNLIT)
+		return float4(s.albedo, 0);
+
+	//view space position from depth
+	float viewDepth = projParams.z / (depth + projParams.w);
+
+	float2 size;
+	Depth.GetDimensions(size.x, size.y);
+	float2 ndc = float2(input.position.x / size.x * 2 - 1, 1 - input.position.y / size.y * 2);
+	float3 worldPos = mul(float4(ndc * projParams.xy * viewDepth, viewDepth, 1), invView).xyz;
+
+	//directional light calculation, the sky's SH for ambient
+	float3 lightDir = normalize(-light.Direction);
+	float totalLight = saturate(dot(s.normal, lightDir));
+	float shadow = ShadowFactor(worldPos, s.normal, viewDepth);
+	float4 color1 = light.DiffuseColor * totalLight * shadow + float4(SkyDiffuse(s.normal), 0);
+
+	//point and spot lights, only the ones that reach this pixel's cluster
+	float3 localLight = ClusteredLights(s.normal, worldPos, camPos, input.position.xy, viewDepth, s.shininess);
+
+	//the sky's reflection, on top of the albedo
+	float3 skySpecular = SkySpecularLight(s.normal, normalize(camPos - worldPos), s.shininess);
+
+	return float4(s.albedo * (color1.rgb + localLight) + skySpecular, 1);
+}
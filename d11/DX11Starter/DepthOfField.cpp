@@ -0,0 +1,231 @@
+#include "DepthOfField.h"
+#include <cstdio>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Loads the DoF shaders and builds the gather disc.
+// Targets come from the render graph.
+// --------------------------------------------------------
+DepthOfField::DepthOfField(ID3D11Device* device, ID3D11DeviceContext* context, SimpleVertexShader* fullscreenVS)
+{
+	this->device = device;
+	this->context = context;
+	this->fullscreenVS = fullscreenVS;
+
+	prepareCS = new SimpleComputeShader(device, context);
+	prepareCS->LoadShaderFile(L"DofPrepareCS.cso");
+
+	tileMaxCS = new SimpleComputeShader(device, context);
+	tileMaxCS->LoadShaderFile(L"DofTileMaxCS.cso");
+
+	dilateCS = new SimpleComputeShader(device, context);
+	dilateCS->LoadShaderFile(L"DofDilateCS.cso");
+
+	gatherCS = new SimpleComputeShader(device, context);
+	gatherCS->LoadShaderFile(L"DofGatherCS.cso");
+
+	compositePS = new SimplePixelShader(device, context);
+	compositePS->LoadShaderFile(L"DofCompositePS.cso");
+
+	tapCount = DofComputeGatherTaps(taps);
+
+	graph = 0;
+	clampSampler = 0;
+}
+
+DepthOfField::~DepthOfField()
+{
+	delete prepareCS;
+	delete tileMaxCS;
+	delete dilateCS;
+	delete gatherCS;
+	delete compositePS;
+}
+
+// --------------------------------------------------------
+// Prepare -> tile max -> dilate -> gather -> composite
+// --------------------------------------------------------
+void DepthOfField::AddPasses(
+	RenderGraph* graph,
+	RGHandle scene,
+	RGHandle depth,
+	RGHandle target,
+	ID3D11SamplerState* clampSampler,
+	const DofParams& params,
+	XMFLOAT2 depthParams)
+{
+	this->graph = graph;
+	this->clampSampler = clampSampler;
+	this->scene = scene;
+	this->depth = depth;
+	this->target = target;
+	dofParams = XMFLOAT4(params.NearStart, params.FocusDistance, params.FarEnd, params.MaxCoC);
+	viewDepthParams = depthParams;
+
+	const RTDesc& sceneDesc = graph->GetDesc(scene);
+	fullSize[0] = sceneDesc.Width;
+	fullSize[1] = sceneDesc.Height;
+	halfSize[0] = (fullSize[0] + 1) / 2;
+	halfSize[1] = (fullSize[1] + 1) / 2;
+	tileCount[0] = (halfSize[0] + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+	tileCount[1] = (halfSize[1] + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+
+	RTDesc halfDesc = { (unsigned int)halfSize[0], (unsigned int)halfSize[1],
+		DXGI_FORMAT_R16G16B16A16_FLOAT, D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE };
+	RTDesc tileDesc = { (unsigned int)tileCount[0], (unsigned int)tileCount[1],
+		DXGI_FORMAT_R16G16_FLOAT, D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE };
+
+	// Full res -> half res color + CoC
+	graph->AddPass("DoF Prepare",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Read(scene);
+			builder.Read(depth);
+			halfColor = builder.Write(builder.Create("DoF Half Color", halfDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this]()
+		{
+			prepareCS->SetShader();
+			prepareCS->SetFloat4("dofParams", dofParams);
+			prepareCS->SetFloat2("depthParams", viewDepthParams);
+			prepareCS->SetData("fullSize", fullSize, sizeof(fullSize));
+			prepareCS->CopyAllBufferData();
+			prepareCS->SetShaderResourceView("Scene", this->graph->GetSRV(this->scene));
+			prepareCS->SetShaderResourceView("Depth", this->graph->GetSRV(this->depth));
+			prepareCS->SetUnorderedAccessView("HalfColor", this->graph->GetUAV(halfColor));
+			prepareCS->DispatchByThreads(halfSize[0], halfSize[1], 1);
+			prepareCS->SetShaderResourceView("Scene", 0);
+			prepareCS->SetShaderResourceView("Depth", 0);
+			prepareCS->SetUnorderedAccessView("HalfColor", 0);
+		});
+
+	// Largest CoC per tile
+	graph->AddPass("DoF Tile Max",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Read(halfColor);
+			tiles = builder.Write(builder.Create("DoF Tiles", tileDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this]()
+		{
+			tileMaxCS->SetShader();
+			tileMaxCS->SetData("halfSize", halfSize, sizeof(halfSize));
+			tileMaxCS->CopyAllBufferData();
+			tileMaxCS->SetShaderResourceView("HalfColor", this->graph->GetSRV(halfColor));
+			tileMaxCS->SetUnorderedAccessView("Tiles", this->graph->GetUAV(tiles));
+			tileMaxCS->DispatchByGroups(tileCount[0], tileCount[1], 1);
+			tileMaxCS->SetShaderResourceView("HalfColor", 0);
+			tileMaxCS->SetUnorderedAccessView("Tiles", 0);
+		});
+
+	// Spread the near CoC to neighbouring tiles
+	graph->AddPass("DoF Dilate",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Read(tiles);
+			dilated = builder.Write(builder.Create("DoF Dilated Tiles", tileDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this]()
+		{
+			dilateCS->SetShader();
+			dilateCS->SetData("tileCount", tileCount, sizeof(tileCount));
+			dilateCS->CopyAllBufferData();
+			dilateCS->SetShaderResourceView("Tiles", this->graph->GetSRV(tiles));
+			dilateCS->SetUnorderedAccessView("Dilated", this->graph->GetUAV(dilated));
+			dilateCS->DispatchByThreads(tileCount[0], tileCount[1], 1);
+			dilateCS->SetShaderResourceView("Tiles", 0);
+			dilateCS->SetUnorderedAccessView("Dilated", 0);
+		});
+
+	// Near and far layers at half res
+	graph->AddPass("DoF Gather",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Read(halfColor);
+			builder.Read(dilated);
+			nearField = builder.Write(builder.Create("DoF Near", halfDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+			farField = builder.Write(builder.Create("DoF Far", halfDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this]()
+		{
+			gatherCS->SetShader();
+			gatherCS->SetData("taps", taps, sizeof(DofTap) * DOF_MAX_TAPS);
+			gatherCS->SetData("halfSize", halfSize, sizeof(halfSize));
+			gatherCS->SetInt("tapCount", tapCount);
+			gatherCS->CopyAllBufferData();
+			gatherCS->SetShaderResourceView("HalfColor", this->graph->GetSRV(halfColor));
+			gatherCS->SetShaderResourceView("Dilated", this->graph->GetSRV(dilated));
+			gatherCS->SetUnorderedAccessView("NearField", this->graph->GetUAV(nearField));
+			gatherCS->SetUnorderedAccessView("FarField", this->graph->GetUAV(farField));
+			gatherCS->DispatchByThreads(halfSize[0], halfSize[1], 1);
+			gatherCS->SetShaderResourceView("HalfColor", 0);
+			gatherCS->SetShaderResourceView("Dilated", 0);
+			gatherCS->SetUnorderedAccessView("NearField", 0);
+			gatherCS->SetUnorderedAccessView("FarField", 0);
+		});
+
+	// Full res composite
+	graph->AddPass("DoF Composite",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Read(scene);
+			builder.Read(depth);
+			builder.Read(nearField);
+			builder.Read(farField);
+			builder.Write(target, RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this]()
+		{
+			ID3D11RenderTargetView* rtv = this->graph->GetRTV(this->target);
+			context->OMSetRenderTargets(1, &rtv, 0);
+			fullscreenVS->SetShader();
+			compositePS->SetShader();
+			compositePS->SetFloat4("dofParams", dofParams);
+			compositePS->SetFloat2("depthParams", viewDepthParams);
+			compositePS->CopyAllBufferData();
+			compositePS->SetShaderResourceView("Scene", this->graph->GetSRV(this->scene));
+			compositePS->SetShaderResourceView("Depth", this->graph->GetSRV(this->depth));
+			compositePS->SetShaderResourceView("NearField", this->graph->GetSRV(nearField));
+			compositePS->SetShaderResourceView("FarField", this->graph->GetSRV(farField));
+			compositePS->SetSamplerState("Sampler", this->clampSampler);
+
+			//unbind vert/index buffer
+			UINT stride = 0;
+			UINT offset = 0;
+			ID3D11Buffer* nothing = 0;
+			context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
+			context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+
+			// Draw a triangle that will hopefully fill the screen
+			context->Draw(3, 0);
+
+			// Depth goes back to being a depth buffer next frame
+			compositePS->SetShaderResourceView("Scene", 0);
+			compositePS->SetShaderResourceView("Depth", 0);
+			compositePS->SetShaderResourceView("NearField", 0);
+			compositePS->SetShaderResourceView("FarField", 0);
+		});
+}
+
+// --------------------------------------------------------
+// The old path was a separable pre-blur (radius 10, 6 bilinear
+// taps per direction) plus a 12 tap Poisson pixel shader that
+// read the scene and blurred scene per tap (29 fetches), all
+// at full res.
+// --------------------------------------------------------
+void DepthOfField::PrintTapReport(unsigned int width, unsigned int height)
+{
+	double fullPixels = (double)width * height;
+	double oldBlur = fullPixels * (11 + 11);
+	double oldDof = fullPixels * 29;
+
+	DofTapReport r = DofEstimateTaps(width, height, tapCount);
+	printf("\nDoF fetches at %ux%u (%d gather taps, worst case)\n", width, height, tapCount);
+	printf("  prepare:   %8.2f M\n", r.Prepare / 1e6);
+	printf("  tile max:  %8.2f M\n", r.TileMax / 1e6);
+	printf("  dilate:    %8.2f M\n", r.Dilate / 1e6);
+	printf("  gather:    %8.2f M\n", r.Gather / 1e6);
+	printf("  composite: %8.2f M\n", r.Composite / 1e6);
+	printf("  total:     %8.2f M  (old blur + poisson: %.2f M)\n", r.Total() / 1e6, (oldBlur + oldDof) / 1e6);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <d3d11.h>
+#include "SimpleShader.h"
+#include "DofKernel.h"
+#include "RenderGraph.h"
+
+// --------------------------------------------------------
+// Compute shader depth of field
+//
+// - The CoC comes from the real depth buffer
+// - Near and far fields are gathered at half res, with the
+//   near CoC dilated across tiles so foreground blur can
+//   spread past silhouettes
+// - A full res pixel shader composites both layers over
+//   the sharp scene
+// - Every intermediate is a render graph transient
+//
+// See DofKernel.h for the stages and their CPU reference.
+// --------------------------------------------------------
+class DepthOfField
+{
+public:
+	DepthOfField(ID3D11Device* device, ID3D11DeviceContext* context, SimpleVertexShader* fullscreenVS);
+	~DepthOfField();
+
+	// Adds every stage, compositing into target
+	// - depth must not be bound as a depth stencil view by then
+	// - depthParams linearize it (Camera::getDepthParams)
+	void AddPasses(
+		RenderGraph* graph,
+		RGHandle scene,
+		RGHandle depth,
+		RGHandle target,
+		ID3D11SamplerState* clampSampler,
+		const DofParams& params,
+		DirectX::XMFLOAT2 depthParams);
+
+	// Prints worst case fetches per stage vs. the old pixel shader DoF
+	void PrintTapReport(unsigned int width, unsigned int height);
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+
+	SimpleVertexShader* fullscreenVS;
+	SimpleComputeShader* prepareCS;
+	SimpleComputeShader* tileMaxCS;
+	SimpleComputeShader* dilateCS;
+	SimpleComputeShader* gatherCS;
+	SimplePixelShader* compositePS;
+
+	DofTap taps[DOF_MAX_TAPS];
+	int tapCount;
+
+	// This frame's settings and graph handles (valid while it executes)
+	RenderGraph* graph;
+	ID3D11SamplerState* clampSampler;
+	DirectX::XMFLOAT4 dofParams;
+	DirectX::XMFLOAT2 viewDepthParams;
+	int fullSize[2];
+	int halfSize[2];
+	int tileCount[2];
+
+	RGHandle scene;
+	RGHandle depth;
+	RGHandle target;
+	RGHandle halfColor;	// Half res color with signed CoC in alpha
+	RGHandle tiles;		// Per tile (near max, far max)
+	RGHandle dilated;
+	RGHandle nearField;	// Gathered layers
+	RGHandle farField;
+};
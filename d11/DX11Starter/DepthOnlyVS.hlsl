@@ -0,0 +1,28 @@
+// Same matrices (and cbuffer layout) as VertexShader
+cbuffer externalData : register(b0)
+{
+	matrix world;
+	matrix view;
+	matrix projection;
+};
+
+// Only the position stream (Mesh::GetPositionBuffer)
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+};
+
+// --------------------------------------------------------
+// Depth pre-pass, no pixel shader bound.
+//
+// The main pass tests against this depth with EQUAL, so the
+// position has to come out bit for bit the same as
+// VertexShader's: same expression, same order, and precise
+// so the compiler can't refactor either one differently.
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+	matrix worldViewProj = mul(mul(world, view), projection);
+	precise float4 position = mul(float4(input.position, 1.0f), worldViewProj);
+	return position;
+}
@@ -0,0 +1,154 @@
+#include "DepthPrecision.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#define DEPTH_UNORM24_MAX 16777215.0
+
+double DepthFromView(const DepthSetup& setup, double viewZ)
+{
+	if (setup.Mapping == DEPTH_STANDARD)
+		return setup.zFar / (setup.zFar - setup.zNear) * (1.0 - setup.zNear / viewZ);
+	return setup.zNear / viewZ;
+}
+
+double DepthToView(const DepthSetup& setup, double depth)
+{
+	// Same as the shaders: Camera::getDepthParams x / (depth + y)
+	if (setup.Mapping == DEPTH_STANDARD)
+		return setup.zNear * setup.zFar / (setup.zFar - depth * (setup.zFar - setup.zNear));
+	return setup.zNear / depth;
+}
+
+double DepthStore(const DepthSetup& setup, double depth)
+{
+	depth = std::min(std::max(depth, 0.0), 1.0);
+	if (setup.Storage == DEPTH_UNORM24)
+		return floor(depth * DEPTH_UNORM24_MAX + 0.5) / DEPTH_UNORM24_MAX;
+	return (double)(float)depth;
+}
+
+// The next value the buffer can hold, heading away from the camera
+static double NextFurther(const DepthSetup& setup, double stored)
+{
+	bool up = setup.Mapping == DEPTH_STANDARD;
+	if (setup.Storage == DEPTH_UNORM24)
+		return stored + (up ? 1.0 : -1.0) / DEPTH_UNORM24_MAX;
+	return (double)nextafterf((float)stored, up ? 2.0f : -1.0f);
+}
+
+double DepthResolution(const DepthSetup& setup, double viewZ)
+{
+	if (viewZ < setup.zNear || (setup.Mapping == DEPTH_STANDARD && viewZ > setup.zFar))
+		return 0;
+
+	double stored = DepthStore(setup, DepthFromView(setup, viewZ));
+	double next = NextFurther(setup, stored);
+	if (next > 1.0 || next <= 0.0)
+		return std::numeric_limits<double>::infinity();
+
+	// Width of the step viewZ falls in
+	return DepthToView(setup, next) - DepthToView(setup, stored);
+}
+
+bool DepthSeparates(const DepthSetup& setup, double a, double b)
+{
+	return DepthStore(setup, DepthFromView(setup, a)) != DepthStore(setup, DepthFromView(setup, b));
+}
+
+static void PrintDistance(double d)
+{
+	if (d == 0) printf("  %10s", "clipped");
+	else if (std::isinf(d)) printf("  %10s", "far plane");
+	else printf("  %10.3g", d);
+}
+
+// --------------------------------------------------------
+// - Resolution table, in world units, for the game's planes,
+//   the standard projection with its far plane pushed out 100x,
+//   and reversed infinite, each 24 bit and float
+// - For each, the first distance where surfaces 0.1% of their
+//   distance apart store the same depth (scanned out to 100000)
+// - Checks: reversed infinite float holds about 2^-23 of the
+//   distance everywhere, resolves 0.1% everywhere, and gets the
+//   distance back from its stored depth; standard 24 bit with
+//   the far plane pushed out doesn't resolve 0.1% to its far plane
+// --------------------------------------------------------
+void DepthPrecisionReport(float zNear, float zFar)
+{
+	const double farOut = zFar * 100.0;
+	const double scanFar = 100000.0;
+	const double separation = 0.001;
+	char standardName[64], pushedName[64];
+	snprintf(standardName, sizeof(standardName), "standard, far %g", zFar);
+	snprintf(pushedName, sizeof(pushedName), "standard, far %g", farOut);
+
+	const DepthSetup setups[] =
+	{
+		{ standardName, DEPTH_STANDARD, DEPTH_UNORM24, zNear, zFar },
+		{ standardName, DEPTH_STANDARD, DEPTH_FLOAT32, zNear, zFar },
+		{ pushedName, DEPTH_STANDARD, DEPTH_UNORM24, zNear, farOut },
+		{ pushedName, DEPTH_STANDARD, DEPTH_FLOAT32, zNear, farOut },
+		{ "reversed, infinite", DEPTH_REVERSED_INFINITE, DEPTH_UNORM24, zNear, 0 },
+		{ "reversed, infinite", DEPTH_REVERSED_INFINITE, DEPTH_FLOAT32, zNear, 0 },
+	};
+	const int setupCount = sizeof(setups) / sizeof(setups[0]);
+	const double distances[] = { 0.5, 1, 5, 20, 50, 100, 500, 1000, 10000, 100000 };
+
+	printf("\nDepth precision (near %g, smallest step at each distance, world units)\n", zNear);
+	printf("  %-10s", "distance");
+	for (auto& d : distances) printf("  %10g", d);
+	printf("\n");
+	for (int s = 0; s < setupCount; s++)
+	{
+		printf("  %-20s %-6s\n  %-10s", setups[s].Name, setups[s].Storage == DEPTH_FLOAT32 ? "float" : "24 bit", "");
+		for (auto& d : distances)
+			PrintDistance(DepthResolution(setups[s], d));
+		printf("\n");
+	}
+
+	// Where 0.1% apart starts to z-fight
+	printf("  surfaces %.1f%% of their distance apart:\n", separation * 100);
+	double fightsAt[setupCount];
+	for (int s = 0; s < setupCount; s++)
+	{
+		const DepthSetup& setup = setups[s];
+		double last = setup.Mapping == DEPTH_STANDARD ? setup.zFar / (1.0 + separation) : scanFar;
+		fightsAt[s] = 0;
+		for (double z = setup.zNear; z <= last; z *= 1.001)
+		{
+			if (!DepthSeparates(setup, z, z * (1.0 + separation)))
+			{
+				fightsAt[s] = z;
+				break;
+			}
+		}
+		printf("    %-20s %-6s  ", setup.Name, setup.Storage == DEPTH_FLOAT32 ? "float" : "24 bit");
+		if (fightsAt[s] > 0) printf("z-fight from %.4g\n", fightsAt[s]);
+		else if (setup.Mapping == DEPTH_STANDARD) printf("apart out to the far plane\n");
+		else printf("apart out to %g\n", scanFar);
+	}
+
+	// Reversed infinite float: relative step and round trip
+	const DepthSetup& reversed = setups[setupCount - 1];
+	double worstRelative = 0, worstRoundTrip = 0;
+	for (double z = zNear; z <= scanFar; z *= 1.01)
+	{
+		worstRelative = std::max(worstRelative, DepthResolution(reversed, z) / z);
+		double back = DepthToView(reversed, DepthStore(reversed, DepthFromView(reversed, z)));
+		worstRoundTrip = std::max(worstRoundTrip, fabs(back - z) / z);
+	}
+	bool relativeOk = worstRelative < 1.25e-7;
+	bool roundTripOk = worstRoundTrip < 1.2e-7;
+	printf("  reversed float: step %.3g of the distance at most, near to %g  %s\n",
+		worstRelative, scanFar, CheckResult(relativeOk));
+	printf("  reversed float: distance back from depth within %.3g  %s\n",
+		worstRoundTrip, CheckResult(roundTripOk));
+
+	bool reversedApart = fightsAt[setupCount - 1] == 0;
+	bool pushedFights = fightsAt[2] > 0;
+	printf("  0.1%% apart: reversed float never z-fights, standard 24 bit at far %g does  %s\n",
+		farOut, CheckResult(reversedApart && pushedFights));
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// --------------------------------------------------------
+// How finely a depth buffer tells distances apart
+//
+// A perspective projection stores something like 1 / z, so
+// the steps between representable depths get wider with
+// distance.  How much wider depends on where those steps are:
+//
+// - Standard (near -> 0, far -> 1): far away lands close to
+//   1, where 24 bit UNORM and float both only have 2^-24
+//   steps, and 1 - n / z squeezes everything past a few
+//   hundred near distances into the last few of them.
+//   Pushing the far plane out makes it worse.
+// - Reversed with the far plane at infinity (near -> 1,
+//   infinity -> 0, Camera's CAMERA_DEPTH_REVERSED_INFINITE):
+//   depth is n / z, and float's exponent keeps the same
+//   relative precision all the way down to 0, so the
+//   smallest step is a fixed fraction of the distance.  With
+//   24 bit UNORM the steps stay even, so it doesn't help.
+//
+// Depth math is done in doubles and only rounded when stored,
+// like the hardware does with clip z / w.  No device needed -
+// see Tools/DepthPrecision for the command line.
+// --------------------------------------------------------
+
+enum DepthMapping
+{
+	DEPTH_STANDARD,          // zNear -> 0, zFar -> 1, clips past zFar
+	DEPTH_REVERSED_INFINITE  // zNear -> 1, infinity -> 0, zFar unused
+};
+
+enum DepthStorage
+{
+	DEPTH_UNORM24,   // D24_UNORM_S8_UINT
+	DEPTH_FLOAT32    // D32_FLOAT
+};
+
+struct DepthSetup
+{
+	const char* Name;
+	DepthMapping Mapping;
+	DepthStorage Storage;
+	double zNear;
+	double zFar;
+};
+
+// View distance <-> depth, before storing
+double DepthFromView(const DepthSetup& setup, double viewZ);
+double DepthToView(const DepthSetup& setup, double depth);
+
+// What the buffer holds for a depth
+double DepthStore(const DepthSetup& setup, double depth);
+
+// How far apart the distances of the depth viewZ stores and
+// the next one further out are - the smallest gap that can
+// still be told apart there.  0 if viewZ is clipped, infinite
+// if there is no further value.
+double DepthResolution(const DepthSetup& setup, double viewZ);
+
+// Whether surfaces at a and b store different depths
+bool DepthSeparates(const DepthSetup& setup, double a, double b);
+
+// Tabulates the resolution by distance for standard and
+// reversed infinite depth, 24 bit and float, and how far out
+// surfaces 0.1% of their distance apart still don't z-fight
+void DepthPrecisionReport(float zNear, float zFar);
@@ -0,0 +1,30 @@
+//shared depth of field math
+//(the CPU reference versions are in DofKernel.cpp)
+#ifndef DOF_COMMON
+#define DOF_COMMON
+
+#define DOF_THREADS 8
+#define DOF_TILE_SIZE 16
+#define DOF_MAX_TAPS 64
+
+//hardware depth (0..1) to view space distance, depthParams
+//from Camera::getDepthParams.  with reversed infinite z the
+//sky (depth 0) comes out +inf, which the CoC clamps to 1
+float DofLinearDepth(float depth, float2 depthParams)
+{
+	return depthParams.x / (depth + depthParams.y);
+}
+
+//signed circle of confusion in half res pixels
+//params: x <-- near start, y <-- focus distance, z <-- far end, w <-- max CoC
+float DofCircleOfConfusion(float viewDepth, float4 params)
+{
+	float f;
+	if (viewDepth < params.y)
+		f = max((viewDepth - params.y) / (params.y - params.x), -1.0f);
+	else
+		f = min((viewDepth - params.y) / (params.z - params.y), 1.0f);
+	return f * params.w;
+}
+
+#endif
@@ -0,0 +1,36 @@
+//depth of field, step 5
+//full res: blend the far layer in by this pixel's own CoC,
+//then lay the near layer over the top by its coverage
+#include "DofCommon.hlsli"
+
+cbuffer Data : register (b0)
+{
+	float4 dofParams;
+	float2 depthParams; //view depth = x / (depth + y)
+}
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD0;
+};
+
+Texture2D Scene            : register(t0);
+Texture2D<float> Depth     : register(t1);
+Texture2D NearField        : register(t2);
+Texture2D FarField         : register(t3);
+SamplerState Sampler       : register(s0); //clamp, linear
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	int3 p = int3(input.position.xy, 0);
+	float3 color = Scene.Load(p).rgb;
+	float coc = DofCircleOfConfusion(DofLinearDepth(Depth.Load(p), depthParams), dofParams);
+
+	float4 nearTap = NearField.Sample(Sampler, input.uv);
+	float3 farTap = FarField.Sample(Sampler, input.uv).rgb;
+
+	color = lerp(color, farTap, saturate(coc));
+	color = lerp(color, nearTap.rgb, nearTap.a);
+	return float4(color, 1);
+}
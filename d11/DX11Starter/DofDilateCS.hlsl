@@ -0,0 +1,31 @@
+//depth of field, step 3
+//spreads each tile's near CoC into its neighbours, so blurry
+//foreground can grow past the edge of the tile it started in
+//(the far CoC doesn't need it, the far field never spills)
+#include "DofCommon.hlsli"
+
+cbuffer Data : register (b0)
+{
+	int2 tileCount;
+}
+
+Texture2D<float2> Tiles        : register(t0);
+RWTexture2D<float2> Dilated    : register(u0);
+
+[numthreads(DOF_THREADS, DOF_THREADS, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (any(int2(id.xy) >= tileCount))
+		return;
+
+	float nearMax = 0;
+	for (int j = -1; j <= 1; j++)
+	{
+		for (int i = -1; i <= 1; i++)
+		{
+			int2 p = clamp(int2(id.xy) + int2(i, j), int2(0, 0), tileCount - 1);
+			nearMax = max(nearMax, Tiles.Load(int3(p, 0)).x);
+		}
+	}
+	Dilated[id.xy] = float2(nearMax, Tiles.Load(int3(id.xy, 0)).y);
+}
@@ -0,0 +1,60 @@
+//depth of field, step 4
+//disc gather at half res, where a tap counts when its own CoC
+//is big enough to reach this pixel (scatter-as-gather)
+//near and far samples go to separate layers so the near
+//layer can be laid over sharp pixels in the composite
+#include "DofCommon.hlsli"
+
+cbuffer Data : register (b0)
+{
+	float4 taps[DOF_MAX_TAPS]; //xy <-- offset in the unit disc
+	int2 halfSize;
+	int tapCount;              //taps[0] is the center
+}
+
+Texture2D HalfColor            : register(t0);
+Texture2D<float2> Dilated      : register(t1);
+RWTexture2D<float4> NearField  : register(u0); //a <-- coverage
+RWTexture2D<float4> FarField   : register(u1);
+
+[numthreads(DOF_THREADS, DOF_THREADS, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	int2 p = int2(id.xy);
+	if (any(p >= halfSize))
+		return;
+
+	float4 center = HalfColor.Load(int3(p, 0));
+	float2 tile = Dilated.Load(int3(p / DOF_TILE_SIZE, 0));
+
+	//nothing blurry can reach this pixel
+	float radius = max(tile.x, center.a);
+	if (radius < 0.5f)
+	{
+		NearField[p] = float4(0, 0, 0, 0);
+		FarField[p] = float4(center.rgb, 1);
+		return;
+	}
+
+	float3 nearSum = float3(0, 0, 0);
+	float3 farSum = float3(0, 0, 0);
+	float nearWeight = 0;
+	float farWeight = 0;
+	for (int t = 0; t < tapCount; t++)
+	{
+		float2 offset = taps[t].xy * radius;
+		float dist = length(offset);
+		int2 q = clamp(p + int2(floor(offset + 0.5f)), int2(0, 0), halfSize - 1);
+		float4 s = HalfColor.Load(int3(q, 0));
+
+		float wn = s.a < 0 ? saturate(-s.a - dist + 0.5f) : 0;
+		float wf = s.a > 0 ? saturate(s.a - dist + 0.5f) : 0;
+		nearSum += s.rgb * wn;
+		farSum += s.rgb * wf;
+		nearWeight += wn;
+		farWeight += wf;
+	}
+
+	NearField[p] = float4(nearWeight > 0 ? nearSum / nearWeight : float3(0, 0, 0), nearWeight / tapCount);
+	FarField[p] = float4(farWeight > 0 ? farSum / farWeight : center.rgb, 1);
+}
@@ -0,0 +1,318 @@
+#include "DofKernel.h"
+#include <cmath>
+#include <vector>
+
+float DofLinearDepth(float depth, float depthScale, float depthBias)
+{
+	return depthScale / (depth + depthBias);
+}
+
+// --------------------------------------------------------
+// Same ramps the scene shaders used to write into the old
+// distance target: -1 at NearStart, 0 at FocusDistance and
+// +1 at FarEnd, then scaled to pixels
+// --------------------------------------------------------
+float DofCircleOfConfusion(float viewDepth, const DofParams& params)
+{
+	float f;
+	if (viewDepth < params.FocusDistance)
+	{
+		f = (viewDepth - params.FocusDistance) / (params.FocusDistance - params.NearStart);
+		if (f < -1.0f) f = -1.0f;
+	}
+	else
+	{
+		f = (viewDepth - params.FocusDistance) / (params.FarEnd - params.FocusDistance);
+		if (f > 1.0f) f = 1.0f;
+	}
+	return f * params.MaxCoC;
+}
+
+int DofComputeGatherTaps(DofTap taps[DOF_MAX_TAPS])
+{
+	taps[0].X = 0.0f;
+	taps[0].Y = 0.0f;
+
+	int count = 1;
+	for (int ring = 1; ring <= DOF_RINGS; ring++)
+	{
+		int ringTaps = ring * 8;
+		float radius = (float)ring / DOF_RINGS;
+		for (int i = 0; i < ringTaps && count < DOF_MAX_TAPS; i++)
+		{
+			float angle = 6.2831853f * i / ringTaps;
+			taps[count].X = cosf(angle) * radius;
+			taps[count].Y = sinf(angle) * radius;
+			count++;
+		}
+	}
+	return count;
+}
+
+DofTapReport DofEstimateTaps(int width, int height, int tapCount)
+{
+	double full = (double)width * height;
+	int halfWidth = (width + 1) / 2;
+	int halfHeight = (height + 1) / 2;
+	double half = (double)halfWidth * halfHeight;
+	double tiles = (double)((halfWidth + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE) *
+		((halfHeight + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE);
+
+	DofTapReport r;
+	r.Prepare = half * 8;             // 2x2 color + 2x2 depth
+	r.TileMax = half;                 // one per half res pixel
+	r.Dilate = tiles * 9;             // 3x3 tiles
+	r.Gather = half * (2 + tapCount); // center + tile + disc
+	r.Composite = full * 4;           // scene, depth, near, far
+	return r;
+}
+
+// Clamped fetch helpers
+static inline int Clamp(int v, int lo, int hi) { return v < lo ? lo : (v > hi ? hi : v); }
+static inline float Saturate(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+static inline const float* Texel(const float* img, int width, int height, int x, int y, int channels)
+{
+	x = Clamp(x, 0, width - 1);
+	y = Clamp(y, 0, height - 1);
+	return img + (y * width + x) * channels;
+}
+
+// Bilinear RGBA fetch with clamp addressing, matching a
+// linear sampler at uv
+static void SampleBilinear(const float* img, int width, int height, float u, float v, float out[4])
+{
+	float x = u * width - 0.5f;
+	float y = v * height - 0.5f;
+	int x0 = (int)floorf(x);
+	int y0 = (int)floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	const float* a = Texel(img, width, height, x0, y0, 4);
+	const float* b = Texel(img, width, height, x0 + 1, y0, 4);
+	const float* c = Texel(img, width, height, x0, y0 + 1, 4);
+	const float* d = Texel(img, width, height, x0 + 1, y0 + 1, 4);
+	for (int i = 0; i < 4; i++)
+	{
+		float top = a[i] + (b[i] - a[i]) * fx;
+		float bottom = c[i] + (d[i] - c[i]) * fx;
+		out[i] = top + (bottom - top) * fy;
+	}
+}
+
+// --------------------------------------------------------
+// Averages each 2x2 block.  The CoC kept is the smallest
+// (signed) one, so the nearest surface wins for the near
+// field and the sharpest surface wins for the far field,
+// which keeps backgrounds from bleeding over focused edges.
+// --------------------------------------------------------
+void DofReferencePrepare(const float* scene, const float* depth, int width, int height,
+	float depthScale, float depthBias, const DofParams& params, float* halfColor, DofTapReport* report)
+{
+	int halfWidth = (width + 1) / 2;
+	int halfHeight = (height + 1) / 2;
+
+	for (int y = 0; y < halfHeight; y++)
+	{
+		for (int x = 0; x < halfWidth; x++)
+		{
+			float sum[3] = { 0, 0, 0 };
+			float coc = params.MaxCoC;
+			for (int j = 0; j < 2; j++)
+			{
+				for (int i = 0; i < 2; i++)
+				{
+					const float* c = Texel(scene, width, height, x * 2 + i, y * 2 + j, 4);
+					float d = *Texel(depth, width, height, x * 2 + i, y * 2 + j, 1);
+					float sampleCoC = DofCircleOfConfusion(DofLinearDepth(d, depthScale, depthBias), params);
+					for (int k = 0; k < 3; k++) sum[k] += c[k];
+					if (sampleCoC < coc) coc = sampleCoC;
+				}
+			}
+
+			float* out = halfColor + (y * halfWidth + x) * 4;
+			for (int k = 0; k < 3; k++) out[k] = sum[k] * 0.25f;
+			out[3] = coc;
+		}
+	}
+
+	if (report) report->Prepare += (double)halfWidth * halfHeight * 8;
+}
+
+void DofReferenceTileMax(const float* halfColor, int halfWidth, int halfHeight, float* tiles, DofTapReport* report)
+{
+	int tilesX = (halfWidth + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+	int tilesY = (halfHeight + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+
+	for (int i = 0; i < tilesX * tilesY * 2; i++)
+		tiles[i] = 0.0f;
+
+	for (int y = 0; y < halfHeight; y++)
+	{
+		for (int x = 0; x < halfWidth; x++)
+		{
+			float coc = halfColor[(y * halfWidth + x) * 4 + 3];
+			float* tile = tiles + ((y / DOF_TILE_SIZE) * tilesX + (x / DOF_TILE_SIZE)) * 2;
+			if (-coc > tile[0]) tile[0] = -coc;
+			if (coc > tile[1]) tile[1] = coc;
+		}
+	}
+
+	if (report) report->TileMax += (double)halfWidth * halfHeight;
+}
+
+void DofReferenceDilate(const float* tiles, int tilesX, int tilesY, float* dilated, DofTapReport* report)
+{
+	for (int y = 0; y < tilesY; y++)
+	{
+		for (int x = 0; x < tilesX; x++)
+		{
+			float nearMax = 0.0f;
+			for (int j = -1; j <= 1; j++)
+			{
+				for (int i = -1; i <= 1; i++)
+				{
+					const float* t = Texel(tiles, tilesX, tilesY, x + i, y + j, 2);
+					if (t[0] > nearMax) nearMax = t[0];
+				}
+			}
+
+			float* out = dilated + (y * tilesX + x) * 2;
+			out[0] = nearMax;
+			out[1] = tiles[(y * tilesX + x) * 2 + 1];
+		}
+	}
+
+	if (report) report->Dilate += (double)tilesX * tilesY * 9;
+}
+
+// --------------------------------------------------------
+// Scatter-as-gather: a tap contributes when its own CoC is
+// large enough to reach this pixel.  Near and far samples are
+// kept apart so the near layer can spill over sharp pixels.
+// --------------------------------------------------------
+void DofReferenceGather(const float* halfColor, const float* dilated, int halfWidth, int halfHeight,
+	const DofTap* taps, int tapCount, float* nearField, float* farField, DofTapReport* report)
+{
+	int tilesX = (halfWidth + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+	double fetches = 0.0;
+
+	for (int y = 0; y < halfHeight; y++)
+	{
+		for (int x = 0; x < halfWidth; x++)
+		{
+			const float* center = halfColor + (y * halfWidth + x) * 4;
+			const float* tile = dilated + ((y / DOF_TILE_SIZE) * tilesX + (x / DOF_TILE_SIZE)) * 2;
+			fetches += 2;
+
+			float* nearOut = nearField + (y * halfWidth + x) * 4;
+			float* farOut = farField + (y * halfWidth + x) * 4;
+
+			float radius = tile[0] > center[3] ? tile[0] : center[3];
+			if (radius < 0.5f)
+			{
+				// Nothing blurry can reach this pixel
+				for (int k = 0; k < 4; k++) nearOut[k] = 0.0f;
+				for (int k = 0; k < 3; k++) farOut[k] = center[k];
+				farOut[3] = 1.0f;
+				continue;
+			}
+
+			float nearSum[3] = { 0, 0, 0 };
+			float farSum[3] = { 0, 0, 0 };
+			float nearWeight = 0.0f;
+			float farWeight = 0.0f;
+			for (int t = 0; t < tapCount; t++)
+			{
+				float ox = taps[t].X * radius;
+				float oy = taps[t].Y * radius;
+				float dist = sqrtf(ox * ox + oy * oy);
+				const float* s = Texel(halfColor, halfWidth, halfHeight,
+					x + (int)floorf(ox + 0.5f), y + (int)floorf(oy + 0.5f), 4);
+
+				float wn = s[3] < 0.0f ? Saturate(-s[3] - dist + 0.5f) : 0.0f;
+				float wf = s[3] > 0.0f ? Saturate(s[3] - dist + 0.5f) : 0.0f;
+				for (int k = 0; k < 3; k++)
+				{
+					nearSum[k] += s[k] * wn;
+					farSum[k] += s[k] * wf;
+				}
+				nearWeight += wn;
+				farWeight += wf;
+			}
+			fetches += tapCount;
+
+			for (int k = 0; k < 3; k++)
+			{
+				nearOut[k] = nearWeight > 0.0f ? nearSum[k] / nearWeight : 0.0f;
+				farOut[k] = farWeight > 0.0f ? farSum[k] / farWeight : center[k];
+			}
+			nearOut[3] = nearWeight / tapCount;
+			farOut[3] = 1.0f;
+		}
+	}
+
+	if (report) report->Gather += fetches;
+}
+
+void DofReferenceComposite(const float* scene, const float* depth, int width, int height,
+	float depthScale, float depthBias, const DofParams& params,
+	const float* nearField, const float* farField, float* dst, DofTapReport* report)
+{
+	int halfWidth = (width + 1) / 2;
+	int halfHeight = (height + 1) / 2;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const float* c = scene + (y * width + x) * 4;
+			float coc = DofCircleOfConfusion(DofLinearDepth(depth[y * width + x], depthScale, depthBias), params);
+
+			float u = (x + 0.5f) / width;
+			float v = (y + 0.5f) / height;
+			float nearTap[4];
+			float farTap[4];
+			SampleBilinear(nearField, halfWidth, halfHeight, u, v, nearTap);
+			SampleBilinear(farField, halfWidth, halfHeight, u, v, farTap);
+
+			float farBlend = Saturate(coc);
+			float* out = dst + (y * width + x) * 4;
+			for (int k = 0; k < 3; k++)
+			{
+				float color = c[k] + (farTap[k] - c[k]) * farBlend;
+				out[k] = color + (nearTap[k] - color) * nearTap[3];
+			}
+			out[3] = 1.0f;
+		}
+	}
+
+	if (report) report->Composite += (double)width * height * 4;
+}
+
+void DofReference(const float* scene, const float* depth, int width, int height,
+	float depthScale, float depthBias, const DofParams& params, float* dst, DofTapReport* report)
+{
+	int halfWidth = (width + 1) / 2;
+	int halfHeight = (height + 1) / 2;
+	int tilesX = (halfWidth + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+	int tilesY = (halfHeight + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+
+	DofTap taps[DOF_MAX_TAPS];
+	int tapCount = DofComputeGatherTaps(taps);
+
+	std::vector<float> halfColor(halfWidth * halfHeight * 4);
+	std::vector<float> tiles(tilesX * tilesY * 2);
+	std::vector<float> dilated(tilesX * tilesY * 2);
+	std::vector<float> nearField(halfWidth * halfHeight * 4);
+	std::vector<float> farField(halfWidth * halfHeight * 4);
+
+	DofReferencePrepare(scene, depth, width, height, depthScale, depthBias, params, halfColor.data(), report);
+	DofReferenceTileMax(halfColor.data(), halfWidth, halfHeight, tiles.data(), report);
+	DofReferenceDilate(tiles.data(), tilesX, tilesY, dilated.data(), report);
+	DofReferenceGather(halfColor.data(), dilated.data(), halfWidth, halfHeight,
+		taps, tapCount, nearField.data(), farField.data(), report);
+	DofReferenceComposite(scene, depth, width, height, depthScale, depthBias, params,
+		nearField.data(), farField.data(), dst, report);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// --------------------------------------------------------
+// Depth of field helpers
+//
+// The GPU path (see DepthOfField.cpp) runs as:
+//   1. Prepare   - full res color + depth -> half res color
+//                  with a signed circle of confusion in alpha
+//                  (negative = near field, positive = far field)
+//   2. Tile max  - largest near/far CoC per DOF_TILE_SIZE tile
+//   3. Dilate    - spreads the near CoC into neighbouring tiles
+//                  so blurry foreground can bleed over its edges
+//   4. Gather    - disc gather at half res, split into a near
+//                  layer (with coverage) and a far layer
+//   5. Composite - full res blend of scene, far and near layers
+//
+// The functions below are the CPU reference for every stage.
+// They use the same math and fetch pattern as the shaders, so
+// their output can be compared against a GPU readback.
+// --------------------------------------------------------
+
+// Threads per side for the per-pixel compute passes
+#define DOF_THREADS 8
+// Half res pixels per side of a CoC tile
+#define DOF_TILE_SIZE 16
+// Gather disc: 1 center tap + 8 * ring taps per ring
+#define DOF_RINGS 3
+#define DOF_MAX_TAPS 64
+
+// Focus settings (all distances in view space units).
+// Laid out as a float4 for the shaders.
+struct DofParams
+{
+	float NearStart;     // Nearest point of the near blur (full near blur)
+	float FocusDistance; // Perfectly sharp distance
+	float FarEnd;        // Distance where the far blur reaches full size
+	float MaxCoC;        // Largest blur radius, in half res pixels
+};
+
+// One gather tap, as an offset in the unit disc
+struct DofTap
+{
+	float X;
+	float Y;
+	float pad[2]; // Keeps each tap on a float4 boundary for HLSL
+};
+
+// Fetches done by each stage (one per Load/Sample)
+struct DofTapReport
+{
+	double Prepare;
+	double TileMax;
+	double Dilate;
+	double Gather;
+	double Composite;
+	double Total() const { return Prepare + TileMax + Dilate + Gather + Composite; }
+};
+
+// Hardware depth (0..1) to view space distance: depthScale /
+// (depth + depthBias), the two from Camera::getDepthParams
+// (so it works for standard and reversed z)
+float DofLinearDepth(float depth, float depthScale, float depthBias);
+
+// Signed CoC in half res pixels (negative in front of focus)
+float DofCircleOfConfusion(float viewDepth, const DofParams& params);
+
+// Concentric rings of taps.  Returns the tap count, with taps[0]
+// always being the center.
+int DofComputeGatherTaps(DofTap taps[DOF_MAX_TAPS]);
+
+// Worst case fetch counts for a full res target
+// (every pixel runs the full gather)
+DofTapReport DofEstimateTaps(int width, int height, int tapCount);
+
+// --------------------------------------------------------
+// CPU reference of each stage.  Color images are RGBA floats,
+// depth is one float per pixel, tiles are two floats per tile
+// (near max, far max).  Half res is (width + 1) / 2.
+// Pass a report to count the fetches actually made.
+// --------------------------------------------------------
+void DofReferencePrepare(const float* scene, const float* depth, int width, int height,
+	float depthScale, float depthBias, const DofParams& params, float* halfColor, DofTapReport* report = 0);
+void DofReferenceTileMax(const float* halfColor, int halfWidth, int halfHeight, float* tiles, DofTapReport* report = 0);
+void DofReferenceDilate(const float* tiles, int tilesX, int tilesY, float* dilated, DofTapReport* report = 0);
+void DofReferenceGather(const float* halfColor, const float* dilated, int halfWidth, int halfHeight,
+	const DofTap* taps, int tapCount, float* nearField, float* farField, DofTapReport* report = 0);
+void DofReferenceComposite(const float* scene, const float* depth, int width, int height,
+	float depthScale, float depthBias, const DofParams& params,
+	const float* nearField, const float* farField, float* dst, DofTapReport* report = 0);
+
+// Runs every stage in order, writing the final image into dst
+void DofReference(const float* scene, const float* depth, int width, int height,
+	float depthScale, float depthBias, const DofParams& params, float* dst, DofTapReport* report = 0);
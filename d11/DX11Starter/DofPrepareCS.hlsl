@@ -0,0 +1,36 @@
+//depth of field, step 1
+//full res color + depth --> half res color with signed CoC in alpha
+//the smallest CoC of each 2x2 block is kept, so the nearest surface wins
+//the near field and the sharpest surface wins the far field
+#include "DofCommon.hlsli"
+
+cbuffer Data : register (b0)
+{
+	float4 dofParams;
+	float2 depthParams; //view depth = x / (depth + y)
+	int2 fullSize;
+}
+
+Texture2D Scene             : register(t0);
+Texture2D<float> Depth      : register(t1);
+RWTexture2D<float4> HalfColor : register(u0);
+
+[numthreads(DOF_THREADS, DOF_THREADS, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (any(int2(id.xy) >= (fullSize + 1) / 2))
+		return;
+
+	float3 sum = float3(0, 0, 0);
+	float coc = dofParams.w;
+	for (int j = 0; j < 2; j++)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			int2 p = min(int2(id.xy) * 2 + int2(i, j), fullSize - 1);
+			sum += Scene.Load(int3(p, 0)).rgb;
+			coc = min(coc, DofCircleOfConfusion(DofLinearDepth(Depth.Load(int3(p, 0)), depthParams), dofParams));
+		}
+	}
+	HalfColor[id.xy] = float4(sum * 0.25f, coc);
+}
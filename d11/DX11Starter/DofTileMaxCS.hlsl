@@ -0,0 +1,38 @@
+//depth of field, step 2
+//one group per tile, reduces the largest near and far CoC
+#include "DofCommon.hlsli"
+
+#define TILE_THREADS (DOF_TILE_SIZE * DOF_TILE_SIZE)
+
+cbuffer Data : register (b0)
+{
+	int2 halfSize;
+}
+
+Texture2D HalfColor          : register(t0);
+RWTexture2D<float2> Tiles    : register(u0);
+
+groupshared float2 maxCoC[TILE_THREADS];
+
+[numthreads(DOF_TILE_SIZE, DOF_TILE_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 groupID : SV_GroupID, uint index : SV_GroupIndex)
+{
+	//pixels past the edge count as in focus
+	float coc = 0;
+	if (all(int2(id.xy) < halfSize))
+		coc = HalfColor.Load(int3(id.xy, 0)).a;
+	maxCoC[index] = float2(max(-coc, 0), max(coc, 0));
+	GroupMemoryBarrierWithGroupSync();
+
+	//tree reduction
+	[unroll]
+	for (uint stride = TILE_THREADS / 2; stride > 0; stride >>= 1)
+	{
+		if (index < stride)
+			maxCoC[index] = max(maxCoC[index], maxCoC[index + stride]);
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (index == 0)
+		Tiles[groupID.xy] = maxCoC[0];
+}
@@ -1,4 +1,5 @@
 #include "Entity.h"
+#include "GBufferKernel.h"
 
 
 
@@ -14,6 +15,7 @@ Entity::Entity(Mesh * myM, ID3D11DeviceContext* c, Material* m)
 	myMat = m;
 	vShader = myMat->getVertexShader();
 	pShader = myMat->getPixelShader();
+	activePS = pShader;
 	//set default value
 	XMMATRIX ident = XMMatrixIdentity();
 	XMStoreFloat4x4(&worldMat, ident);
@@ -21,7 +23,7 @@ Entity::Entity(Mesh * myM, ID3D11DeviceContext* c, Material* m)
 	pos = XMFLOAT3(0.0, 0.0, 0.0);
 	rot = XMFLOAT3(0.0, 0.0, 0.0);
 	scale = XMFLOAT3(1.0, 1.0, 1.0);
-
+	SaveState();
 }
 
 Entity::~Entity()
@@ -81,33 +83,63 @@ void Entity::Update(float dt)
 
 }
 
+void Entity::SaveState()
+{
+	prevPos = pos;
+	prevRot = rot;
+	prevScale = scale;
+}
+
+void Entity::Interpolate(float alpha)
+{
+	//blend between the previous and current sim tick
+	XMVECTOR p = XMVectorLerp(XMLoadFloat3(&prevPos), XMLoadFloat3(&pos), alpha);
+	XMVECTOR s = XMVectorLerp(XMLoadFloat3(&prevScale), XMLoadFloat3(&scale), alpha);
+	XMVECTOR q = XMQuaternionSlerp(
+		XMQuaternionRotationRollPitchYaw(prevRot.x, prevRot.y, prevRot.z),
+		XMQuaternionRotationRollPitchYaw(rot.x, rot.y, rot.z),
+		alpha);
+
+	XMMATRIX wm = XMMatrixScalingFromVector(s) * XMMatrixRotationQuaternion(q) * XMMatrixTranslationFromVector(p);
+	XMStoreFloat4x4(&worldMat, XMMatrixTranspose(wm));
+}
+
 void Entity::PrepareMaterial(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat)
 {
 	vShader->SetMatrix4x4("view", viewMat);
 	vShader->SetMatrix4x4("projection", projMat);
-	pShader->SetSamplerState("basicSampler", myMat->getSampler());
-	pShader->SetShaderResourceView("diffuseMap", myMat->getSRV());
-	pShader->SetShaderResourceView("normalMap", myMat->getNormalSRV());
 	vShader->SetShader();
-	pShader->SetShader();
+	myMat->Bind();
+	activePS = pShader;
 }
 
-void Entity::PrepareMat(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat)
+void Entity::PrepareGBuffer(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat, SimplePixelShader* gbufferPS)
 {
 	vShader->SetMatrix4x4("view", viewMat);
 	vShader->SetMatrix4x4("projection", projMat);
-	pShader->SetSamplerState("basicSampler", myMat->getSampler());
-	pShader->SetShaderResourceView("diffuseMap", myMat->getSRV());
+	gbufferPS->SetSamplerState("basicSampler", myMat->getSampler());
+	myMat->BindTextures(gbufferPS);
+	const MaterialParams& p = myMat->GetParams();
+	gbufferPS->SetInt("diffuseSlice", p.DiffuseSlice);
+	gbufferPS->SetInt("normalSlice", p.NormalSlice);
+	gbufferPS->SetFloat("diffuseMinMip", p.DiffuseMinMip);
+	gbufferPS->SetFloat("normalMinMip", p.NormalMinMip);
+	gbufferPS->SetFloat4("color", p.Color);
+	gbufferPS->SetFloat("shininess", p.Shininess);
+	gbufferPS->SetInt("material", (myMat->GetFeatures() & MATERIAL_UNLIT) ? GBUFFER_MATERIAL_UNLIT : GBUFFER_MATERIAL_LIT);
+	gbufferPS->SetInt("useVirtualTexture", (myMat->GetFeatures() & MATERIAL_VIRTUAL_TEXTURE) != 0);
 	vShader->SetShader();
-	pShader->SetShader();
+	gbufferPS->SetShader();
+	activePS = gbufferPS;
 }
 
-void Entity::SolidMaterial(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat)
+void Entity::PrepareShader(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat, SimplePixelShader* ps)
 {
 	vShader->SetMatrix4x4("view", viewMat);
 	vShader->SetMatrix4x4("projection", projMat);
 	vShader->SetShader();
-	pShader->SetShader();
+	ps->SetShader();
+	activePS = ps;
 }
 
 void Entity::Draw()
@@ -122,8 +154,40 @@ void Entity::Draw()
 	
 	vShader->SetMatrix4x4("world", worldMat);
 	vShader->CopyAllBufferData();
-	pShader->CopyAllBufferData();
+	activePS->CopyAllBufferData();
 
 	//draw
 	context->DrawIndexed(myMesh->GetIndexCount(), 0, 0);
 }
+
+void Entity::DrawDepth(SimpleVertexShader* depthVS)
+{
+	//12 byte positions, shares the index buffer with Draw()
+	ID3D11Buffer* positions = myMesh->GetPositionBuffer();
+	UINT stride = sizeof(XMFLOAT3);
+	UINT offset = 0;
+
+	context->IASetVertexBuffers(0, 1, &positions, &stride, &offset);
+	context->IASetIndexBuffer(myMesh->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
+
+	depthVS->SetMatrix4x4("world", worldMat);
+	depthVS->CopyAllBufferData();
+
+	context->DrawIndexed(myMesh->GetIndexCount(), 0, 0);
+}
+
+void Entity::GetBoundingSphere(XMFLOAT3* center, float* radius)
+{
+	//worldMat is stored transposed for HLSL
+	XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&worldMat));
+	XMFLOAT3 meshCenter = myMesh->GetBoundsCenter();
+	XMStoreFloat3(center, XMVector3TransformCoord(XMLoadFloat3(&meshCenter), world));
+
+	//largest axis scale, so the sphere still covers a stretched mesh
+	float sx = XMVectorGetX(XMVector3Length(XMVector3TransformNormal(XMVectorSet(1, 0, 0, 0), world)));
+	float sy = XMVectorGetX(XMVector3Length(XMVector3TransformNormal(XMVectorSet(0, 1, 0, 0), world)));
+	float sz = XMVectorGetX(XMVector3Length(XMVector3TransformNormal(XMVectorSet(0, 0, 1, 0), world)));
+	float scale = sx > sy ? sx : sy;
+	scale = scale > sz ? scale : sz;
+	*radius = myMesh->GetBoundsRadius() * scale;
+}
@@ -12,11 +12,13 @@ class Entity
 	//need world matrix, pos, rot, scale, pointer to Mesh
 	XMFLOAT4X4 worldMat;
 	XMFLOAT3 pos, rot, scale;
+	XMFLOAT3 prevPos, prevRot, prevScale; //transform at the start of the current sim tick
 	Mesh* myMesh;
 	ID3D11Buffer* vBuffer;
 	ID3D11DeviceContext* context;
 	SimpleVertexShader* vShader;
 	SimplePixelShader* pShader;
+	SimplePixelShader* activePS; //whichever pixel shader the last Prepare* set
 	Material* myMat;
 
 public:
@@ -29,6 +31,10 @@ public:
 
 	//geter & seter
 	XMFLOAT4X4 GetMatrix() { return worldMat; };
+	Mesh* GetMesh() { return myMesh; }
+	Material* GetMaterial() { return myMat; }
+	//the mesh's bounding sphere, moved and scaled like the entity
+	void GetBoundingSphere(XMFLOAT3* center, float* radius);
 
 	XMFLOAT3 SetPos(float x, float y, float z);
 	XMFLOAT3 SetRot(float x, float y, float z);
@@ -41,13 +47,23 @@ public:
 	void Update(float dt); //should offset pos
 	// MoveForward()
 
+	//fixed timestep helpers
+	//SaveState() at the start of a tick, Interpolate() before drawing
+	void SaveState();
+	void Interpolate(float alpha);
+
+	//the material's permutation, textures and parameter block
 	void PrepareMaterial(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat);
-	void PrepareMat(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat);
-	void SolidMaterial(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat);
+	//deferred path: the material's textures and params go to the g-buffer shader instead
+	void PrepareGBuffer(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat, SimplePixelShader* gbufferPS);
+	//any pixel shader, none of the material's textures (virtual texture feedback)
+	void PrepareShader(XMFLOAT4X4 viewMat, XMFLOAT4X4 projMat, SimplePixelShader* ps);
 	//set buffers, draw commands
 	// NOTE: more advanced engine might need a Renderer class
 	// that makes decisions about what to render and when
 	void Draw();
+	//depth pre-pass: position stream only, depthVS already has view/projection
+	void DrawDepth(SimpleVertexShader* depthVS);
 
 private:
 
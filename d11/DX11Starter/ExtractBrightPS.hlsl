@@ -1,3 +1,13 @@
+//bright pass, full res scene -> half res first bloom level
+//same 13 taps as BloomDownsamplePS, but each of the five 2x2 boxes
+//is weighted by 1 / (1 + luma) (Karis average), so a single very
+//bright pixel can't flicker the whole chain as it moves
+//(see BloomKernel.cpp for the CPU reference)
+cbuffer Data : register (b0)
+{
+	float2 texelSize; //one texel of the full res scene
+}
+
 //input
 struct VertexToPixel
 {
@@ -9,15 +19,17 @@ struct VertexToPixel
 Texture2D Pixels        : register(t0);
 SamplerState Sampler    : register(s0);
 
-float4 main(VertexToPixel input) : SV_TARGET
+float Luma(float3 color)
 {
-	//sample color for the current uv
-	float4 finalColor = Pixels.Sample(Sampler, input.uv);
-	//return finalColor;
-	//determine if this pixel is bright or not
-	//if it is bright enough, keep it
-	//if it is not, make it black
-	float brightness = 0.2126f * finalColor.r + 0.7152f * finalColor.g + 0.0722f * finalColor.b;
+	return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+//determine if this pixel is bright or not
+//if it is bright enough, keep it
+//if it is not, make it black
+float4 Bright(float4 finalColor)
+{
+	float brightness = Luma(finalColor.rgb);
 	//light object, always bloom
 	if (finalColor.a == 0)
 	{
@@ -25,7 +37,7 @@ float4 main(VertexToPixel input) : SV_TARGET
 	}
 	else if (finalColor.a == 1)
 	{
-		//others 
+		//others
 		if (brightness <= 0.72f)
 		{
 			finalColor.rgb = float3(0, 0, 0);
@@ -43,6 +55,43 @@ float4 main(VertexToPixel input) : SV_TARGET
 			finalColor.rgb /= 5.0;
 		}
 	}
-	
 	return finalColor;
-}
\ No newline at end of file
+}
+
+float4 KarisBox(float4 a, float4 b, float4 c, float4 d, float weight, inout float weights)
+{
+	float4 box = (a + b + c + d) * 0.25f;
+	float w = weight / (1.0f + Luma(box.rgb));
+	weights += w;
+	return box * w;
+}
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float2 uv = input.uv;
+	float2 t = texelSize;
+
+	float4 a = Bright(Pixels.Sample(Sampler, uv + t * float2(-2, -2)));
+	float4 b = Bright(Pixels.Sample(Sampler, uv + t * float2( 0, -2)));
+	float4 c = Bright(Pixels.Sample(Sampler, uv + t * float2( 2, -2)));
+	float4 d = Bright(Pixels.Sample(Sampler, uv + t * float2(-1, -1)));
+	float4 e = Bright(Pixels.Sample(Sampler, uv + t * float2( 1, -1)));
+	float4 f = Bright(Pixels.Sample(Sampler, uv + t * float2(-2,  0)));
+	float4 g = Bright(Pixels.Sample(Sampler, uv));
+	float4 h = Bright(Pixels.Sample(Sampler, uv + t * float2( 2,  0)));
+	float4 i = Bright(Pixels.Sample(Sampler, uv + t * float2(-1,  1)));
+	float4 j = Bright(Pixels.Sample(Sampler, uv + t * float2( 1,  1)));
+	float4 k = Bright(Pixels.Sample(Sampler, uv + t * float2(-2,  2)));
+	float4 l = Bright(Pixels.Sample(Sampler, uv + t * float2( 0,  2)));
+	float4 m = Bright(Pixels.Sample(Sampler, uv + t * float2( 2,  2)));
+
+	//center box gets half the weight, the four corner boxes share the rest,
+	//then each is scaled down by how bright it is
+	float weights = 0;
+	float4 color = KarisBox(d, e, i, j, 0.5f, weights);
+	color += KarisBox(a, b, f, g, 0.125f, weights);
+	color += KarisBox(b, c, g, h, 0.125f, weights);
+	color += KarisBox(f, g, k, l, 0.125f, weights);
+	color += KarisBox(g, h, l, m, 0.125f, weights);
+	return color / weights;
+}
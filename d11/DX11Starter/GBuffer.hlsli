@@ -0,0 +1,67 @@
+//compact g-buffer for the deferred path
+//(mirrored on the CPU in GBufferKernel.h)
+//  target 0  R8G8B8A8_UNORM     albedo.rgb, shininess / 255
+//  target 1  R10G10B10A2_UNORM  octahedral normal.xy, material
+//    the normal is 15 bits an axis: the top 10 in r and g, the
+//    low 5 of each in b (10 bits was visibly off in highlights)
+#ifndef GBUFFER
+#define GBUFFER
+
+#define GBUFFER_MATERIAL_LIT 0
+#define GBUFFER_MATERIAL_UNLIT 1
+
+struct GBufferSurface
+{
+	float3 albedo;
+	float3 normal;
+	float shininess; //0 = no highlight
+	uint material;   //GBUFFER_MATERIAL_*
+};
+
+struct GBufferOut
+{
+	float4 albedo   : SV_TARGET0;
+	float4 normal   : SV_TARGET1;
+};
+
+//unit vector --> [0,1]^2, folding the lower hemisphere over the upper one
+float2 OctEncode(float3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0)
+		n.xy = (1.0 - abs(n.yx)) * (n.xy >= 0.0 ? 1.0 : -1.0);
+	return n.xy * 0.5 + 0.5;
+}
+
+float3 OctDecode(float2 e)
+{
+	e = e * 2 - 1;
+	float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+GBufferOut PackGBuffer(GBufferSurface s)
+{
+	GBufferOut output;
+	output.albedo = float4(s.albedo, s.shininess / 255.0);
+	uint2 oct = (uint2)round(OctEncode(s.normal) * 32767.0);
+	uint low = (oct.x & 31) | ((oct.y & 31) << 5);
+	output.normal = float4((oct >> 5) / 1023.0, low / 1023.0, s.material / 3.0);
+	return output;
+}
+
+GBufferSurface UnpackGBuffer(float4 albedo, float4 normal)
+{
+	GBufferSurface s;
+	s.albedo = albedo.rgb;
+	s.shininess = round(albedo.a * 255.0);
+	uint3 bits = (uint3)round(normal.rgb * 1023.0);
+	uint2 oct = (bits.xy << 5) | uint2(bits.z & 31, bits.z >> 5);
+	s.normal = OctDecode(oct / 32767.0);
+	s.material = (uint)round(normal.a * 3.0);
+	return s;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include "GBufferKernel.h"
+#include "DofKernel.h"
+#include "Check.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+// Float -> UNORM the way the output merger does it
+static unsigned int ToUnorm(float v, int bits)
+{
+	float maxValue = (float)((1 << bits) - 1);
+	v = std::min(std::max(v, 0.0f), 1.0f);
+	return (unsigned int)floorf(v * maxValue + 0.5f);
+}
+
+static float FromUnorm(unsigned int v, int bits)
+{
+	return v / (float)((1 << bits) - 1);
+}
+
+XMFLOAT2 GBufferOctEncode(XMFLOAT3 n)
+{
+	float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float x = n.x / sum;
+	float y = n.y / sum;
+	if (n.z < 0)
+	{
+		float fx = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+	}
+	return XMFLOAT2(x * 0.5f + 0.5f, y * 0.5f + 0.5f);
+}
+
+XMFLOAT3 GBufferOctDecode(XMFLOAT2 e)
+{
+	float x = e.x * 2 - 1;
+	float y = e.y * 2 - 1;
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = std::min(std::max(-z, 0.0f), 1.0f);
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(x, y, z, 0)));
+	return n;
+}
+
+GBufferTexel GBufferPack(const GBufferSurface& s)
+{
+	XMFLOAT2 oct = GBufferOctEncode(s.Normal);
+
+	GBufferTexel t;
+	t.Albedo = ToUnorm(s.Albedo.x, 8) | (ToUnorm(s.Albedo.y, 8) << 8) |
+		(ToUnorm(s.Albedo.z, 8) << 16) | (ToUnorm(s.Shininess / 255.0f, 8) << 24);
+	unsigned int octX = ToUnorm(oct.x, 15), octY = ToUnorm(oct.y, 15);
+	t.Normal = (octX >> 5) | ((octY >> 5) << 10) | (((octX & 31) | ((octY & 31) << 5)) << 20) |
+		(ToUnorm(s.Material / 3.0f, 2) << 30);
+	return t;
+}
+
+GBufferSurface GBufferUnpack(const GBufferTexel& t)
+{
+	GBufferSurface s;
+	s.Albedo = XMFLOAT3(FromUnorm(t.Albedo & 0xFF, 8), FromUnorm((t.Albedo >> 8) & 0xFF, 8),
+		FromUnorm((t.Albedo >> 16) & 0xFF, 8));
+	s.Shininess = (float)(t.Albedo >> 24);
+	unsigned int low = (t.Normal >> 20) & 0x3FF;
+	unsigned int octX = ((t.Normal & 0x3FF) << 5) | (low & 31);
+	unsigned int octY = (((t.Normal >> 10) & 0x3FF) << 5) | (low >> 5);
+	s.Normal = GBufferOctDecode(XMFLOAT2(FromUnorm(octX, 15), FromUnorm(octY, 15)));
+	s.Material = (int)(t.Normal >> 30);
+	return s;
+}
+
+static float Saturate(float v)
+{
+	return std::min(std::max(v, 0.0f), 1.0f);
+}
+
+static float Dot(FXMVECTOR a, FXMVECTOR b)
+{
+	return XMVectorGetX(XMVector3Dot(a, b));
+}
+
+// LocalLightColor from ClusteredLighting.hlsli
+static XMVECTOR LocalLightColor(const LocalLight& l, FXMVECTOR N, FXMVECTOR worldPos, FXMVECTOR toCam, float specPower)
+{
+	XMVECTOR toPixel = worldPos - XMLoadFloat3(&l.LightPos);
+	float dist = XMVectorGetX(XMVector3Length(toPixel));
+	XMVECTOR dir = toPixel * (1.0f / std::max(dist, 0.0001f));
+	float NdotL = Saturate(-Dot(N, dir));
+
+	float spec = 0;
+	if (specPower > 0)
+	{
+		XMVECTOR reflected = dir - N * (2.0f * Dot(dir, N));
+		spec = powf(std::max(Dot(reflected, toCam), 0.0f), specPower);
+	}
+
+	float window = Saturate(1.0f - dist * dist / (l.range * l.range));
+	window *= window;
+
+	XMVECTOR diffuse = XMLoadFloat4(&l.DiffuseColor);
+	XMVECTOR specular = XMVectorSet(spec, spec, spec, 0);
+	if (l.type == LIGHT_TYPE_POINT)
+	{
+		float attenuation = 1.0f / (1.0f + 0.1f * dist * dist);
+		return (diffuse * NdotL + specular) * (attenuation * window);
+	}
+
+	float angleFromCenter = std::max(-Dot(dir, XMVector3Normalize(XMLoadFloat3(&l.Direction) * -1.0f)), 0.0f);
+	float spotAmount = powf(angleFromCenter, 45.0f - l.cone);
+	return (diffuse * (NdotL * spotAmount) + XMLoadFloat4(&l.AmbientColor) + specular) * window;
+}
+
+XMFLOAT4 GBufferShade(const GBufferSurface& s, XMFLOAT3 worldPos, XMFLOAT3 camPos,
+	const DirectionalLight& light, const LocalLight* lights, unsigned int lightCount,
+	const SkySH9* sky, float skyIntensity)
+{
+	if (s.Material == GBUFFER_MATERIAL_UNLIT)
+		return XMFLOAT4(s.Albedo.x, s.Albedo.y, s.Albedo.z, 0);
+
+	XMVECTOR N = XMLoadFloat3(&s.Normal);
+	XMVECTOR P = XMLoadFloat3(&worldPos);
+	XMVECTOR toCam = XMVector3Normalize(XMLoadFloat3(&camPos) - P);
+
+	XMVECTOR lightDir = XMVector3Normalize(XMLoadFloat3(&light.Direction) * -1.0f);
+	float totalLight = Saturate(Dot(N, lightDir));
+	XMVECTOR ambient = XMLoadFloat4(&light.AmbientColor);
+	if (sky)
+	{
+		float n[3] = { s.Normal.x, s.Normal.y, s.Normal.z }, rgb[3];
+		SkyEvalSH(*sky, n, rgb);
+		ambient = XMVectorMax(XMVectorSet(rgb[0], rgb[1], rgb[2], 0), XMVectorZero()) * skyIntensity;
+	}
+	XMVECTOR total = XMLoadFloat4(&light.DiffuseColor) * totalLight + ambient;
+
+	for (unsigned int i = 0; i < lightCount; i++)
+		total = total + LocalLightColor(lights[i], N, P, toCam, s.Shininess);
+
+	XMFLOAT4 color;
+	XMStoreFloat4(&color, total);
+	return XMFLOAT4(s.Albedo.x * color.x, s.Albedo.y * color.y, s.Albedo.z * color.z, 1);
+}
+
+static float RandomRange(float lo, float hi)
+{
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// --------------------------------------------------------
+// Points are picked per pixel (random NDC position and view
+// depth), so both paths shade the same spot.  Output is
+// compared after 8 bit quantization, like the scene target.
+// --------------------------------------------------------
+void GBufferParityReport(const DirectionalLight& light, const LocalLight* lights, unsigned int lightCount,
+	const XMFLOAT4X4& view, float fovY, float aspect, float zNear, float zFar, unsigned int samples,
+	const SkySH9* sky, float skyIntensity)
+{
+	XMMATRIX invView = XMMatrixInverse(0, XMLoadFloat4x4(&view));
+	XMFLOAT3 camPos;
+	XMStoreFloat3(&camPos, XMVector3TransformCoord(XMVectorSet(0, 0, 0, 1), invView));
+	float tanY = tanf(fovY * 0.5f);
+	float tanX = tanY * aspect;
+
+	float maxNormalError = 0;
+	float maxPositionError = 0;
+	unsigned int maxStep = 0;
+	unsigned int offByMore = 0;
+	double totalSteps = 0;
+
+	srand(4321);
+	for (unsigned int i = 0; i < samples; i++)
+	{
+		float ndcX = RandomRange(-1, 1);
+		float ndcY = RandomRange(-1, 1);
+		float viewZ = RandomRange(1.0f, zFar);
+
+		GBufferSurface s;
+		s.Albedo = XMFLOAT3(rand() % 256 / 255.0f, rand() % 256 / 255.0f, rand() % 256 / 255.0f);
+		s.Shininess = (i & 1) ? 64.0f : 0.0f;
+		s.Material = (i % 8 == 0) ? GBUFFER_MATERIAL_UNLIT : GBUFFER_MATERIAL_LIT;
+
+		// Any normal that faces the camera
+		XMVECTOR viewPos = XMVectorSet(ndcX * tanX * viewZ, ndcY * tanY * viewZ, viewZ, 1);
+		XMVECTOR worldPos = XMVector3TransformCoord(viewPos, invView);
+		XMVECTOR N = XMVector3Normalize(XMVectorSet(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1), 0));
+		if (Dot(N, XMLoadFloat3(&camPos) - worldPos) < 0)
+			N = N * -1.0f;
+		XMStoreFloat3(&s.Normal, N);
+
+		XMFLOAT3 forwardPos;
+		XMStoreFloat3(&forwardPos, worldPos);
+		XMFLOAT4 forward = GBufferShade(s, forwardPos, camPos, light, lights, lightCount, sky, skyIntensity);
+
+		// Deferred: quantized surface, position from 32 bit float
+		// depth (reversed, infinite far plane: zNear / z)
+		GBufferSurface packed = GBufferUnpack(GBufferPack(s));
+		float storedDepth = (float)((double)zNear / viewZ);
+		float rebuiltZ = DofLinearDepth(storedDepth, zNear, 0);
+		XMFLOAT3 deferredPos;
+		XMStoreFloat3(&deferredPos, XMVector3TransformCoord(
+			XMVectorSet(ndcX * tanX * rebuiltZ, ndcY * tanY * rebuiltZ, rebuiltZ, 1), invView));
+		XMFLOAT4 deferred = GBufferShade(packed, deferredPos, camPos, light, lights, lightCount, sky, skyIntensity);
+
+		float cosError = Saturate(Dot(N, XMLoadFloat3(&packed.Normal)));
+		maxNormalError = std::max(maxNormalError, acosf(cosError) * 57.29578f);
+		maxPositionError = std::max(maxPositionError,
+			XMVectorGetX(XMVector3Length(XMLoadFloat3(&deferredPos) - worldPos)) / viewZ);
+
+		const float* f = &forward.x;
+		const float* d = &deferred.x;
+		unsigned int worst = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			int step = abs((int)ToUnorm(f[c], 8) - (int)ToUnorm(d[c], 8));
+			worst = std::max(worst, (unsigned int)step);
+			totalSteps += step;
+		}
+		maxStep = std::max(maxStep, worst);
+		if (worst > 1) offByMore++;
+	}
+
+	printf("\nDeferred vs. forward, %u random surface points, %u local lights\n", samples, lightCount);
+	printf("  G-buffer: 8 bytes/pixel + depth (RGBA8 albedo/shininess, RGB10A2 15 bit octahedral normal/material)\n");
+	printf("  normal error:   %.3f degrees at most\n", maxNormalError);
+	printf("  position error: %.5f%% of view depth at most (float reversed z)\n", maxPositionError * 100.0f);
+	printf("  output (8 bit): %.4f steps per channel on average, %u at most, %u points off by more than 1  %s\n",
+		totalSteps / (samples * 4.0), maxStep, offByMore, CheckResult(maxStep <= 1));
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "Light.h"
+#include "SkyConvolution.h"
+
+// --------------------------------------------------------
+// Deferred G-buffer helpers
+//
+// The deferred path writes two 32 bit targets per pixel
+// (see GBuffer.hlsli):
+//   0  R8G8B8A8_UNORM     albedo.rgb, shininess / 255
+//   1  R10G10B10A2_UNORM  octahedral normal.xy, material
+// The normal gets 15 bits an axis: the top 10 in R and G and
+// the low 5 of both in B.
+// and a full screen pass lights every pixel from those plus
+// the depth buffer.
+//
+// The functions below are the CPU reference for the packing
+// and the lighting, using the same math and quantization as
+// the shaders, so the deferred output can be compared with
+// what the forward shaders would have written.
+// --------------------------------------------------------
+
+#define GBUFFER_MATERIAL_LIT 0
+#define GBUFFER_MATERIAL_UNLIT 1
+
+// What a material writes for one pixel
+struct GBufferSurface
+{
+	XMFLOAT3 Albedo;
+	XMFLOAT3 Normal;   // World space, unit length
+	float Shininess;   // 0 = no highlight, whole numbers up to 255
+	int Material;      // GBUFFER_MATERIAL_*
+};
+
+// One packed pixel, as the two targets store it
+struct GBufferTexel
+{
+	unsigned int Albedo; // R8G8B8A8_UNORM
+	unsigned int Normal; // R10G10B10A2_UNORM
+};
+
+// Unit vector <-> [0,1]^2
+XMFLOAT2 GBufferOctEncode(XMFLOAT3 n);
+XMFLOAT3 GBufferOctDecode(XMFLOAT2 e);
+
+GBufferTexel GBufferPack(const GBufferSurface& s);
+GBufferSurface GBufferUnpack(const GBufferTexel& t);
+
+// The scene lighting for one surface point (directional light
+// plus every local light, no clusters).  Alpha is 1 for lit
+// surfaces and 0 for unlit ones, like the shaders.
+// - sky (scaled by skyIntensity) is the ambient in place of the
+//   light's AmbientColor, as SkyLighting.hlsli's SkyDiffuse.
+//   The sky's specular reflection isn't modelled.
+XMFLOAT4 GBufferShade(const GBufferSurface& s, XMFLOAT3 worldPos, XMFLOAT3 camPos,
+	const DirectionalLight& light, const LocalLight* lights, unsigned int lightCount,
+	const SkySH9* sky = 0, float skyIntensity = 1);
+
+// Shades random visible points both ways - forward (exact surface
+// and position) and deferred (packed surface, position rebuilt
+// from float reversed z depth) - and prints how far apart they
+// end up.  Fails if any 8 bit output channel is off by more
+// than one step.  Points are placed out to zFar.
+// view is the world -> view matrix (not transposed).
+void GBufferParityReport(const DirectionalLight& light, const LocalLight* lights, unsigned int lightCount,
+	const XMFLOAT4X4& view, float fovY, float aspect, float zNear, float zFar, unsigned int samples,
+	const SkySH9* sky = 0, float skyIntensity = 1);
@@ -0,0 +1,63 @@
+// Struct representing the data we expect to receive from earlier pipeline stages
+// - Should match the output of our corresponding vertex shader
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD;
+	float3 normal       : NORMAL;
+	float3 tangent      : TANGENT;
+	float3 worldPos     : POSITION;
+	float depth         : DEPTH;        //depth in view space
+};
+
+#include "GBuffer.hlsli"
+#include "VirtualTexture.hlsli"
+#include "TextureArrays.hlsli"
+
+//constant buffer
+//covers all the forward materials (MaterialPS permutations):
+//  normal mapped, textured, solid color (unlit), virtual textured
+cbuffer externalData : register(b0)
+{
+	float4 color;        //used when there's no diffuse map
+	float shininess;
+	int diffuseSlice;    //-1 = no diffuse map (or not loaded yet)
+	int normalSlice;     //-1 = no normal map (or not loaded yet)
+	int material;        //GBUFFER_MATERIAL_*
+	int useVirtualTexture;  //albedo from the virtual texture (MATERIAL_VIRTUAL_TEXTURE)
+	float diffuseMinMip; //finest resident level of each slice
+	float normalMinMip;
+};
+
+//textures, one slice each (TextureArrays.hlsli)
+Texture2DArray diffuseMap : register(t0);
+Texture2DArray normalMap: register(t1);
+SamplerState basicSampler : register(s0);
+
+// --------------------------------------------------------
+// Writes the surface, no lighting at all
+// --------------------------------------------------------
+GBufferOut main(VertexToPixel input)
+{
+	GBufferSurface s;
+
+	float3 N = normalize(input.normal);
+	if (normalSlice >= 0)
+	{
+		//same TBN as MaterialPS
+		float3 normalFromMap = SampleNormalSlice(normalMap, basicSampler, input.uv, normalSlice, normalMinMip);
+		float3 T = normalize(normalize(input.tangent) - N * dot(normalize(input.tangent), N));
+		float3 B = cross(T, N);
+		N = normalize(mul(normalFromMap, float3x3(T, B, N)));
+	}
+	s.normal = N;
+
+	if (useVirtualTexture)
+		s.albedo = VirtualSample(input.uv).rgb;
+	else
+		s.albedo = diffuseSlice >= 0 ? SampleSlice(diffuseMap, basicSampler, input.uv, diffuseSlice, diffuseMinMip).rgb : color.rgb;
+	s.shininess = shininess;
+	s.material = material;
+
+	return PackGBuffer(s);
+}
@@ -21,8 +21,19 @@ Game::Game(HINSTANCE hInstance)
 {
 	// Initialize fields
 	vertexShader = 0;
-	pixelShader = 0;
-	dShader = 0;
+	materialShaders = 0;
+	gbufferPS = 0;
+	deferredPS = 0;
+	bloom = 0;
+	dof = 0;
+	targetPool = 0;
+	frameGraph = 0;
+	clusters = 0;
+	virtualTexture = 0;
+	states = 0;
+	textureArrays = 0;
+	skyLighting = 0;
+	myCam = 0;
 
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
@@ -44,49 +55,39 @@ Game::~Game()
 	// Delete our simple shader objects, which
 	// will clean up their own internal DirectX stuff
 	delete vertexShader;
-	delete pixelShader;
-	delete dShader;
-	delete pShader2;
-	delete blurShader;
+	delete depthVS;
+	delete materialShaders;
+	delete gbufferPS;
+	delete deferredPS;
 	delete ppVS;
-	delete ppExtract;
-	delete ppBlur;
 	delete addBlend;
 	delete skyVS;
 	delete skyPS;
-	delete dofPS;
 	
 	for (auto& m : meshes)delete m;
 	for (auto& e : entities)delete e;
 
 	delete myCam;
-
-	delete material;
-	delete mat2;
-	delete mat3;
-	delete blurMat;
-
-	rockSRV->Release();
-	floorSRV->Release();
-	rockNormal->Release();
-	sampler->Release();
-	bloomSampler->Release();
-	dofSampler->Release();
-	skyRasterState->Release();
-	skyDepthState->Release();
-
-	ppRTV->Release();
-	ppSRV->Release();
-	extractBrightRTV->Release();
-	extractSRV->Release();
-	blurRTV->Release();
-	blurSRV->Release();
-	skySRV->Release();
-	depthRTV->Release();
-	depthSRV->Release();
-	dofRTV->Release();
-	dofBlurRTV->Release();
-	dofBlurSRV->Release();
+	delete gpuProfiler;
+	delete frameGraph;
+	delete clusters;
+	delete shadows;
+	delete localShadows;
+	delete skyLighting;
+	delete virtualTexture;
+	delete targetPool;
+	delete bloom;
+	delete dof;
+
+	for (auto& m : materials) delete m;
+
+	textures->Release(rockTex);
+	textures->Release(rockNormalTex);
+	textures->Release(floorTex);
+	textures->Release(skyTex);
+	delete textures;
+	delete textureArrays;
+	delete states;
 }
 
 // --------------------------------------------------------
@@ -99,22 +100,45 @@ void Game::Init()
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
 
-	myCam = new Camera(width, height, zNear, zFar);
+	myCam = new Camera(width, height, zNear, zFar, CAMERA_DEPTH_REVERSED_INFINITE);
 	myCam->Start();
 
+	gpuProfiler = new GpuProfiler(new D3D11QueryBackend(device, context));
+	targetPool = new RenderTargetPool(new D3D11TargetBackend(device, context));
+	targetPool->Resize(width, height);
+	frameGraph = new RenderGraph(targetPool);
+
 	LoadShaders();
 
-	//load textures
-	CreateWICTextureFromFile(device, context, L"Textures/gray.jpg", 0, &floorSRV);
-	CreateWICTextureFromFile(device, context, L"Textures/rock.jpg", 0, &rockSRV);
-	CreateWICTextureFromFile(device, context, L"Textures/rockNormals.jpg", 0, &rockNormal);
+	//load textures - decoded on worker threads, with 1x1
+	//placeholders until Draw's textures->Update() uploads them
+	//(the callbacks copy the real ones into their texture array
+	//slice, and again whenever mips stream in or out - materials
+	//pick the slices up in Draw)
+	textures = new TextureStreamer(new D3D11TextureBackend(device, context));
+	textureArrays = new TextureArrays(device, context);
+	floorTex = LoadMaterialTexture(L"Textures/gray.jpg", TEXTURE_PLACEHOLDER_GRAY);
+	rockTex = LoadMaterialTexture(L"Textures/rock.jpg", TEXTURE_PLACEHOLDER_GRAY);
+	rockNormalTex = LoadMaterialTexture(L"Textures/rockNormals.jpg", TEXTURE_PLACEHOLDER_NORMAL);
 	//CreateWICTextureFromFile(device, context, L"Textures/skybox.png", 0, &skyboxSRV);
+	skyTex = textures->Load(L"Textures/nightSkybox.dds", TEXTURE_PLACEHOLDER_BLACK_CUBE,
+		[this](ID3D11ShaderResourceView* srv) { skySRV = srv; });
+	skySRV = textures->GetSRV(skyTex);
+
+	//the ground's terrain texture: a tiled file if one has been
+	//built, otherwise generated on the tile loader's threads
+	VirtualTextureFile* terrainFile = new VirtualTextureFile();
+	IVirtualTileSource* terrain = terrainFile;
+	if (!terrainFile->Open("Textures/terrain.vtex"))
+	{
+		delete terrainFile;
+		terrain = new ProceduralTileSource(512, 512, 1);  //64k x 64k texels
+	}
+	virtualTexture = new VirtualTexturing(device, context, terrain, width, height);
 
-	CreateDDSTextureFromFile(
-		device,
-		L"Textures/nightSkybox.dds",
-		0,
-		&skySRV);
+	// Every sampler / rasterizer / depth state comes from the
+	// cache, one object per distinct descriptor
+	states = new StateCache(new D3D11StateBackend(device, context));
 
 	// Manually create a sampler state
 	D3D11_SAMPLER_DESC samplerDesc = {}; // Zero out the struct memory
@@ -124,7 +148,7 @@ void Game::Init()
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
-	device->CreateSamplerState(&samplerDesc, &sampler);
+	sampler = states->GetSampler(states->Sampler(samplerDesc));
 
 	// Sampler for bloom
 	D3D11_SAMPLER_DESC samplerDesc1 = {}; // Zero out the struct memory
@@ -134,7 +158,7 @@ void Game::Init()
 	samplerDesc1.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	samplerDesc1.MaxLOD = D3D11_FLOAT32_MAX;
 
-	device->CreateSamplerState(&samplerDesc1, &bloomSampler);
+	bloomSampler = states->GetSampler(states->Sampler(samplerDesc1));
 
 	// Sampler for dof
 	D3D11_SAMPLER_DESC samplerDesc2 = {}; // Zero out the struct memory
@@ -144,30 +168,69 @@ void Game::Init()
 	samplerDesc2.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	samplerDesc2.MaxLOD = D3D11_FLOAT32_MAX;
 
-	device->CreateSamplerState(&samplerDesc2, &dofSampler);
+	dofSampler = states->GetSampler(states->Sampler(samplerDesc2));
+
+	// Depth tests follow the camera: with reversed z nearer is
+	// greater, and the far depth (what depth clears to) is 0
+	bool reversedZ = myCam->getDepthMode() != CAMERA_DEPTH_STANDARD;
 
-	//skybox sampler state
-	D3D11_RASTERIZER_DESC rd = {}; // Remember to zero it out!
-	rd.CullMode = D3D11_CULL_FRONT;
-	rd.FillMode = D3D11_FILL_SOLID;
-	rd.DepthClipEnable = true;
-	device->CreateRasterizerState(&rd, &skyRasterState);
+	// Opaque passes without a pre-pass, and the pre-pass itself
+	D3D11_DEPTH_STENCIL_DESC ods = {};
+	ods.DepthEnable = true;
+	ods.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	ods.DepthFunc = reversedZ ? D3D11_COMPARISON_GREATER : D3D11_COMPARISON_LESS;
+	opaquePipeline = states->Pipeline(STATE_DEFAULT, states->DepthStencil(ods));
 
-	// Depth state for accepting pixels with depth EQUAL to existing depth
+	// Sky: a fullscreen triangle at the far depth that only lands
+	// where nothing else did.  Nothing reads its depth, so no
+	// writes, and the pixel shader never touches depth or
+	// discards, so covered pixels are rejected before shading.
 	D3D11_DEPTH_STENCIL_DESC ds = {};
 	ds.DepthEnable = true;
-	ds.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-	ds.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-	device->CreateDepthStencilState(&ds, &skyDepthState);
-
-	material = new Material(vertexShader, pixelShader, rockSRV, rockNormal, sampler);
-	mat2 = new Material(vertexShader, dShader);
-	mat3 = new Material(vertexShader, pShader2, floorSRV, sampler);
-	blurMat = new Material(vertexShader, blurShader, rockSRV, rockNormal, sampler);
+	ds.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	ds.DepthFunc = reversedZ ? D3D11_COMPARISON_GREATER_EQUAL : D3D11_COMPARISON_LESS_EQUAL;
+	skyPipeline = states->Pipeline(STATE_DEFAULT, states->DepthStencil(ds));
+
+	// Opaque passes after the depth pre-pass: only the closest
+	// surface survives the test, and depth is already final
+	D3D11_DEPTH_STENCIL_DESC eds = {};
+	eds.DepthEnable = true;
+	eds.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	eds.DepthFunc = D3D11_COMPARISON_EQUAL;
+	equalPipeline = states->Pipeline(STATE_DEFAULT, states->DepthStencil(eds));
+
+	//each picks its MaterialPS permutation from what it uses
+	const unsigned int lit = MATERIAL_LOCAL_LIGHTS | MATERIAL_SHADOWS;
+	MaterialParams rockParams = { XMFLOAT4(1, 1, 1, 1), 64.0f, 0.0f };
+	MaterialParams matteParams = { XMFLOAT4(1, 1, 1, 1), 0.0f, 0.0f };
+	MaterialParams blurParams = { XMFLOAT4(1, 1, 1, 1), 64.0f, 0.005f };
+	material = new Material(device, vertexShader, materialShaders, lit | MATERIAL_NORMAL_MAP, rockParams,
+		textureArrays, rockTex, rockNormalTex, sampler);
+	for (int i = 0; i < 4; i++)
+	{
+		MaterialParams markerParams = { markerColors[i], 0.0f, 0.0f };
+		markerMats[i] = new Material(device, vertexShader, materialShaders, MATERIAL_UNLIT, markerParams);
+		materials.push_back(markerMats[i]);
+	}
+	mat3 = new Material(device, vertexShader, materialShaders, lit, matteParams, textureArrays, floorTex, -1, sampler);
+	groundMat = new Material(device, vertexShader, materialShaders, lit | MATERIAL_VIRTUAL_TEXTURE, matteParams);
+	blurMat = new Material(device, vertexShader, materialShaders,
+		MATERIAL_NORMAL_MAP | MATERIAL_LOCAL_LIGHTS | MATERIAL_DIFFUSE_BLUR, blurParams,
+		textureArrays, rockTex, rockNormalTex, sampler);
+	materials.push_back(material);
+	materials.push_back(mat3);
+	materials.push_back(groundMat);
+	materials.push_back(blurMat);
 	CreateMatrices();
 
 	CreateBasicGeometry();
 
+	//Draw can run before the first sim tick and blends from the
+	//saved state, so both ends start at the initial placement
+	myCam->Update();
+	myCam->SaveState();
+	for (auto& e : entities) e->SaveState();
+
 	//set mouse pos
 	prevMousePos.x = width / 2;
 	prevMousePos.y = height / 2;
@@ -175,146 +238,50 @@ void Game::Init()
 	light = { XMFLOAT4(0.1,0.1,0.1,1.0),                  //ambient color
 			  XMFLOAT4(0.2, 0.2, 0.2, 1),           //diffuse color
 			  XMFLOAT3(1, -1, 0), 1.0 };                  //direction
-	light2 = { XMFLOAT4(0.1, 0.1, 0.1, 1.0),              //ambient color
-			   XMFLOAT4(0.4, 0.478, 0.980, 1),          //diffuse color               
-			   XMFLOAT3(5, -2 , -5), 1.0 };               //light position
-	light3 = { XMFLOAT4(0.01, 0.01, 0.01, 1.0),           //ambient
-			   XMFLOAT4(0.8, 0.160, 0.074, 1.0),          //Diffuse            
-			   XMFLOAT3(-1.0, -0.5, 0),                        //Direction
-			   30.0f,                                     //cone
-			   XMFLOAT3(7, 2, 0),                        //Light Pos
-			   120.0f };                                    //Range
-	light4 = { XMFLOAT4(0.01, 0.01, 0.01, 1.0),           //ambient
-		XMFLOAT4(0.992, 0.882, 0.227, 1.0),          //Diffuse            
-		XMFLOAT3(1, -0.2, 0),                        //Direction
-		30.0f,                                     //cone
-		XMFLOAT3(-7.0f, 2.0f, 0.0f),              //Light Pos
-		80.0f };                                    //Range
-	light5 = { XMFLOAT4(0.01, 0.01, 0.01, 1.0),           //ambient
-		XMFLOAT4(0.8, 0.8, 0.8, 1.0),          //Diffuse            
-		XMFLOAT3(0, -1, 1),                        //Direction
-		40.0f,                                     //cone
-		XMFLOAT3(0.0f, 30.0f, -30.0f),              //Light Pos
-		100.0f };                                    //Range
+	localLights.push_back({ XMFLOAT4(0.1, 0.1, 0.1, 1.0),  //ambient color
+		XMFLOAT4(0.4, 0.478, 0.980, 1),                  //diffuse color
+		XMFLOAT3(0, 0, 0), 0.0f,                         //(no direction/cone)
+		XMFLOAT3(5, -2, -5),                             //light position
+		20.0f,                                           //range
+		LIGHT_TYPE_POINT, -1, { 0, 0 } });
+	localLights.push_back({ XMFLOAT4(0.01, 0.01, 0.01, 1.0), //ambient
+		XMFLOAT4(0.8, 0.160, 0.074, 1.0),                //Diffuse
+		XMFLOAT3(-1.0, -0.5, 0),                         //Direction
+		30.0f,                                           //cone
+		XMFLOAT3(7, 2, 0),                               //Light Pos
+		120.0f,                                          //Range
+		LIGHT_TYPE_SPOT, -1, { 0, 0 } });
+	localLights.push_back({ XMFLOAT4(0.01, 0.01, 0.01, 1.0), //ambient
+		XMFLOAT4(0.992, 0.882, 0.227, 1.0),              //Diffuse
+		XMFLOAT3(1, -0.2, 0),                            //Direction
+		30.0f,                                           //cone
+		XMFLOAT3(-7.0f, 2.0f, 0.0f),                     //Light Pos
+		80.0f,                                           //Range
+		LIGHT_TYPE_SPOT, -1, { 0, 0 } });
+	localLights.push_back({ XMFLOAT4(0.01, 0.01, 0.01, 1.0), //ambient
+		XMFLOAT4(0.8, 0.8, 0.8, 1.0),                    //Diffuse
+		XMFLOAT3(0, -1, 1),                              //Direction
+		40.0f,                                           //cone
+		XMFLOAT3(0.0f, 30.0f, -30.0f),                   //Light Pos
+		100.0f,                                          //Range
+		LIGHT_TYPE_SPOT, -1, { 0, 0 } });
 //Lights end------------------------------------
 
 	//pass light to pixel shader
-	pixelShader->SetData("light", &light, sizeof(DirectionalLight));
-	pixelShader->SetData("light2", &light2, sizeof(PointLight));
-	pixelShader->SetData("light3", &light3, sizeof(SpotLight));
-	pixelShader->SetData("light4", &light4, sizeof(SpotLight));
-	pixelShader->SetData("light5", &light5, sizeof(SpotLight));
-	pixelShader->SetFloat("shininess", 64.0f);
-	pixelShader->SetFloat3("camPos", myCam->getCamPos());
-
-	pShader2->SetData("light", &light, sizeof(DirectionalLight));
-	pShader2->SetData("light2", &light2, sizeof(PointLight));
-	pShader2->SetData("light3", &light3, sizeof(SpotLight));
-	pShader2->SetData("light4", &light4, sizeof(SpotLight));
-	pShader2->SetData("light5", &light5, sizeof(SpotLight));
-	pShader2->SetFloat3("camPos", myCam->getCamPos());
-
-	blurShader->SetData("light", &light, sizeof(DirectionalLight));
-	blurShader->SetData("light2", &light2, sizeof(PointLight));
-	blurShader->SetData("light3", &light3, sizeof(SpotLight));
-	blurShader->SetData("light4", &light4, sizeof(SpotLight));
-	blurShader->SetData("light5", &light5, sizeof(SpotLight));
-	blurShader->SetFloat("shininess", 64.0f);
-	blurShader->SetFloat3("camPos", myCam->getCamPos());
-
-	//post processing stuff---------------------------
-	//Bloom ------------------------------
-	D3D11_TEXTURE2D_DESC textureDesc = {};
-	textureDesc.Width = width;
-	textureDesc.Height = height;
-	textureDesc.ArraySize = 1;
-	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	textureDesc.CPUAccessFlags = 0;
-	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	textureDesc.MipLevels = 1;
-	textureDesc.MiscFlags = 0;
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Usage = D3D11_USAGE_DEFAULT;
-
-	ID3D11Texture2D* ppTexture;
-	device->CreateTexture2D(&textureDesc, 0, &ppTexture);
-	// Create the Render Target View
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-	rtvDesc.Format = textureDesc.Format;
-	rtvDesc.Texture2D.MipSlice = 0;
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-
-	device->CreateRenderTargetView(ppTexture, &rtvDesc, &ppRTV);
-
-	// Create the Shader Resource View
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Format = textureDesc.Format;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-
-	device->CreateShaderResourceView(ppTexture, &srvDesc, &ppSRV);
-
-	// We don't need the texture reference itself no mo'
-	ppTexture->Release();
-
-	ID3D11Texture2D* extractTexture;
-	device->CreateTexture2D(&textureDesc, 0, &extractTexture);
-	device->CreateRenderTargetView(extractTexture, &rtvDesc, &extractBrightRTV);
-
-	// Create the Shader Resource View
-	device->CreateShaderResourceView(extractTexture, &srvDesc, &extractSRV);
-
-	// We don't need the texture reference itself no mo'
-	extractTexture->Release();
-
-	ID3D11Texture2D* blurTexture;
-	device->CreateTexture2D(&textureDesc, 0, &blurTexture);
-	// Create the Render Target View
-	device->CreateRenderTargetView(blurTexture, &rtvDesc, &blurRTV);
-
-	// Create the Shader Resource View
-	device->CreateShaderResourceView(blurTexture, &srvDesc, &blurSRV);
-
-	// We don't need the texture reference itself no mo'
-	blurTexture->Release();
-
-	//Depth of Field --------------------
-	ID3D11Texture2D* depthTexture;
-	//textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-	device->CreateTexture2D(&textureDesc, 0, &depthTexture);
-	// Create the Render Target View
-	device->CreateRenderTargetView(depthTexture, &rtvDesc, &depthRTV);
-
-	// Create the Shader Resource View
-	device->CreateShaderResourceView(depthTexture, &srvDesc, &depthSRV);
-
-	// We don't need the texture reference itself no mo'
-	depthTexture->Release();
-
-	ID3D11Texture2D* dofTex;
-	device->CreateTexture2D(&textureDesc, 0, &dofTex);
-	// Create the Render Target View
-	device->CreateRenderTargetView(dofTex, &rtvDesc, &dofRTV);
-	// Create the Shader Resource View
-	device->CreateShaderResourceView(dofTex, &srvDesc, &dofSRV);
-	
-	dofTex->Release();
-
-	ID3D11Texture2D* dofBlurTex;
-	//textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-	device->CreateTexture2D(&textureDesc, 0, &dofBlurTex);
-	// Create the Render Target View
-	device->CreateRenderTargetView(dofBlurTex, &rtvDesc, &dofBlurRTV);
+	//(point and spot lights go through the cluster buffers instead)
+	clusters = new ClusteredLighting(device, context);
+	shadows = new ShadowMaps(device, context);
+	localShadows = new LocalShadows(device, context);
 
-	// Create the Shader Resource View
-	device->CreateShaderResourceView(dofBlurTex, &srvDesc, &dofBlurSRV);
+	//the sky's irradiance SH stands in for the flat ambient (scaled
+	//to its brightness), its prefiltered cube adds reflections
+	//(convolved on a worker - flat ambient until Draw swaps it in)
+	skyLighting = new SkyLighting(device, context);
+	skyLighting->Load(L"Textures/nightSkybox.dds", light.AmbientColor);
+	for (auto& ps : materialShaders->GetLoaded())
+		ps->SetData("light", &light, sizeof(DirectionalLight));
 
-	// We don't need the texture reference itself no mo'
-	dofBlurTex->Release();
-
-	//Post Process Finished--------------------------------
+	deferredPS->SetData("light", &light, sizeof(DirectionalLight));
 
 	// Tell the input assembler stage of the pipeline what kind of
 	// geometric primitives (points, lines or triangles) we want to draw.  
@@ -333,33 +300,28 @@ void Game::LoadShaders()
 	vertexShader = new SimpleVertexShader(device, context);
 	vertexShader->LoadShaderFile(L"VertexShader.cso");  //'L' to make it a wide string
 
-	pixelShader = new SimplePixelShader(device, context);
-	pixelShader->LoadShaderFile(L"PixelShader.cso");
+	depthVS = new SimpleVertexShader(device, context);
+	depthVS->LoadShaderFile(L"DepthOnlyVS.cso");
 
-	//have a check here if!=NULL 
-	dShader = new SimplePixelShader(device, context);
-	dShader->LoadShaderFile(L"defaultPixelShader.cso");
+	// Forward path: the materials load the MaterialPS permutations they need
+	materialShaders = new MaterialShaders(device, context);
 
-	//have a check here if!=NULL 
-	pShader2 = new SimplePixelShader(device, context);
-	pShader2->LoadShaderFile(L"PixelShader2.cso");
+	// Deferred path: one g-buffer shader for every material, then a full screen lighting pass
+	gbufferPS = new SimplePixelShader(device, context);
+	gbufferPS->LoadShaderFile(L"GBufferPS.cso");
 
-	//have a check here if!=NULL 
-	blurShader = new SimplePixelShader(device, context);
-	blurShader->LoadShaderFile(L"BlurShader.cso");
+	deferredPS = new SimplePixelShader(device, context);
+	deferredPS->LoadShaderFile(L"DeferredLightingPS.cso");
 
 	ppVS = new SimpleVertexShader(device, context);
 	ppVS->LoadShaderFile(L"PostProcessVS.cso");
 
-	ppExtract = new SimplePixelShader(device, context);
-	ppExtract->LoadShaderFile(L"ExtractBrightPS.cso");
-
-	ppBlur = new SimplePixelShader(device, context);
-	ppBlur->LoadShaderFile(L"GaussianBlur.cso");
-
 	addBlend = new SimplePixelShader(device, context);
 	addBlend->LoadShaderFile(L"AdditiveBlend.cso");
 
+	// Bloom's mip chain lives in the frame graph
+	bloom = new Bloom(device, context, ppVS);
+
 	// Load the shaders for the sky
 	skyVS = new SimpleVertexShader(device, context);
 	skyVS->LoadShaderFile(L"SkyVS.cso");
@@ -367,8 +329,8 @@ void Game::LoadShaders()
 	skyPS = new SimplePixelShader(device, context);
 	skyPS->LoadShaderFile(L"SkyPS.cso");
 
-	dofPS = new SimplePixelShader(device, context);
-	dofPS->LoadShaderFile(L"dofPS.cso");
+	// Half res compute DoF, composites straight to the back buffer
+	dof = new DepthOfField(device, context, ppVS);
 }
 
 
@@ -430,11 +392,11 @@ void Game::CreateBasicGeometry()
 
 	myEnt1 = new Entity(myMesh2, context, material);
 	//myEnt1 = new Entity(myMesh2, context, mat3);
-	myEnt2 = new Entity(myMesh2, context, mat2);
-	myEnt3 = new Entity(myMesh2, context, mat2);
-	myEnt4 = new Entity(myMesh2, context, mat2);
-	myEnt5 = new Entity(myMesh2, context, mat2);
-	ground = new Entity(myMesh1, context, mat3);
+	myEnt2 = new Entity(myMesh2, context, markerMats[0]);
+	myEnt3 = new Entity(myMesh2, context, markerMats[1]);
+	myEnt4 = new Entity(myMesh2, context, markerMats[2]);
+	myEnt5 = new Entity(myMesh2, context, markerMats[3]);
+	ground = new Entity(myMesh1, context, groundMat);
 	myEnt6 = new Entity(myMesh2, context, material);
 	trees = new Entity(myMesh3, context, mat3);
 
@@ -446,6 +408,25 @@ void Game::CreateBasicGeometry()
 	entities.push_back(ground);
 	entities.push_back(myEnt6);
 	entities.push_back(trees);
+
+	virtualTextured.push_back(ground);
+
+	//nothing in the scene moves, so it's placed once here
+	myEnt1->SetScale(5, 5, 5);
+	myEnt6->SetScale(5, 5, 5);
+	myEnt6->SetPos(-5, 0, -10);
+	trees->SetPos(0, -10, 20);
+	myEnt2->SetScale(0.5, 0.5, 0.5);
+	myEnt2->SetPos(-3, 3, 0);
+	myEnt3->SetScale(0.5, 0.5, 0.5);
+	myEnt3->SetPos(5, -2, -5);
+	myEnt4->SetScale(0.5, 0.5, 0.5);
+	myEnt4->SetPos(7, 2, 0);
+	myEnt5->SetScale(0.5, 0.5, 0.5);
+	myEnt5->SetPos(-5, 2, 0);
+	ground->SetPos(0, -10, 0);
+	ground->SetScale(150, 0.5, 150);
+	for (auto& e : entities) e->Update();
 }
 
 
@@ -458,84 +439,233 @@ void Game::OnResize()
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
 
-	// Update our projection matrix since the window size changed
-	XMMATRIX P = XMMatrixPerspectiveFovLH(
-		0.25f * 3.1415926535f,	// Field of View Angle
-		(float)width / height,	// Aspect ratio
-		0.1f,				  	// Near clip plane distance
-		100.0f);			  	// Far clip plane distance
-	XMStoreFloat4x4(&projectionMatrix, XMMatrixTranspose(P)); // Transpose for HLSL!
+	// Screen sized targets follow the window (not created yet on the first call)
+	if (targetPool) targetPool->Resize(width, height);
+	if (virtualTexture) virtualTexture->Resize(width, height);
+
+	// Update the camera's projection since the aspect ratio changed
+	if (myCam) myCam->OnResize(width, height);
 }
 
 // --------------------------------------------------------
-// Update your game here - user input, move objects, AI, etc.
+// Keys that aren't part of the simulation - checked once per
+// frame, so they work the same at any tick rate
 // --------------------------------------------------------
-void Game::Update(float deltaTime, float totalTime)
+void Game::HandleKeys()
 {
 	// Quit if the escape key is pressed
 	if (GetAsyncKeyState(VK_ESCAPE))
 		Quit();
-	if (GetAsyncKeyState('W') &0x8000)
+
+	// Capture a profiler trace when P is pressed
+	bool captureKey = (GetAsyncKeyState('P') & 0x8000) != 0;
+	if (captureKey && !captureKeyDown)
+		Profiler::BeginCapture(120, "profile.json");
+	captureKeyDown = captureKey;
+
+	// Switch between forward and deferred shading when G is pressed
+	bool deferredKey = (GetAsyncKeyState('G') & 0x8000) != 0;
+	if (deferredKey && !deferredKeyDown)
 	{
-		myCam->Move(0, 0, 0.05f);
-		myCam->Update();
+		deferred = !deferred;
+		printf("\n%s shading\n", deferred ? "Deferred" : "Forward");
 	}
-	if (GetAsyncKeyState('S') & 0x8000)
+	deferredKeyDown = deferredKey;
+
+	// Depth pre-pass on/off when Z is pressed
+	bool prepassKey = (GetAsyncKeyState('Z') & 0x8000) != 0;
+	if (prepassKey && !prepassKeyDown)
 	{
-		myCam->Move(0, 0, -0.05f);
-		myCam->Update();
+		depthPrepass = !depthPrepass;
+		printf("\nDepth pre-pass %s\n", depthPrepass ? "on" : "off");
 	}
-	if (GetAsyncKeyState('A') & 0x8000)
+	prepassKeyDown = prepassKey;
+
+	// Pixel shader invocations (etc.) per pass when I is pressed
+	bool statsKey = (GetAsyncKeyState('I') & 0x8000) != 0;
+	if (statsKey && !statsKeyDown)
 	{
-		myCam->Move(0.05f, 0, 0);
-		myCam->Update();
+		printf("\n%s shading, depth pre-pass %s", deferred ? "Deferred" : "Forward", depthPrepass ? "on" : "off");
+		gpuProfiler->PrintPassStats();
 	}
-	if (GetAsyncKeyState('D') & 0x8000)
+	statsKeyDown = statsKey;
+
+	// Record the sim input when K is pressed (again to stop)
+	bool recordKey = (GetAsyncKeyState('K') & 0x8000) != 0;
+	if (recordKey && !recordKeyDown && !replayingInput)
 	{
-		myCam->Move(-0.05f, 0, 0);
-		myCam->Update();
+		recordingInput = !recordingInput;
+		if (recordingInput)
+		{
+			inputRecording.Clear();
+			recordStart = *myCam;
+		}
+		printf("\nInput recording %s (%u ticks)\n", recordingInput ? "started" : "stopped",
+			inputRecording.GetTickCount());
 	}
-	if (GetAsyncKeyState('X') & 0x8000)
+	recordKeyDown = recordKey;
+
+	// Replay it from the same starting point when L is pressed
+	bool replayKey = (GetAsyncKeyState('L') & 0x8000) != 0;
+	if (replayKey && !replayKeyDown && !recordingInput && inputRecording.GetTickCount() > 0)
 	{
-		myCam->MoveUpDown(0.01f);
-		myCam->Update();
+		*myCam = recordStart;
+		myCam->OnResize(width, height);
+		inputRecording.Rewind();
+		replayingInput = true;
+		printf("\nReplaying %u ticks of input\n", inputRecording.GetTickCount());
 	}
-	if (GetAsyncKeyState(VK_SPACE) & 0x8000)
+	replayKeyDown = replayKey;
+
+#if defined(DEBUG) || defined(_DEBUG)
+	// Reports that need the device or the scene when R is pressed
+	bool reportKey = (GetAsyncKeyState('R') & 0x8000) != 0;
+	if (reportKey && !reportKeyDown)
+		PrintDiagnostics();
+	reportKeyDown = reportKey;
+#endif
+}
+
+// --------------------------------------------------------
+// The input for one sim tick: held movement keys plus the
+// mouse turn since the last tick - or the next recorded tick
+// while replaying
+// --------------------------------------------------------
+SimInput Game::SampleInput()
+{
+	SimInput input = {};
+	if (replayingInput)
 	{
-		myCam->MoveUpDown(-0.01f);
-		myCam->Update();
+		if (inputRecording.Next(&input))
+			return input;
+		replayingInput = false;
+		printf("\nReplay finished\n");
 	}
-	myEnt1->SetScale(5, 5, 5);
-	//myEnt1->Update(deltaTime);
-	myEnt1->Update();
 
-	myEnt6->SetScale(5, 5, 5);
-	myEnt6->SetPos(-5, 0, -10);
-	myEnt6->Update();
+	if (GetAsyncKeyState('W') & 0x8000) input.Buttons |= SIM_FORWARD;
+	if (GetAsyncKeyState('S') & 0x8000) input.Buttons |= SIM_BACK;
+	if (GetAsyncKeyState('A') & 0x8000) input.Buttons |= SIM_LEFT;
+	if (GetAsyncKeyState('D') & 0x8000) input.Buttons |= SIM_RIGHT;
+	if (GetAsyncKeyState('X') & 0x8000) input.Buttons |= SIM_UP;
+	if (GetAsyncKeyState(VK_SPACE) & 0x8000) input.Buttons |= SIM_DOWN;
+	input.TurnX = pendingTurnX;
+	input.TurnY = pendingTurnY;
+	pendingTurnX = 0.0f;
+	pendingTurnY = 0.0f;
+
+	if (recordingInput) inputRecording.Add(input);
+	return input;
+}
 
-	trees->SetPos(0, -10, 20);
-	trees->Update();
+// --------------------------------------------------------
+// Update your game here - move objects, AI, etc.  Reads only
+// the input snapshot, never the keyboard or mouse directly.
+// --------------------------------------------------------
+void Game::Update(const SimInput& input, float deltaTime, double totalTime)
+{
+	PROFILE_ZONE("Game::Update");
 
-	myEnt2->SetScale(0.5, 0.5, 0.5);
-	myEnt2->SetPos(-3, 3, 0);
-	myEnt2->Update();
-	myEnt3->SetScale(0.5, 0.5, 0.5);
-	myEnt3->SetPos(5, -2, -5);
-	myEnt3->Update();
+	// deltaTime is the fixed sim step, so movement is
+	// the same no matter how fast we're drawing
+	myCam->SaveState();
+	for (auto& e : entities) e->SaveState();
 
-	myEnt4->SetScale(0.5, 0.5, 0.5);
-	myEnt4->SetPos(7, 2, 0);
-	myEnt4->Update();
+	myCam->Simulate(input, deltaTime, camMoveSpeed, camClimbSpeed);
+}
 
-	myEnt5->SetScale(0.5, 0.5, 0.5);
-	myEnt5->SetPos(-5, 2, 0);
-	myEnt5->Update();
+// --------------------------------------------------------
+// Reports that need the device or this scene - the rest
+// (kernel checks and benchmarks) are in Tools/Checks
+// --------------------------------------------------------
+void Game::PrintDiagnostics()
+{
+	bloom->PrintCostModel(width, height);
+	dof->PrintTapReport(width, height);
+	MaterialBindBenchmark(material, blurMat, 10000);
+
+	// How close the deferred path gets to the forward shaders
+	XMFLOAT4X4 camView = myCam->getView();
+	XMFLOAT4X4 parityView;
+	XMStoreFloat4x4(&parityView, XMMatrixTranspose(XMLoadFloat4x4(&camView)));
+	GBufferParityReport(light, localLights.data(), (unsigned int)localLights.size(), parityView,
+		myCam->getAngle(), (float)width / height, zNear, zFar, 100000, &skyLighting->GetSH(), skyLighting->GetIntensity());
+
+	// Build one frame without a GPU to see what the graph culls and shares
+	RecordingTargetBackend* recorder = new RecordingTargetBackend();
+	RenderTargetPool* dryPool = new RenderTargetPool(recorder);
+	RenderGraph* dryRun = new RenderGraph(dryPool);
+	BuildFrameGraph(dryRun);
+	dryRun->Compile();
+	dryRun->PrintReport();
+	dryPool->PrintReport();
+
+	// What the backend is asked to clear in a frame, keeping every
+	// clear the passes ask for vs. dropping the ones nobody sees
+	unsigned long long clearedBytes[2];
+	unsigned int clears[2];
+	for (int eliminate = 0; eliminate < 2; eliminate++)
+	{
+		unsigned long long bytesBefore = recorder->GetClearedBytes();
+		unsigned int countBefore = recorder->GetClearCount();
+		dryRun->SetClearElimination(eliminate == 1);
+		dryRun->Compile();
+		dryRun->ExecuteClears();
+		clearedBytes[eliminate] = recorder->GetClearedBytes() - bytesBefore;
+		clears[eliminate] = recorder->GetClearCount() - countBefore;
+	}
+	printf("\nClears per frame (recording backend): %u (%.2f MB) as asked, %u (%.2f MB) after dropping unseen ones\n",
+		clears[0], clearedBytes[0] / (1024.0 * 1024.0), clears[1], clearedBytes[1] / (1024.0 * 1024.0));
+	delete dryRun;
+	delete dryPool;
+}
 
-	ground->SetPos(0, -10, 0);
-	ground->SetScale(150, 0.5, 150);
-	ground->Update();
+// --------------------------------------------------------
+// Tells the texture streamer how big each entity's textures
+// look on screen (assuming a texture spans its mesh about
+// once), so it knows which mips are worth keeping
+// --------------------------------------------------------
+void Game::RequestTextureMips()
+{
+	XMFLOAT3 camPos = myCam->getCamPos();
+	float focal = myCam->getProj()._22; //1 / tan(fov / 2), same transposed or not
+	for (auto& e : entities)
+	{
+		XMFLOAT3 center;
+		float radius;
+		e->GetBoundingSphere(&center, &radius);
+		float dx = center.x - camPos.x, dy = center.y - camPos.y, dz = center.z - camPos.z;
+		float dist = sqrtf(dx * dx + dy * dy + dz * dz) - radius;
+		float pixels = radius / (dist > zNear ? dist : zNear) * focal * height;
+
+		Material* m = e->GetMaterial();
+		if (m->GetDiffuseTexture() >= 0)
+			textures->RequestScreenSize(m->GetDiffuseTexture(), pixels);
+		if (m->GetNormalTexture() >= 0)
+			textures->RequestScreenSize(m->GetNormalTexture(), pixels);
+	}
+}
 
-	
+// --------------------------------------------------------
+// Streams a texture a material samples through its array -
+// every time the streamer swaps its SRV (loaded, mips in or
+// out) the resident levels are copied into its slice
+// --------------------------------------------------------
+TextureHandle Game::LoadMaterialTexture(const std::wstring& path, TexturePlaceholder placeholder)
+{
+	//the callback can't capture a handle Load hasn't returned
+	//yet, so it looks it up
+	size_t index = materialTextures.size();
+	materialTextures.push_back(-1);
+	materialTextures[index] = textures->Load(path, placeholder, [this, index](ID3D11ShaderResourceView* srv) {
+		TextureHandle handle = materialTextures[index];
+		if (handle >= 0 && textures->IsReady(handle))
+			textureArrays->Place(handle, srv, textures->GetResidentMip(handle));
+	});
+	//a path that was already loaded called back before that
+	TextureHandle handle = materialTextures[index];
+	if (textures->IsReady(handle))
+		textureArrays->Place(handle, textures->GetSRV(handle), textures->GetResidentMip(handle));
+	return handle;
 }
 
 // --------------------------------------------------------
@@ -543,229 +673,422 @@ void Game::Update(float deltaTime, float totalTime)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
-	RTarray[0] = ppRTV;
-	RTarray[1] = depthRTV;
-
-	//update cam pos
-	//pixelShader->SetFloat3("camPos", myCam->getCamPos());
-	//pixelShader->CopyAllBufferData();
-
-	// Background color (Cornflower Blue in this case) for clearing
-	const float color[4] = { 0.05f, 0.05f, 0.05f, 0.5f };
-
-	// Clear the render target and depth buffer (erases what's on the screen)
-	//  - Do this ONCE PER FRAME
-	//  - At the beginning of Draw (before drawing *anything*)
-	context->ClearRenderTargetView(backBufferRTV, color);
-	context->ClearRenderTargetView(ppRTV, color);
-	context->ClearRenderTargetView(extractBrightRTV, color);
-	context->ClearRenderTargetView(blurRTV, color);
-	context->ClearRenderTargetView(depthRTV, color);
-	context->ClearRenderTargetView(dofRTV, color);
-	context->ClearRenderTargetView(dofBlurRTV, color);
-
-	context->ClearDepthStencilView(
-		depthStencilView,
-		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
-		1.0f,
-		0);
-
-	context->OMSetRenderTargets(2, &RTarray[0], depthStencilView);
-
-	myEnt1->PrepareMaterial(myCam->getView(), myCam->getProj());
-	pixelShader->SetFloat3("camPos", myCam->getCamPos());
-	pixelShader->SetFloat4("dofPara", dofPara);
-	myEnt1->Draw();
-
-	myEnt6->PrepareMaterial(myCam->getView(), myCam->getProj());
-	pixelShader->SetFloat3("camPos", myCam->getCamPos());
-	pixelShader->SetFloat4("dofPara", dofPara);
-	myEnt6->Draw();
-	
-	dShader->SetFloat4("color", XMFLOAT4(0.992, 0.709, 0.972, 0));
-	dShader->SetFloat4("dofPara", dofPara);
-	myEnt2->SolidMaterial(myCam->getView(),myCam->getProj());
-	myEnt2->Draw();
-
-	dShader->SetFloat4("color", XMFLOAT4(0.305, 0.388, 0.894, 0));
-	dShader->SetFloat4("dofPara", dofPara);
-	myEnt3->SolidMaterial(myCam->getView(),myCam->getProj());
-	myEnt3->Draw();
-	
-	dShader->SetFloat4("color", XMFLOAT4(0.8, 0.160, 0.074, 0));
-	dShader->SetFloat4("dofPara", dofPara);
-	myEnt4->SolidMaterial(myCam->getView(),myCam->getProj());
-	myEnt4->Draw();
-
-	dShader->SetFloat4("color", XMFLOAT4(1, 0.925, 0.478, 0));
-	dShader->SetFloat4("dofPara", dofPara);
-	myEnt5->SolidMaterial(myCam->getView(), myCam->getProj());
-	myEnt5->Draw();
-
-	pShader2->SetFloat3("camPos", myCam->getCamPos());
-	pShader2->SetFloat4("dofPara", dofPara);
-	ground->PrepareMat(myCam->getView(), myCam->getProj());
-	ground->Draw();
-
-	pShader2->SetFloat3("camPos", myCam->getCamPos());
-	pShader2->SetFloat4("dofPara", dofPara);
-	trees->PrepareMat(myCam->getView(), myCam->getProj());
-	trees->Draw();
-
-//set buffers in the input assembler
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
+	PROFILE_ZONE("Game::Draw");
+	HandleKeys();
+	gpuProfiler->BeginFrame();
 
-//skybox ---------------------------
-// Draw the sky LAST - Ideally, we've set this up so that it
-// only keeps pixels that haven't been "drawn to" yet (ones that
-// have a depth of 1.0)
-	ID3D11Buffer* skyVB = myMesh1->GetVertexBuffer();
-	ID3D11Buffer* skyIB = myMesh1->GetIndexBuffer();
-
-	// Set the buffers
-	context->IASetVertexBuffers(0, 1, &skyVB, &stride, &offset);
-	context->IASetIndexBuffer(skyIB, DXGI_FORMAT_R32_UINT, 0);
-
-	// Set up the sky shaders
-	//skyVS->SetMatrix4x4("world", );
-	skyVS->SetMatrix4x4("view", myCam->getView());
-	skyVS->SetMatrix4x4("projection", myCam->getProj());
-	skyVS->CopyAllBufferData();
-	skyVS->SetShader();
+	// Swap in whatever textures finished loading, and stream
+	// mips for how big things looked last frame
+	RequestTextureMips();
+	textures->Update();
+	for (auto& m : materials) m->UpdateTextures(context);
+	skyLighting->Update();
 
-	skyPS->SetFloat4("dofPara", dofPara);
-	skyPS->SetShaderResourceView("SkyTexture", skySRV);
-	skyPS->SetSamplerState("BasicSampler", sampler);
-	skyPS->SetShader();
+	// Virtual texture: read back feedback, load what it asks
+	// for, upload the pages that are ready
+	virtualTexture->Update();
 
-	// Set up the render state options
-	context->RSSetState(skyRasterState);
-	context->OMSetDepthStencilState(skyDepthState, 0);
-	// Finally do the actual drawing
-	context->DrawIndexed(myMesh1->GetIndexCount(), 0, 0);
-	// Reset any states we've changed for the next frame!
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
+	// Blend transforms between the last two sim ticks
+	float alpha = GetInterpolationAlpha();
+	myCam->Interpolate(alpha);
+	for (auto& e : entities) e->Interpolate(alpha);
 
-//Post Process--------------------
-	
-	//post process
-	context->OMSetRenderTargets(1, &backBufferRTV, 0);
-	context->OMSetRenderTargets(1, &extractBrightRTV, depthStencilView);
-	//Extract Bright Pixels--------------------
-	//set to post processing shaders
-	ppVS->SetShader();
-	ppExtract->SetShader();
-	ppExtract->SetShaderResourceView("Pixels", ppSRV);
-	ppExtract->SetSamplerState("Sampler", sampler);
-	ppExtract->CopyAllBufferData();
-
-	//unbind vert/index buffer
-	ID3D11Buffer* nothing = 0;
-	context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
-	context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+	XMFLOAT4X4 camView = myCam->getView();
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixTranspose(XMLoadFloat4x4(&camView)));
 
-	// Draw a triangle that will hopefully fill the screen
-	context->Draw(3, 0);
+	// Place the point/spot light shadow tiles (this sets each
+	// light's shadow index, so it goes before the upload)
+	localShadows->Update(localLights, entities, view, myCam->getAngle(), height);
 
-	// Unbind this particular register
-	ppExtract->SetShaderResourceView("Pixels", 0);
-
-
-	//Blur-----------------
-	context->OMSetRenderTargets(1, &backBufferRTV, 0);
-	context->OMSetRenderTargets(1, &blurRTV, 0);
-	ppVS->SetShader();
-	ppBlur->SetShader();
-	ppBlur->SetShaderResourceView("Pixels", extractSRV);
-	ppBlur->SetShaderResourceView("Pixels2", ppSRV);
-	ppBlur->SetSamplerState("Sampler", bloomSampler);
-	ppBlur->SetInt("blurAmount", 15);
-	ppBlur->SetFloat("pixelWidth", 1.0f / width);
-	ppBlur->SetFloat("pixelHeight", 1.0f / height);
-	ppBlur->CopyAllBufferData();
-	//unbind vert/index buffer
-	context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
-	context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+	// Bin this frame's point/spot lights into the cluster grid
+	clusters->Update(localLights.data(), (unsigned int)localLights.size(), view,
+		myCam->getAngle(), width, height, zNear, zFar);
 
-	// Draw a triangle that will hopefully fill the screen
-	context->Draw(3, 0);
+	// Fit the shadow cascades to the camera and pick their casters
+	shadows->Update(entities, view, myCam->getAngle(), (float)width / height, zNear, shadowDistance, light.Direction);
 
-	// Unbind this particular register
-	ppBlur->SetShaderResourceView("Pixels", 0);
-	ppBlur->SetShaderResourceView("Pixels2", 0);
+	{
+		PROFILE_ZONE("Build Frame Graph");
+		frameGraph->Reset();
+		BuildFrameGraph(frameGraph);
+		frameGraph->Compile();
+	}
 
-	//Additive Blend-------------------------
-	context->OMSetRenderTargets(1, &backBufferRTV, 0);
-	context->OMSetRenderTargets(1, &dofRTV, 0);
-	ppVS->SetShader();
-	addBlend->SetShader();
-	addBlend->SetShaderResourceView("Original", ppSRV);
-	addBlend->SetShaderResourceView("Blurred", blurSRV);
-	addBlend->SetSamplerState("Sampler", bloomSampler);
-	addBlend->CopyAllBufferData();
-	//unbind vert/index buffer
-	context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
-	context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+	// Every pass is timed on the GPU by the graph.  The cache
+	// can't see what last frame's passes and Present left bound.
+	states->Invalidate();
+	frameGraph->Execute(gpuProfiler);
+	targetPool->EndFrame();
+
+	// Present the back buffer to the user
+	//  - Puts the final frame we're drawing into the window so the user can see it
+	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
+	gpuProfiler->EndFrame();
+	{
+		PROFILE_ZONE("Present");
+		swapChain->Present(0, 0);
+	}
+}
 
-	// Draw a triangle that will hopefully fill the screen
-	context->Draw(3, 0);
 
-	// Unbind this particular register
-	addBlend->SetShaderResourceView("Original", 0);
-	addBlend->SetShaderResourceView("Blurred", 0);
+// --------------------------------------------------------
+// Declares this frame's passes
+// - Scene and sky draw into an offscreen target, bloom and
+//   DoF post process it into the back buffer
+// - Post process targets are graph transients, so they track
+//   the window size and share memory when they can
+// --------------------------------------------------------
+void Game::BuildFrameGraph(RenderGraph* graph)
+{
+	// Background color for clearing
+	static const float color[4] = { 0.05f, 0.05f, 0.05f, 0.5f };
+
+	RTDesc screenDesc = { (unsigned int)width, (unsigned int)height,
+		DXGI_FORMAT_R8G8B8A8_UNORM, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE };
+	RTDesc depthDesc = { (unsigned int)width, (unsigned int)height,
+		DXGI_FORMAT_R32_TYPELESS, D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE };
+
+	RGHandle backBuffer = graph->Import("Back Buffer", screenDesc, backBufferRTV, 0);
+	// Depth clears to the camera's far depth (0 with reversed z)
+	// through the graph, in the first pass that writes it
+	const float farDepth[4] = { myCam->getFarDepth(), 0, 0, 0 };
+	RGHandle depth = graph->Import("Depth", depthDesc, 0, depthBufferSRV, 0, depthStencilView, farDepth);
+
+	// Cascaded shadow maps, recorded on worker threads
+	RTDesc shadowDesc = { shadows->GetResolution(), shadows->GetResolution(),
+		DXGI_FORMAT_R32_TYPELESS, D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE };
+	RGHandle shadowMap = graph->Import("Shadow Maps", shadowDesc, 0, shadows->GetSRV());
+	graph->AddPass("Shadow Maps",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Write(shadowMap);
+		},
+		[this]()
+		{
+			shadows->Render(entities);
+		});
+
+	// Point/spot light shadows - only tiles whose casters or
+	// light changed are redrawn, the rest carry over
+	RTDesc atlasDesc = { localShadows->GetSize(), localShadows->GetSize(),
+		DXGI_FORMAT_R32_TYPELESS, D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE };
+	RGHandle shadowAtlas = graph->Import("Shadow Atlas", atlasDesc, 0, localShadows->GetSRV());
+	graph->AddPass("Local Shadows",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Write(shadowAtlas, RG_LOAD_PRESERVE);
+		},
+		[this]()
+		{
+			localShadows->Render(entities);
+		});
+
+	// Which virtual texture pages the ground needs, drawn small
+	// and read back a few frames later by VirtualTexturing::Update
+	RTDesc feedbackDesc = { virtualTexture->GetFeedbackWidth(), virtualTexture->GetFeedbackHeight(),
+		DXGI_FORMAT_R32_UINT, D3D11_BIND_RENDER_TARGET };
+	RGHandle feedback = graph->Import("VT Feedback", feedbackDesc, virtualTexture->GetFeedbackRTV(), 0);
+	graph->AddPass("Virtual Texture Feedback",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Write(feedback);
+		},
+		[this]()
+		{
+			//same depth test as the scene
+			states->Apply(opaquePipeline);
+			virtualTexture->RenderFeedback(virtualTextured, myCam->getView(), myCam->getProj(), myCam->getFarDepth());
+			states->Apply(PIPELINE_DEFAULT);
+		});
+
+	// Depth pre-pass: positions only and no pixel shader, then the
+	// opaque pass tests EQUAL without writing depth, so its pixel
+	// shader only runs for the surface that ends up visible
+	RGLoadOp opaqueDepthLoad = RG_LOAD_CLEAR;
+	if (depthPrepass)
+	{
+		graph->AddPass("Depth Prepass",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Write(depth, RG_LOAD_CLEAR);
+			},
+			[this]()
+			{
+				context->OMSetRenderTargets(0, 0, depthStencilView);
+				DrawDepthPrepass();
+				states->Apply(PIPELINE_DEFAULT);
+			});
+		opaqueDepthLoad = RG_LOAD_PRESERVE;
+	}
+
+	if (!deferred)
+	{
+		// Forward: every material lights its own pixels
+		graph->AddPass("Scene",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Read(shadowMap);
+				builder.Read(shadowAtlas);
+				sceneColor = builder.Write(builder.Create("Scene Color", screenDesc, color), RG_LOAD_CLEAR);
+				builder.Write(depth, opaqueDepthLoad);
+			},
+			[this, graph]()
+			{
+				ID3D11RenderTargetView* rtv = graph->GetRTV(sceneColor);
+				context->OMSetRenderTargets(1, &rtv, depthStencilView);
+				DrawScene();
+				states->Apply(PIPELINE_DEFAULT);
+			});
+	}
+	else
+	{
+		// Deferred: surfaces only, then light each pixel once
+		// (the lighting pass skips empty pixels, so the g-buffer needs no clear)
+		RTDesc albedoDesc = { (unsigned int)width, (unsigned int)height,
+			DXGI_FORMAT_R8G8B8A8_UNORM, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE };
+		RTDesc normalDesc = { (unsigned int)width, (unsigned int)height,
+			DXGI_FORMAT_R10G10B10A2_UNORM, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE };
+
+		graph->AddPass("G-Buffer",
+			[&](RGPassBuilder& builder)
+			{
+				gbufferAlbedo = builder.Write(builder.Create("G-Buffer Albedo", albedoDesc));
+				gbufferNormal = builder.Write(builder.Create("G-Buffer Normal", normalDesc));
+				builder.Write(depth, opaqueDepthLoad);
+			},
+			[this, graph]()
+			{
+				ID3D11RenderTargetView* rtvs[2] = { graph->GetRTV(gbufferAlbedo), graph->GetRTV(gbufferNormal) };
+				context->OMSetRenderTargets(2, rtvs, depthStencilView);
+				DrawGBuffer();
+				states->Apply(PIPELINE_DEFAULT);
+			});
+
+		graph->AddPass("Deferred Lighting",
+			[&](RGPassBuilder& builder)
+			{
+				builder.Read(gbufferAlbedo);
+				builder.Read(gbufferNormal);
+				builder.Read(depth);
+				builder.Read(shadowMap);
+				builder.Read(shadowAtlas);
+				sceneColor = builder.Write(builder.Create("Scene Color", screenDesc, color), RG_LOAD_CLEAR);
+			},
+			[this, graph, depth]()
+			{
+				// Depth is a texture for this pass
+				ID3D11RenderTargetView* rtv = graph->GetRTV(sceneColor);
+				context->OMSetRenderTargets(1, &rtv, 0);
+
+				// Position from depth needs view --> world and the frustum's slopes
+				XMFLOAT4X4 camView = myCam->getView();
+				XMFLOAT4X4 camProj = myCam->getProj();
+				XMFLOAT4X4 invView;
+				XMMATRIX V = XMMatrixTranspose(XMLoadFloat4x4(&camView));
+				XMStoreFloat4x4(&invView, XMMatrixTranspose(XMMatrixInverse(0, V)));
+
+				ppVS->SetShader();
+				deferredPS->SetShader();
+				deferredPS->SetFloat3("camPos", myCam->getCamPos());
+				deferredPS->SetMatrix4x4("invView", invView);
+				XMFLOAT2 depthParams = myCam->getDepthParams();
+				deferredPS->SetFloat4("projParams", XMFLOAT4(1.0f / camProj._11, 1.0f / camProj._22, depthParams.x, depthParams.y));
+				deferredPS->SetFloat("farDepth", myCam->getFarDepth());
+				clusters->Bind(deferredPS);
+				shadows->Bind(deferredPS);
+				localShadows->Bind(deferredPS);
+				skyLighting->Bind(deferredPS);
+				deferredPS->CopyAllBufferData();
+				deferredPS->SetShaderResourceView("GBufferAlbedo", graph->GetSRV(gbufferAlbedo));
+				deferredPS->SetShaderResourceView("GBufferNormal", graph->GetSRV(gbufferNormal));
+				deferredPS->SetShaderResourceView("Depth", graph->GetSRV(depth));
+
+				//unbind vert/index buffer
+				UINT stride = 0;
+				UINT offset = 0;
+				ID3D11Buffer* nothing = 0;
+				context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
+				context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+
+				// Draw a triangle that will hopefully fill the screen
+				context->Draw(3, 0);
+
+				// Depth goes back to being a depth buffer for the sky
+				deferredPS->SetShaderResourceView("GBufferAlbedo", 0);
+				deferredPS->SetShaderResourceView("GBufferNormal", 0);
+				deferredPS->SetShaderResourceView("Depth", 0);
+			});
+	}
+
+	// Draw the sky LAST - Ideally, we've set this up so that it
+	// only keeps pixels that haven't been "drawn to" yet (ones still
+	// at the far depth, 0 with reversed z).  That's every pixel the
+	// scene left, so the graph drops the scene color's clear.
+	graph->AddPass("Sky",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Write(sceneColor, RG_LOAD_PRESERVE, RG_COVER_REMAINDER);
+			builder.Write(depth, RG_LOAD_PRESERVE);
+		},
+		[this, graph]()
+		{
+			// The deferred lighting pass leaves depth unbound
+			ID3D11RenderTargetView* skyRTV = graph->GetRTV(sceneColor);
+			context->OMSetRenderTargets(1, &skyRTV, depthStencilView);
+			DrawSky();
+
+			// Depth is read as a texture from here on
+			ID3D11RenderTargetView* rtv = graph->GetRTV(sceneColor);
+			context->OMSetRenderTargets(1, &rtv, 0);
+		});
+
+	//Extract Bright Pixels, then blur them down and back up the mip chain
+	bloomTex = bloom->AddPasses(graph, sceneColor, bloomSampler);
+
+	//Additive Blend-------------------------
+	graph->AddPass("Additive Blend",
+		[&](RGPassBuilder& builder)
+		{
+			builder.Read(sceneColor);
+			builder.Read(bloomTex);
+			sceneBloom = builder.Write(builder.Create("Scene + Bloom", screenDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		},
+		[this, graph]()
+		{
+			ID3D11RenderTargetView* rtv = graph->GetRTV(sceneBloom);
+			context->OMSetRenderTargets(1, &rtv, 0);
+			ppVS->SetShader();
+			addBlend->SetShader();
+			addBlend->SetShaderResourceView("Original", graph->GetSRV(sceneColor));
+			addBlend->SetShaderResourceView("Blurred", graph->GetSRV(bloomTex));
+			addBlend->SetSamplerState("Sampler", bloomSampler);
+			addBlend->SetFloat("bloomStrength", bloom->GetStrength());
+			addBlend->CopyAllBufferData();
+			//unbind vert/index buffer
+			UINT stride = 0;
+			UINT offset = 0;
+			ID3D11Buffer* nothing = 0;
+			context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
+			context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+
+			// Draw a triangle that will hopefully fill the screen
+			context->Draw(3, 0);
+
+			// Unbind this particular register
+			addBlend->SetShaderResourceView("Original", 0);
+			addBlend->SetShaderResourceView("Blurred", 0);
+		});
 
 	//DOF-----------------------------------------
-	//Blur-----------------
-	context->OMSetRenderTargets(1, &backBufferRTV, 0);
-	context->OMSetRenderTargets(1, &dofBlurRTV, 0);
-	ppVS->SetShader();
-	ppBlur->SetShader();
-	ppBlur->SetShaderResourceView("Pixels", dofSRV);
-	ppBlur->SetShaderResourceView("Pixels2", ppSRV);
-	ppBlur->SetSamplerState("Sampler", bloomSampler);
-	ppBlur->SetInt("blurAmount", 10);
-	ppBlur->SetFloat("pixelWidth", 1.0f / width);
-	ppBlur->SetFloat("pixelHeight", 1.0f / height);
-	ppBlur->CopyAllBufferData();
-	//unbind vert/index buffer
-	context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
-	context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
+	//CoC from the real depth buffer, gathered at half res
+	dof->AddPasses(graph, sceneBloom, depth, backBuffer, dofSampler, dofParams, myCam->getDepthParams());
+}
 
-	// Draw a triangle that will hopefully fill the screen
-	context->Draw(3, 0);
+// --------------------------------------------------------
+// Every opaque entity's depth, nothing else.  Has to cover
+// exactly what DrawScene / DrawGBuffer draw, or the EQUAL
+// test after it throws those pixels away.
+// --------------------------------------------------------
+void Game::DrawDepthPrepass()
+{
+	depthVS->SetMatrix4x4("view", myCam->getView());
+	depthVS->SetMatrix4x4("projection", myCam->getProj());
+	depthVS->SetShader();
+	context->PSSetShader(0, 0, 0);
+	states->Apply(opaquePipeline);
+
+	for (auto& e : entities)
+		e->DrawDepth(depthVS);
+}
+
+// --------------------------------------------------------
+// Opaque entities
+// --------------------------------------------------------
+void Game::DrawScene()
+{
+	//the passes before this bound their own SRVs over the arrays
+	textureArrays->Invalidate();
+
+	//per frame data, once per permutation rather than per draw
+	for (auto& ps : materialShaders->GetLoaded())
+	{
+		ps->SetFloat3("camPos", myCam->getCamPos());
+		clusters->Bind(ps);
+		shadows->Bind(ps);
+		localShadows->Bind(ps);
+		skyLighting->Bind(ps);
+		virtualTexture->Bind(ps);
+	}
+
+	//every draw names its pipeline, the cache only sets it once
+	PipelineID pipeline = depthPrepass ? equalPipeline : opaquePipeline;
+	Entity* opaque[] = { myEnt1, myEnt6, myEnt2, myEnt3, myEnt4, myEnt5, ground, trees };
+	for (auto& e : opaque)
+	{
+		states->Apply(pipeline);
+		e->PrepareMaterial(myCam->getView(), myCam->getProj());
+		e->Draw();
+	}
+}
+
+// --------------------------------------------------------
+// Same entities as DrawScene, written to the g-buffer with
+// the settings their forward shaders use
+// --------------------------------------------------------
+void Game::DrawGBuffer()
+{
+	XMFLOAT4X4 view = myCam->getView();
+	XMFLOAT4X4 proj = myCam->getProj();
+
+	//shininess, color and lit / unlit come from each material
+	textureArrays->Invalidate();
+	virtualTexture->Bind(gbufferPS);
+	PipelineID pipeline = depthPrepass ? equalPipeline : opaquePipeline;
+	Entity* opaque[] = { myEnt1, myEnt6, myEnt2, myEnt3, myEnt4, myEnt5, ground, trees };
+	for (auto& e : opaque)
+	{
+		states->Apply(pipeline);
+		e->PrepareGBuffer(view, proj, gbufferPS);
+		e->Draw();
+	}
+}
 
-	// Unbind this particular register
-	ppBlur->SetShaderResourceView("Pixels", 0);
-	ppBlur->SetShaderResourceView("Pixels2", 0);
-
-	//Blur using depth buffer
-	context->OMSetRenderTargets(1, &backBufferRTV, 0);
-	ppVS->SetShader();
-	dofPS->SetShader();
-	dofPS->SetFloat("pixelSize", 1.0f / (width*height));
-	dofPS->SetShaderResourceView("Pixels", dofSRV);
-	dofPS->SetShaderResourceView("Pixels2", dofBlurSRV);
-	dofPS->SetShaderResourceView("Pixels3", depthSRV);
-	dofPS->SetSamplerState("dofSampler", dofSampler);
-	dofPS->CopyAllBufferData();
-	//unbind vert/index buffer
+// --------------------------------------------------------
+// Sky as one fullscreen triangle at the far depth, looking the
+// cube map up along each pixel's view ray
+// --------------------------------------------------------
+void Game::DrawSky()
+{
+	//no vertex or index buffer, the triangle comes from SV_VertexID
+	UINT stride = 0;
+	UINT offset = 0;
+	ID3D11Buffer* nothing = 0;
 	context->IASetVertexBuffers(0, 1, &nothing, &stride, &offset);
 	context->IASetIndexBuffer(0, DXGI_FORMAT_R32_UINT, 0);
 
-	// Draw a triangle that will hopefully fill the screen
-	context->Draw(3, 0);
+	// View rays: the frustum's slopes, rotated into world space
+	XMFLOAT4X4 camView = myCam->getView();
+	XMFLOAT4X4 camProj = myCam->getProj();
+	XMFLOAT4X4 invView;
+	XMMATRIX V = XMMatrixTranspose(XMLoadFloat4x4(&camView));
+	XMStoreFloat4x4(&invView, XMMatrixTranspose(XMMatrixInverse(0, V)));
+	skyVS->SetMatrix4x4("invView", invView);
+	skyVS->SetFloat4("projParams", XMFLOAT4(1.0f / camProj._11, 1.0f / camProj._22, myCam->getFarDepth(), 0));
+	skyVS->CopyAllBufferData();
+	skyVS->SetShader();
 
-	// Unbind this particular register
-	dofPS->SetShaderResourceView("Pixels", 0);
-	dofPS->SetShaderResourceView("Pixels2", 0);
-	dofPS->SetShaderResourceView("Pixels3", 0);
+	skyPS->SetShaderResourceView("SkyTexture", skySRV);
+	skyPS->SetSamplerState("BasicSampler", sampler);
+	skyPS->SetShader();
 
-	// Present the back buffer to the user
-	//  - Puts the final frame we're drawing into the window so the user can see it
-	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
-	swapChain->Present(0, 0);
+	// Set up the render state options
+	states->Apply(skyPipeline);
+	// Finally do the actual drawing
+	context->Draw(3, 0);
+	// Reset any states we've changed - the post process passes
+	// set their own states directly and expect the defaults
+	states->Apply(PIPELINE_DEFAULT);
 }
 
 
@@ -814,8 +1137,9 @@ void Game::OnMouseMove(WPARAM buttonState, int x, int y)
 	float dx = (prevMousePos.y - y)*0.005;
 	float dy = -(prevMousePos.x - x)*0.005;
 	
-	myCam->Turn(dx, dy);
-	myCam->Update();
+	//turned by the next sim tick
+	pendingTurnX += dx;
+	pendingTurnY += dy;
 
 	// Save the previous mouse position, so we have it for the future
 	prevMousePos.x = x;
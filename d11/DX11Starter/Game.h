@@ -7,6 +7,23 @@
 #include "Entity.h"
 #include "Camera.h"
 #include "Light.h"
+#include "ClusteredLighting.h"
+#include "LightBinning.h"
+#include "GBufferKernel.h"
+#include "ShadowMaps.h"
+#include "LocalShadows.h"
+#include "TextureStreamer.h"
+#include "TextureCooker.h"
+#include "SkyConvolution.h"
+#include "SkyLighting.h"
+#include "VirtualTexturing.h"
+#include "Profiler.h"
+#include "GpuProfiler.h"
+#include "Bloom.h"
+#include "DepthOfField.h"
+#include "RenderGraph.h"
+#include "StateCache.h"
+#include "TextureArrays.h"
 #include "pch.h"
 #include <vector>
 
@@ -24,8 +41,9 @@ public:
 	// will be called automatically
 	void Init();
 	void OnResize();
-	void Update(float deltaTime, float totalTime);
+	void Update(const SimInput& input, float deltaTime, double totalTime);
 	void Draw(float deltaTime, float totalTime);
+	SimInput SampleInput();
 
 	// Overridden mouse input helper methods
 	void OnMouseDown (WPARAM buttonState, int x, int y);
@@ -38,16 +56,24 @@ private:
 	void LoadShaders(); 
 	void CreateMatrices();
 	void CreateBasicGeometry();
-
-	//Render Target Array
-	ID3D11RenderTargetView* RTarray[2];
+	void HandleKeys();
+
+	// Post process helpers
+	void BuildFrameGraph(RenderGraph* graph);
+	void RequestTextureMips();
+	TextureHandle LoadMaterialTexture(const std::wstring& path, TexturePlaceholder placeholder);
+	void DrawDepthPrepass();
+	void DrawScene();
+	void DrawGBuffer();
+	void DrawSky();
+	void PrintDiagnostics();
 
 	// Wrappers for DirectX shaders to provide simplified functionality
 	SimpleVertexShader* vertexShader;
-	SimplePixelShader* pixelShader;
-	SimplePixelShader* pShader2;
-	SimplePixelShader* dShader;
-	SimplePixelShader* blurShader;
+	SimpleVertexShader* depthVS;    //depth pre-pass, positions only
+	MaterialShaders* materialShaders; //forward: MaterialPS permutations
+	SimplePixelShader* gbufferPS;   //deferred: every material's surface
+	SimplePixelShader* deferredPS;  //deferred: full screen lighting
 
 	// The matrices to go from model space to screen space
 	DirectX::XMFLOAT4X4 worldMatrix;
@@ -57,6 +83,48 @@ private:
 	// Keeps track of the old mouse position.  Useful for 
 	// determining how far the mouse moved in a single frame.
 	POINT prevMousePos;
+	// Mouse turn since the last sim tick, handed to the next one
+	float pendingTurnX = 0.0f;
+	float pendingTurnY = 0.0f;
+
+	// K starts / stops recording the sim input, L replays it from
+	// where the recording started
+	SimInputRecording inputRecording;
+	Camera recordStart;
+	bool recordingInput = false;
+	bool replayingInput = false;
+	bool recordKeyDown = false;
+	bool replayKeyDown = false;
+
+	// Edge detection for the profiler capture key
+	bool captureKeyDown = false;
+
+	// G toggles between forward and deferred shading
+	bool deferred = false;
+	bool deferredKeyDown = false;
+
+	// Z toggles the depth pre-pass, I prints per pass pipeline statistics
+	bool depthPrepass = true;
+	bool prepassKeyDown = false;
+	bool statsKeyDown = false;
+
+	// R prints the reports that need the device (debug builds),
+	// the rest are in Tools/Checks
+	bool reportKeyDown = false;
+
+	// Per-pass GPU timings
+	GpuProfiler* gpuProfiler;
+
+	// Rebuilt every frame, leases the post process targets from the pool
+	RenderTargetPool* targetPool;
+	RenderGraph* frameGraph;
+
+	// This frame's graph handles (valid while it executes)
+	RGHandle sceneColor;
+	RGHandle gbufferAlbedo;
+	RGHandle gbufferNormal;
+	RGHandle bloomTex;
+	RGHandle sceneBloom;
 
 	//entity
 	std::vector<Entity*> entities;
@@ -65,6 +133,11 @@ private:
 	Entity* myEnt3;
 	Entity* myEnt4;
 	Entity* myEnt5;
+	DirectX::XMFLOAT4 markerColors[4] = { //myEnt2-5, unlit
+		DirectX::XMFLOAT4(0.992, 0.709, 0.972, 0),
+		DirectX::XMFLOAT4(0.305, 0.388, 0.894, 0),
+		DirectX::XMFLOAT4(0.8, 0.160, 0.074, 0),
+		DirectX::XMFLOAT4(1, 0.925, 0.478, 0) };
 	Entity* ground;
 	Entity* myEnt6;
 	Entity* trees;
@@ -77,31 +150,38 @@ private:
 
 	//camera
 	Camera* myCam;
+	float camMoveSpeed = 3.0f;  //units per second
+	float camClimbSpeed = 0.6f; //units per second
 	float zNear = 0.1f;
-	float zFar = 100.0f;
-	XMFLOAT4 dofPara = XMFLOAT4(2,8,20,15);
-	//x <-- near blur depth   
-	//y <-- focal plane depth
-	//z <-- far blur depth
-	//w <-- blurriness cutoff constant for objects behind the focal plane
+	float zFar = 100.0f; //the projection has no far plane (reversed z), this bounds the light clusters
+	DofParams dofParams = { 2.0f, 8.0f, 20.0f, 8.0f };
+	//near blur depth, focal plane depth, far blur depth,
+	//largest blur radius (half res pixels)
 
 	//material
 	Material* material;
-	Material* mat2;
+	Material* markerMats[4]; //markerColors, unlit
 	Material* mat3;
 	Material* blurMat;
+	Material* groundMat;  //virtual texture, no SRVs of its own
+	std::vector<Material*> materials; //all of the above, owned
 
 	//light
 	DirectionalLight light;
-	PointLight light2;
-	SpotLight light3;
-	SpotLight light4;
-	SpotLight light5;
+	std::vector<LocalLight> localLights; //point + spot, shaded per cluster
+	ClusteredLighting* clusters;
+	ShadowMaps* shadows;         //cascades for the directional light
+	LocalShadows* localShadows;  //atlas tiles for the point/spot lights
+	float shadowDistance = 60.0f; //no shadows past this view depth
 
 	//texture
-	ID3D11ShaderResourceView* rockSRV;
-	ID3D11ShaderResourceView* rockNormal;
-	ID3D11ShaderResourceView* floorSRV;
+	TextureStreamer* textures;   //loads on worker threads, placeholders until then
+	TextureHandle rockTex, rockNormalTex, floorTex, skyTex;
+	std::vector<TextureHandle> materialTextures; //copied into textureArrays (LoadMaterialTexture)
+	TextureArrays* textureArrays; //every material texture, a slice each
+	VirtualTexturing* virtualTexture; //the ground's unique terrain texture
+	std::vector<Entity*> virtualTextured; //entities drawn into its feedback
+	StateCache* states;          //owns every sampler / rasterizer / depth state below
 	ID3D11SamplerState* sampler;
 	ID3D11SamplerState* bloomSampler;
 	ID3D11SamplerState* dofSampler;
@@ -110,40 +190,21 @@ private:
 	ID3D11ShaderResourceView* skySRV;
 	SimpleVertexShader* skyVS;
 	SimplePixelShader* skyPS;
+	SkyLighting* skyLighting;    //the sky's SH ambient + reflections
 
-	ID3D11RasterizerState* skyRasterState;
-	ID3D11DepthStencilState* skyDepthState;
+	PipelineID opaquePipeline;   //GREATER (reversed z), depth writes
+	PipelineID skyPipeline;      //GREATER_EQUAL, no depth writes
+	PipelineID equalPipeline;    //after the pre-pass: EQUAL, no writes
 
 	//post processing
 	//Bloom-----------------------------
-	//Render Targets and Shader Resource Views
-	ID3D11RenderTargetView* ppRTV; //render to a texture <--- before pp
-	ID3D11ShaderResourceView* ppSRV; //to sample from the same texture <--- original
-	
-	ID3D11RenderTargetView* extractBrightRTV; //RRT for extracting bright pixels
-	ID3D11ShaderResourceView* extractSRV; 
-
-	ID3D11RenderTargetView* blurRTV; // RRT for Gaussian blur
-	ID3D11ShaderResourceView* blurSRV;
+	Bloom* bloom; //extract + downsample/upsample chain
 
 	//shaders
 	SimpleVertexShader* ppVS;
-	SimplePixelShader* ppExtract;
-	SimplePixelShader* ppBlur; //does 2 passes
 	SimplePixelShader* addBlend;
 
 	//Depth of Field ----------------------------------
-
-	//shaders
-	ID3D11RenderTargetView* depthRTV;
-	ID3D11ShaderResourceView* depthSRV;
-
-	ID3D11RenderTargetView* dofBlurRTV;
-	ID3D11ShaderResourceView* dofBlurSRV;
-
-	ID3D11RenderTargetView* dofRTV;
-	ID3D11ShaderResourceView* dofSRV;
-
-	SimplePixelShader* dofPS; //post process
+	DepthOfField* dof;
 	
 };
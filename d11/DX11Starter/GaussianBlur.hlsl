@@ -1,8 +1,12 @@
+//one direction of a separable gaussian blur
+//run once horizontally, then once vertically
+//neighbouring texels are merged into single bilinear fetches
+//(see BlurKernel.cpp for how the taps are built)
 cbuffer Data : register (b0)
 {
-	float pixelWidth;
-	float pixelHeight;
-	int blurAmount;
+	float4 taps[16];   //x <-- offset in texels, y <-- weight
+	float2 texelStep;  //one texel along the blur direction (in uv)
+	int tapCount;      //taps[0] is the center
 }
 
 //input to pixel shader
@@ -15,27 +19,19 @@ struct VertexToPixel
 
 //Textures
 Texture2D Pixels       :   register(t0);
-Texture2D Pixels2      :   register(t1);
 SamplerState Sampler   :   register(s0);
 
 float4 main(VertexToPixel input) : SV_TARGET
 {
-	//keep track of total color
-	float4 totalColor = float4(0,0,0,0);
-	uint numSamples = 0;
+	//center tap
+	float4 totalColor = Pixels.Sample(Sampler, input.uv) * taps[0].y;
 
-	//blur <---- 2 passes
-	for (int y = -blurAmount; y <= blurAmount; y++)
+	//both sides of every other tap
+	for (int i = 1; i < tapCount; i++)
 	{
-		for (int x = -blurAmount; x <= blurAmount; x++)
-		{
-			float2 uv = input.uv + float2(x*pixelWidth, y*pixelHeight);
-			totalColor += Pixels.Sample(Sampler, uv);
-
-			numSamples++;
-		}
+		float2 offset = texelStep * taps[i].x;
+		totalColor += Pixels.Sample(Sampler, input.uv + offset) * taps[i].y;
+		totalColor += Pixels.Sample(Sampler, input.uv - offset) * taps[i].y;
 	}
-	totalColor = totalColor / numSamples;
-	//totalColor += Pixels2.Sample(Sampler, input.uv);
 	return totalColor;
-}
\ No newline at end of file
+}
@@ -0,0 +1,500 @@
+#include "GpuProfiler.h"
+#include "Check.h"
+#include <algorithm>
+#include <cstdio>
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ D3D11 QUERY BACKEND -------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Creates every query we'll ever need up front
+// --------------------------------------------------------
+D3D11QueryBackend::D3D11QueryBackend(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->context = context;
+
+	D3D11_QUERY_DESC disjointDesc = {};
+	disjointDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+
+	D3D11_QUERY_DESC timestampDesc = {};
+	timestampDesc.Query = D3D11_QUERY_TIMESTAMP;
+
+	D3D11_QUERY_DESC statsDesc = {};
+	statsDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+
+	for (unsigned int f = 0; f < GPU_PROFILER_FRAME_LATENCY; f++)
+	{
+		device->CreateQuery(&disjointDesc, &disjointQueries[f]);
+		for (unsigned int q = 0; q < GPU_PROFILER_MAX_QUERIES; q++)
+			device->CreateQuery(&timestampDesc, &timestampQueries[f][q]);
+		for (unsigned int p = 0; p < GPU_PROFILER_MAX_PASSES; p++)
+			device->CreateQuery(&statsDesc, &statsQueries[f][p]);
+	}
+}
+
+D3D11QueryBackend::~D3D11QueryBackend()
+{
+	for (unsigned int f = 0; f < GPU_PROFILER_FRAME_LATENCY; f++)
+	{
+		if (disjointQueries[f]) disjointQueries[f]->Release();
+		for (unsigned int q = 0; q < GPU_PROFILER_MAX_QUERIES; q++)
+			if (timestampQueries[f][q]) timestampQueries[f][q]->Release();
+		for (unsigned int p = 0; p < GPU_PROFILER_MAX_PASSES; p++)
+			if (statsQueries[f][p]) statsQueries[f][p]->Release();
+	}
+}
+
+void D3D11QueryBackend::BeginFrame(unsigned int frameSlot)
+{
+	context->Begin(disjointQueries[frameSlot]);
+}
+
+void D3D11QueryBackend::EndFrame(unsigned int frameSlot)
+{
+	context->End(disjointQueries[frameSlot]);
+}
+
+void D3D11QueryBackend::Timestamp(unsigned int frameSlot, unsigned int queryIndex)
+{
+	// Timestamp queries only use End()
+	context->End(timestampQueries[frameSlot][queryIndex]);
+}
+
+bool D3D11QueryBackend::GetFrameData(unsigned int frameSlot, UINT64* frequency, bool* disjoint)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT data;
+	if (context->GetData(disjointQueries[frameSlot], &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	*frequency = data.Frequency;
+	*disjoint = data.Disjoint != 0;
+	return true;
+}
+
+bool D3D11QueryBackend::GetTimestamp(unsigned int frameSlot, unsigned int queryIndex, UINT64* timestamp)
+{
+	return context->GetData(
+		timestampQueries[frameSlot][queryIndex],
+		timestamp,
+		sizeof(UINT64),
+		D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+}
+
+void D3D11QueryBackend::BeginStats(unsigned int frameSlot, unsigned int passIndex)
+{
+	context->Begin(statsQueries[frameSlot][passIndex]);
+}
+
+void D3D11QueryBackend::EndStats(unsigned int frameSlot, unsigned int passIndex)
+{
+	context->End(statsQueries[frameSlot][passIndex]);
+}
+
+bool D3D11QueryBackend::GetStats(unsigned int frameSlot, unsigned int passIndex, GpuPassStats* stats)
+{
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS data;
+	if (context->GetData(statsQueries[frameSlot][passIndex], &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	stats->VSInvocations = data.VSInvocations;
+	stats->Primitives = data.CPrimitives;
+	stats->PSInvocations = data.PSInvocations;
+	stats->CSInvocations = data.CSInvocations;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ SCRIPTED QUERY BACKEND ----------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+ScriptedQueryBackend::ScriptedQueryBackend(unsigned int latency)
+{
+	this->latency = latency;
+	begun = 0;
+	submitted = 0;
+	for (unsigned int f = 0; f < GPU_PROFILER_FRAME_LATENCY; f++)
+		slotFrames[f] = 0;
+}
+
+void ScriptedQueryBackend::MarkDisjoint(unsigned int frame)
+{
+	disjointFrames.push_back(frame);
+}
+
+void ScriptedQueryBackend::DelayTimestamp(unsigned int frame, unsigned int queryIndex, unsigned int extraFrames)
+{
+	Delay d = { frame, queryIndex, extraFrames };
+	delays.push_back(d);
+}
+
+void ScriptedQueryBackend::BeginFrame(unsigned int frameSlot)
+{
+	slotFrames[frameSlot] = begun++;
+}
+
+bool ScriptedQueryBackend::Finished(unsigned int frameSlot, unsigned int extraFrames)
+{
+	return submitted >= slotFrames[frameSlot] + latency + extraFrames;
+}
+
+bool ScriptedQueryBackend::GetFrameData(unsigned int frameSlot, UINT64* frequency, bool* disjoint)
+{
+	if (!Finished(frameSlot, 0))
+		return false;
+
+	unsigned int frame = slotFrames[frameSlot];
+	*frequency = 1000000000;
+	*disjoint = std::find(disjointFrames.begin(), disjointFrames.end(), frame) != disjointFrames.end();
+	return true;
+}
+
+bool ScriptedQueryBackend::GetTimestamp(unsigned int frameSlot, unsigned int queryIndex, UINT64* timestamp)
+{
+	unsigned int frame = slotFrames[frameSlot];
+	unsigned int extraFrames = 0;
+	for (const Delay& d : delays)
+		if (d.Frame == frame && d.Query == queryIndex)
+			extraFrames = d.ExtraFrames;
+	if (!Finished(frameSlot, extraFrames))
+		return false;
+
+	*timestamp = (UINT64)frame * 1000000 + queryIndex * 1000;
+	return true;
+}
+
+bool ScriptedQueryBackend::GetStats(unsigned int frameSlot, unsigned int passIndex, GpuPassStats* stats)
+{
+	if (!Finished(frameSlot, 0))
+		return false;
+
+	stats->VSInvocations = 3;
+	stats->Primitives = 1;
+	stats->PSInvocations = slotFrames[frameSlot];
+	stats->CSInvocations = 0;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ GPU PROFILER --------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Takes ownership of the backend
+// --------------------------------------------------------
+GpuProfiler::GpuProfiler(IGpuQueryBackend* backend)
+{
+	this->backend = backend;
+	frameIndex = 0;
+	currentSlot = 0;
+	inFrame = false;
+	resolvedFrames = 0;
+	droppedFrames = 0;
+
+	for (unsigned int f = 0; f < GPU_PROFILER_FRAME_LATENCY; f++)
+	{
+		frames[f].Pending = false;
+		frames[f].QueryCount = 0;
+		frames[f].PassCount = 0;
+		frames[f].OpenCount = 0;
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	delete backend;
+}
+
+// --------------------------------------------------------
+// Starts recording into the next slot of the ring.  If that
+// slot still hasn't come back from the GPU, its results are
+// thrown away instead of waiting for them.
+// --------------------------------------------------------
+void GpuProfiler::BeginFrame()
+{
+	Resolve();
+
+	currentSlot = frameIndex % GPU_PROFILER_FRAME_LATENCY;
+	FrameRecord& frame = frames[currentSlot];
+	if (frame.Pending)
+	{
+		frame.Pending = false;
+		droppedFrames++;
+	}
+
+	frame.CpuStartNs = Profiler::NowNs();
+	frame.QueryCount = 0;
+	frame.PassCount = 0;
+	frame.OpenCount = 0;
+
+	backend->BeginFrame(currentSlot);
+
+	// First timestamp marks the start of the frame, so passes
+	// can be placed relative to the CPU time above
+	backend->Timestamp(currentSlot, frame.QueryCount++);
+	inFrame = true;
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (!inFrame) return;
+
+	// Close anything left open so the frame still resolves
+	while (frames[currentSlot].OpenCount > 0)
+		EndPass();
+
+	backend->EndFrame(currentSlot);
+	frames[currentSlot].Pending = true;
+	frameIndex++;
+	inFrame = false;
+}
+
+void GpuProfiler::BeginPass(const char* name)
+{
+	if (!inFrame) return;
+	FrameRecord& frame = frames[currentSlot];
+
+	// Out of queries for this frame - skip the pass, but keep
+	// the stack balanced for the matching EndPass()
+	if (frame.QueryCount + 2 > GPU_PROFILER_MAX_QUERIES)
+	{
+		frame.OpenPasses[frame.OpenCount++] = SkippedPass;
+		return;
+	}
+
+	PassRecord& pass = frame.Passes[frame.PassCount];
+	pass.Name = name;
+	pass.BeginQuery = frame.QueryCount++;
+	pass.EndQuery = frame.QueryCount++;
+	backend->Timestamp(currentSlot, pass.BeginQuery);
+	backend->BeginStats(currentSlot, frame.PassCount);
+
+	frame.OpenPasses[frame.OpenCount++] = frame.PassCount++;
+}
+
+void GpuProfiler::EndPass()
+{
+	if (!inFrame) return;
+	FrameRecord& frame = frames[currentSlot];
+	if (frame.OpenCount == 0) return;
+
+	unsigned int passIndex = frame.OpenPasses[--frame.OpenCount];
+	if (passIndex == SkippedPass) return;
+
+	backend->EndStats(currentSlot, passIndex);
+	backend->Timestamp(currentSlot, frame.Passes[passIndex].EndQuery);
+}
+
+// --------------------------------------------------------
+// Reads back finished frames, oldest first, and stops at
+// the first one the GPU hasn't gotten to yet
+// --------------------------------------------------------
+void GpuProfiler::Resolve()
+{
+	for (unsigned int i = 0; i < GPU_PROFILER_FRAME_LATENCY; i++)
+	{
+		unsigned int slot = (frameIndex + i) % GPU_PROFILER_FRAME_LATENCY;
+		if (!frames[slot].Pending)
+			continue;
+		if (!TryResolve(slot))
+			break;
+	}
+}
+
+// --------------------------------------------------------
+// Attempts to read a single frame.  Returns false (and leaves
+// it pending) if any of its data isn't available yet.
+// --------------------------------------------------------
+bool GpuProfiler::TryResolve(unsigned int slot)
+{
+	FrameRecord& frame = frames[slot];
+
+	UINT64 frequency;
+	bool disjoint;
+	if (!backend->GetFrameData(slot, &frequency, &disjoint))
+		return false;
+
+	UINT64 stamps[GPU_PROFILER_MAX_QUERIES];
+	for (unsigned int q = 0; q < frame.QueryCount; q++)
+	{
+		if (!backend->GetTimestamp(slot, q, &stamps[q]))
+			return false;
+	}
+
+	GpuPassStats stats[GPU_PROFILER_MAX_PASSES];
+	for (unsigned int p = 0; p < frame.PassCount; p++)
+	{
+		if (!backend->GetStats(slot, p, &stats[p]))
+			return false;
+	}
+
+	frame.Pending = false;
+
+	// Clock changed mid-frame (power state, etc.), so the
+	// timestamps can't be trusted
+	if (disjoint || frequency == 0)
+	{
+		droppedFrames++;
+		return true;
+	}
+
+	double nsPerTick = 1e9 / (double)frequency;
+	for (unsigned int p = 0; p < frame.PassCount; p++)
+	{
+		const PassRecord& pass = frame.Passes[p];
+		double start = (double)(stamps[pass.BeginQuery] - stamps[0]) * nsPerTick;
+		double duration = (double)(stamps[pass.EndQuery] - stamps[pass.BeginQuery]) * nsPerTick;
+
+		// Prefix so GPU stats don't merge with the CPU zone of the same name
+		std::string name = std::string("GPU ") + pass.Name;
+		Profiler::AddExternalEvent(name.c_str(), frame.CpuStartNs + start, duration, 0);
+	}
+
+	// Counts don't depend on the clock, but keep them with the timings
+	lastPassStats.resize(frame.PassCount);
+	for (unsigned int p = 0; p < frame.PassCount; p++)
+	{
+		lastPassStats[p].Name = frame.Passes[p].Name;
+		lastPassStats[p].Stats = stats[p];
+	}
+
+	resolvedFrames++;
+	return true;
+}
+
+// --------------------------------------------------------
+// One line per pass of the last frame that resolved.  Nested
+// passes are counted in their parent too.
+// --------------------------------------------------------
+void GpuProfiler::PrintPassStats()
+{
+	if (lastPassStats.empty())
+	{
+		printf("\nNo GPU frame resolved yet\n");
+		return;
+	}
+
+	UINT64 totalPS = 0;
+	printf("\n%-24s %12s %12s %12s %12s\n", "Pass", "VS", "Primitives", "PS", "CS");
+	for (const ResolvedPassStats& pass : lastPassStats)
+	{
+		printf("%-24s %12llu %12llu %12llu %12llu\n", pass.Name.c_str(),
+			(unsigned long long)pass.Stats.VSInvocations,
+			(unsigned long long)pass.Stats.Primitives,
+			(unsigned long long)pass.Stats.PSInvocations,
+			(unsigned long long)pass.Stats.CSInvocations);
+		totalPS += pass.Stats.PSInvocations;
+	}
+	printf("%-24s %12s %12s %12llu\n", "Total", "", "", (unsigned long long)totalPS);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ REPORT --------------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// One frame with two passes, like a stripped down Game::Draw
+static void ScriptedFrame(GpuProfiler& profiler)
+{
+	profiler.BeginFrame();
+	profiler.BeginPass("Scene");
+	profiler.EndPass();
+	profiler.BeginPass("Post");
+	profiler.EndPass();
+	profiler.EndFrame();
+}
+
+void GpuProfilerReport()
+{
+	const unsigned int frameCount = 20;
+	printf("\nGPU profiler (scripted queries, %u frames, ring of %u)\n", frameCount, GPU_PROFILER_FRAME_LATENCY);
+
+	// Latency up to the ring size: frame f is read back at the
+	// start of frame f + latency, and nothing is dropped
+	for (unsigned int latency = 1; latency <= GPU_PROFILER_FRAME_LATENCY; latency++)
+	{
+		GpuProfiler profiler(new ScriptedQueryBackend(latency));
+		bool onTime = true;
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			unsigned int expected = f + 1 > latency ? f + 1 - latency : 0;
+			profiler.BeginFrame();
+			onTime = onTime && profiler.GetResolvedFrames() == expected;
+			profiler.EndFrame();
+		}
+		printf("  latency %u: each frame read back %u frame%s later, %u dropped  %s\n", latency, latency,
+			latency == 1 ? "" : "s", profiler.GetDroppedFrames(),
+			CheckResult(onTime && profiler.GetDroppedFrames() == 0));
+	}
+
+	// A GPU further behind than the ring: every slot is still
+	// pending when it comes round again, so each reuse drops a
+	// frame instead of waiting - then the GPU catches up
+	{
+		ScriptedQueryBackend* backend = new ScriptedQueryBackend(GPU_PROFILER_FRAME_LATENCY + 2);
+		GpuProfiler profiler(backend);
+		for (unsigned int f = 0; f < frameCount; f++)
+			ScriptedFrame(profiler);
+		unsigned int stalledResolved = profiler.GetResolvedFrames();
+		unsigned int stalledDropped = profiler.GetDroppedFrames();
+
+		backend->SetLatency(2);
+		for (unsigned int f = 0; f < frameCount; f++)
+			ScriptedFrame(profiler);
+		profiler.Resolve();
+
+		bool ok = stalledResolved == 0 && stalledDropped == frameCount - GPU_PROFILER_FRAME_LATENCY;
+		ok = ok && profiler.GetDroppedFrames() == stalledDropped;
+		ok = ok && profiler.GetResolvedFrames() + profiler.GetDroppedFrames() == 2 * frameCount - 1;
+		printf("  stalled GPU: %u dropped, %u read; caught up: %u read, no more dropped  %s\n", stalledDropped,
+			stalledResolved, profiler.GetResolvedFrames(), CheckResult(ok));
+	}
+
+	// Disjoint frames come back but their timings are thrown away
+	{
+		ScriptedQueryBackend* backend = new ScriptedQueryBackend(2);
+		backend->MarkDisjoint(3);
+		backend->MarkDisjoint(7);
+		GpuProfiler profiler(backend);
+		for (unsigned int f = 0; f < frameCount; f++)
+			ScriptedFrame(profiler);
+		profiler.Resolve();
+
+		bool ok = profiler.GetDroppedFrames() == 2 && profiler.GetResolvedFrames() == frameCount - 1 - 2;
+		printf("  2 disjoint frames: %u dropped, %u read  %s\n", profiler.GetDroppedFrames(),
+			profiler.GetResolvedFrames(), CheckResult(ok));
+	}
+
+	// One late timestamp holds its frame - and the ones behind it,
+	// since frames resolve oldest first - until it arrives
+	{
+		ScriptedQueryBackend* backend = new ScriptedQueryBackend(2);
+		backend->DelayTimestamp(5, 3, 2);
+		GpuProfiler profiler(backend);
+		unsigned int heldAt = 0;
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			ScriptedFrame(profiler);
+			if (f == 7) heldAt = profiler.GetResolvedFrames();
+		}
+		profiler.Resolve();
+
+		bool ok = heldAt == 5 && profiler.GetDroppedFrames() == 0 && profiler.GetResolvedFrames() == frameCount - 1;
+		printf("  timestamp 2 frames late: held at %u read, then all %u read, none dropped  %s\n", heldAt,
+			profiler.GetResolvedFrames(), CheckResult(ok));
+	}
+
+	// ...unless it's later than the ring is long, then that frame
+	// is dropped when its slot is reused and the rest carry on
+	{
+		ScriptedQueryBackend* backend = new ScriptedQueryBackend(2);
+		backend->DelayTimestamp(5, 3, 1000);
+		GpuProfiler profiler(backend);
+		for (unsigned int f = 0; f < frameCount; f++)
+			ScriptedFrame(profiler);
+		profiler.Resolve();
+
+		bool ok = profiler.GetDroppedFrames() == 1 && profiler.GetResolvedFrames() == frameCount - 2;
+		printf("  timestamp that never comes back: %u dropped, %u read  %s\n", profiler.GetDroppedFrames(),
+			profiler.GetResolvedFrames(), CheckResult(ok));
+	}
+}
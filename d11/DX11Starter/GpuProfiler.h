@@ -0,0 +1,226 @@
+#pragma once
+#include <d3d11.h>
+#include "Profiler.h"
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// GPU pass timing using timestamp queries
+//
+// - Each frame gets a disjoint query plus a pair of timestamps
+//   per pass.  Results are read back a few frames later with
+//   DONOTFLUSH so we never stall waiting on the GPU.
+// - Finished passes are pushed into the CPU Profiler on their
+//   own track, lined up with the CPU time the frame started.
+// - The actual queries live behind IGpuQueryBackend so the ring
+//   and readback logic doesn't care where timestamps come from.
+// - Each pass also gets a pipeline statistics query, so the last
+//   resolved frame's per pass invocation counts can be printed.
+// --------------------------------------------------------
+
+// How many frames of queries are in flight at once
+#define GPU_PROFILER_FRAME_LATENCY 4
+// Timestamps per frame (frame start + begin/end for each pass)
+#define GPU_PROFILER_MAX_QUERIES 64
+// Passes per frame (each one takes two timestamps)
+#define GPU_PROFILER_MAX_PASSES (GPU_PROFILER_MAX_QUERIES / 2)
+
+// The pipeline statistics we keep for each pass
+struct GpuPassStats
+{
+	UINT64 VSInvocations;
+	UINT64 Primitives;		// Sent to the rasterizer (after clipping)
+	UINT64 PSInvocations;
+	UINT64 CSInvocations;
+};
+
+// --------------------------------------------------------
+// Where the raw timestamps come from
+// --------------------------------------------------------
+class IGpuQueryBackend
+{
+public:
+	virtual ~IGpuQueryBackend() {}
+
+	// Brackets all timestamps for the given frame slot
+	virtual void BeginFrame(unsigned int frameSlot) = 0;
+	virtual void EndFrame(unsigned int frameSlot) = 0;
+
+	// Records a timestamp in the given slot
+	virtual void Timestamp(unsigned int frameSlot, unsigned int queryIndex) = 0;
+
+	// Non-blocking readback - false if the GPU isn't done yet
+	virtual bool GetFrameData(unsigned int frameSlot, UINT64* frequency, bool* disjoint) = 0;
+	virtual bool GetTimestamp(unsigned int frameSlot, unsigned int queryIndex, UINT64* timestamp) = 0;
+
+	// Brackets one pass's pipeline statistics
+	virtual void BeginStats(unsigned int frameSlot, unsigned int passIndex) = 0;
+	virtual void EndStats(unsigned int frameSlot, unsigned int passIndex) = 0;
+	virtual bool GetStats(unsigned int frameSlot, unsigned int passIndex, GpuPassStats* stats) = 0;
+};
+
+// --------------------------------------------------------
+// D3D11 timestamp / disjoint queries
+// --------------------------------------------------------
+class D3D11QueryBackend : public IGpuQueryBackend
+{
+public:
+	D3D11QueryBackend(ID3D11Device* device, ID3D11DeviceContext* context);
+	~D3D11QueryBackend();
+
+	void BeginFrame(unsigned int frameSlot);
+	void EndFrame(unsigned int frameSlot);
+	void Timestamp(unsigned int frameSlot, unsigned int queryIndex);
+	bool GetFrameData(unsigned int frameSlot, UINT64* frequency, bool* disjoint);
+	bool GetTimestamp(unsigned int frameSlot, unsigned int queryIndex, UINT64* timestamp);
+	void BeginStats(unsigned int frameSlot, unsigned int passIndex);
+	void EndStats(unsigned int frameSlot, unsigned int passIndex);
+	bool GetStats(unsigned int frameSlot, unsigned int passIndex, GpuPassStats* stats);
+
+private:
+	ID3D11DeviceContext* context;
+	ID3D11Query* disjointQueries[GPU_PROFILER_FRAME_LATENCY];
+	ID3D11Query* timestampQueries[GPU_PROFILER_FRAME_LATENCY][GPU_PROFILER_MAX_QUERIES];
+	ID3D11Query* statsQueries[GPU_PROFILER_FRAME_LATENCY][GPU_PROFILER_MAX_PASSES];
+};
+
+// --------------------------------------------------------
+// No GPU at all - a frame "finishes" once enough later frames
+// have been submitted behind it, so readback latency, late
+// queries and disjoint frames can be scripted frame by frame.
+// Frames are numbered from 0 in the order they begin.
+// Timestamps are 1 ns ticks: 1000000 per frame, 1000 per query.
+// --------------------------------------------------------
+class ScriptedQueryBackend : public IGpuQueryBackend
+{
+public:
+	// A frame's data comes back once latency frames (itself
+	// included) have been submitted
+	ScriptedQueryBackend(unsigned int latency);
+
+	// Changes the latency from here on (a long one stalls the GPU)
+	void SetLatency(unsigned int frames) { latency = frames; }
+	// The given frame's disjoint query reports a clock change
+	void MarkDisjoint(unsigned int frame);
+	// One timestamp of the given frame comes back this many
+	// frames after the rest
+	void DelayTimestamp(unsigned int frame, unsigned int queryIndex, unsigned int extraFrames);
+
+	void BeginFrame(unsigned int frameSlot);
+	void EndFrame(unsigned int frameSlot) { submitted++; }
+	void Timestamp(unsigned int frameSlot, unsigned int queryIndex) {}
+	bool GetFrameData(unsigned int frameSlot, UINT64* frequency, bool* disjoint);
+	bool GetTimestamp(unsigned int frameSlot, unsigned int queryIndex, UINT64* timestamp);
+	void BeginStats(unsigned int frameSlot, unsigned int passIndex) {}
+	void EndStats(unsigned int frameSlot, unsigned int passIndex) {}
+	bool GetStats(unsigned int frameSlot, unsigned int passIndex, GpuPassStats* stats);
+
+private:
+	struct Delay
+	{
+		unsigned int Frame;
+		unsigned int Query;
+		unsigned int ExtraFrames;
+	};
+
+	unsigned int latency;
+	unsigned int begun;		// Frames started
+	unsigned int submitted;	// Frames ended
+	unsigned int slotFrames[GPU_PROFILER_FRAME_LATENCY]; // Which frame each slot holds
+	std::vector<unsigned int> disjointFrames;
+	std::vector<Delay> delays;
+
+	bool Finished(unsigned int frameSlot, unsigned int extraFrames);
+};
+
+// --------------------------------------------------------
+// Ring of in-flight frames and their pass timings
+// --------------------------------------------------------
+class GpuProfiler
+{
+public:
+	GpuProfiler(IGpuQueryBackend* backend);
+	~GpuProfiler();
+
+	void BeginFrame();
+	void EndFrame();
+
+	void BeginPass(const char* name);
+	void EndPass();
+
+	// Reads back every frame that has finished on the GPU
+	void Resolve();
+
+	// Stats
+	unsigned int GetResolvedFrames() { return resolvedFrames; }
+	unsigned int GetDroppedFrames() { return droppedFrames; }
+
+	// Pipeline statistics of the most recently resolved frame
+	void PrintPassStats();
+
+private:
+	struct PassRecord
+	{
+		const char* Name;
+		unsigned int BeginQuery;
+		unsigned int EndQuery;
+	};
+
+	struct FrameRecord
+	{
+		bool Pending;					// Submitted but not resolved
+		double CpuStartNs;				// CPU time when the frame began
+		unsigned int QueryCount;
+		unsigned int PassCount;
+		PassRecord Passes[GPU_PROFILER_MAX_PASSES];
+		unsigned int OpenPasses[GPU_PROFILER_MAX_QUERIES]; // Stack of pass indices
+		unsigned int OpenCount;
+	};
+
+	// Marks a pass that didn't get queries (frame ran out)
+	static const unsigned int SkippedPass = 0xFFFFFFFF;
+
+	IGpuQueryBackend* backend;
+	FrameRecord frames[GPU_PROFILER_FRAME_LATENCY];
+	unsigned int frameIndex;
+	unsigned int currentSlot;
+	bool inFrame;
+
+	unsigned int resolvedFrames;
+	unsigned int droppedFrames;
+
+	// Copied out of the ring when a frame resolves
+	struct ResolvedPassStats
+	{
+		std::string Name;
+		GpuPassStats Stats;
+	};
+	std::vector<ResolvedPassStats> lastPassStats;
+
+	bool TryResolve(unsigned int slot);
+};
+
+// --------------------------------------------------------
+// RAII helper - times a pass on both the CPU and GPU
+// --------------------------------------------------------
+class GpuPassScope
+{
+public:
+	GpuPassScope(GpuProfiler* profiler, const char* name) : zone(name)
+	{
+		this->profiler = profiler;
+		profiler->BeginPass(name);
+	}
+	~GpuPassScope() { profiler->EndPass(); }
+
+private:
+	ProfileZone zone;
+	GpuProfiler* profiler;
+};
+
+// Runs the profiler against the scripted backend: readback
+// latency up to the ring size, a stalled GPU overflowing the
+// ring, disjoint frames and a late timestamp
+void GpuProfilerReport();
+
+#define PROFILE_PASS(gpuProfiler, name) GpuPassScope PROFILE_CONCAT(gpuPass, __LINE__)(gpuProfiler, name)
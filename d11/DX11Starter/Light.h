@@ -13,19 +13,21 @@ struct DirectionalLight
 	XMFLOAT3 Direction;
 	float pad;
 };
-struct PointLight
+
+// Point and spot lights share one struct, so they can live
+// in a single structured buffer for clustered shading
+#define LIGHT_TYPE_POINT 0
+#define LIGHT_TYPE_SPOT 1
+
+struct LocalLight
 {
 	XMFLOAT4 AmbientColor;
 	XMFLOAT4 DiffuseColor;
+	XMFLOAT3 Direction;  //spot only
+	float cone;          //spot only, bigger = wider
 	XMFLOAT3 LightPos;
-	float range;
+	float range;         //light is zero past this distance
+	int type;            //LIGHT_TYPE_*
+	int shadow;          //first shadow atlas view, -1 = unshadowed
+	float pad[2];
 };
-struct SpotLight
-{
-	XMFLOAT4 AmbientColor;
-	XMFLOAT4 DiffuseColor;
-	XMFLOAT3 Direction;
-	float cone;
-	XMFLOAT3 LightPos;
-	float range;
-};
\ No newline at end of file
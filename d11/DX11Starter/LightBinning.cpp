@@ -0,0 +1,384 @@
+#include "LightBinning.h"
+#include "Profiler.h"
+#include <emmintrin.h>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+// --------------------------------------------------------
+// Runs fn(begin, end) over [0, count) in threadCount chunks,
+// one of them on the calling thread
+// --------------------------------------------------------
+template<typename Fn>
+static void ParallelFor(unsigned int count, unsigned int threadCount, Fn fn)
+{
+	threadCount = std::max(std::min(threadCount, count), 1u);
+	unsigned int chunk = (count + threadCount - 1) / threadCount;
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threadCount; t++)
+	{
+		unsigned int begin = std::min(t * chunk, count);
+		unsigned int end = std::min(begin + chunk, count);
+		workers.push_back(std::thread(fn, begin, end));
+	}
+	fn(0u, std::min(chunk, count));
+
+	for (auto& w : workers)
+		w.join();
+}
+
+TileLightBinner::TileLightBinner(unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	this->threadCount = threadCount;
+
+	lightCount = 0;
+	maskWords = 0;
+	SetGrid(1280, 720, 16, 0.25f * 3.1415926535f, 0.1f, 100.0f);
+}
+
+void TileLightBinner::SetGrid(unsigned int width, unsigned int height, unsigned int tileSize,
+	float fovY, float zNear, float zFar)
+{
+	this->width = width;
+	this->height = height;
+	this->tileSize = tileSize;
+	this->zNear = zNear;
+	this->zFar = zFar;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	tanHalfFovY = tanf(fovY * 0.5f);
+	tanHalfFovX = tanHalfFovY * width / height;
+
+	// Inward facing planes through the eye:
+	//   left   x - x0 * tanX * z >= 0
+	//   right -x + x1 * tanX * z >= 0
+	// and the same for rows (NDC y goes up, rows go down)
+	auto plane = [](float x, float y, float z)
+	{
+		float len = sqrtf(x * x + y * y + z * z);
+		Plane p = { x / len, y / len, z / len };
+		return p;
+	};
+
+	columnPlanes.resize(tilesX * 2);
+	for (unsigned int x = 0; x < tilesX; x++)
+	{
+		float x0 = -1.0f + 2.0f * (x * tileSize) / width;
+		float x1 = -1.0f + 2.0f * std::min((x + 1) * tileSize, width) / width;
+		columnPlanes[x * 2 + 0] = plane(1, 0, -x0 * tanHalfFovX);
+		columnPlanes[x * 2 + 1] = plane(-1, 0, x1 * tanHalfFovX);
+	}
+
+	rowPlanes.resize(tilesY * 2);
+	for (unsigned int y = 0; y < tilesY; y++)
+	{
+		float y1 = 1.0f - 2.0f * (y * tileSize) / height;
+		float y0 = 1.0f - 2.0f * std::min((y + 1) * tileSize, height) / height;
+		rowPlanes[y * 2 + 0] = plane(0, 1, -y0 * tanHalfFovY);
+		rowPlanes[y * 2 + 1] = plane(0, -1, y1 * tanHalfFovY);
+	}
+}
+
+// --------------------------------------------------------
+// Moves the lights into view space SoA arrays and works out
+// which ones are inside the near/far range
+// --------------------------------------------------------
+void TileLightBinner::PrepareLights(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view)
+{
+	lightCount = std::min(lightCount, (unsigned int)BIN_MAX_LIGHTS);
+	this->lightCount = lightCount;
+	maskWords = (lightCount + 31) / 32;
+
+	unsigned int padded = maskWords * 32;
+	for (auto v : { &px, &py, &pz, &tx, &ty, &tz, &dx, &dy, &dz, &radius, &radiusSq })
+		v->assign(padded, 0.0f);
+	depthMask.assign(maskWords, 0);
+
+	XMMATRIX V = XMLoadFloat4x4(&view);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		const LocalLight& l = lights[i];
+		XMFLOAT3 p, d;
+		XMStoreFloat3(&p, XMVector3TransformCoord(XMLoadFloat3(&l.LightPos), V));
+		XMStoreFloat3(&d, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&l.Direction), V)));
+
+		// The shader's spot falloff is pow(cos, 45 - cone).  Past the
+		// angle where that drops under 1/256 the light is invisible.
+		bool cone = false;
+		float baseRadius = l.range;
+		float exponent = 45.0f - l.cone;
+		bool ambient = l.AmbientColor.x > 0 || l.AmbientColor.y > 0 || l.AmbientColor.z > 0;
+		if (l.type == LIGHT_TYPE_SPOT && !ambient && exponent > 0)
+		{
+			float cosAngle = powf(1.0f / 256.0f, 1.0f / exponent);
+			float tanAngle = sqrtf(1.0f - cosAngle * cosAngle) / cosAngle;
+
+			// Past 45 degrees the cone's base pokes out of the sphere
+			if (tanAngle <= 1.0f)
+			{
+				cone = true;
+				baseRadius = l.range * tanAngle;
+			}
+		}
+
+		px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+		if (cone)
+		{
+			tx[i] = p.x + d.x * l.range; ty[i] = p.y + d.y * l.range; tz[i] = p.z + d.z * l.range;
+			dx[i] = d.x; dy[i] = d.y; dz[i] = d.z;
+		}
+		else
+		{
+			tx[i] = p.x; ty[i] = p.y; tz[i] = p.z;
+		}
+		radius[i] = baseRadius;
+		radiusSq[i] = baseRadius * baseRadius;
+
+		// Depth range of the sphere / cone
+		float spread = radius[i] * sqrtf(std::max(1.0f - dz[i] * dz[i], 0.0f));
+		float zMin = std::min(pz[i], tz[i] - spread);
+		float zMax = std::max(pz[i], tz[i] + spread);
+		if (zMax >= zNear && zMin <= zFar)
+			depthMask[i / 32] |= 1u << (i % 32);
+	}
+}
+
+// --------------------------------------------------------
+// Four lights vs. two planes at a time.  Against a plane n:
+//   sphere: n.P + R >= 0
+//   cone:   max(n.P, n.T + R * sqrt(1 - (n.D)^2)) >= 0
+// A sphere is stored as a cone with T = P and D = 0, where
+// the cone test turns into the sphere test.  The cone test
+// is done without the square root:
+//   n.P >= 0  or  n.T >= 0  or  R^2 * (1 - (n.D)^2) >= (n.T)^2
+//
+// Side planes only have two non-zero components (x and z
+// for columns, y and z for rows), so u is whichever of the
+// light's x or y arrays goes with the plane.
+// --------------------------------------------------------
+void TileLightBinner::TestPlanes(const Plane& a, const Plane& b,
+	const float* pu, const float* tu, const float* du, unsigned int* out)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 au = _mm_set1_ps(a.X + a.Y), az = _mm_set1_ps(a.Z);
+	__m128 bu = _mm_set1_ps(b.X + b.Y), bz = _mm_set1_ps(b.Z);
+
+	for (unsigned int w = 0; w < maskWords; w++)
+	{
+		unsigned int bits = 0;
+		for (unsigned int k = 0; k < 8; k++)
+		{
+			unsigned int i = w * 32 + k * 4;
+			__m128 Pu = _mm_loadu_ps(&pu[i]), Pz = _mm_loadu_ps(&pz[i]);
+			__m128 Tu = _mm_loadu_ps(&tu[i]), Tz = _mm_loadu_ps(&tz[i]);
+			__m128 Du = _mm_loadu_ps(&du[i]), Dz = _mm_loadu_ps(&dz[i]);
+			__m128 R2 = _mm_loadu_ps(&radiusSq[i]);
+
+			// Plane a
+			__m128 nP = _mm_add_ps(_mm_mul_ps(au, Pu), _mm_mul_ps(az, Pz));
+			__m128 nT = _mm_add_ps(_mm_mul_ps(au, Tu), _mm_mul_ps(az, Tz));
+			__m128 nD = _mm_add_ps(_mm_mul_ps(au, Du), _mm_mul_ps(az, Dz));
+			__m128 rim = _mm_mul_ps(R2, _mm_sub_ps(one, _mm_mul_ps(nD, nD)));
+			__m128 inA = _mm_or_ps(_mm_or_ps(_mm_cmpge_ps(nP, zero), _mm_cmpge_ps(nT, zero)),
+				_mm_cmpge_ps(rim, _mm_mul_ps(nT, nT)));
+
+			// Plane b
+			nP = _mm_add_ps(_mm_mul_ps(bu, Pu), _mm_mul_ps(bz, Pz));
+			nT = _mm_add_ps(_mm_mul_ps(bu, Tu), _mm_mul_ps(bz, Tz));
+			nD = _mm_add_ps(_mm_mul_ps(bu, Du), _mm_mul_ps(bz, Dz));
+			rim = _mm_mul_ps(R2, _mm_sub_ps(one, _mm_mul_ps(nD, nD)));
+			__m128 inB = _mm_or_ps(_mm_or_ps(_mm_cmpge_ps(nP, zero), _mm_cmpge_ps(nT, zero)),
+				_mm_cmpge_ps(rim, _mm_mul_ps(nT, nT)));
+
+			bits |= (unsigned int)_mm_movemask_ps(_mm_and_ps(inA, inB)) << (k * 4);
+		}
+		out[w] = bits & depthMask[w];
+	}
+}
+
+// Scalar version of the same test, one light vs. one plane
+bool TileLightBinner::TestLight(unsigned int i, const Plane& n)
+{
+	float u = n.X + n.Y;
+	float pu = n.X != 0 ? px[i] : py[i];
+	float tu = n.X != 0 ? tx[i] : ty[i];
+	float du = n.X != 0 ? dx[i] : dy[i];
+
+	float nP = u * pu + n.Z * pz[i];
+	float nT = u * tu + n.Z * tz[i];
+	float nD = u * du + n.Z * dz[i];
+	return nP >= 0 || nT >= 0 || radiusSq[i] * (1.0f - nD * nD) >= nT * nT;
+}
+
+void TileLightBinner::Bin(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view)
+{
+	PROFILE_ZONE("TileLightBinner::Bin");
+
+	PrepareLights(lights, lightCount, view);
+	columnMasks.resize(tilesX * maskWords);
+	rowMasks.resize(tilesY * maskWords);
+	masks.resize(tilesX * tilesY * maskWords);
+
+	// Columns then rows, as one list of plane pairs
+	ParallelFor(tilesX + tilesY, threadCount, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			if (i < tilesX)
+				TestPlanes(columnPlanes[i * 2], columnPlanes[i * 2 + 1],
+					px.data(), tx.data(), dx.data(), &columnMasks[i * maskWords]);
+			else
+			{
+				unsigned int y = i - tilesX;
+				TestPlanes(rowPlanes[y * 2], rowPlanes[y * 2 + 1],
+					py.data(), ty.data(), dy.data(), &rowMasks[y * maskWords]);
+			}
+		}
+	});
+
+	// Tile = column AND row
+	ParallelFor(tilesY, threadCount, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int y = begin; y < end; y++)
+		{
+			const unsigned int* row = &rowMasks[y * maskWords];
+			for (unsigned int x = 0; x < tilesX; x++)
+			{
+				const unsigned int* column = &columnMasks[x * maskWords];
+				unsigned int* tile = &masks[(x + y * tilesX) * maskWords];
+				unsigned int w = 0;
+				for (; w + 4 <= maskWords; w += 4)
+				{
+					__m128i c = _mm_loadu_si128((const __m128i*)&column[w]);
+					__m128i r = _mm_loadu_si128((const __m128i*)&row[w]);
+					_mm_storeu_si128((__m128i*)&tile[w], _mm_and_si128(c, r));
+				}
+				for (; w < maskWords; w++)
+					tile[w] = column[w] & row[w];
+			}
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Every tile's four planes against every light, one at a time
+// --------------------------------------------------------
+void TileLightBinner::BinReference(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view)
+{
+	PrepareLights(lights, lightCount, view);
+	masks.assign(tilesX * tilesY * maskWords, 0);
+
+	for (unsigned int y = 0; y < tilesY; y++)
+		for (unsigned int x = 0; x < tilesX; x++)
+		{
+			unsigned int* tile = &masks[(x + y * tilesX) * maskWords];
+			for (unsigned int i = 0; i < this->lightCount; i++)
+			{
+				if (!(depthMask[i / 32] & (1u << (i % 32)))) continue;
+				if (!TestLight(i, columnPlanes[x * 2]) || !TestLight(i, columnPlanes[x * 2 + 1])) continue;
+				if (!TestLight(i, rowPlanes[y * 2]) || !TestLight(i, rowPlanes[y * 2 + 1])) continue;
+				tile[i / 32] |= 1u << (i % 32);
+			}
+		}
+}
+
+unsigned int TileLightBinner::CountTileLights(unsigned int x, unsigned int y)
+{
+	const unsigned int* tile = GetTileMask(x, y);
+	unsigned int count = 0;
+	for (unsigned int w = 0; w < maskWords; w++)
+		for (unsigned int bits = tile[w]; bits; bits &= bits - 1)
+			count++;
+	return count;
+}
+
+static float RandomRange(float lo, float hi)
+{
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// --------------------------------------------------------
+// Same kind of light field as ClusterBenchmark, except the
+// spots have no ambient term so they get culled as cones
+// --------------------------------------------------------
+void LightBinningBenchmark()
+{
+	std::vector<LocalLight> lights(BIN_MAX_LIGHTS);
+	srand(1234);
+	for (unsigned int i = 0; i < BIN_MAX_LIGHTS; i++)
+	{
+		LocalLight& l = lights[i];
+		l.AmbientColor = XMFLOAT4(0, 0, 0, 1);
+		l.DiffuseColor = XMFLOAT4(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1), 1);
+		l.LightPos = XMFLOAT3(RandomRange(-50, 50), RandomRange(-10, 10), RandomRange(0, 100));
+		l.range = RandomRange(1, 6);
+		l.type = (i & 1) ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+		XMStoreFloat3(&l.Direction, XMVector3Normalize(XMVectorSet(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1), 0)));
+		l.cone = 30.0f;
+	}
+
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixIdentity());
+
+	TileLightBinner single(1);
+	TileLightBinner threaded;
+
+	printf("\nCPU tile light binning, 16x16 pixel tiles (%u threads)\n", threaded.GetThreadCount());
+	printf("  %-10s %6s %10s %10s %12s\n", "screen", "lights", "1 thread", "threaded", "lights/tile");
+
+	const unsigned int sizes[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const unsigned int counts[3] = { 1024, 4096, 16384 };
+	const unsigned int iterations = 10;
+	for (auto& size : sizes)
+	{
+		single.SetGrid(size[0], size[1], 16, 0.25f * 3.1415926535f, 0.1f, 100.0f);
+		threaded.SetGrid(size[0], size[1], 16, 0.25f * 3.1415926535f, 0.1f, 100.0f);
+
+		for (unsigned int count : counts)
+		{
+			double ms[2];
+			TileLightBinner* binners[2] = { &single, &threaded };
+			for (int b = 0; b < 2; b++)
+			{
+				binners[b]->Bin(lights.data(), count, view); // Warm up the allocations
+				unsigned __int64 start = Profiler::Now();
+				for (unsigned int i = 0; i < iterations; i++)
+					binners[b]->Bin(lights.data(), count, view);
+				ms[b] = Profiler::TicksToNs(Profiler::Now() - start) / 1e6 / iterations;
+			}
+
+			unsigned long long total = 0;
+			for (unsigned int y = 0; y < threaded.GetTilesY(); y++)
+				for (unsigned int x = 0; x < threaded.GetTilesX(); x++)
+					total += threaded.CountTileLights(x, y);
+
+			char screen[32];
+			sprintf_s(screen, "%ux%u", size[0], size[1]);
+			printf("  %-10s %6u %8.3fms %8.3fms %12.1f\n", screen, count, ms[0], ms[1],
+				total / (double)(threaded.GetTilesX() * threaded.GetTilesY()));
+		}
+	}
+
+	// The fast path has to give exactly the reference's bits
+	TileLightBinner reference(1);
+	reference.SetGrid(1920, 1080, 16, 0.25f * 3.1415926535f, 0.1f, 100.0f);
+	reference.BinReference(lights.data(), 1024, view);
+	threaded.SetGrid(1920, 1080, 16, 0.25f * 3.1415926535f, 0.1f, 100.0f);
+	threaded.Bin(lights.data(), 1024, view);
+
+	unsigned int mismatches = 0;
+	for (unsigned int y = 0; y < threaded.GetTilesY(); y++)
+		for (unsigned int x = 0; x < threaded.GetTilesX(); x++)
+			for (unsigned int w = 0; w < threaded.GetMaskWords(); w++)
+				if (threaded.GetTileMask(x, y)[w] != reference.GetTileMask(x, y)[w])
+					mismatches++;
+	printf("  vs. scalar reference (1920x1080, 1024 lights): %s (%u words differ)\n",
+		mismatches ? "MISMATCH" : "match", mismatches);
+}
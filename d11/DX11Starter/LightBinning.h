@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include "Light.h"
+
+// --------------------------------------------------------
+// CPU tiled light binning
+//
+// Assigns point and spot lights to screen tiles and emits one
+// bit per light per tile:
+//
+//   mask = GetTileMask(x, y)
+//   lit  = mask[light / 32] & (1 << (light % 32))
+//
+// - Lights are copied into SoA arrays in view space and
+//   tested four at a time with SSE
+// - Point lights are spheres.  Spot lights are cones capped
+//   at their range, unless they have an ambient term (that
+//   isn't limited to the cone) or are too wide for the cone
+//   to be tighter than the sphere
+// - A tile's frustum test is the AND of its column's left and
+//   right planes and its row's top and bottom planes, so the
+//   planes are only tested once per column and once per row.
+//   Each tile is then the AND of two masks.
+// - Columns/rows and then tile rows are split across threads
+//
+// Bin() is the fast path.  BinReference() is a plain scalar
+// loop over every tile and light that gives the same bits,
+// so it can be used to check Bin() or any other binning.
+// --------------------------------------------------------
+
+#define BIN_MAX_LIGHTS 16384
+
+class TileLightBinner
+{
+public:
+	// threadCount 0 = one per hardware thread
+	TileLightBinner(unsigned int threadCount = 0);
+
+	// Screen and tile size in pixels, plus the camera's
+	// (left handed) perspective
+	void SetGrid(unsigned int width, unsigned int height, unsigned int tileSize,
+		float fovY, float zNear, float zFar);
+
+	// view is the world -> view matrix (not transposed)
+	// - Lights past BIN_MAX_LIGHTS are ignored
+	void Bin(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view);
+	void BinReference(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view);
+
+	// Results of the last Bin / BinReference
+	unsigned int GetTilesX() { return tilesX; }
+	unsigned int GetTilesY() { return tilesY; }
+	unsigned int GetMaskWords() { return maskWords; }
+	const unsigned int* GetTileMask(unsigned int x, unsigned int y) { return &masks[(x + y * tilesX) * maskWords]; }
+	unsigned int CountTileLights(unsigned int x, unsigned int y);
+	unsigned int GetThreadCount() { return threadCount; }
+
+private:
+	// A side plane through the eye, n.x * x + n.y * y + n.z * z >= 0
+	// is inside.  Column planes have y = 0, row planes have x = 0.
+	struct Plane
+	{
+		float X;
+		float Y;
+		float Z;
+	};
+
+	unsigned int threadCount;
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int tileSize;
+	unsigned int tilesX;
+	unsigned int tilesY;
+	float tanHalfFovX;
+	float tanHalfFovY;
+	float zNear;
+	float zFar;
+
+	// Left/right per column, bottom/top per row
+	std::vector<Plane> columnPlanes;
+	std::vector<Plane> rowPlanes;
+
+	// View space lights, padded to a multiple of 32
+	// - P is a sphere's center or a cone's apex
+	// - T is the center of a cone's base (= P for a sphere)
+	// - D is a cone's axis (0 for a sphere)
+	// - R is a cone's base radius or a sphere's radius
+	unsigned int lightCount;
+	unsigned int maskWords;
+	std::vector<float> px, py, pz;
+	std::vector<float> tx, ty, tz;
+	std::vector<float> dx, dy, dz;
+	std::vector<float> radius;
+	std::vector<float> radiusSq;
+	std::vector<unsigned int> depthMask; // In front of the far plane and past the near one
+
+	std::vector<unsigned int> columnMasks;
+	std::vector<unsigned int> rowMasks;
+	std::vector<unsigned int> masks;
+
+	void PrepareLights(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view);
+	void TestPlanes(const Plane& a, const Plane& b,
+		const float* pu, const float* tu, const float* du, unsigned int* out);
+	bool TestLight(unsigned int light, const Plane& plane);
+};
+
+// Times Bin() with 1k - 16k lights on 1080p and 4K tile grids
+// (16 pixel tiles), and checks it against BinReference()
+void LightBinningBenchmark();
@@ -0,0 +1,408 @@
+#include "LightClusters.h"
+#include "Profiler.h"
+#include "Check.h"
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+ClusterGrid::ClusterGrid()
+{
+	maxClusterLights = 0;
+	droppedIndices = 0;
+	for (int i = 0; i < CLUSTER_COUNT; i++)
+		ranges[i].Offset = ranges[i].Count = 0;
+	SetProjection(0.25f * 3.1415926535f, 16.0f / 9.0f, 0.1f, 100.0f);
+}
+
+void ClusterGrid::SetProjection(float fovY, float aspect, float zNear, float zFar)
+{
+	this->zNear = zNear;
+	this->zFar = zFar;
+	tanHalfFovY = tanf(fovY * 0.5f);
+	tanHalfFovX = tanHalfFovY * aspect;
+
+	// slice = CLUSTER_Z * log(z / near) / log(far / near)
+	sliceScale = CLUSTER_Z / logf(zFar / zNear);
+	sliceBias = -CLUSTER_Z * logf(zNear) / logf(zFar / zNear);
+
+	for (int z = 0; z < CLUSTER_Z; z++)
+	{
+		float z0 = zNear * powf(zFar / zNear, (float)z / CLUSTER_Z);
+		float z1 = zNear * powf(zFar / zNear, (float)(z + 1) / CLUSTER_Z);
+
+		for (int y = 0; y < CLUSTER_Y; y++)
+		{
+			// Tile edges in NDC (y goes up, tile rows go down the screen)
+			float y0 = 1.0f - 2.0f * (y + 1) / CLUSTER_Y;
+			float y1 = 1.0f - 2.0f * y / CLUSTER_Y;
+
+			for (int x = 0; x < CLUSTER_X; x++)
+			{
+				float x0 = -1.0f + 2.0f * x / CLUSTER_X;
+				float x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+
+				// The frustum piece is widest at whichever depth
+				// pushes each edge furthest out
+				ClusterBounds& b = bounds[x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y];
+				b.Min.x = std::min(x0 * z0, x0 * z1) * tanHalfFovX;
+				b.Max.x = std::max(x1 * z0, x1 * z1) * tanHalfFovX;
+				b.Min.y = std::min(y0 * z0, y0 * z1) * tanHalfFovY;
+				b.Max.y = std::max(y1 * z0, y1 * z1) * tanHalfFovY;
+				b.Min.z = z0;
+				b.Max.z = z1;
+			}
+		}
+	}
+}
+
+int ClusterGrid::GetSlice(float viewZ)
+{
+	int slice = (int)floorf(logf(std::max(viewZ, zNear)) * sliceScale + sliceBias);
+	return std::min(std::max(slice, 0), CLUSTER_Z - 1);
+}
+
+// Screen tile column/row an NDC coordinate falls in
+static int TileX(float ndc) { return std::min(std::max((int)floorf((ndc + 1.0f) * 0.5f * CLUSTER_X), 0), CLUSTER_X - 1); }
+static int TileY(float ndc) { return std::min(std::max((int)floorf((1.0f - ndc) * 0.5f * CLUSTER_Y), 0), CLUSTER_Y - 1); }
+
+static bool SphereTouchesBox(const XMFLOAT3& c, float r, const ClusterBounds& b)
+{
+	float dx = std::max(std::max(b.Min.x - c.x, 0.0f), c.x - b.Max.x);
+	float dy = std::max(std::max(b.Min.y - c.y, 0.0f), c.y - b.Max.y);
+	float dz = std::max(std::max(b.Min.z - c.z, 0.0f), c.z - b.Max.z);
+	return dx * dx + dy * dy + dz * dz <= r * r;
+}
+
+// --------------------------------------------------------
+// For every light:
+//  - Move its bounding sphere into view space
+//  - Work out the slices and the screen tiles its box covers
+//    (the box's projection is widest at its nearest depth)
+//  - Test the sphere against each cluster box in that range
+// Hits are collected as (cluster, light) pairs, counted,
+// then scattered into one list sorted by cluster.
+// --------------------------------------------------------
+void ClusterGrid::Assign(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view)
+{
+	PROFILE_ZONE("ClusterGrid::Assign");
+
+	XMMATRIX V = XMLoadFloat4x4(&view);
+	lightCount = std::min(lightCount, (unsigned int)CLUSTER_MAX_LIGHTS);
+
+	unsigned int counts[CLUSTER_COUNT] = {};
+	pairs.clear();
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		const LocalLight& l = lights[i];
+		XMFLOAT3 c;
+		XMStoreFloat3(&c, XMVector3TransformCoord(XMLoadFloat3(&l.LightPos), V));
+		float r = l.range;
+
+		float zMin = std::max(c.z - r, zNear);
+		float zMax = std::min(c.z + r, zFar);
+		if (zMin > zMax) continue;
+
+		// NDC x = x / (z * tanHalfFovX), pick the depth that gives the extreme
+		float left = c.x - r, right = c.x + r;
+		float bottom = c.y - r, top = c.y + r;
+		float ndcLeft = std::min(left / zMin, left / zMax) / tanHalfFovX;
+		float ndcRight = std::max(right / zMin, right / zMax) / tanHalfFovX;
+		float ndcBottom = std::min(bottom / zMin, bottom / zMax) / tanHalfFovY;
+		float ndcTop = std::max(top / zMin, top / zMax) / tanHalfFovY;
+		if (ndcLeft > 1.0f || ndcRight < -1.0f || ndcBottom > 1.0f || ndcTop < -1.0f) continue;
+
+		int x0 = TileX(ndcLeft), x1 = TileX(ndcRight);
+		int y0 = TileY(ndcTop), y1 = TileY(ndcBottom);
+		int z0 = GetSlice(zMin), z1 = GetSlice(zMax);
+
+		for (int z = z0; z <= z1; z++)
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+				{
+					unsigned int cluster = x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y;
+					if (!SphereTouchesBox(c, r, bounds[cluster])) continue;
+					pairs.push_back((cluster << 16) | i);
+					counts[cluster]++;
+				}
+	}
+
+	// Offsets, cutting clusters short if the list would overflow
+	unsigned int offset = 0;
+	maxClusterLights = 0;
+	droppedIndices = 0;
+	for (int i = 0; i < CLUSTER_COUNT; i++)
+	{
+		unsigned int count = std::min(counts[i], (unsigned int)CLUSTER_MAX_INDICES - offset);
+		droppedIndices += counts[i] - count;
+		ranges[i].Offset = offset;
+		ranges[i].Count = 0; // Filled back up by the scatter
+		maxClusterLights = std::max(maxClusterLights, counts[i]);
+		counts[i] = count;
+		offset += count;
+	}
+
+	indices.resize(offset);
+	for (auto p : pairs)
+	{
+		unsigned int cluster = p >> 16;
+		ClusterRange& range = ranges[cluster];
+		if (range.Count == counts[cluster]) continue;
+		indices[range.Offset + range.Count++] = p & 0xFFFF;
+	}
+}
+
+static float RandomRange(float lo, float hi)
+{
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// --------------------------------------------------------
+// Lights are scattered through a box in front of the camera
+// roughly the size of the scene, with ranges like the ones
+// the scene uses for its small lights.
+// --------------------------------------------------------
+void ClusterBenchmark(unsigned int lightCount, unsigned int iterations)
+{
+	std::vector<LocalLight> lights(lightCount);
+	srand(1234);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		LocalLight& l = lights[i];
+		l.AmbientColor = XMFLOAT4(0, 0, 0, 1);
+		l.DiffuseColor = XMFLOAT4(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1), 1);
+		l.LightPos = XMFLOAT3(RandomRange(-50, 50), RandomRange(-10, 10), RandomRange(0, 100));
+		l.range = RandomRange(1, 6);
+		l.type = (i & 1) ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+		l.Direction = XMFLOAT3(0, -1, 0);
+		l.cone = 30.0f;
+	}
+
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixIdentity());
+
+	// Too big for the stack
+	ClusterGrid* grid = new ClusterGrid();
+	grid->SetProjection(0.25f * 3.1415926535f, 16.0f / 9.0f, 0.1f, 100.0f);
+
+	unsigned __int64 start = Profiler::Now();
+	for (unsigned int i = 0; i < iterations; i++)
+		grid->Assign(lights.data(), lightCount, view);
+	double ms = Profiler::TicksToNs(Profiler::Now() - start) / 1e6 / iterations;
+
+	printf("\nCluster assignment, %u point/spot lights, %dx%dx%d clusters\n", lightCount, CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+	printf("  %.3f ms per frame (average of %u)\n", ms, iterations);
+	printf("  %u indices, %.1f lights per cluster on average, %u at most, %u dropped\n",
+		grid->GetIndexCount(), grid->GetIndexCount() / (double)CLUSTER_COUNT,
+		grid->GetMaxClusterLights(), grid->GetDroppedIndices());
+
+	delete grid;
+}
+
+
+// --------------------------------------------------------
+// Report
+// --------------------------------------------------------
+
+// Corner i of a cluster's frustum piece: bit 0 picks the right
+// edge, bit 1 the top, bit 2 the far slice
+static void ClusterCorners(int x, int y, int z, float tanHalfFovX, float tanHalfFovY, float zNear, float zFar,
+	XMVECTOR corners[8])
+{
+	for (int i = 0; i < 8; i++)
+	{
+		float ndcX = -1.0f + 2.0f * (x + (i & 1)) / CLUSTER_X;
+		float ndcY = 1.0f - 2.0f * (y + 1 - ((i >> 1) & 1)) / CLUSTER_Y;
+		float depth = zNear * powf(zFar / zNear, (float)(z + ((i >> 2) & 1)) / CLUSTER_Z);
+		corners[i] = XMVectorSet(ndcX * depth * tanHalfFovX, ndcY * depth * tanHalfFovY, depth, 0);
+	}
+}
+
+static float DistanceToSegment(FXMVECTOR p, FXMVECTOR a, FXMVECTOR b)
+{
+	XMVECTOR ab = b - a;
+	float t = XMVectorGetX(XMVector3Dot(p - a, ab)) / XMVectorGetX(XMVector3Dot(ab, ab));
+	t = std::min(std::max(t, 0.0f), 1.0f);
+	return XMVectorGetX(XMVector3Length(p - (a + ab * t)));
+}
+
+static XMVECTOR PieceCenter(const XMVECTOR corners[8])
+{
+	XMVECTOR center = XMVectorZero();
+	for (int i = 0; i < 8; i++) center += corners[i] * 0.125f;
+	return center;
+}
+
+// The corners of the face where corner bit (1 << axis) is side,
+// in order around it, and the face's outward normal
+static XMVECTOR PieceFace(const XMVECTOR corners[8], int axis, int side, XMVECTOR q[4])
+{
+	int a = side << axis, b = 1 << ((axis + 1) % 3), c = 1 << ((axis + 2) % 3);
+	q[0] = corners[a];
+	q[1] = corners[a | b];
+	q[2] = corners[a | b | c];
+	q[3] = corners[a | c];
+	XMVECTOR n = XMVector3Normalize(XMVector3Cross(q[1] - q[0], q[3] - q[0]));
+	if (XMVectorGetX(XMVector3Dot(n, PieceCenter(corners) - q[0])) > 0) n = -n;
+	return n;
+}
+
+// Exact distance from p to the frustum piece (0 inside): the
+// nearest face it projects into, or else the nearest edge
+static float DistanceToPiece(FXMVECTOR p, const XMVECTOR corners[8])
+{
+	bool inside = true;
+	float best = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+		for (int side = 0; side < 2; side++)
+		{
+			XMVECTOR q[4];
+			XMVECTOR n = PieceFace(corners, axis, side, q);
+
+			float d = XMVectorGetX(XMVector3Dot(n, p - q[0]));
+			if (d <= 0) continue;
+			inside = false;
+
+			XMVECTOR onPlane = p - n * d;
+			XMVECTOR faceCenter = (q[0] + q[1] + q[2] + q[3]) * 0.25f;
+			bool within = true;
+			for (int k = 0; k < 4 && within; k++)
+			{
+				XMVECTOR out = XMVector3Cross(q[(k + 1) % 4] - q[k], n);
+				if (XMVectorGetX(XMVector3Dot(out, faceCenter - q[k])) > 0) out = -out;
+				within = XMVectorGetX(XMVector3Dot(out, onPlane - q[k])) <= 0;
+			}
+			if (within) best = std::min(best, d);
+		}
+	if (inside) return 0;
+
+	for (int i = 0; i < 8; i++)
+		for (int bit = 1; bit < 8; bit <<= 1)
+			if (!(i & bit))
+				best = std::min(best, DistanceToSegment(p, corners[i], corners[i | bit]));
+	return best;
+}
+
+// --------------------------------------------------------
+// Checks Assign against a brute force test of every light's
+// sphere against every cluster's exact frustum piece, from a
+// turned camera.  The lights are a random field, the scene's
+// range 20 point light, and lights placed just outside random
+// clusters' faces, edges and corners, close enough to touch -
+// the cases a too tight cull would miss.  Every light that
+// touches a cluster has to be in its list; extra ones (the
+// box around the piece is a little bigger) only cost shading.
+// --------------------------------------------------------
+void ClusterReferenceReport()
+{
+	const float fovY = 0.25f * 3.1415926535f, aspect = 16.0f / 9.0f, zNear = 0.1f, zFar = 100.0f;
+	const float tanHalfFovY = tanf(fovY * 0.5f), tanHalfFovX = tanHalfFovY * aspect;
+
+	std::vector<LocalLight> lights;
+	LocalLight l = {};
+	l.type = LIGHT_TYPE_POINT;
+	l.shadow = -1;
+	srand(4321);
+	for (int i = 0; i < 512; i++)
+	{
+		l.LightPos = XMFLOAT3(RandomRange(-50, 50), RandomRange(-10, 10), RandomRange(-10, 90));
+		l.range = RandomRange(0.2f, 6);
+		lights.push_back(l);
+	}
+	l.LightPos = XMFLOAT3(5, -2, -5);
+	l.range = 20.0f;
+	lights.push_back(l);
+
+	XMMATRIX V = XMMatrixLookToLH(XMVectorSet(0, 1, -15, 1), XMVectorSet(0.3f, -0.1f, 1, 0), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX inverseV = XMMatrixInverse(0, V);
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, V);
+
+	// Just outside: pushed out from a face center, an edge's
+	// middle or a corner, along the normals that meet there
+	const unsigned int edgeLights = 768;
+	for (unsigned int i = 0; i < edgeLights; i++)
+	{
+		int x = rand() % CLUSTER_X, y = rand() % CLUSTER_Y, z = rand() % CLUSTER_Z;
+		XMVECTOR corners[8];
+		ClusterCorners(x, y, z, tanHalfFovX, tanHalfFovY, zNear, zFar, corners);
+
+		// The corner bits that are fixed pick the spot: one (a
+		// face), two (an edge) or all three (a corner)
+		int fixedBits = 1 + rand() % 3, mask = 0, bits = 0;
+		while (bits < fixedBits)
+		{
+			int bit = 1 << (rand() % 3);
+			if (!(mask & bit)) { mask |= bit; bits++; }
+		}
+		int side = rand() & mask;
+		XMVECTOR spot = XMVectorZero(), outward = XMVectorZero();
+		int count = 0;
+		for (int c = 0; c < 8; c++)
+			if ((c & mask) == side) { spot += corners[c]; count++; }
+		spot /= (float)count;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			XMVECTOR q[4];
+			if (mask & (1 << axis))
+				outward += PieceFace(corners, axis, (side >> axis) & 1, q);
+		}
+		outward = XMVector3Normalize(outward);
+
+		float size = XMVectorGetX(XMVector3Length(corners[7] - corners[0]));
+		l.range = size * RandomRange(0.05f, 2.0f);
+		XMVECTOR p = spot + outward * (l.range * 0.999f);
+		XMStoreFloat3(&l.LightPos, XMVector3TransformCoord(p, inverseV));
+		lights.push_back(l);
+	}
+
+	ClusterGrid* grid = new ClusterGrid();
+	grid->SetProjection(fovY, aspect, zNear, zFar);
+	grid->Assign(lights.data(), (unsigned int)lights.size(), view);
+
+	std::vector<XMVECTOR> centers(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+		centers[i] = XMVector3TransformCoord(XMLoadFloat3(&lights[i].LightPos), V);
+
+	unsigned int missing = 0, missingEdge = 0, extra = 0, touching = 0;
+	std::vector<bool> listed(lights.size());
+	for (int z = 0; z < CLUSTER_Z; z++)
+		for (int y = 0; y < CLUSTER_Y; y++)
+			for (int x = 0; x < CLUSTER_X; x++)
+			{
+				const ClusterRange& range = grid->GetRanges()[x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y];
+				std::fill(listed.begin(), listed.end(), false);
+				for (unsigned int i = 0; i < range.Count; i++)
+					listed[grid->GetIndices()[range.Offset + i]] = true;
+
+				XMVECTOR corners[8];
+				ClusterCorners(x, y, z, tanHalfFovX, tanHalfFovY, zNear, zFar, corners);
+				for (size_t i = 0; i < lights.size(); i++)
+				{
+					float r = lights[i].range;
+					float d = DistanceToPiece(centers[i], corners);
+					// A hair of slack for float rounding either way
+					if (d < r * 0.9999f)
+					{
+						touching++;
+						if (!listed[i])
+						{
+							missing++;
+							if (i >= lights.size() - edgeLights) missingEdge++;
+						}
+					}
+					else if (listed[i] && d > r * 1.0001f) extra++;
+				}
+			}
+
+	printf("\nCluster assignment vs. brute force (%u lights, %u placed just outside clusters)\n",
+		(unsigned int)lights.size(), edgeLights);
+	printf("  %u light/cluster pairs touch, %u missing (%u of them edge lights), %u dropped  %s\n", touching, missing,
+		missingEdge, grid->GetDroppedIndices(), CheckResult(missing == 0 && grid->GetDroppedIndices() == 0));
+	printf("  %u extra pairs from the boxes being bigger than the clusters (%.1f%%)\n", extra,
+		100.0 * extra / (touching + extra));
+
+	delete grid;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include "Light.h"
+
+// --------------------------------------------------------
+// Clustered light assignment
+//
+// The view frustum is cut into CLUSTER_X x CLUSTER_Y screen
+// tiles and CLUSTER_Z depth slices.  Slices are spaced
+// exponentially between the near and far planes, so clusters
+// stay roughly cube shaped at every distance.
+//
+// Each point/spot light's bounding sphere is tested against
+// the clusters it can touch, and every cluster ends up with a
+// compact list of the lights that reach it:
+//
+//   Ranges[cluster] = (offset, count) into Indices
+//
+// No device is needed here - ClusteredLighting uploads the
+// results, and ClusteredLighting.hlsli does the shading.
+// --------------------------------------------------------
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Capacity of the GPU buffers
+#define CLUSTER_MAX_LIGHTS 4096
+#define CLUSTER_MAX_INDICES (CLUSTER_COUNT * 64)
+
+// Where a cluster's lights are in the index list
+struct ClusterRange
+{
+	unsigned int Offset;
+	unsigned int Count;
+};
+
+// View space box around one cluster
+struct ClusterBounds
+{
+	XMFLOAT3 Min;
+	XMFLOAT3 Max;
+};
+
+class ClusterGrid
+{
+public:
+	ClusterGrid();
+
+	// Rebuilds the cluster boxes (left handed perspective, like Camera)
+	void SetProjection(float fovY, float aspect, float zNear, float zFar);
+
+	// Bins the lights.  view is the world -> view matrix (not transposed)
+	// - Lights past CLUSTER_MAX_LIGHTS are ignored, and clusters are
+	//   cut short once the list hits CLUSTER_MAX_INDICES
+	void Assign(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view);
+
+	// Results of the last Assign
+	const ClusterRange* GetRanges() { return ranges; }
+	const unsigned int* GetIndices() { return indices.data(); }
+	unsigned int GetIndexCount() { return (unsigned int)indices.size(); }
+	unsigned int GetMaxClusterLights() { return maxClusterLights; }
+	unsigned int GetDroppedIndices() { return droppedIndices; }
+
+	// Depth slice for a view space depth:
+	//   slice = log(z) * scale + bias
+	float GetSliceScale() { return sliceScale; }
+	float GetSliceBias() { return sliceBias; }
+	int GetSlice(float viewZ);
+
+	const ClusterBounds& GetBounds(int x, int y, int z) { return bounds[x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y]; }
+
+private:
+	ClusterBounds bounds[CLUSTER_COUNT];
+	float tanHalfFovX;
+	float tanHalfFovY;
+	float zNear;
+	float zFar;
+	float sliceScale;
+	float sliceBias;
+
+	ClusterRange ranges[CLUSTER_COUNT];
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> pairs; // (cluster << 16) | light, reused between frames
+	unsigned int maxClusterLights;
+	unsigned int droppedIndices;
+};
+
+// Times Assign() on a random field of point and spot lights
+// (half each) and prints the per-frame cost and list stats
+void ClusterBenchmark(unsigned int lightCount, unsigned int iterations);
+
+// Checks Assign never misses a light that touches a cluster,
+// against a brute force test of every light and cluster
+void ClusterReferenceReport();
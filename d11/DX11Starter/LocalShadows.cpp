@@ -0,0 +1,206 @@
+#include "LocalShadows.h"
+#include "Profiler.h"
+#include <cstring>
+
+// What LocalShadows.hlsli reads per view
+struct LocalShadowGPU
+{
+	XMFLOAT4X4 ViewProj;   // Transposed for HLSL
+	XMFLOAT4 UVRect;       // Corner and size in atlas UVs
+};
+
+LocalShadows::LocalShadows(ID3D11Device* device, ID3D11DeviceContext* context, unsigned int size)
+	: atlas(size)
+{
+	this->context = context;
+	this->size = size;
+
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = size;
+	td.Height = size;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_R32_TYPELESS;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&td, 0, &texture);
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(texture, &dsvDesc, &dsv);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(texture, &srvDesc, &srv);
+
+	// The shader keeps lookups inside their tile, so clamp is fine
+	D3D11_SAMPLER_DESC sd = {};
+	sd.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+	sd.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+	sd.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&sd, &sampler);
+
+	D3D11_RASTERIZER_DESC rd = {};
+	rd.FillMode = D3D11_FILL_SOLID;
+	rd.CullMode = D3D11_CULL_BACK;
+	rd.DepthBias = 100;
+	rd.SlopeScaledDepthBias = 2.0f;
+	rd.DepthClipEnable = true;
+	device->CreateRasterizerState(&rd, &rasterState);
+
+	// Tiles are cleared by drawing the far plane over them, since
+	// a depth clear can't be limited to part of the texture
+	D3D11_DEPTH_STENCIL_DESC dd = {};
+	dd.DepthEnable = true;
+	dd.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	dd.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	device->CreateDepthStencilState(&dd, &clearState);
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.ByteWidth = sizeof(LocalShadowGPU) * SHADOW_ATLAS_MAX_VIEWS;
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bd.StructureByteStride = sizeof(LocalShadowGPU);
+	device->CreateBuffer(&bd, 0, &viewBuffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewSrvDesc = {};
+	viewSrvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	viewSrvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewSrvDesc.Buffer.FirstElement = 0;
+	viewSrvDesc.Buffer.NumElements = SHADOW_ATLAS_MAX_VIEWS;
+	device->CreateShaderResourceView(viewBuffer, &viewSrvDesc, &viewSRV);
+
+	depthVS = new SimpleVertexShader(device, context);
+	depthVS->LoadShaderFile(L"ShadowDepthVS.cso");
+	clearVS = new SimpleVertexShader(device, context);
+	clearVS->LoadShaderFile(L"ShadowClearVS.cso");
+}
+
+LocalShadows::~LocalShadows()
+{
+	if (dsv) dsv->Release();
+	if (srv) srv->Release();
+	if (texture) texture->Release();
+	if (sampler) sampler->Release();
+	if (rasterState) rasterState->Release();
+	if (clearState) clearState->Release();
+	if (viewSRV) viewSRV->Release();
+	if (viewBuffer) viewBuffer->Release();
+	delete depthVS;
+	delete clearVS;
+}
+
+void LocalShadows::Update(std::vector<LocalLight>& lights, const std::vector<Entity*>& entities, const XMFLOAT4X4& view,
+	float fovY, unsigned int screenHeight)
+{
+	PROFILE_ZONE("LocalShadows::Update");
+
+	casters.resize(entities.size());
+	for (size_t i = 0; i < entities.size(); i++)
+		entities[i]->GetBoundingSphere(&casters[i].Center, &casters[i].Radius);
+
+	atlas.Update(lights.data(), (unsigned int)lights.size(), casters.data(), (unsigned int)casters.size(),
+		view, fovY, screenHeight);
+
+	const std::vector<ShadowView>& views = atlas.GetViews();
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(context->Map(viewBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	LocalShadowGPU* gpuViews = (LocalShadowGPU*)mapped.pData;
+	for (size_t v = 0; v < views.size(); v++)
+	{
+		const AtlasTile& t = views[v].Tile;
+		XMStoreFloat4x4(&gpuViews[v].ViewProj, XMMatrixTranspose(XMLoadFloat4x4(&views[v].ViewProj)));
+		gpuViews[v].UVRect = XMFLOAT4((float)t.X / size, (float)t.Y / size, (float)t.Size / size, (float)t.Size / size);
+	}
+	context->Unmap(viewBuffer, 0);
+}
+
+// --------------------------------------------------------
+// Clears and redraws the dirty tiles.  The clean ones still
+// hold what they were last drawn with.
+// --------------------------------------------------------
+void LocalShadows::Render(const std::vector<Entity*>& entities)
+{
+	// Last frame's lit shaders may still have the atlas bound
+	ID3D11ShaderResourceView* none = 0;
+	context->PSSetShaderResources(LOCAL_SHADOW_ATLAS_SLOT, 1, &none);
+
+	const std::vector<ShadowView>& views = atlas.GetViews();
+	if (atlas.GetDirtyViewCount() == 0)
+		return;
+
+	UINT viewportCount = 1;
+	D3D11_VIEWPORT oldViewport;
+	context->RSGetViewports(&viewportCount, &oldViewport);
+
+	context->OMSetRenderTargets(0, 0, dsv);
+	context->RSSetState(rasterState);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->PSSetShader(0, 0, 0);
+
+	UINT stride = sizeof(XMFLOAT3);
+	UINT offset = 0;
+	for (unsigned int v = 0; v < views.size(); v++)
+	{
+		if (!views[v].Dirty) continue;
+
+		D3D11_VIEWPORT viewport = {};
+		viewport.TopLeftX = (float)views[v].Tile.X;
+		viewport.TopLeftY = (float)views[v].Tile.Y;
+		viewport.Width = (float)views[v].Tile.Size;
+		viewport.Height = (float)views[v].Tile.Size;
+		viewport.MaxDepth = 1.0f;
+		context->RSSetViewports(1, &viewport);
+
+		// Clear just this tile
+		ID3D11Buffer* nothing = 0;
+		UINT zero = 0;
+		context->IASetVertexBuffers(0, 1, &nothing, &zero, &zero);
+		context->OMSetDepthStencilState(clearState, 0);
+		clearVS->SetShader();
+		context->Draw(3, 0);
+		context->OMSetDepthStencilState(0, 0);
+
+		depthVS->SetShader();
+		XMMATRIX viewProj = XMLoadFloat4x4(&views[v].ViewProj);
+		for (unsigned int c : atlas.GetViewCasters(v))
+		{
+			Entity* e = entities[c];
+			Mesh* mesh = e->GetMesh();
+
+			// Entity matrices are stored transposed for HLSL
+			XMFLOAT4X4 world = e->GetMatrix();
+			XMFLOAT4X4 worldViewProj;
+			XMStoreFloat4x4(&worldViewProj,
+				XMMatrixTranspose(XMMatrixTranspose(XMLoadFloat4x4(&world)) * viewProj));
+			depthVS->SetMatrix4x4("worldViewProj", worldViewProj);
+			depthVS->CopyAllBufferData();
+
+			ID3D11Buffer* positions = mesh->GetPositionBuffer();
+			context->IASetVertexBuffers(0, 1, &positions, &stride, &offset);
+			context->IASetIndexBuffer(mesh->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
+			context->DrawIndexed(mesh->GetIndexCount(), 0, 0);
+		}
+	}
+
+	context->RSSetViewports(1, &oldViewport);
+	context->RSSetState(0);
+}
+
+void LocalShadows::Bind(SimplePixelShader* ps)
+{
+	ps->SetShaderResourceView("LocalShadows", viewSRV);
+	ps->SetShaderResourceView("LocalShadowAtlas", srv);
+	ps->SetSamplerState("LocalShadowSampler", sampler);
+}
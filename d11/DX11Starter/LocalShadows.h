@@ -0,0 +1,68 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include "SimpleShader.h"
+#include "Entity.h"
+#include "ShadowAtlas.h"
+
+// --------------------------------------------------------
+// Shadows for the point and spot lights
+//
+// - ShadowAtlas decides each light's tiles and which ones are
+//   out of date; only those are cleared and redrawn, the rest
+//   keep last frame's depth
+// - Tiles are drawn from the meshes' position-only streams
+//   with no pixel shader, like the cascades
+// - Lit pixel shaders get LocalShadows.hlsli through
+//   ClusteredLighting.hlsli, and Bind() sets its atlas, sampler
+//   and the per-view matrices
+// --------------------------------------------------------
+
+// Keep in sync with LocalShadows.hlsli
+#define LOCAL_SHADOW_BUFFER_SLOT 7
+#define LOCAL_SHADOW_ATLAS_SLOT 8
+
+class LocalShadows
+{
+public:
+	LocalShadows(ID3D11Device* device, ID3D11DeviceContext* context, unsigned int size = SHADOW_ATLAS_SIZE);
+	~LocalShadows();
+
+	// Places every light's tiles and works out which to redraw.
+	// Sets the lights' shadow indices, so call it before the
+	// lights are uploaded.
+	// - view is the world -> view matrix (not transposed)
+	void Update(std::vector<LocalLight>& lights, const std::vector<Entity*>& entities, const XMFLOAT4X4& view,
+		float fovY, unsigned int screenHeight);
+
+	// Draws the out of date tiles (same entities as the last Update)
+	void Render(const std::vector<Entity*>& entities);
+
+	// Sets the atlas and view buffer on a lit pixel shader
+	void Bind(SimplePixelShader* ps);
+
+	ID3D11ShaderResourceView* GetSRV() { return srv; }
+	unsigned int GetSize() { return size; }
+	ShadowAtlas* GetAtlas() { return &atlas; }
+
+private:
+	ID3D11DeviceContext* context;
+	unsigned int size;
+
+	ShadowAtlas atlas;
+	std::vector<ShadowCaster> casters;
+
+	ID3D11Texture2D* texture;
+	ID3D11DepthStencilView* dsv;
+	ID3D11ShaderResourceView* srv;
+	ID3D11SamplerState* sampler;           // Comparison, for PCF
+	ID3D11RasterizerState* rasterState;    // Slope bias
+	ID3D11DepthStencilState* clearState;   // Always passes, writes depth
+
+	// One LocalShadow (matrix + atlas rect) per view
+	ID3D11Buffer* viewBuffer;
+	ID3D11ShaderResourceView* viewSRV;
+
+	SimpleVertexShader* depthVS;
+	SimpleVertexShader* clearVS;   // Far plane over the whole viewport
+};
@@ -0,0 +1,66 @@
+//shadows for the point and spot lights, all in one atlas
+//(see ShadowAtlas.h for how tiles are placed and cached)
+#ifndef LOCAL_SHADOWS
+#define LOCAL_SHADOWS
+
+struct LocalShadow
+{
+	matrix viewProj;  //world --> tile clip space
+	float4 uvRect;    //tile's corner and size in atlas UVs
+};
+
+StructuredBuffer<LocalShadow> LocalShadows : register(t7);  //LOCAL_SHADOW_BUFFER_SLOT
+Texture2D LocalShadowAtlas : register(t8);                  //LOCAL_SHADOW_ATLAS_SLOT
+SamplerComparisonState LocalShadowSampler : register(s2);
+
+//1 = lit, 0 = fully in shadow
+//first is the light's first view (-1 = no shadow), point
+//lights have six: +X, -X, +Y, -Y, +Z, -Z
+float LocalShadowFactor(int first, bool isPoint, float3 lightPos, float3 worldPos, float3 N)
+{
+	if (first < 0)
+		return 1;
+
+	float3 toPixel = worldPos - lightPos;
+	int view = first;
+	if (isPoint)
+	{
+		float3 a = abs(toPixel);
+		if (a.x >= a.y && a.x >= a.z)
+			view += toPixel.x < 0 ? 1 : 0;
+		else if (a.y >= a.z)
+			view += toPixel.y < 0 ? 3 : 2;
+		else
+			view += toPixel.z < 0 ? 5 : 4;
+	}
+	LocalShadow s = LocalShadows[view];
+
+	float atlasSize, unused;
+	LocalShadowAtlas.GetDimensions(atlasSize, unused);
+	float tileTexels = s.uvRect.z * atlasSize;
+
+	//a texel covers about 2 * distance / tileTexels here, move
+	//the lookup along the normal by that much
+	float texelWorld = 2 * length(toPixel) / tileTexels;
+	float4 shadowPos = mul(float4(worldPos + N * texelWorld * 1.5, 1), s.viewProj);
+	if (shadowPos.w <= 0)
+		return 1;
+	shadowPos.xyz /= shadowPos.w;
+	if (any(abs(shadowPos.xy) > 1) || shadowPos.z > 1)
+		return 1;
+
+	//2x2 bilinear comparisons, each kept half a texel inside
+	//the tile so filtering never reads a neighbor's depth
+	float2 uv = shadowPos.xy * float2(0.5, -0.5) + 0.5;
+	float texel = 1 / tileTexels;
+	float lit = 0;
+	[unroll]
+	for (int i = 0; i < 4; i++)
+	{
+		float2 tap = clamp(uv + (float2(i & 1, i >> 1) - 0.5) * texel, 0.5 * texel, 1 - 0.5 * texel);
+		lit += LocalShadowAtlas.SampleCmpLevelZero(LocalShadowSampler, s.uvRect.xy + tap * s.uvRect.zw, shadowPos.z);
+	}
+	return lit / 4;
+}
+
+#endif
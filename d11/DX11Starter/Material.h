@@ -1,5 +1,62 @@
 #pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <utility>
 #include "SimpleShader.h"
+#include "TextureArrays.h"
+
+//what a material's pixel shader does, one bit each
+//keep in sync with MaterialPS.hlsli
+enum MaterialFeature
+{
+	MATERIAL_NORMAL_MAP      = 1,   //tangent space normal map in t1
+	MATERIAL_LOCAL_LIGHTS    = 2,   //clustered point and spot lights
+	MATERIAL_SHADOWS         = 4,   //directional light cascades
+	MATERIAL_DIFFUSE_BLUR    = 8,   //blurred diffuse map
+	MATERIAL_VIRTUAL_TEXTURE = 16,  //albedo from the virtual texture
+	MATERIAL_UNLIT           = 32   //flat color, nothing else
+};
+
+//register of the materialData block
+#define MATERIAL_CB_SLOT 4
+
+//materialData in MaterialPS.hlsli, 16 byte aligned
+struct MaterialParams
+{
+	DirectX::XMFLOAT4 Color;   //MATERIAL_UNLIT's color
+	float Shininess;
+	float BlurDistance;        //MATERIAL_DIFFUSE_BLUR's tap spacing, in uv
+	int DiffuseSlice;          //slice in the diffuse map's array, -1 = not loaded yet
+	int NormalSlice;
+	float DiffuseMinMip;       //finest level of the slice that isn't stale
+	float NormalMinMip;
+	float Pad[2];
+};
+
+// --------------------------------------------------------
+// One pixel shader per feature mask, loaded the first time
+// a material asks for it.  MaterialPS_XX.cso (XX = the mask
+// in hex) is built from MaterialPS.hlsli, so a new
+// combination needs its own MaterialPS_XX.hlsl.
+// --------------------------------------------------------
+class MaterialShaders
+{
+public:
+	MaterialShaders(ID3D11Device* device, ID3D11DeviceContext* context);
+	~MaterialShaders();
+
+	//0 if that permutation wasn't built
+	SimplePixelShader* Get(unsigned int features);
+
+	//every permutation loaded so far, for the per frame data
+	const std::vector<SimplePixelShader*>& GetLoaded() { return loaded; }
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	std::vector<std::pair<unsigned int, SimplePixelShader*>> shaders;
+	std::vector<SimplePixelShader*> loaded;
+};
 
 //represents a set of vertex and pixel shaders
 //needed to be updated in Entity
@@ -13,24 +70,48 @@ public:
 	~Material();
 	//material only has a color as output
 	Material(SimpleVertexShader* v, SimplePixelShader* p);
-	//w/ diffuse map
-	Material(SimpleVertexShader* v, SimplePixelShader* p, ID3D11ShaderResourceView* srv, ID3D11SamplerState* s);
-	//w/ diffuse & normal maps
-	Material(SimpleVertexShader* v, SimplePixelShader* p, ID3D11ShaderResourceView* srv, ID3D11ShaderResourceView* srvN, ID3D11SamplerState* s);
-
+	//permutation of MaterialPS, params uploaded once to their own constant buffer
+	//diffuse / normal are the caller's texture ids in arrays, -1 for none
+	Material(ID3D11Device* device, SimpleVertexShader* v, MaterialShaders* shaders, unsigned int features,
+		const MaterialParams& params, TextureArrays* arrays = 0, int diffuse = -1, int normal = -1,
+		ID3D11SamplerState* s = 0);
 
 	//getter
 	SimplePixelShader* getPixelShader() { return pShader; }
 	SimpleVertexShader* getVertexShader() { return vShader; }
-	ID3D11ShaderResourceView* getSRV() { return mySRV; }
-	ID3D11ShaderResourceView* getNormalSRV() { return myNormalSRV; }
 	ID3D11SamplerState* getSampler() { return sampler; }
-	//setter
-	void setSRV(ID3D11ShaderResourceView* t) { myNormalSRV = t; }
+	const MaterialParams& GetParams() { return params; }
+	unsigned int GetFeatures() { return features; }
+	int GetDiffuseTexture() { return diffuseTexture; }
+	int GetNormalTexture() { return normalTexture; }
+	ID3D11ShaderResourceView* GetDiffuseArray() { return diffuseArray >= 0 ? arrays->GetSRV(diffuseArray) : 0; }
+	ID3D11ShaderResourceView* GetNormalArray() { return normalArray >= 0 ? arrays->GetSRV(normalArray) : 0; }
+	//uploads the block again, only when it actually changed
+	void SetParams(ID3D11DeviceContext* context, const MaterialParams& p);
+	//picks up where the arrays put its textures (they move in
+	//once loaded, and their first mip changes as they stream)
+	void UpdateTextures(ID3D11DeviceContext* context);
+
+	//texture arrays, sampler, materialData and the pixel shader
+	void Bind();
+	//just the texture arrays, into another shader with the same names
+	void BindTextures(SimplePixelShader* ps);
 
 	//texture related
-	ID3D11ShaderResourceView* mySRV;
-	ID3D11ShaderResourceView* myNormalSRV;
 	ID3D11SamplerState* sampler;
+
+private:
+	MaterialParams params;
+	unsigned int features;
+	ID3D11Buffer* paramBuffer;   //0 for the hand written shaders
+
+	TextureArrays* arrays;
+	int diffuseTexture;
+	int normalTexture;
+	int diffuseArray;            //array each is in, -1 until placed
+	int normalArray;
 };
 
+//times binding two materials back and forth, the old way (every
+//parameter by name, every buffer uploaded) against Bind()
+void MaterialBindBenchmark(Material* a, Material* b, unsigned int binds);
@@ -0,0 +1,173 @@
+//forward pixel shader for every material, one permutation per
+//feature mask - MaterialPS_XX.hlsl defines MATERIAL_FEATURES
+//(XX in hex) and includes this.  Keep the bits in sync with
+//MaterialFeature in Material.h.
+#ifndef MATERIAL_FEATURES
+#define MATERIAL_FEATURES 0
+#endif
+
+#define MATERIAL_NORMAL_MAP      ((MATERIAL_FEATURES & 1) != 0)   //tangent space normal map in t1
+#define MATERIAL_LOCAL_LIGHTS    ((MATERIAL_FEATURES & 2) != 0)   //clustered point and spot lights
+#define MATERIAL_SHADOWS         ((MATERIAL_FEATURES & 4) != 0)   //directional light cascades
+#define MATERIAL_DIFFUSE_BLUR    ((MATERIAL_FEATURES & 8) != 0)   //13 tap blur of the diffuse map
+#define MATERIAL_VIRTUAL_TEXTURE ((MATERIAL_FEATURES & 16) != 0)  //albedo from the virtual texture
+#define MATERIAL_UNLIT           ((MATERIAL_FEATURES & 32) != 0)  //flat color, nothing else
+
+// Struct representing the data we expect to receive from earlier pipeline stages
+// - Should match the output of our corresponding vertex shader
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD;
+	float3 normal       : NORMAL;
+	float3 tangent      : TANGENT;
+	float3 worldPos     : POSITION;
+	float depth         : DEPTH;        //depth in view space
+};
+
+//direction light struct
+struct DirectionalLight
+{
+	float4 AmbientColor;
+	float4 DiffuseColor;
+	float3 Direction;
+	float pad;
+};
+
+#if MATERIAL_LOCAL_LIGHTS
+#include "ClusteredLighting.hlsli"
+#endif
+#if MATERIAL_SHADOWS
+#include "Shadows.hlsli"
+#endif
+#if MATERIAL_VIRTUAL_TEXTURE
+#include "VirtualTexture.hlsli"
+#endif
+#include "TextureArrays.hlsli"
+#include "SkyLighting.hlsli"
+
+//per frame, set on every permutation (Game::DrawScene)
+cbuffer externalData : register(b0)
+{
+	DirectionalLight light;
+
+	//the camera
+	float3 camPos;
+};
+
+//per material, uploaded once (MaterialParams in Material.h)
+cbuffer materialData : register(b4)
+{
+	float4 materialColor;   //MATERIAL_UNLIT's color
+	float shininess;
+	float blurDistance;     //MATERIAL_DIFFUSE_BLUR's tap spacing, in uv
+	int diffuseSlice;       //slice in diffuseMap, -1 = not loaded yet
+	int normalSlice;        //slice in normalMap, -1 = not loaded yet
+	float diffuseMinMip;    //finest level of those slices that's resident
+	float normalMinMip;
+	float2 materialPad;
+};
+
+//textures, one slice each (TextureArrays.hlsli)
+Texture2DArray diffuseMap : register(t0);
+Texture2DArray normalMap: register(t1);
+SamplerState basicSampler : register(s0);
+
+struct PixelOut
+{
+	float4 color    : SV_TARGET0;
+};
+
+//one tap of the diffuse map's slice
+float4 Diffuse(float2 uv)
+{
+	return SampleSlice(diffuseMap, basicSampler, uv, diffuseSlice, diffuseMinMip);
+}
+
+float4 DiffuseColor(float2 uv)
+{
+#if MATERIAL_VIRTUAL_TEXTURE
+	//albedo from whichever virtual texture pages are resident
+	return VirtualSample(uv);
+#elif MATERIAL_DIFFUSE_BLUR
+	if (diffuseSlice < 0)
+		return 0.5;
+	float bDis = blurDistance;
+	float4 blurColor = Diffuse(uv);
+	blurColor += Diffuse(float2(uv.x - bDis, uv.y)) * 0.8f;
+	blurColor += Diffuse(float2(uv.x + bDis, uv.y)) * 0.8f;
+	blurColor += Diffuse(float2(uv.x, uv.y + bDis)) * 0.8f;
+	blurColor += Diffuse(float2(uv.x, uv.y - bDis)) * 0.8f;
+	blurColor += Diffuse(float2(uv.x - bDis, uv.y - bDis)) * 0.3f;
+	blurColor += Diffuse(float2(uv.x - bDis, uv.y + bDis)) * 0.3f;
+	blurColor += Diffuse(float2(uv.x + bDis, uv.y + bDis)) * 0.3f;
+	blurColor += Diffuse(float2(uv.x + bDis, uv.y - bDis)) * 0.3f;
+	blurColor += Diffuse(float2(uv.x, uv.y - 2 * bDis)) * 0.1f;
+	blurColor += Diffuse(float2(uv.x, uv.y + 2 * bDis)) * 0.1f;
+	blurColor += Diffuse(float2(uv.x + 2 * bDis, uv.y)) * 0.1f;
+	blurColor += Diffuse(float2(uv.x - 2 * bDis, uv.y)) * 0.1f;
+	return blurColor / (1 + 0.8f * 4 + 0.3f * 4 + 0.1f * 4);
+#else
+	//gray until the texture is in its array, like the streamer's placeholder
+	return diffuseSlice < 0 ? 0.5 : Diffuse(uv);
+#endif
+}
+
+// --------------------------------------------------------
+// The entry point (main method) for our pixel shader
+// --------------------------------------------------------
+PixelOut main(VertexToPixel input)
+{
+	PixelOut output;
+
+#if MATERIAL_UNLIT
+	//light markers, alpha 0 so they always bloom
+	output.color = float4(materialColor.rgb, 0);
+	return output;
+#else
+	//inputs
+	float3 N = normalize(input.normal);
+
+	//shadows use the surface's own normal, not the mapped one
+#if MATERIAL_SHADOWS
+	float shadow = ShadowFactor(input.worldPos, N, input.depth);
+#else
+	float shadow = 1;
+#endif
+
+#if MATERIAL_NORMAL_MAP
+	//normal mapping, the flat normal until the map is loaded
+	if (normalSlice >= 0)
+	{
+		float3 normalFromMap = SampleNormalSlice(normalMap, basicSampler, input.uv, normalSlice, normalMinMip);
+
+		//TBN matrix
+		float3 tangent = normalize(input.tangent);
+		float3 T = normalize(tangent - N * dot(tangent, N));
+		float3 B = cross(T, N);
+		float3x3 TBN = float3x3(T, B, N);
+		N = normalize(mul(normalFromMap, TBN));
+	}
+#endif
+
+	//directional light calculation, the sky's SH for ambient
+	float3 lightDir = normalize(-light.Direction);
+	float totalLight = saturate(dot(N, lightDir));
+	float4 color1 = light.DiffuseColor * totalLight * shadow + float4(SkyDiffuse(N), 0);
+
+	//point and spot lights, only the ones that reach this pixel's cluster
+#if MATERIAL_LOCAL_LIGHTS
+	float3 localLight = ClusteredLights(N, input.worldPos, camPos, input.position.xy, input.depth, shininess);
+#else
+	float3 localLight = 0;
+#endif
+
+	//the sky's reflection, on top of the albedo
+	float3 V = normalize(camPos - input.worldPos);
+	float3 skySpecular = SkySpecularLight(N, V, shininess);
+
+	float4 textureColor = DiffuseColor(input.uv);
+	output.color = float4(textureColor.rgb * (color1.rgb + localLight) + skySpecular, 1);
+	return output;
+#endif
+}
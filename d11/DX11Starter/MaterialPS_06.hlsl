@@ -0,0 +1,3 @@
+//permutation 0x06: local lights, shadows - the trees
+#define MATERIAL_FEATURES 0x06
+#include "MaterialPS.hlsli"
@@ -0,0 +1,3 @@
+//permutation 0x07: normal map, local lights, shadows - the rock
+#define MATERIAL_FEATURES 0x07
+#include "MaterialPS.hlsli"
@@ -0,0 +1,3 @@
+//permutation 0x0B: normal map, local lights, diffuse blur
+#define MATERIAL_FEATURES 0x0B
+#include "MaterialPS.hlsli"
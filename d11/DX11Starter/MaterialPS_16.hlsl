@@ -0,0 +1,3 @@
+//permutation 0x16: local lights, shadows, virtual texture - the ground
+#define MATERIAL_FEATURES 0x16
+#include "MaterialPS.hlsli"
@@ -0,0 +1,3 @@
+//permutation 0x20: unlit - the light markers
+#define MATERIAL_FEATURES 0x20
+#include "MaterialPS.hlsli"
@@ -1,4 +1,5 @@
 #include "Mesh.h"
+#include <cfloat>
 
 
 Mesh::Mesh(Vertex vert[], int vertC, //vertex
@@ -15,6 +16,8 @@ Mesh::Mesh(Vertex vert[], int vertC, //vertex
 
 Mesh::Mesh(char * filename, ID3D11Device* device)
 {
+	PROFILE_ZONE("Mesh::Load");
+
 	d = device;
 	// File input object
 	std::ifstream obj(filename);
@@ -190,6 +193,7 @@ Mesh::~Mesh()
 {
 	if (vertexBuffer) { vertexBuffer->Release(); }
 	if (indexBuffer) { indexBuffer->Release(); } 
+	if (positionBuffer) { positionBuffer->Release(); }
 }
 
 ID3D11Buffer * Mesh::GetVertexBuffer()
@@ -197,6 +201,11 @@ ID3D11Buffer * Mesh::GetVertexBuffer()
 	return vertexBuffer;
 }
 
+ID3D11Buffer * Mesh::GetPositionBuffer()
+{
+	return positionBuffer;
+}
+
 ID3D11Buffer * Mesh::GetIndexBuffer()
 {
 	return indexBuffer;
@@ -286,6 +295,7 @@ void Mesh::Init()
 	//initialize 
 	vertexBuffer = 0;
 	indexBuffer = 0;
+	positionBuffer = 0;
 
 	//create the Vertex Buffer description
 	// - The description is created on the stack because we only need
@@ -327,4 +337,35 @@ void Mesh::Init()
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
 	d->CreateBuffer(&ibd, &initialIndexData, &indexBuffer);
 
+	// Position-only stream for the depth pre-pass ---------------------------
+	// - 12 bytes a vertex instead of 44, so the pre-pass fetches a
+	//    quarter of the data.  The index buffer is shared.
+	std::vector<XMFLOAT3> positions(vertCount);
+	for (int i = 0; i < vertCount; i++)
+		positions[i] = vertices[i].Position;
+
+	// Bounding sphere around the box, for culling
+	XMVECTOR minPos = XMVectorSet(FLT_MAX, FLT_MAX, FLT_MAX, 0);
+	XMVECTOR maxPos = XMVectorSet(-FLT_MAX, -FLT_MAX, -FLT_MAX, 0);
+	for (int i = 0; i < vertCount; i++)
+	{
+		minPos = XMVectorMin(minPos, XMLoadFloat3(&positions[i]));
+		maxPos = XMVectorMax(maxPos, XMLoadFloat3(&positions[i]));
+	}
+	XMVECTOR center = (minPos + maxPos) * 0.5f;
+	float radiusSq = 0;
+	for (int i = 0; i < vertCount; i++)
+	{
+		float distSq = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&positions[i]) - center));
+		if (distSq > radiusSq) radiusSq = distSq;
+	}
+	XMStoreFloat3(&boundsCenter, center);
+	boundsRadius = sqrtf(radiusSq);
+
+	D3D11_BUFFER_DESC pbd = vbd;
+	pbd.ByteWidth = sizeof(XMFLOAT3) * vertCount;
+
+	D3D11_SUBRESOURCE_DATA initialPositionData;
+	initialPositionData.pSysMem = positions.data();
+	d->CreateBuffer(&pbd, &initialPositionData, &positionBuffer);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Vertex.h"
+#include "Profiler.h"
 #include <DirectXMath.h>
 #include <d3d11.h>
 #include <iostream>
@@ -30,17 +31,25 @@ public:
 	//geter
 	ID3D11Buffer* GetVertexBuffer();
 	ID3D11Buffer* GetIndexBuffer();
+	ID3D11Buffer* GetPositionBuffer(); //positions only, for depth-only passes
 	int GetIndexCount();
+	//bounding sphere in model space
+	XMFLOAT3 GetBoundsCenter() { return boundsCenter; }
+	float GetBoundsRadius() { return boundsRadius; }
 
 private:
 	//buffers
 	// Buffers to hold actual geometry data
 	ID3D11Buffer* vertexBuffer;
 	ID3D11Buffer* indexBuffer;
+	ID3D11Buffer* positionBuffer; //XMFLOAT3 per vertex, same order as vertexBuffer
 
 	int vertCount; // how many indices are in the index buffer
 	int indCount;
 
+	XMFLOAT3 boundsCenter; //center of the vertices' box
+	float boundsRadius;
+
 	ID3D11Device* d;
 	//functions
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
@@ -0,0 +1,295 @@
+#include "Profiler.h"
+#include "Check.h"
+
+#include <intrin.h>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+// Static data
+double Profiler::nsPerTick = 0.0;
+unsigned __int64 Profiler::epoch = 0;
+unsigned int Profiler::captureFramesLeft = 0;
+std::string Profiler::captureFile;
+
+namespace
+{
+	// How many recent samples each zone keeps for percentiles
+	const unsigned int SampleWindow = 256;
+
+	struct ZoneStats
+	{
+		float Samples[SampleWindow];	// Durations in ns
+		unsigned int Count;
+		unsigned int Next;
+	};
+
+	// All thread buffers ever created (only touched on registration/drain)
+	std::mutex registryLock;
+	std::vector<ProfileThreadBuffer*> threadBuffers;
+	unsigned int nextThreadID = 0;
+
+	thread_local ProfileThreadBuffer* localBuffer = 0;
+
+	// Owned by the main thread
+	std::unordered_map<std::string, ZoneStats> zoneStats;
+	std::vector<ProfileTraceEvent> capturedEvents;
+}
+
+// --------------------------------------------------------
+// Raw timestamp.  rdtsc is invariant on anything we'd run on,
+// and is a fraction of the cost of QueryPerformanceCounter.
+// --------------------------------------------------------
+unsigned __int64 Profiler::Now()
+{
+	return __rdtsc();
+}
+
+// --------------------------------------------------------
+// Works out how long a TSC tick is by comparing it against
+// the performance counter over a short interval
+// --------------------------------------------------------
+void Profiler::Init()
+{
+	__int64 perfFreq, qpcStart, qpcEnd;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&perfFreq);
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&qpcStart);
+	unsigned __int64 tscStart = __rdtsc();
+	Sleep(20);
+	QueryPerformanceCounter((LARGE_INTEGER*)&qpcEnd);
+	unsigned __int64 tscEnd = __rdtsc();
+
+	double seconds = (double)(qpcEnd - qpcStart) / (double)perfFreq;
+	nsPerTick = (seconds * 1e9) / (double)(tscEnd - tscStart);
+	epoch = tscEnd;
+
+	// Make sure the main thread has a buffer up front
+	GetThreadBuffer();
+}
+
+// --------------------------------------------------------
+// Frees every thread buffer.  Only call once other threads
+// have stopped recording zones.
+// --------------------------------------------------------
+void Profiler::Shutdown()
+{
+	std::lock_guard<std::mutex> lock(registryLock);
+	for (auto& b : threadBuffers) delete b;
+	threadBuffers.clear();
+	localBuffer = 0;
+}
+
+// --------------------------------------------------------
+// Gets (or creates) the calling thread's ring buffer
+// --------------------------------------------------------
+ProfileThreadBuffer* Profiler::GetThreadBuffer()
+{
+	if (localBuffer) return localBuffer;
+
+	ProfileThreadBuffer* b = new ProfileThreadBuffer();
+	b->Head = 0;
+	b->Tail = 0;
+	b->Depth = 0;
+	b->Dropped = 0;
+
+	std::lock_guard<std::mutex> lock(registryLock);
+	b->ThreadID = nextThreadID++;
+	threadBuffers.push_back(b);
+	localBuffer = b;
+	return b;
+}
+
+// --------------------------------------------------------
+// Pulls everything out of the thread buffers.  Called once
+// per frame from the main loop.
+// --------------------------------------------------------
+void Profiler::EndFrame()
+{
+	std::unique_lock<std::mutex> lock(registryLock);
+	for (auto& b : threadBuffers)
+	{
+		unsigned int tail = b->Tail.load(std::memory_order_relaxed);
+		unsigned int head = b->Head.load(std::memory_order_acquire);
+		for (; tail != head; tail++)
+		{
+			const ProfileEvent& e = b->Events[tail & (ProfileThreadBuffer::Capacity - 1)];
+			double duration = TicksToNs(e.End - e.Start);
+			RecordSample(e.Name, duration);
+
+			if (captureFramesLeft > 0)
+			{
+				ProfileTraceEvent t;
+				t.Name = e.Name;
+				t.StartNs = TicksToNs(e.Start - epoch);
+				t.DurationNs = duration;
+				t.ThreadID = b->ThreadID;
+				t.Depth = e.Depth;
+				capturedEvents.push_back(t);
+			}
+		}
+		b->Tail.store(tail, std::memory_order_release);
+	}
+	lock.unlock();
+
+	// Finished a capture?  (PrintSummary takes the lock itself)
+	if (captureFramesLeft > 0 && --captureFramesLeft == 0)
+	{
+		WriteChromeTrace();
+		PrintSummary();
+	}
+}
+
+// --------------------------------------------------------
+// Adds a sample to a zone's rolling window
+// --------------------------------------------------------
+void Profiler::RecordSample(const char* name, double durationNs)
+{
+	ZoneStats& s = zoneStats[name];
+	s.Samples[s.Next] = (float)durationNs;
+	s.Next = (s.Next + 1) % SampleWindow;
+	if (s.Count < SampleWindow) s.Count++;
+}
+
+// --------------------------------------------------------
+// External timings (e.g. GPU passes) go straight into the
+// stats and capture, on their own track
+// --------------------------------------------------------
+void Profiler::AddExternalEvent(const char* name, double startNs, double durationNs, unsigned int trackID)
+{
+	RecordSample(name, durationNs);
+	if (captureFramesLeft == 0) return;
+
+	ProfileTraceEvent t;
+	t.Name = name;
+	t.StartNs = startNs;
+	t.DurationNs = durationNs;
+	t.ThreadID = ExternalTrackBase + trackID;
+	t.Depth = 0;
+	capturedEvents.push_back(t);
+}
+
+// --------------------------------------------------------
+// Starts recording trace events for the next few frames
+// --------------------------------------------------------
+void Profiler::BeginCapture(unsigned int frameCount, const char* fileName)
+{
+	if (captureFramesLeft > 0) return;
+	capturedEvents.clear();
+	captureFile = fileName;
+	captureFramesLeft = frameCount;
+	printf("\nProfiler: capturing %u frames to %s\n", frameCount, fileName);
+}
+
+// --------------------------------------------------------
+// Writes the capture in the Chrome trace event format
+//  - "X" (complete) events, timestamps in microseconds
+// --------------------------------------------------------
+void Profiler::WriteChromeTrace()
+{
+	std::ofstream out(captureFile);
+	if (!out.is_open()) return;
+
+	out << "{\"traceEvents\":[\n";
+	for (size_t i = 0; i < capturedEvents.size(); i++)
+	{
+		const ProfileTraceEvent& e = capturedEvents[i];
+		char line[512];
+		sprintf_s(line,
+			"{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			e.Name.c_str(),
+			e.ThreadID >= ExternalTrackBase ? "gpu" : "cpu",
+			e.ThreadID,
+			e.StartNs / 1000.0,
+			e.DurationNs / 1000.0,
+			i + 1 < capturedEvents.size() ? "," : "");
+		out << line;
+	}
+	out << "],\"displayTimeUnit\":\"ns\"}\n";
+	out.close();
+
+	printf("Profiler: wrote %u events to %s\n", (unsigned int)capturedEvents.size(), captureFile.c_str());
+	capturedEvents.clear();
+}
+
+// --------------------------------------------------------
+// Prints percentiles over each zone's recent samples
+// --------------------------------------------------------
+void Profiler::PrintSummary()
+{
+	std::vector<std::string> names;
+	for (auto& z : zoneStats) names.push_back(z.first);
+	std::sort(names.begin(), names.end());
+
+	printf("%-28s %10s %10s %10s\n", "Zone", "p50 (us)", "p95 (us)", "p99 (us)");
+	for (auto& n : names)
+	{
+		ZoneStats& s = zoneStats[n];
+		if (s.Count == 0) continue;
+
+		std::vector<float> sorted(s.Samples, s.Samples + s.Count);
+		std::sort(sorted.begin(), sorted.end());
+		float p50 = sorted[(s.Count - 1) * 50 / 100];
+		float p95 = sorted[(s.Count - 1) * 95 / 100];
+		float p99 = sorted[(s.Count - 1) * 99 / 100];
+		printf("%-28s %10.2f %10.2f %10.2f\n", n.c_str(), p50 / 1000.0f, p95 / 1000.0f, p99 / 1000.0f);
+	}
+
+	unsigned int dropped = 0;
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		for (auto& b : threadBuffers) dropped += b->Dropped.load(std::memory_order_relaxed);
+	}
+	if (dropped > 0)
+		printf("Profiler: %u events dropped (ring buffer full)\n", dropped);
+}
+
+// --------------------------------------------------------
+// Times a large batch of empty zones.  The ring is drained
+// between batches so we measure the normal (non-dropping)
+// path, and the samples are thrown away afterwards.
+// --------------------------------------------------------
+double Profiler::MeasureOverhead()
+{
+	ProfileThreadBuffer* b = GetThreadBuffer();
+	const unsigned int batch = ProfileThreadBuffer::Capacity / 2;
+	const unsigned int batches = 32;
+
+	unsigned __int64 total = 0;
+	for (unsigned int i = 0; i < batches; i++)
+	{
+		// Discard anything already in the buffer
+		b->Tail.store(b->Head.load());
+
+		unsigned __int64 start = Now();
+		for (unsigned int j = 0; j < batch; j++)
+		{
+			ProfileZone zone("Overhead");
+		}
+		total += Now() - start;
+	}
+	b->Tail.store(b->Head.load());
+
+	return TicksToNs(total) / (double)(batch * batches);
+}
+
+
+// --------------------------------------------------------
+// Report
+// --------------------------------------------------------
+
+void ProfilerOverheadReport()
+{
+	// The median run, so one preempted run doesn't decide it
+	const int runs = 9;
+	double ns[runs];
+	for (int i = 0; i < runs; i++)
+		ns[i] = Profiler::MeasureOverhead();
+	std::sort(ns, ns + runs);
+
+	printf("\nProfiler overhead per empty zone (%d runs)\n", runs);
+	printf("  %.1f ns median, %.1f best, %.1f worst  %s\n", ns[runs / 2], ns[0], ns[runs - 1],
+		CheckResult(ns[runs / 2] < 50.0));
+}
@@ -0,0 +1,158 @@
+#pragma once
+// std::min/max stay usable in whatever includes this first
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <atomic>
+#include <vector>
+#include <string>
+
+// --------------------------------------------------------
+// Hierarchical CPU frame profiler
+//
+// - Drop PROFILE_ZONE("Name") at the top of a scope to time it
+// - Each thread writes into its own lock-free ring buffer,
+//   which the main thread drains once per frame in EndFrame()
+// - Timestamps come from the CPU's TSC, converted to ns
+// - Press the capture key to record a number of frames, which
+//   are written out as a Chrome trace (chrome://tracing or
+//   ui.perfetto.dev) along with a p50/p95/p99 summary
+//
+// NOTE: zone names must be string literals (or otherwise live
+//       forever), since only the pointer is stored per event
+// --------------------------------------------------------
+
+// A single finished zone
+struct ProfileEvent
+{
+	const char* Name;
+	unsigned __int64 Start;	// Raw TSC ticks
+	unsigned __int64 End;	// Raw TSC ticks
+	unsigned int Depth;		// Nesting level on its thread
+};
+
+// Single-producer (owning thread), single-consumer (main thread) ring
+struct ProfileThreadBuffer
+{
+	static const unsigned int Capacity = 8192; // Must be a power of two
+
+	ProfileEvent Events[Capacity];
+	std::atomic<unsigned int> Head;	// Next slot the owner writes
+	std::atomic<unsigned int> Tail;	// Next slot the reader reads
+	unsigned int Depth;				// Current zone nesting (owner only)
+	std::atomic<unsigned int> Dropped;	// Events lost because the ring was full (summed by the reader)
+	unsigned int ThreadID;
+};
+
+// An event that has already been converted to nanoseconds,
+// used for the trace capture and for merging external timings
+struct ProfileTraceEvent
+{
+	std::string Name;
+	double StartNs;
+	double DurationNs;
+	unsigned int ThreadID;
+	unsigned int Depth;
+};
+
+class Profiler
+{
+public:
+	// Calibrates the TSC and registers the calling (main) thread
+	static void Init();
+	static void Shutdown();
+
+	// Drains all thread buffers into stats (and the capture, if running)
+	static void EndFrame();
+
+	// Records the next frameCount frames, then writes fileName
+	static void BeginCapture(unsigned int frameCount, const char* fileName);
+	static bool IsCapturing() { return captureFramesLeft > 0; }
+
+	// Adds an event from another timeline (e.g. GPU), already in ns
+	// relative to the profiler's epoch.  Uses its own track (thread) ID.
+	static void AddExternalEvent(const char* name, double startNs, double durationNs, unsigned int trackID);
+
+	// Prints the rolling p50/p95/p99 per zone to stdout
+	static void PrintSummary();
+
+	// Measures the cost of one empty zone, in nanoseconds
+	static double MeasureOverhead();
+
+	// Helpers for converting timestamps
+	static unsigned __int64 Now();
+	static double TicksToNs(unsigned __int64 ticks) { return ticks * nsPerTick; }
+	static double NowNs() { return (Now() - epoch) * nsPerTick; }
+
+	// Per-thread buffer (lazily created and registered)
+	static ProfileThreadBuffer* GetThreadBuffer();
+
+	// Track IDs above this are reserved for external timelines
+	static const unsigned int ExternalTrackBase = 1000;
+
+private:
+	static double nsPerTick;
+	static unsigned __int64 epoch;
+	static unsigned int captureFramesLeft;
+	static std::string captureFile;
+
+	static void WriteChromeTrace();
+	static void RecordSample(const char* name, double durationNs);
+};
+
+// --------------------------------------------------------
+// RAII zone - times the enclosing scope
+// --------------------------------------------------------
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name)
+	{
+		buffer = Profiler::GetThreadBuffer();
+		this->name = name;
+		depth = buffer->Depth++;
+		start = Profiler::Now();
+	}
+
+	~ProfileZone()
+	{
+		unsigned __int64 end = Profiler::Now();
+		buffer->Depth--;
+
+		// Drop the event if the reader hasn't caught up
+		unsigned int head = buffer->Head.load(std::memory_order_relaxed);
+		unsigned int tail = buffer->Tail.load(std::memory_order_acquire);
+		if (head - tail >= ProfileThreadBuffer::Capacity)
+		{
+			buffer->Dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		ProfileEvent& e = buffer->Events[head & (ProfileThreadBuffer::Capacity - 1)];
+		e.Name = name;
+		e.Start = start;
+		e.End = end;
+		e.Depth = depth;
+		buffer->Head.store(head + 1, std::memory_order_release);
+	}
+
+private:
+	ProfileThreadBuffer* buffer;
+	const char* name;
+	unsigned __int64 start;
+	unsigned int depth;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifndef DISABLE_PROFILER
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+// Times empty zones a few times over and checks the typical
+// one stays under the 50 ns budget
+void ProfilerOverheadReport();
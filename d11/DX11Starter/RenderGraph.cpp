@@ -0,0 +1,408 @@
+#include "RenderGraph.h"
+#include "Profiler.h"
+#include <cstdio>
+
+// --------------------------------------------------------
+// Pass builder
+// --------------------------------------------------------
+RGHandle RGPassBuilder::Create(const char* name, const RTDesc& desc)
+{
+	const float black[4] = { 0, 0, 0, 0 };
+	return Create(name, desc, black);
+}
+
+RGHandle RGPassBuilder::Create(const char* name, const RTDesc& desc, const float clearColor[4])
+{
+	RenderGraph::Resource r = {};
+	r.Name = name;
+	r.Desc = desc;
+	for (int i = 0; i < 4; i++) r.ClearColor[i] = clearColor[i];
+	r.Physical = -1;
+	graph->resources.push_back(r);
+	return (RGHandle)graph->resources.size() - 1;
+}
+
+RGHandle RGPassBuilder::Read(RGHandle texture)
+{
+	graph->passes[passIndex].Reads.push_back(texture);
+	return texture;
+}
+
+RGHandle RGPassBuilder::Write(RGHandle texture, RGLoadOp load, RGCoverage coverage)
+{
+	RenderGraph::Access a = { texture, load, coverage };
+	graph->passes[passIndex].Writes.push_back(a);
+	return texture;
+}
+
+void RGPassBuilder::SideEffect()
+{
+	graph->passes[passIndex].SideEffect = true;
+}
+
+// --------------------------------------------------------
+// Graph
+// --------------------------------------------------------
+RenderGraph::RenderGraph(RenderTargetPool* pool)
+{
+	this->pool = pool;
+	culledPasses = 0;
+	eliminateClears = true;
+	clearCount = 0;
+	clearedBytes = 0;
+	droppedClears = 0;
+	droppedClearBytes = 0;
+	slowClears = 0;
+	unaliasedBytes = 0;
+	aliasedBytes = 0;
+	textureCount = 0;
+}
+
+RenderGraph::~RenderGraph()
+{
+	ReleasePhysicals();
+}
+
+void RenderGraph::Reset()
+{
+	ReleasePhysicals();
+	resources.clear();
+	passes.clear();
+}
+
+void RenderGraph::ReleasePhysicals()
+{
+	for (auto& p : physicals)
+		pool->Release(p.Target);
+	physicals.clear();
+}
+
+RGHandle RenderGraph::Import(const char* name, const RTDesc& desc,
+	ID3D11RenderTargetView* rtv, ID3D11ShaderResourceView* srv, ID3D11UnorderedAccessView* uav,
+	ID3D11DepthStencilView* dsv, const float clearColor[4])
+{
+	Resource r = {};
+	r.Name = name;
+	r.Desc = desc;
+	r.Imported = true;
+	r.RTV = rtv;
+	r.SRV = srv;
+	r.UAV = uav;
+	r.DSV = dsv;
+	if (clearColor)
+		for (int i = 0; i < 4; i++) r.ClearColor[i] = clearColor[i];
+	r.Physical = -1;
+	resources.push_back(r);
+	return (RGHandle)resources.size() - 1;
+}
+
+void RenderGraph::AddPass(const char* name,
+	std::function<void(RGPassBuilder&)> setup,
+	std::function<void()> execute)
+{
+	Pass p;
+	p.Name = name;
+	p.Execute = execute;
+	p.SideEffect = false;
+	p.Live = true;
+	passes.push_back(p);
+
+	RGPassBuilder builder(this, (int)passes.size() - 1);
+	setup(builder);
+}
+
+// --------------------------------------------------------
+// Walks the passes backwards, keeping a pass only if it
+// writes something a later live pass reads (or an imported
+// texture).  A full overwrite satisfies the need, so an
+// earlier writer of the same texture isn't kept alive by it.
+// --------------------------------------------------------
+void RenderGraph::Cull()
+{
+	std::vector<bool> needed(resources.size(), false);
+	culledPasses = 0;
+
+	for (int i = (int)passes.size() - 1; i >= 0; i--)
+	{
+		Pass& p = passes[i];
+		bool live = p.SideEffect;
+		for (auto& w : p.Writes)
+			if (resources[w.Texture].Imported || needed[w.Texture])
+				live = true;
+
+		p.Live = live;
+		if (!live)
+		{
+			culledPasses++;
+			continue;
+		}
+
+		for (auto& w : p.Writes)
+			needed[w.Texture] = (w.Load == RG_LOAD_PRESERVE);
+		for (auto r : p.Reads)
+			needed[r] = true;
+	}
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+	for (auto& r : resources)
+	{
+		r.FirstPass = -1;
+		r.LastPass = -1;
+		r.Physical = -1;
+	}
+
+	for (int i = 0; i < (int)passes.size(); i++)
+	{
+		if (!passes[i].Live) continue;
+
+		auto touch = [&](RGHandle h)
+		{
+			Resource& r = resources[h];
+			if (r.FirstPass < 0) r.FirstPass = i;
+			r.LastPass = i;
+		};
+		for (auto r : passes[i].Reads) touch(r);
+		for (auto& w : passes[i].Writes) touch(w.Texture);
+	}
+}
+
+// Finds a free slot that fits, or makes a new one
+int RenderGraph::AcquirePhysical(const RTDesc& desc)
+{
+	for (size_t i = 0; i < physicals.size(); i++)
+	{
+		Physical& p = physicals[i];
+		if (p.InUse || !p.Desc.Compatible(desc)) continue;
+
+		p.Desc.BindFlags |= desc.BindFlags;
+		p.InUse = true;
+		return (int)i;
+	}
+
+	Physical p;
+	p.Desc = desc;
+	p.Target = RT_INVALID_HANDLE;
+	p.InUse = true;
+	physicals.push_back(p);
+	return (int)physicals.size() - 1;
+}
+
+// --------------------------------------------------------
+// Hands out real textures in pass order.  A transient takes
+// one when its first pass starts and gives it back once its
+// last pass is done, so the next compatible transient can
+// reuse it.  The slots are then leased from the pool until
+// the frame is executed, and the pool keeps the textures
+// around between frames.
+// --------------------------------------------------------
+void RenderGraph::AssignPhysical()
+{
+	ReleasePhysicals();
+
+	unaliasedBytes = 0;
+	for (int i = 0; i < (int)passes.size(); i++)
+	{
+		if (!passes[i].Live) continue;
+
+		for (auto& r : resources)
+		{
+			if (r.Imported || r.FirstPass != i) continue;
+			r.Physical = AcquirePhysical(r.Desc);
+			unaliasedBytes += RTBytes(r.Desc);
+		}
+		for (auto& r : resources)
+			if (!r.Imported && r.LastPass == i)
+				physicals[r.Physical].InUse = false;
+	}
+
+	aliasedBytes = 0;
+	for (auto& p : physicals)
+	{
+		p.Target = pool->Acquire(p.Desc);
+		aliasedBytes += RTBytes(p.Desc);
+	}
+	textureCount = (unsigned int)physicals.size();
+}
+
+void RenderGraph::Compile()
+{
+	PROFILE_ZONE("RenderGraph::Compile");
+
+	Cull();
+	ComputeLifetimes();
+	AssignPhysical();
+	PlanClears();
+}
+
+// --------------------------------------------------------
+// Whether anything can see what a clear wrote: the write
+// itself covers every pixel, or later writes fill in what it
+// left before any pass reads the texture.  Running off the
+// end counts as seen (imported textures outlive the frame).
+// --------------------------------------------------------
+bool RenderGraph::ClearIsSeen(int passIndex, const Access& write)
+{
+	if (write.Coverage == RG_COVER_FULL && write.Load != RG_LOAD_PRESERVE)
+		return false;
+
+	for (int i = passIndex + 1; i < (int)passes.size(); i++)
+	{
+		const Pass& p = passes[i];
+		if (!p.Live) continue;
+
+		for (auto r : p.Reads)
+			if (r == write.Texture)
+				return true;
+		for (auto& w : p.Writes)
+		{
+			if (w.Texture != write.Texture) continue;
+			if (w.Coverage == RG_COVER_REMAINDER || (w.Coverage == RG_COVER_FULL && w.Load != RG_LOAD_PRESERVE))
+				return false;
+		}
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// Clears passes ask for, or that keeping the contents of a
+// fresh (or shared) texture needs - less the ones nobody
+// would see.  Whatever's left is a whole-texture clear, and
+// depth + stencil are cleared together, which is what the
+// hardware's fast clears want; values other than 0 and 1 are
+// counted since many GPUs can't fast clear to those.
+// --------------------------------------------------------
+void RenderGraph::PlanClears()
+{
+	clearCount = 0;
+	clearedBytes = 0;
+	droppedClears = 0;
+	droppedClearBytes = 0;
+	slowClears = 0;
+	for (int i = 0; i < (int)passes.size(); i++)
+	{
+		Pass& p = passes[i];
+		p.Clears.clear();
+		if (!p.Live) continue;
+
+		for (auto& w : p.Writes)
+		{
+			Resource& r = resources[w.Texture];
+			bool clear = w.Load == RG_LOAD_CLEAR ||
+				(w.Load == RG_LOAD_PRESERVE && r.FirstPass == i && !r.Imported);
+			if (!clear || (r.Imported && !r.RTV && !r.DSV))
+				continue;
+
+			if (eliminateClears && !ClearIsSeen(i, w))
+			{
+				droppedClears++;
+				droppedClearBytes += RTBytes(r.Desc);
+				continue;
+			}
+
+			p.Clears.push_back(w.Texture);
+			clearCount++;
+			clearedBytes += RTBytes(r.Desc);
+			int channels = r.DSV ? 2 : 4;
+			for (int c = 0; c < channels; c++)
+				if (r.ClearColor[c] != 0 && r.ClearColor[c] != 1)
+				{
+					slowClears++;
+					break;
+				}
+		}
+	}
+}
+
+void RenderGraph::IssueClears(const Pass& pass)
+{
+	for (auto h : pass.Clears)
+	{
+		Resource& r = resources[h];
+		if (r.Imported)
+			pool->ClearViews(r.Desc, r.RTV, r.DSV, r.ClearColor);
+		else
+			pool->Clear(physicals[r.Physical].Target, r.ClearColor);
+	}
+}
+
+void RenderGraph::Execute(GpuProfiler* profiler)
+{
+	for (auto& p : passes)
+	{
+		if (!p.Live) continue;
+
+		IssueClears(p);
+
+		if (profiler)
+		{
+			GpuPassScope scope(profiler, p.Name);
+			p.Execute();
+		}
+		else
+		{
+			ProfileZone zone(p.Name);
+			p.Execute();
+		}
+	}
+
+	// Done with them until the next Compile - idle, the pool can
+	// evict them (say on a resize, when they're the wrong size)
+	ReleasePhysicals();
+}
+
+void RenderGraph::ExecuteClears()
+{
+	for (auto& p : passes)
+		if (p.Live)
+			IssueClears(p);
+	ReleasePhysicals();
+}
+
+ID3D11RenderTargetView* RenderGraph::GetRTV(RGHandle texture)
+{
+	Resource& r = resources[texture];
+	return r.Imported ? r.RTV : pool->GetRTV(physicals[r.Physical].Target);
+}
+
+ID3D11ShaderResourceView* RenderGraph::GetSRV(RGHandle texture)
+{
+	Resource& r = resources[texture];
+	return r.Imported ? r.SRV : pool->GetSRV(physicals[r.Physical].Target);
+}
+
+ID3D11UnorderedAccessView* RenderGraph::GetUAV(RGHandle texture)
+{
+	Resource& r = resources[texture];
+	return r.Imported ? r.UAV : pool->GetUAV(physicals[r.Physical].Target);
+}
+
+void RenderGraph::PrintReport()
+{
+	printf("\nRender graph: %u passes (%u culled), %u clears (%.2f MB, %u not to 0 / 1), %u dropped (%.2f MB)\n",
+		GetPassCount(), culledPasses, clearCount, clearedBytes / (1024.0 * 1024.0), slowClears,
+		droppedClears, droppedClearBytes / (1024.0 * 1024.0));
+	printf("  transients: %.2f MB one texture each, %.2f MB shared (%u real textures)\n",
+		unaliasedBytes / (1024.0 * 1024.0), aliasedBytes / (1024.0 * 1024.0), textureCount);
+
+	for (size_t i = 0; i < passes.size(); i++)
+	{
+		const Pass& p = passes[i];
+		printf("  %-18s %s\n", p.Name, p.Live ? "" : "(culled)");
+		for (auto& w : p.Writes)
+		{
+			const Resource& r = resources[w.Texture];
+			const char* coverage = w.Coverage == RG_COVER_FULL ? ", covers all" :
+				w.Coverage == RG_COVER_REMAINDER ? ", covers the rest" : "";
+			bool cleared = false;
+			for (auto h : p.Clears)
+				cleared = cleared || h == w.Texture;
+			if (r.Imported)
+				printf("      -> %s (imported%s)%s\n", r.Name, coverage, cleared ? " cleared" : "");
+			else
+				printf("      -> %s [%d..%d] texture %d%s%s\n", r.Name, r.FirstPass, r.LastPass, r.Physical,
+					coverage, cleared ? " cleared" : "");
+		}
+	}
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include <functional>
+#include "GpuProfiler.h"
+#include "RenderTargetPool.h"
+
+// --------------------------------------------------------
+// Render graph for the frame's passes
+//
+// - Passes are declared every frame with the textures they
+//   read and write, then the graph is compiled and executed
+// - Compile culls passes whose output nobody uses, works out
+//   when each transient texture is first and last used, and
+//   lets transients with matching size/format share one real
+//   texture when their lifetimes don't overlap
+// - Targets are only cleared when a pass asks for it, and
+//   not even then if every pixel is overwritten before anyone
+//   reads it - passes say how much of a target they cover
+//   (a fullscreen triangle, or the sky behind everything else)
+//   and Compile drops the clears that can't be seen
+// - Imported targets given a depth or render target view are
+//   cleared by the graph too (depth and stencil in one go), so
+//   every clear of the frame is in one place and in the report
+// - Real textures are leased from a RenderTargetPool from
+//   Compile until Execute is done, so the pool keeps them
+//   across frames (and can drop them on a resize), and the
+//   bookkeeping can run headless (see RecordingTargetBackend)
+//
+// D3D11 has no placed resources, so "aliasing" here means
+// two transients share a whole texture, not just its memory.
+// --------------------------------------------------------
+
+typedef int RGHandle;
+#define RG_INVALID_HANDLE -1
+
+// What a pass does with a target's previous contents
+enum RGLoadOp
+{
+	RG_LOAD_DONTCARE,	// Pass overwrites every pixel
+	RG_LOAD_CLEAR,		// Clear to the texture's clear color first (imported: needs a view)
+	RG_LOAD_PRESERVE	// Pass blends onto / partially writes it
+};
+
+// How much of a target a write covers
+enum RGCoverage
+{
+	RG_COVER_PARTIAL,	// Only what it draws (geometry, discards)
+	RG_COVER_FULL,		// Every pixel (fullscreen triangle or a dispatch over all of it)
+	RG_COVER_REMAINDER	// Every pixel the writes since the last clear left (the sky, at the far depth)
+};
+
+class RenderGraph;
+
+// --------------------------------------------------------
+// Handed to a pass's setup function to declare its accesses
+// --------------------------------------------------------
+class RGPassBuilder
+{
+public:
+	RGPassBuilder(RenderGraph* graph, int passIndex) : graph(graph), passIndex(passIndex) {}
+
+	// New transient texture, only alive while passes use it
+	RGHandle Create(const char* name, const RTDesc& desc);
+	RGHandle Create(const char* name, const RTDesc& desc, const float clearColor[4]);
+
+	RGHandle Read(RGHandle texture);
+	RGHandle Write(RGHandle texture, RGLoadOp load = RG_LOAD_DONTCARE, RGCoverage coverage = RG_COVER_PARTIAL);
+
+	// Keeps the pass alive even if nothing reads its output
+	void SideEffect();
+
+private:
+	RenderGraph* graph;
+	int passIndex;
+};
+
+// --------------------------------------------------------
+// The graph itself
+// --------------------------------------------------------
+class RenderGraph
+{
+public:
+	// The pool isn't owned, and must outlive the graph
+	RenderGraph(RenderTargetPool* pool);
+	~RenderGraph();
+
+	// Drops last frame's passes (and its textures, if it was
+	// compiled but never executed)
+	void Reset();
+
+	// An existing texture the graph doesn't own (back buffer, depth)
+	// - Writing to one keeps the pass alive
+	// - RG_LOAD_CLEAR clears it through rtv or dsv, to clearColor
+	//   (depth to clearColor[0], stencil to clearColor[1])
+	RGHandle Import(const char* name, const RTDesc& desc,
+		ID3D11RenderTargetView* rtv, ID3D11ShaderResourceView* srv, ID3D11UnorderedAccessView* uav = 0,
+		ID3D11DepthStencilView* dsv = 0, const float clearColor[4] = 0);
+
+	// Name must outlive the frame (profilers keep the pointer)
+	void AddPass(const char* name,
+		std::function<void(RGPassBuilder&)> setup,
+		std::function<void()> execute);
+
+	// Off keeps every clear passes ask for (to compare against)
+	void SetClearElimination(bool enabled) { eliminateClears = enabled; }
+
+	// Compile leases the textures, both Executes hand them back
+	// to the pool when they're done
+	void Compile();
+	void Execute(GpuProfiler* profiler = 0);
+
+	// Only the clears, none of the passes - for headless runs
+	// against a RecordingTargetBackend
+	void ExecuteClears();
+
+	// Valid during Execute
+	ID3D11RenderTargetView* GetRTV(RGHandle texture);
+	ID3D11ShaderResourceView* GetSRV(RGHandle texture);
+	ID3D11UnorderedAccessView* GetUAV(RGHandle texture);
+	const RTDesc& GetDesc(RGHandle texture) { return resources[texture].Desc; }
+
+	// Stats from the last Compile
+	unsigned int GetPassCount() { return (unsigned int)passes.size(); }
+	unsigned int GetCulledPassCount() { return culledPasses; }
+	unsigned int GetClearCount() { return clearCount; }                       // Issued
+	unsigned long long GetClearedBytes() { return clearedBytes; }
+	unsigned int GetDroppedClearCount() { return droppedClears; }             // Asked for, never seen
+	unsigned long long GetDroppedClearBytes() { return droppedClearBytes; }
+	unsigned int GetSlowClearCount() { return slowClears; }                   // Issued, not 0 / 1 values
+	unsigned long long GetUnaliasedBytes() { return unaliasedBytes; } // One texture per transient
+	unsigned long long GetAliasedBytes() { return aliasedBytes; }     // After sharing
+	unsigned int GetTextureCount() { return textureCount; }           // Real textures leased
+	void PrintReport();
+
+	// Where a transient landed in the last Compile: its first and
+	// last live pass, and the real texture it got (-1 if culled)
+	int GetFirstPass(RGHandle texture) { return resources[texture].FirstPass; }
+	int GetLastPass(RGHandle texture) { return resources[texture].LastPass; }
+	int GetTextureIndex(RGHandle texture) { return resources[texture].Physical; }
+
+private:
+	friend class RGPassBuilder;
+
+	struct Resource
+	{
+		const char* Name;
+		RTDesc Desc;
+		float ClearColor[4];
+		bool Imported;
+		ID3D11RenderTargetView* RTV;		// Imported only
+		ID3D11ShaderResourceView* SRV;
+		ID3D11UnorderedAccessView* UAV;
+		ID3D11DepthStencilView* DSV;
+
+		// Filled in by Compile
+		int FirstPass;
+		int LastPass;
+		int Physical;
+	};
+
+	struct Access
+	{
+		RGHandle Texture;
+		RGLoadOp Load;
+		RGCoverage Coverage;
+	};
+
+	struct Pass
+	{
+		const char* Name;
+		std::vector<RGHandle> Reads;
+		std::vector<Access> Writes;
+		std::function<void()> Execute;
+		bool SideEffect;
+		bool Live;
+		std::vector<RGHandle> Clears; // Filled in by Compile
+	};
+
+	// A real texture, possibly shared by several transients
+	struct Physical
+	{
+		RTDesc Desc;         // Bind flags merged from every user this frame
+		RTHandle Target;     // Leased from the pool
+		bool InUse;          // Taken during the current Compile walk
+	};
+
+	RenderTargetPool* pool;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<Physical> physicals;
+
+	unsigned int culledPasses;
+	bool eliminateClears;
+	unsigned int clearCount;
+	unsigned long long clearedBytes;
+	unsigned int droppedClears;
+	unsigned long long droppedClearBytes;
+	unsigned int slowClears;
+	unsigned long long unaliasedBytes;
+	unsigned long long aliasedBytes;
+	unsigned int textureCount;
+
+	void Cull();
+	void ComputeLifetimes();
+	void AssignPhysical();
+	void PlanClears();
+	bool ClearIsSeen(int passIndex, const Access& write);
+	void IssueClears(const Pass& pass);
+	int AcquirePhysical(const RTDesc& desc);
+	void ReleasePhysicals();
+};
@@ -0,0 +1,356 @@
+#include "RenderTargetPool.h"
+#include <cstdio>
+
+unsigned int RTFormatBytes(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R32G32_FLOAT:
+		return 8;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+		return 4;
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_R8G8_UNORM:
+		return 2;
+	case DXGI_FORMAT_R8_UNORM:
+		return 1;
+	default:
+		return 4;
+	}
+}
+
+unsigned long long RTBytes(const RTDesc& desc)
+{
+	return (unsigned long long)desc.Width * desc.Height * RTFormatBytes(desc.Format);
+}
+
+// --------------------------------------------------------
+// D3D11 backend
+// --------------------------------------------------------
+D3D11TargetBackend::D3D11TargetBackend(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+D3D11TargetBackend::~D3D11TargetBackend()
+{
+	for (size_t i = 0; i < textures.size(); i++)
+		DestroyTexture((int)i);
+}
+
+int D3D11TargetBackend::CreateTexture(const RTDesc& desc)
+{
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = desc.Width;
+	textureDesc.Height = desc.Height;
+	textureDesc.ArraySize = 1;
+	textureDesc.BindFlags = desc.BindFlags;
+	textureDesc.Format = desc.Format;
+	textureDesc.MipLevels = 1;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	Texture t = {};
+	ID3D11Texture2D* tex;
+	device->CreateTexture2D(&textureDesc, 0, &tex);
+	if (desc.BindFlags & D3D11_BIND_RENDER_TARGET) device->CreateRenderTargetView(tex, 0, &t.RTV);
+	if (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE) device->CreateShaderResourceView(tex, 0, &t.SRV);
+	if (desc.BindFlags & D3D11_BIND_UNORDERED_ACCESS) device->CreateUnorderedAccessView(tex, 0, &t.UAV);
+	tex->Release();
+
+	// Reuse a slot if one's free
+	if (!freeIDs.empty())
+	{
+		int id = freeIDs.back();
+		freeIDs.pop_back();
+		textures[id] = t;
+		return id;
+	}
+	textures.push_back(t);
+	return (int)textures.size() - 1;
+}
+
+void D3D11TargetBackend::DestroyTexture(int id)
+{
+	Texture& t = textures[id];
+	if (!t.RTV && !t.SRV && !t.UAV) return;
+	if (t.RTV) t.RTV->Release();
+	if (t.SRV) t.SRV->Release();
+	if (t.UAV) t.UAV->Release();
+	t = Texture();
+	freeIDs.push_back(id);
+}
+
+void D3D11TargetBackend::ClearTexture(int id, const float color[4])
+{
+	Texture& t = textures[id];
+	if (t.RTV) context->ClearRenderTargetView(t.RTV, color);
+	else if (t.UAV) context->ClearUnorderedAccessViewFloat(t.UAV, color);
+}
+
+void D3D11TargetBackend::ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv,
+	const float color[4])
+{
+	if (dsv)
+	{
+		// Only touch stencil when the format has some
+		bool stencil = desc.Format == DXGI_FORMAT_R24G8_TYPELESS || desc.Format == DXGI_FORMAT_R32G8X24_TYPELESS;
+		UINT flags = D3D11_CLEAR_DEPTH | (stencil ? D3D11_CLEAR_STENCIL : 0);
+		context->ClearDepthStencilView(dsv, flags, color[0], (UINT8)color[1]);
+	}
+	else if (rtv) context->ClearRenderTargetView(rtv, color);
+}
+
+ID3D11RenderTargetView* D3D11TargetBackend::GetRTV(int id) { return textures[id].RTV; }
+ID3D11ShaderResourceView* D3D11TargetBackend::GetSRV(int id) { return textures[id].SRV; }
+ID3D11UnorderedAccessView* D3D11TargetBackend::GetUAV(int id) { return textures[id].UAV; }
+
+// --------------------------------------------------------
+// Recording backend
+// --------------------------------------------------------
+RecordingTargetBackend::RecordingTargetBackend()
+{
+	createCount = 0;
+	clearCount = 0;
+	liveBytes = 0;
+	clearedBytes = 0;
+}
+
+int RecordingTargetBackend::CreateTexture(const RTDesc& desc)
+{
+	textures.push_back(desc);
+	alive.push_back(true);
+	createCount++;
+	liveBytes += RTBytes(desc);
+	return (int)textures.size() - 1;
+}
+
+void RecordingTargetBackend::DestroyTexture(int id)
+{
+	if (!alive[id]) return;
+	alive[id] = false;
+	liveBytes -= RTBytes(textures[id]);
+}
+
+void RecordingTargetBackend::ClearTexture(int id, const float color[4])
+{
+	clearCount++;
+	clearedBytes += RTBytes(textures[id]);
+}
+
+void RecordingTargetBackend::ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv,
+	const float color[4])
+{
+	clearCount++;
+	clearedBytes += RTBytes(desc);
+}
+
+
+// --------------------------------------------------------
+// Pool
+// --------------------------------------------------------
+RenderTargetPool::RenderTargetPool(IRenderTargetBackend* backend, unsigned int evictAfterFrames)
+{
+	this->backend = backend;
+	this->evictAfterFrames = evictAfterFrames;
+	frame = 0;
+	screenWidth = 0;
+	screenHeight = 0;
+	createCount = 0;
+	reuseCount = 0;
+	evictCount = 0;
+	liveBytes = 0;
+	peakBytes = 0;
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	for (auto& e : entries)
+		DestroyTexture(e);
+	delete backend;
+}
+
+void RenderTargetPool::CreateTexture(Entry& e)
+{
+	e.BackendID = backend->CreateTexture(e.Desc);
+	createCount++;
+	liveBytes += RTBytes(e.Desc);
+	if (liveBytes > peakBytes) peakBytes = liveBytes;
+}
+
+void RenderTargetPool::DestroyTexture(Entry& e)
+{
+	if (e.BackendID < 0) return;
+	backend->DestroyTexture(e.BackendID);
+	e.BackendID = -1;
+	liveBytes -= RTBytes(e.Desc);
+}
+
+// Rounds up, so a half res target of an odd size covers every pixel
+void RenderTargetPool::ScaledSize(float scale, unsigned int* width, unsigned int* height)
+{
+	*width = (unsigned int)(screenWidth * scale + 0.999f);
+	*height = (unsigned int)(screenHeight * scale + 0.999f);
+	if (*width < 1) *width = 1;
+	if (*height < 1) *height = 1;
+}
+
+RTHandle RenderTargetPool::AddEntry(const RTDesc& desc, float scale)
+{
+	Entry e;
+	e.Desc = desc;
+	e.Scale = scale;
+	e.InUse = true;
+	e.LastUsedFrame = frame;
+	CreateTexture(e);
+
+	if (!emptySlots.empty())
+	{
+		RTHandle h = emptySlots.back();
+		emptySlots.pop_back();
+		entries[h] = e;
+		return h;
+	}
+	entries.push_back(e);
+	return (RTHandle)entries.size() - 1;
+}
+
+RTHandle RenderTargetPool::Acquire(const RTDesc& desc)
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry& e = entries[i];
+		if (e.InUse || e.BackendID < 0 || e.Scale > 0 || !(e.Desc == desc)) continue;
+
+		e.InUse = true;
+		e.LastUsedFrame = frame;
+		reuseCount++;
+		return (RTHandle)i;
+	}
+	return AddEntry(desc, 0);
+}
+
+void RenderTargetPool::Release(RTHandle target)
+{
+	Entry& e = entries[target];
+	e.InUse = false;
+	e.LastUsedFrame = frame;
+}
+
+RTHandle RenderTargetPool::CreateScaled(float scale, DXGI_FORMAT format, unsigned int bindFlags)
+{
+	RTDesc desc = { 0, 0, format, bindFlags };
+	ScaledSize(scale, &desc.Width, &desc.Height);
+	return AddEntry(desc, scale);
+}
+
+void RenderTargetPool::Destroy(RTHandle target)
+{
+	// Already evicted, and so already on emptySlots - pushing it
+	// again would hand the slot to two AddEntry calls
+	Entry& e = entries[target];
+	if (e.BackendID < 0) return;
+	DestroyTexture(e);
+	e.InUse = false;
+	e.Scale = 0;
+	emptySlots.push_back(target);
+}
+
+void RenderTargetPool::Resize(unsigned int width, unsigned int height)
+{
+	if (width == screenWidth && height == screenHeight) return;
+	screenWidth = width;
+	screenHeight = height;
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry& e = entries[i];
+		if (e.BackendID < 0) continue;
+
+		if (e.Scale > 0)
+		{
+			DestroyTexture(e);
+			ScaledSize(e.Scale, &e.Desc.Width, &e.Desc.Height);
+			CreateTexture(e);
+		}
+		else if (!e.InUse)
+		{
+			DestroyTexture(e);
+			evictCount++;
+			emptySlots.push_back((RTHandle)i);
+		}
+	}
+}
+
+void RenderTargetPool::EndFrame()
+{
+	frame++;
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry& e = entries[i];
+		if (e.BackendID < 0 || e.InUse || e.Scale > 0) continue;
+		if (frame - e.LastUsedFrame <= evictAfterFrames) continue;
+
+		DestroyTexture(e);
+		evictCount++;
+		emptySlots.push_back((RTHandle)i);
+	}
+}
+
+void RenderTargetPool::Clear(RTHandle target, const float color[4])
+{
+	backend->ClearTexture(entries[target].BackendID, color);
+}
+
+void RenderTargetPool::ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv,
+	const float color[4])
+{
+	backend->ClearViews(desc, rtv, dsv, color);
+}
+
+ID3D11RenderTargetView* RenderTargetPool::GetRTV(RTHandle target) { return backend->GetRTV(entries[target].BackendID); }
+ID3D11ShaderResourceView* RenderTargetPool::GetSRV(RTHandle target) { return backend->GetSRV(entries[target].BackendID); }
+ID3D11UnorderedAccessView* RenderTargetPool::GetUAV(RTHandle target) { return backend->GetUAV(entries[target].BackendID); }
+
+unsigned int RenderTargetPool::GetTargetCount()
+{
+	unsigned int count = 0;
+	for (auto& e : entries)
+		if (e.BackendID >= 0) count++;
+	return count;
+}
+
+unsigned int RenderTargetPool::GetInUseCount()
+{
+	unsigned int count = 0;
+	for (auto& e : entries)
+		if (e.BackendID >= 0 && e.InUse) count++;
+	return count;
+}
+
+void RenderTargetPool::PrintReport()
+{
+	printf("\nRender target pool: %u targets (%u in use), %.2f MB live, %.2f MB peak\n",
+		GetTargetCount(), GetInUseCount(), liveBytes / (1024.0 * 1024.0), peakBytes / (1024.0 * 1024.0));
+	printf("  %u created, %u reused, %u evicted (after %u idle frames)\n",
+		createCount, reuseCount, evictCount, evictAfterFrames);
+
+	for (auto& e : entries)
+	{
+		if (e.BackendID < 0) continue;
+		printf("  %4ux%-4u format %2d flags 0x%02x %s%s\n",
+			e.Desc.Width, e.Desc.Height, (int)e.Desc.Format, e.Desc.BindFlags,
+			e.InUse ? "in use" : "idle", e.Scale > 0 ? " (scaled)" : "");
+	}
+}
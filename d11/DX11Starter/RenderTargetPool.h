@@ -0,0 +1,202 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Pool of render targets
+//
+// - Targets are keyed by (size, format, bind flags). Released
+//   ones go back to the pool and the next Acquire with the
+//   same key gets them again instead of a new texture
+// - Targets nobody has used for a few frames are evicted
+// - Scaled targets are sized off the screen and recreated
+//   behind the same handle when the window resizes
+// - Real textures come from an IRenderTargetBackend, so the
+//   bookkeeping can run headless (see RecordingTargetBackend)
+// --------------------------------------------------------
+
+struct RTDesc
+{
+	unsigned int Width;
+	unsigned int Height;
+	DXGI_FORMAT Format;
+	unsigned int BindFlags; // D3D11_BIND_*
+
+	// Same size and format (bind flags can differ)
+	bool Compatible(const RTDesc& other) const
+	{
+		return Width == other.Width && Height == other.Height && Format == other.Format;
+	}
+
+	bool operator==(const RTDesc& other) const
+	{
+		return Compatible(other) && BindFlags == other.BindFlags;
+	}
+};
+
+// Bytes per pixel for the formats the pool deals with
+unsigned int RTFormatBytes(DXGI_FORMAT format);
+unsigned long long RTBytes(const RTDesc& desc);
+
+// --------------------------------------------------------
+// Where real textures come from
+// --------------------------------------------------------
+class IRenderTargetBackend
+{
+public:
+	virtual ~IRenderTargetBackend() {}
+
+	// Returns an id for the new texture
+	virtual int CreateTexture(const RTDesc& desc) = 0;
+	virtual void DestroyTexture(int id) = 0;
+	virtual void ClearTexture(int id, const float color[4]) = 0;
+
+	// A texture the pool doesn't own, through whichever view it
+	// has (depth to color[0] and stencil to color[1], together)
+	virtual void ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv,
+		const float color[4]) = 0;
+
+	// Views (null if the texture wasn't created with that bind flag)
+	virtual ID3D11RenderTargetView* GetRTV(int id) = 0;
+	virtual ID3D11ShaderResourceView* GetSRV(int id) = 0;
+	virtual ID3D11UnorderedAccessView* GetUAV(int id) = 0;
+};
+
+// --------------------------------------------------------
+// D3D11 textures + views
+// --------------------------------------------------------
+class D3D11TargetBackend : public IRenderTargetBackend
+{
+public:
+	D3D11TargetBackend(ID3D11Device* device, ID3D11DeviceContext* context);
+	~D3D11TargetBackend();
+
+	int CreateTexture(const RTDesc& desc);
+	void DestroyTexture(int id);
+	void ClearTexture(int id, const float color[4]);
+	void ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv, const float color[4]);
+	ID3D11RenderTargetView* GetRTV(int id);
+	ID3D11ShaderResourceView* GetSRV(int id);
+	ID3D11UnorderedAccessView* GetUAV(int id);
+
+private:
+	struct Texture
+	{
+		ID3D11RenderTargetView* RTV;
+		ID3D11ShaderResourceView* SRV;
+		ID3D11UnorderedAccessView* UAV;
+	};
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	std::vector<Texture> textures;
+	std::vector<int> freeIDs;
+};
+
+// --------------------------------------------------------
+// No GPU at all - just keeps track of what was asked for.
+// Used to report memory and clears without a device.
+// --------------------------------------------------------
+class RecordingTargetBackend : public IRenderTargetBackend
+{
+public:
+	RecordingTargetBackend();
+
+	int CreateTexture(const RTDesc& desc);
+	void DestroyTexture(int id);
+	void ClearTexture(int id, const float color[4]);
+	void ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv, const float color[4]);
+	ID3D11RenderTargetView* GetRTV(int id) { return 0; }
+	ID3D11ShaderResourceView* GetSRV(int id) { return 0; }
+	ID3D11UnorderedAccessView* GetUAV(int id) { return 0; }
+
+	unsigned int GetCreateCount() { return createCount; }
+	unsigned int GetClearCount() { return clearCount; }
+	unsigned long long GetLiveBytes() { return liveBytes; }
+	unsigned long long GetClearedBytes() { return clearedBytes; }
+
+private:
+	std::vector<RTDesc> textures;
+	std::vector<bool> alive;
+	unsigned int createCount;
+	unsigned int clearCount;
+	unsigned long long liveBytes;
+	unsigned long long clearedBytes;
+};
+
+typedef int RTHandle;
+#define RT_INVALID_HANDLE -1
+
+// --------------------------------------------------------
+// The pool itself
+// --------------------------------------------------------
+class RenderTargetPool
+{
+public:
+	// Takes ownership of the backend
+	RenderTargetPool(IRenderTargetBackend* backend, unsigned int evictAfterFrames = 8);
+	~RenderTargetPool();
+
+	// A target matching desc exactly, yours until Release
+	RTHandle Acquire(const RTDesc& desc);
+	void Release(RTHandle target);
+
+	// A target that's scale * the screen size, recreated by
+	// Resize (the handle stays the same) until Destroy
+	RTHandle CreateScaled(float scale, DXGI_FORMAT format, unsigned int bindFlags);
+	void Destroy(RTHandle target);
+
+	// New screen size - scaled targets are recreated and idle
+	// ones are dropped, since they're most likely the old size
+	void Resize(unsigned int width, unsigned int height);
+
+	// Call once per frame, evicts targets idle for too long
+	void EndFrame();
+
+	void Clear(RTHandle target, const float color[4]);
+	void ClearViews(const RTDesc& desc, ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv, const float color[4]);
+	ID3D11RenderTargetView* GetRTV(RTHandle target);
+	ID3D11ShaderResourceView* GetSRV(RTHandle target);
+	ID3D11UnorderedAccessView* GetUAV(RTHandle target);
+	const RTDesc& GetDesc(RTHandle target) { return entries[target].Desc; }
+
+	// Stats
+	unsigned int GetTargetCount();                              // Textures alive right now
+	unsigned int GetInUseCount();
+	unsigned int GetCreateCount() { return createCount; }       // Since startup
+	unsigned int GetReuseCount() { return reuseCount; }         // Acquires served from the pool
+	unsigned int GetEvictCount() { return evictCount; }
+	unsigned long long GetLiveBytes() { return liveBytes; }
+	unsigned long long GetPeakBytes() { return peakBytes; }
+	void PrintReport();
+
+private:
+	struct Entry
+	{
+		RTDesc Desc;
+		float Scale;                // 0 for a fixed size target
+		int BackendID;              // -1 for an empty slot
+		bool InUse;
+		unsigned int LastUsedFrame;
+	};
+
+	IRenderTargetBackend* backend;
+	std::vector<Entry> entries;
+	std::vector<int> emptySlots;
+
+	unsigned int evictAfterFrames;
+	unsigned int frame;
+	unsigned int screenWidth;
+	unsigned int screenHeight;
+
+	unsigned int createCount;
+	unsigned int reuseCount;
+	unsigned int evictCount;
+	unsigned long long liveBytes;
+	unsigned long long peakBytes;
+
+	RTHandle AddEntry(const RTDesc& desc, float scale);
+	void CreateTexture(Entry& e);
+	void DestroyTexture(Entry& e);
+	void ScaledSize(float scale, unsigned int* width, unsigned int* height);
+};
@@ -0,0 +1,742 @@
+#include "ShadowAtlas.h"
+#include "Check.h"
+#include "Profiler.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// --------------------------------------------------------
+// AtlasPacker
+// --------------------------------------------------------
+AtlasPacker::AtlasPacker(unsigned int size, unsigned int minTile)
+{
+	this->size = size;
+	this->minTile = minTile;
+	levelCount = 1;
+	while ((size >> levelCount) >= minTile) levelCount++;
+	freeLists.resize(levelCount);
+	Reset();
+}
+
+void AtlasPacker::Reset()
+{
+	for (auto& list : freeLists) list.clear();
+	freeLists[0].push_back(0);
+}
+
+int AtlasPacker::Level(unsigned int tileSize)
+{
+	int level = 0;
+	while (level < levelCount && (size >> level) > tileSize) level++;
+	return level;
+}
+
+static unsigned int PackXY(unsigned int x, unsigned int y) { return x << 16 | y; }
+
+// Takes the lowest free block at level, splitting a bigger one
+// if there isn't one.  Blocks are split into four quadrants.
+bool AtlasPacker::Allocate(unsigned int tileSize, AtlasTile* tile)
+{
+	int level = Level(tileSize);
+	if (level >= levelCount || (size >> level) != tileSize)
+		return false;
+
+	// Smallest free block that's big enough
+	int from = level;
+	while (from >= 0 && freeLists[from].empty()) from--;
+	if (from < 0)
+		return false;
+
+	// Lowest address first keeps the free space in one corner
+	std::vector<unsigned int>& list = freeLists[from];
+	auto lowest = std::min_element(list.begin(), list.end());
+	unsigned int block = *lowest;
+	*lowest = list.back();
+	list.pop_back();
+
+	unsigned int x = block >> 16;
+	unsigned int y = block & 0xffff;
+	for (int l = from + 1; l <= level; l++)
+	{
+		unsigned int half = size >> l;
+		freeLists[l].push_back(PackXY(x + half, y));
+		freeLists[l].push_back(PackXY(x, y + half));
+		freeLists[l].push_back(PackXY(x + half, y + half));
+	}
+
+	tile->X = x;
+	tile->Y = y;
+	tile->Size = tileSize;
+	return true;
+}
+
+// Gives a block back, merging it with its three buddies for as
+// long as they're all free
+void AtlasPacker::Free(const AtlasTile& tile)
+{
+	int level = Level(tile.Size);
+	unsigned int x = tile.X;
+	unsigned int y = tile.Y;
+
+	while (level > 0)
+	{
+		unsigned int blockSize = size >> level;
+		unsigned int px = x & ~(2 * blockSize - 1);
+		unsigned int py = y & ~(2 * blockSize - 1);
+
+		std::vector<unsigned int>& list = freeLists[level];
+		unsigned int mine = PackXY(x, y);
+		unsigned int quads[4] = { PackXY(px, py), PackXY(px + blockSize, py),
+			PackXY(px, py + blockSize), PackXY(px + blockSize, py + blockSize) };
+
+		int found = 0;
+		for (unsigned int q : quads)
+			if (q != mine && std::find(list.begin(), list.end(), q) != list.end())
+				found++;
+		if (found < 3)
+			break;
+
+		for (unsigned int q : quads)
+			if (q != mine)
+				list.erase(std::find(list.begin(), list.end(), q));
+
+		x = px;
+		y = py;
+		level--;
+	}
+
+	freeLists[level].push_back(PackXY(x, y));
+}
+
+unsigned long long AtlasPacker::GetFreeTexels()
+{
+	unsigned long long texels = 0;
+	for (int l = 0; l < levelCount; l++)
+	{
+		unsigned long long s = size >> l;
+		texels += freeLists[l].size() * s * s;
+	}
+	return texels;
+}
+
+// --------------------------------------------------------
+// Light volumes
+// --------------------------------------------------------
+
+// Half angle of a spot light's shadow.  Spot falloff is
+// pow(cos, 45 - cone), so this is where it drops to 1/256.
+static float SpotShadowAngle(const LocalLight& light)
+{
+	float maxAngle = XMConvertToRadians(SHADOW_SPOT_MAX_ANGLE);
+	float exponent = 45.0f - light.cone;
+	if (exponent <= 1.0f)
+		return maxAngle;
+	float angle = acosf(powf(1.0f / 256.0f, 1.0f / exponent));
+	return angle < maxAngle ? angle : maxAngle;
+}
+
+bool ShadowCasterTouchesLight(const LocalLight& light, const ShadowCaster& caster)
+{
+	XMVECTOR v = XMVectorSubtract(XMLoadFloat3(&caster.Center), XMLoadFloat3(&light.LightPos));
+	float distSq = XMVectorGetX(XMVector3LengthSq(v));
+	float reach = light.range + caster.Radius;
+	if (distSq > reach * reach)
+		return false;
+	if (light.type != LIGHT_TYPE_SPOT)
+		return true;
+
+	// Sphere against the cone: along the axis and away from it
+	float angle = SpotShadowAngle(light);
+	float sinA = sinf(angle), cosA = cosf(angle);
+	XMVECTOR axis = XMVector3Normalize(XMLoadFloat3(&light.Direction));
+	float along = XMVectorGetX(XMVector3Dot(v, axis));
+	float across = sqrtf(std::max(distSq - along * along, 0.0f));
+
+	// Closest point of the cone is its tip
+	if (along * cosA + across * sinA < 0)
+		return distSq <= caster.Radius * caster.Radius;
+	return across * cosA - along * sinA <= caster.Radius;
+}
+
+// Cube face f looks down axis f / 2, positive for even f.
+// Its frustum is the four 45 degree planes around that axis.
+static bool CasterInFace(const LocalLight& light, const ShadowCaster& caster, int face)
+{
+	float d[3] = { caster.Center.x - light.LightPos.x, caster.Center.y - light.LightPos.y, caster.Center.z - light.LightPos.z };
+	int axis = face / 2;
+	float major = (face & 1) ? -d[axis] : d[axis];
+	float slack = -caster.Radius * 1.41421356f;
+	for (int other = 0; other < 3; other++)
+	{
+		if (other == axis) continue;
+		if (major - d[other] < slack || major + d[other] < slack)
+			return false;
+	}
+	return true;
+}
+
+// +X, -X, +Y, -Y, +Z, -Z - the order LocalShadows.hlsli expects
+static const XMFLOAT3 cubeForward[6] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+static const XMFLOAT3 cubeUp[6] = { {0, 1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}, {0, 1, 0}, {0, 1, 0} };
+
+static XMFLOAT4X4 LightViewProj(const LocalLight& light, int face)
+{
+	XMVECTOR pos = XMLoadFloat3(&light.LightPos);
+	XMMATRIX view, proj;
+	float zNear = std::max(light.range * 0.001f, 0.05f);
+
+	if (light.type == LIGHT_TYPE_SPOT)
+	{
+		XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&light.Direction));
+		XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+		view = XMMatrixLookToLH(pos, dir, up);
+		proj = XMMatrixPerspectiveFovLH(2.0f * SpotShadowAngle(light), 1.0f, zNear, light.range);
+	}
+	else
+	{
+		view = XMMatrixLookToLH(pos, XMLoadFloat3(&cubeForward[face]), XMLoadFloat3(&cubeUp[face]));
+		proj = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, zNear, light.range);
+	}
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, view * proj);
+	return viewProj;
+}
+
+// Only what the shadow map was drawn from - not colors
+static bool SameShadow(const LocalLight& a, const LocalLight& b)
+{
+	return a.type == b.type && a.range == b.range &&
+		a.LightPos.x == b.LightPos.x && a.LightPos.y == b.LightPos.y && a.LightPos.z == b.LightPos.z &&
+		(a.type != LIGHT_TYPE_SPOT || (a.cone == b.cone &&
+			a.Direction.x == b.Direction.x && a.Direction.y == b.Direction.y && a.Direction.z == b.Direction.z));
+}
+
+static bool SameCaster(const ShadowCaster& a, const ShadowCaster& b)
+{
+	return a.Center.x == b.Center.x && a.Center.y == b.Center.y && a.Center.z == b.Center.z && a.Radius == b.Radius;
+}
+
+// --------------------------------------------------------
+// ShadowAtlas
+// --------------------------------------------------------
+ShadowAtlas::ShadowAtlas(unsigned int size)
+	: packer(size, SHADOW_ATLAS_MIN_TILE)
+{
+	dirtyViews = 0;
+	repacks = 0;
+}
+
+void ShadowAtlas::Invalidate()
+{
+	for (auto& s : states) s.Valid = false;
+}
+
+// --------------------------------------------------------
+// Tile size from how much of the screen the light's range
+// covers, then halved until everything fits:
+// - every light wants the next power of two above its
+//   projected height in pixels
+// - sizes only go down after SHADOW_ATLAS_SHRINK_FRAMES
+//   frames of wanting less, so lights near a boundary don't
+//   flip between two sizes (and redraw) every frame
+// - while the tiles don't fit, the light with the most texels
+//   for its importance is halved; lights that can't shrink
+//   any more are dropped, least important first
+// --------------------------------------------------------
+void ShadowAtlas::ChooseSizes(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view,
+	float fovY, unsigned int screenHeight)
+{
+	XMMATRIX viewMat = XMLoadFloat4x4(&view);
+	float tanHalf = tanf(fovY * 0.5f);
+	unsigned int maxTile = std::min((unsigned int)SHADOW_ATLAS_MAX_TILE, packer.GetSize());
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		LightState& s = states[i];
+		const LocalLight& l = lights[i];
+
+		// Projected sphere, as a fraction of the screen's height
+		XMVECTOR p = XMVector3TransformCoord(XMLoadFloat3(&l.LightPos), viewMat);
+		float distSq = XMVectorGetX(XMVector3LengthSq(p));
+		float rangeSq = l.range * l.range;
+		s.Importance = 1.0f;
+		if (distSq > rangeSq)
+			s.Importance = std::min(l.range / (sqrtf(distSq - rangeSq) * tanHalf), 1.0f);
+
+		unsigned int wanted = SHADOW_ATLAS_MIN_TILE;
+		while (wanted < maxTile && wanted < s.Importance * screenHeight) wanted *= 2;
+		s.WantedSize = wanted;
+
+		if (wanted >= s.TileSize)
+		{
+			s.TargetSize = wanted;
+			s.ShrinkFrames = 0;
+		}
+		else if (++s.ShrinkFrames >= SHADOW_ATLAS_SHRINK_FRAMES)
+		{
+			s.TargetSize = wanted;
+			s.ShrinkFrames = 0;
+		}
+		else
+			s.TargetSize = s.TileSize;
+	}
+
+	// Fit the budget
+	unsigned long long area = (unsigned long long)packer.GetSize() * packer.GetSize();
+	for (;;)
+	{
+		unsigned long long used = 0;
+		unsigned int viewCount = 0;
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			used += (unsigned long long)states[i].TargetSize * states[i].TargetSize * states[i].TileCount;
+			if (states[i].TargetSize) viewCount += states[i].TileCount;
+		}
+		if (used <= area && viewCount <= SHADOW_ATLAS_MAX_VIEWS)
+			break;
+
+		int shrink = -1, drop = -1;
+		float shrinkScore = 0, dropImportance = 0;
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			const LightState& s = states[i];
+			if (!s.TargetSize) continue;
+			float score = s.TargetSize / s.Importance;
+			if (s.TargetSize > SHADOW_ATLAS_MIN_TILE && used > area && (shrink < 0 || score > shrinkScore))
+			{
+				shrink = i;
+				shrinkScore = score;
+			}
+			if (drop < 0 || s.Importance < dropImportance)
+			{
+				drop = i;
+				dropImportance = s.Importance;
+			}
+		}
+
+		if (shrink >= 0)
+			states[shrink].TargetSize /= 2;
+		else
+			states[drop].TargetSize = 0;
+	}
+}
+
+// --------------------------------------------------------
+// Lights whose size changed give their tiles back, then the
+// ones without tiles are placed biggest first.  If that
+// fails the atlas is too fragmented, so every tile is thrown
+// away and packed again - with power of two squares, biggest
+// first into an empty atlas always fits what the budget let
+// through.
+// --------------------------------------------------------
+void ShadowAtlas::Pack(unsigned int lightCount)
+{
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		LightState& s = states[i];
+		if (s.TileSize == s.TargetSize) continue;
+		for (unsigned int t = 0; s.TileSize && t < s.TileCount; t++)
+			packer.Free(s.Tiles[t]);
+		s.TileSize = 0;
+		s.Valid = false;
+	}
+
+	std::vector<unsigned int> order;
+	for (unsigned int i = 0; i < lightCount; i++)
+		if (states[i].TargetSize && !states[i].TileSize)
+			order.push_back(i);
+
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		std::stable_sort(order.begin(), order.end(),
+			[this](unsigned int a, unsigned int b) { return states[a].TargetSize > states[b].TargetSize; });
+
+		bool fits = true;
+		for (unsigned int i : order)
+		{
+			LightState& s = states[i];
+			for (unsigned int t = 0; t < s.TileCount && fits; t++)
+				fits = packer.Allocate(s.TargetSize, &s.Tiles[t]);
+			if (!fits) break;
+			s.TileSize = s.TargetSize;
+		}
+		if (fits)
+			return;
+
+		packer.Reset();
+		repacks++;
+		order.clear();
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			states[i].TileSize = 0;
+			states[i].Valid = false;
+			if (states[i].TargetSize)
+				order.push_back(i);
+		}
+	}
+}
+
+void ShadowAtlas::Update(LocalLight* lights, unsigned int lightCount, const ShadowCaster* casters, unsigned int casterCount,
+	const XMFLOAT4X4& view, float fovY, unsigned int screenHeight)
+{
+	PROFILE_ZONE("ShadowAtlas::Update");
+
+	// Lights that went away give their tiles back
+	for (unsigned int i = lightCount; i < states.size(); i++)
+		for (unsigned int t = 0; states[i].TileSize && t < states[i].TileCount; t++)
+			packer.Free(states[i].Tiles[t]);
+	if (states.size() != lightCount)
+	{
+		LightState blank = {};
+		states.resize(lightCount, blank);
+	}
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		unsigned int tileCount = lights[i].type == LIGHT_TYPE_SPOT ? 1 : 6;
+		if (states[i].TileSize && states[i].TileCount != tileCount)
+		{
+			for (unsigned int t = 0; t < states[i].TileCount; t++)
+				packer.Free(states[i].Tiles[t]);
+			states[i].TileSize = 0;
+			states[i].Valid = false;
+		}
+		states[i].TileCount = tileCount;
+		if (states[i].Valid && !SameShadow(lights[i], states[i].Last))
+			states[i].Valid = false;
+	}
+
+	ChooseSizes(lights, lightCount, view, fovY, screenHeight);
+	Pack(lightCount);
+
+	// Casters that moved (or came or went) redraw every light
+	// they were or are now in reach of
+	unsigned int known = std::min(casterCount, (unsigned int)lastCasters.size());
+	for (unsigned int c = 0; c < std::max(casterCount, (unsigned int)lastCasters.size()); c++)
+	{
+		bool before = c < lastCasters.size();
+		bool after = c < casterCount;
+		if (c < known && SameCaster(casters[c], lastCasters[c]))
+			continue;
+
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			LightState& s = states[i];
+			if (!s.Valid) continue;
+			if ((before && ShadowCasterTouchesLight(s.Last, lastCasters[c])) ||
+				(after && ShadowCasterTouchesLight(lights[i], casters[c])))
+				s.Valid = false;
+		}
+	}
+	lastCasters.assign(casters, casters + casterCount);
+
+	views.clear();
+	dirtyViews = 0;
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		LightState& s = states[i];
+		if (!s.TileSize)
+		{
+			lights[i].shadow = -1;
+			continue;
+		}
+
+		lights[i].shadow = (int)views.size();
+		for (unsigned int t = 0; t < s.TileCount; t++)
+		{
+			ShadowView v;
+			v.ViewProj = LightViewProj(lights[i], t);
+			v.Tile = s.Tiles[t];
+			v.Light = i;
+			v.Dirty = !s.Valid;
+			views.push_back(v);
+			if (v.Dirty) dirtyViews++;
+		}
+
+		s.Valid = true;
+		s.Last = lights[i];
+	}
+
+	// What each dirty view has to draw
+	viewCasters.resize(views.size());
+	for (unsigned int v = 0; v < views.size(); v++)
+	{
+		viewCasters[v].clear();
+		if (!views[v].Dirty) continue;
+
+		const LocalLight& l = lights[views[v].Light];
+		int face = v - l.shadow;
+		for (unsigned int c = 0; c < casterCount; c++)
+			if (ShadowCasterTouchesLight(l, casters[c]) && (l.type == LIGHT_TYPE_SPOT || CasterInFace(l, casters[c], face)))
+				viewCasters[v].push_back(c);
+	}
+}
+
+// --------------------------------------------------------
+// The atlas "unit tests", run at debug startup
+// --------------------------------------------------------
+static float RandomRange(float min, float max)
+{
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static bool TilesOverlap(const AtlasTile& a, const AtlasTile& b)
+{
+	return a.X < b.X + b.Size && b.X < a.X + a.Size && a.Y < b.Y + b.Size && b.Y < a.Y + a.Size;
+}
+
+static bool AnyOverlap(const std::vector<AtlasTile>& tiles)
+{
+	for (size_t i = 0; i < tiles.size(); i++)
+		for (size_t j = i + 1; j < tiles.size(); j++)
+			if (TilesOverlap(tiles[i], tiles[j]))
+				return true;
+	return false;
+}
+
+static LocalLight MakeLight(int type, XMFLOAT3 pos, float range, XMFLOAT3 dir = XMFLOAT3(0, 0, 1), float cone = 30.0f)
+{
+	LocalLight l = {};
+	l.DiffuseColor = XMFLOAT4(1, 1, 1, 1);
+	l.type = type;
+	l.LightPos = pos;
+	l.range = range;
+	l.Direction = dir;
+	l.cone = cone;
+	l.shadow = -1;
+	return l;
+}
+
+// Camera at the origin looking down +Z
+static XMFLOAT4X4 ReportView(XMFLOAT3 eye)
+{
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMLoadFloat3(&eye), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	return view;
+}
+
+//  - the packer hands out tiles that never overlap, fills the
+//    atlas exactly, and merges back to one block when emptied
+//  - a static scene redraws nothing after the first frame
+//  - moving a caster redraws only the lights it's in reach of
+//  - moving a light redraws only that light
+void ShadowAtlasReport()
+{
+	printf("\nShadow atlas (%ux%u, tiles %u to %u)\n", SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE,
+		SHADOW_ATLAS_MIN_TILE, SHADOW_ATLAS_MAX_TILE);
+
+	// Packer: fill with the biggest tiles, then empty it again
+	{
+		AtlasPacker packer(SHADOW_ATLAS_SIZE, SHADOW_ATLAS_MIN_TILE);
+		std::vector<AtlasTile> tiles;
+		AtlasTile t;
+		while (packer.Allocate(SHADOW_ATLAS_MAX_TILE, &t))
+			tiles.push_back(t);
+		unsigned int expected = (SHADOW_ATLAS_SIZE / SHADOW_ATLAS_MAX_TILE) * (SHADOW_ATLAS_SIZE / SHADOW_ATLAS_MAX_TILE);
+		bool filled = tiles.size() == expected && packer.GetFreeTexels() == 0 && !AnyOverlap(tiles);
+
+		for (auto& tile : tiles) packer.Free(tile);
+		bool merged = packer.GetFreeTexels() == (unsigned long long)SHADOW_ATLAS_SIZE * SHADOW_ATLAS_SIZE &&
+			packer.Allocate(SHADOW_ATLAS_SIZE, &t);
+
+		printf("  packer: %u of %u %ux%u tiles, %s, empties back to one block %s\n", (unsigned int)tiles.size(),
+			expected, SHADOW_ATLAS_MAX_TILE, SHADOW_ATLAS_MAX_TILE, CheckResult(filled), CheckResult(merged));
+	}
+
+	// Packer: random sizes in and out
+	{
+		srand(2468);
+		AtlasPacker packer(SHADOW_ATLAS_SIZE, SHADOW_ATLAS_MIN_TILE);
+		std::vector<AtlasTile> live;
+		unsigned int ops = 20000, failures = 0, allocations = 0;
+		bool ok = true;
+		for (unsigned int op = 0; op < ops; op++)
+		{
+			if (!live.empty() && (rand() % 2 || live.size() > 200))
+			{
+				size_t i = rand() % live.size();
+				packer.Free(live[i]);
+				live[i] = live.back();
+				live.pop_back();
+			}
+			else
+			{
+				AtlasTile t;
+				unsigned int size = SHADOW_ATLAS_MIN_TILE << (rand() % 4);
+				if (packer.Allocate(size, &t))
+				{
+					for (auto& other : live)
+						ok = ok && !TilesOverlap(t, other);
+					ok = ok && t.X + t.Size <= SHADOW_ATLAS_SIZE && t.Y + t.Size <= SHADOW_ATLAS_SIZE;
+					live.push_back(t);
+					allocations++;
+				}
+				else failures++;
+			}
+
+			unsigned long long used = 0;
+			for (auto& t : live) used += (unsigned long long)t.Size * t.Size;
+			ok = ok && used + packer.GetFreeTexels() == (unsigned long long)SHADOW_ATLAS_SIZE * SHADOW_ATLAS_SIZE;
+		}
+		for (auto& t : live) packer.Free(t);
+		ok = ok && packer.GetFreeTexels() == (unsigned long long)SHADOW_ATLAS_SIZE * SHADOW_ATLAS_SIZE;
+		printf("  packer stress: %u ops, %u allocations, %u full, no overlaps or lost texels  %s\n",
+			ops, allocations, failures, CheckResult(ok));
+	}
+
+	// Invalidation: one point light, one spot light looking down +Z
+	{
+		ShadowAtlas atlas;
+		LocalLight lights[2] = {
+			MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 20), 10.0f),
+			MakeLight(LIGHT_TYPE_SPOT, XMFLOAT3(40, 0, 0), 30.0f, XMFLOAT3(0, 0, 1), 30.0f) };
+		ShadowCaster casters[3] = {
+			{ XMFLOAT3(2, 0, 20), 1.0f },     // next to the point light
+			{ XMFLOAT3(40, 0, 15), 1.0f },    // in front of the spot light
+			{ XMFLOAT3(-60, 0, 0), 1.0f } };  // nowhere near either
+		XMFLOAT4X4 view = ReportView(XMFLOAT3(0, 0, -10));
+		float fovY = 0.25f * 3.1415926535f;
+
+		struct Step { const char* name; unsigned int expected; unsigned int got; };
+		std::vector<Step> steps;
+		auto frame = [&](const char* name, unsigned int expected)
+		{
+			atlas.Update(lights, 2, casters, 3, view, fovY, 720);
+			steps.push_back({ name, expected, atlas.GetDirtyViewCount() });
+		};
+
+		frame("first frame", 7);
+		frame("nothing moved", 0);
+		casters[0].Center.y += 0.5f;
+		frame("caster moved by the point light", 6);
+		casters[2].Center.x -= 5.0f;
+		frame("caster moved far from both", 0);
+		lights[1].LightPos.y += 1.0f;
+		frame("spot light moved", 1);
+		casters[1].Center.x += 30.0f;
+		frame("caster left the spot light", 1);
+		casters[1].Center.z -= 20.0f;
+		frame("caster moved outside both", 0);
+		lights[0].DiffuseColor = XMFLOAT4(1, 0, 0, 1);
+		frame("point light changed color", 0);
+		atlas.Invalidate();
+		frame("invalidated", 7);
+		frame("nothing moved", 0);
+
+		bool ok = atlas.GetRepackCount() == 0;
+		for (auto& s : steps)
+		{
+			printf("  %-32s %u views redrawn (expect %u)  %s\n", s.name, s.got, s.expected, CheckResult(s.got == s.expected));
+			ok = ok && s.got == s.expected;
+		}
+		printf("  invalidation %s, %u repacks\n", CheckResult(ok), atlas.GetRepackCount());
+	}
+
+	// Cone test against brute force points on the caster's surface
+	{
+		srand(97531);
+		unsigned int missed = 0, tests = 20000;
+		for (unsigned int n = 0; n < tests; n++)
+		{
+			XMFLOAT3 dir(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1));
+			LocalLight l = MakeLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 0, 0), 20.0f, dir, RandomRange(0, 44));
+			ShadowCaster c = { XMFLOAT3(RandomRange(-25, 25), RandomRange(-25, 25), RandomRange(-25, 25)), RandomRange(0.1f, 5.0f) };
+			if (ShadowCasterTouchesLight(l, c)) continue;
+
+			// Nothing inside the sphere may be lit by the cone
+			XMVECTOR axis = XMVector3Normalize(XMLoadFloat3(&dir));
+			float cosA = cosf(SpotShadowAngle(l));
+			for (int k = 0; k < 64; k++)
+			{
+				XMVECTOR p = XMVectorAdd(XMLoadFloat3(&c.Center), XMVectorScale(XMVector3Normalize(
+					XMVectorSet(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1), 0)), c.Radius * RandomRange(0, 1)));
+				float len = XMVectorGetX(XMVector3Length(p));
+				if (len < l.range && XMVectorGetX(XMVector3Dot(p, axis)) >= cosA * len)
+				{
+					missed++;
+					break;
+				}
+			}
+		}
+		printf("  spot light reach: %u of %u rejected casters were really in the cone  %s\n",
+			missed, tests, CheckResult(missed == 0));
+	}
+}
+
+// --------------------------------------------------------
+// A few hundred static casters, a handful that move, a set
+// of point and spot lights and a camera that flies past them
+// --------------------------------------------------------
+void ShadowAtlasBenchmark(unsigned int frames)
+{
+	srand(8642);
+	const unsigned int staticCount = 400;
+	const unsigned int movingCount = 4;
+	const unsigned int lightCount = 16;
+
+	std::vector<ShadowCaster> casters(staticCount + movingCount);
+	for (unsigned int i = 0; i < staticCount; i++)
+		casters[i] = { XMFLOAT3(RandomRange(-100, 100), RandomRange(-2, 6), RandomRange(-100, 100)), RandomRange(0.5f, 2.0f) };
+
+	std::vector<LocalLight> lights(lightCount);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		XMFLOAT3 pos(RandomRange(-90, 90), RandomRange(4, 10), RandomRange(-90, 90));
+		if (i < 6)
+			lights[i] = MakeLight(LIGHT_TYPE_POINT, pos, RandomRange(8, 16));
+		else
+			lights[i] = MakeLight(LIGHT_TYPE_SPOT, pos, RandomRange(15, 30),
+				XMFLOAT3(RandomRange(-0.5f, 0.5f), -1, RandomRange(-0.5f, 0.5f)), RandomRange(20, 35));
+	}
+
+	ShadowAtlas atlas;
+	float fovY = 0.25f * 3.1415926535f;
+	unsigned long long cachedViews = 0, allViews = 0, cachedDraws = 0, allDraws = 0;
+	double ms = 0;
+
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		float t = (float)f / frames;
+
+		// Movers circle around the middle of the scene
+		for (unsigned int m = 0; m < movingCount; m++)
+		{
+			float angle = t * 6.2831853f * 4 + m * 1.5707963f;
+			float radius = 20.0f + 15.0f * m;
+			casters[staticCount + m] = { XMFLOAT3(cosf(angle) * radius, 1.0f, sinf(angle) * radius), 1.5f };
+		}
+
+		// Camera flies across the scene
+		XMFLOAT3 eye(-100 + 200 * t, 10, -60 + 40 * t);
+		XMFLOAT4X4 view = ReportView(eye);
+
+		unsigned __int64 start = Profiler::Now();
+		atlas.Update(lights.data(), lightCount, casters.data(), (unsigned int)casters.size(), view, fovY, 720);
+		ms += Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+
+		const std::vector<ShadowView>& views = atlas.GetViews();
+		cachedViews += atlas.GetDirtyViewCount();
+		allViews += views.size();
+		for (unsigned int v = 0; v < views.size(); v++)
+		{
+			unsigned int draws = 0;
+			const LocalLight& l = lights[views[v].Light];
+			for (auto& c : casters)
+				if (ShadowCasterTouchesLight(l, c) && (l.type == LIGHT_TYPE_SPOT || CasterInFace(l, c, v - l.shadow)))
+					draws++;
+			allDraws += draws;
+			if (views[v].Dirty) cachedDraws += draws;
+		}
+	}
+
+	printf("\nShadow atlas caching, %u frames, %u lights, %u casters (%u moving)\n",
+		frames, lightCount, (unsigned int)casters.size(), movingCount);
+	printf("  views drawn:   %llu cached vs %llu every frame (%.1f%%)\n", cachedViews, allViews,
+		allViews ? 100.0 * cachedViews / allViews : 0.0);
+	printf("  casters drawn: %llu cached vs %llu every frame (%.1f%%)\n", cachedDraws, allDraws,
+		allDraws ? 100.0 * cachedDraws / allDraws : 0.0);
+	printf("  repacks: %u, update: %.3fms per frame\n", atlas.GetRepackCount(), ms / frames);
+}
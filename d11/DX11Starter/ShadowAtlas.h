@@ -0,0 +1,142 @@
+#pragma once
+#include <vector>
+#include "Light.h"
+#include "ShadowCascades.h"
+
+// --------------------------------------------------------
+// Shadow atlas for the point and spot lights
+//
+// Every shadowed light gets square tiles in one big depth
+// texture - one for a spot light, six (a cube) for a point
+// light.  Each frame:
+//
+// - Tile sizes follow how big the light's range looks on
+//   screen, rounded to a power of two and halved for the
+//   least important lights until everything fits.  Lights
+//   only drop to a smaller tile after wanting one for
+//   SHADOW_ATLAS_SHRINK_FRAMES frames in a row.
+// - Tiles come from AtlasPacker, a buddy allocator.  If a
+//   new tile doesn't fit, the whole atlas is repacked.
+// - Tiles are kept from frame to frame and only redrawn when
+//   they have to be: new tile, light moved or changed, or a
+//   caster moved into, inside or out of the light's volume.
+//
+// No device is needed here - LocalShadows draws the dirty
+// views, and LocalShadows.hlsli samples them.
+// --------------------------------------------------------
+
+#define SHADOW_ATLAS_SIZE 4096
+#define SHADOW_ATLAS_MIN_TILE 128
+#define SHADOW_ATLAS_MAX_TILE 1024
+#define SHADOW_ATLAS_MAX_VIEWS 64
+#define SHADOW_ATLAS_SHRINK_FRAMES 30
+
+// Widest spot light shadow (half angle, degrees).  Light past
+// it isn't shadowed.
+#define SHADOW_SPOT_MAX_ANGLE 60.0f
+
+// A square region of the atlas, in texels
+struct AtlasTile
+{
+	unsigned int X;
+	unsigned int Y;
+	unsigned int Size;
+};
+
+// --------------------------------------------------------
+// Buddy allocator for power of two square tiles
+// --------------------------------------------------------
+class AtlasPacker
+{
+public:
+	AtlasPacker(unsigned int size, unsigned int minTile);
+
+	// Size must be a power of two between minTile and the atlas size
+	bool Allocate(unsigned int tileSize, AtlasTile* tile);
+	void Free(const AtlasTile& tile);
+	void Reset();
+
+	unsigned int GetSize() { return size; }
+	unsigned long long GetFreeTexels();
+
+private:
+	unsigned int size;
+	unsigned int minTile;
+	int levelCount;
+
+	// Free blocks per level (level 0 = the whole atlas), x << 16 | y
+	std::vector<std::vector<unsigned int>> freeLists;
+
+	int Level(unsigned int tileSize);
+};
+
+// One tile to draw: a spot light, or one face of a point light
+struct ShadowView
+{
+	XMFLOAT4X4 ViewProj;   // World -> tile clip space (not transposed)
+	AtlasTile Tile;
+	unsigned int Light;    // Index into the light list
+	bool Dirty;            // Has to be drawn this frame
+};
+
+class ShadowAtlas
+{
+public:
+	ShadowAtlas(unsigned int size = SHADOW_ATLAS_SIZE);
+
+	// Sizes, packs and works out what needs drawing, and sets
+	// each light's shadow to its first view (-1 for none)
+	// - casters have to be in the same order every frame
+	// - view is the world -> view matrix (not transposed)
+	void Update(LocalLight* lights, unsigned int lightCount, const ShadowCaster* casters, unsigned int casterCount,
+		const XMFLOAT4X4& view, float fovY, unsigned int screenHeight);
+
+	// Forgets every tile's contents (everything redraws next Update)
+	void Invalidate();
+
+	const std::vector<ShadowView>& GetViews() { return views; }
+
+	// Casters that reach a dirty view's light (empty for clean views)
+	const std::vector<unsigned int>& GetViewCasters(unsigned int view) { return viewCasters[view]; }
+
+	// Stats
+	unsigned int GetDirtyViewCount() { return dirtyViews; }   // Last Update
+	unsigned int GetRepackCount() { return repacks; }         // Since creation
+	AtlasPacker* GetPacker() { return &packer; }
+
+private:
+	struct LightState
+	{
+		AtlasTile Tiles[6];
+		unsigned int TileCount;
+		unsigned int TileSize;       // 0 = no tiles
+		unsigned int TargetSize;     // This frame
+		unsigned int WantedSize;     // Before hysteresis
+		unsigned int ShrinkFrames;
+		float Importance;
+		bool Valid;                  // Tiles hold this light's shadow
+		LocalLight Last;             // What the tiles were drawn with
+	};
+
+	AtlasPacker packer;
+	std::vector<LightState> states;
+	std::vector<ShadowCaster> lastCasters;
+	std::vector<ShadowView> views;
+	std::vector<std::vector<unsigned int>> viewCasters;
+	unsigned int dirtyViews;
+	unsigned int repacks;
+
+	void ChooseSizes(const LocalLight* lights, unsigned int lightCount, const XMFLOAT4X4& view,
+		float fovY, unsigned int screenHeight);
+	void Pack(unsigned int lightCount);
+};
+
+// Can a caster's shadow land anywhere the light reaches?
+bool ShadowCasterTouchesLight(const LocalLight& light, const ShadowCaster& caster);
+
+// Checks the packer and the cache invalidation, and prints the results
+void ShadowAtlasReport();
+
+// Scripted scene with a few moving objects, prints how many
+// tiles get redrawn with and without the cache
+void ShadowAtlasBenchmark(unsigned int frames);
@@ -0,0 +1,344 @@
+#include "ShadowCascades.h"
+#include "Check.h"
+#include "Profiler.h"
+#include <emmintrin.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+void ShadowComputeSplits(float zNear, float shadowDistance, float lambda, float* splits)
+{
+	splits[0] = zNear;
+	for (int i = 1; i < SHADOW_CASCADES; i++)
+	{
+		float t = (float)i / SHADOW_CASCADES;
+		float logSplit = zNear * powf(shadowDistance / zNear, t);
+		float uniformSplit = zNear + (shadowDistance - zNear) * t;
+		splits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+	}
+	splits[SHADOW_CASCADES] = shadowDistance;
+}
+
+// Light looks along its direction, from the world origin
+static XMMATRIX LightRotation(XMFLOAT3 lightDirection)
+{
+	XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+	XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	return XMMatrixLookToLH(XMVectorSet(0, 0, 0, 1), dir, up);
+}
+
+// --------------------------------------------------------
+// The smallest sphere around the slice has its center on the
+// view axis, equally far from the near and far corners.  It
+// only depends on the slice, never on where the camera is
+// pointing.
+// --------------------------------------------------------
+ShadowCascade ShadowFitCascade(const XMFLOAT4X4& invView, float tanX, float tanY,
+	float splitNear, float splitFar, XMFLOAT3 lightDirection, unsigned int resolution, float casterDepth)
+{
+	float k = tanX * tanX + tanY * tanY;
+	float centerZ = 0.5f * (splitNear + splitFar) * (1.0f + k);
+	float radius;
+	if (centerZ >= splitFar)
+	{
+		// Wide slice - the far cap alone decides
+		centerZ = splitFar;
+		radius = splitFar * sqrtf(k);
+	}
+	else
+	{
+		float dz = splitFar - centerZ;
+		radius = sqrtf(dz * dz + k * splitFar * splitFar);
+	}
+
+	// One texel of border, so the sphere still fits once its
+	// center moves to the texel grid
+	float texelSize = 2.0f * radius / (resolution - 2);
+	float halfSize = 0.5f * texelSize * resolution;
+
+	XMMATRIX rotation = LightRotation(lightDirection);
+	XMVECTOR worldCenter = XMVector3TransformCoord(XMVectorSet(0, 0, centerZ, 1), XMLoadFloat4x4(&invView));
+	XMFLOAT3 lightCenter;
+	XMStoreFloat3(&lightCenter, XMVector3TransformCoord(worldCenter, rotation));
+	lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+	lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+
+	ShadowCascade c;
+	XMStoreFloat4x4(&c.LightRotation, rotation);
+	c.LightCenter = lightCenter;
+	c.HalfSize = halfSize;
+	c.NearZ = lightCenter.z - radius - casterDepth;
+	c.FarZ = lightCenter.z + radius;
+	c.TexelSize = texelSize;
+	c.SplitNear = splitNear;
+	c.SplitFar = splitFar;
+
+	XMMATRIX proj = XMMatrixOrthographicOffCenterLH(
+		lightCenter.x - halfSize, lightCenter.x + halfSize,
+		lightCenter.y - halfSize, lightCenter.y + halfSize,
+		c.NearZ, c.FarZ);
+	XMStoreFloat4x4(&c.ViewProj, rotation * proj);
+	return c;
+}
+
+// --------------------------------------------------------
+// Sphere vs. the map's footprint, and anything not entirely
+// behind the far plane.  Nothing is cut at the near plane,
+// since those casters are flattened onto it.
+//
+// A ShadowCaster is exactly one __m128, so four of them are
+// loaded and transposed to (x, y, z, radius) lanes.
+// --------------------------------------------------------
+unsigned int ShadowCullCasters(const ShadowCaster* casters, unsigned int count,
+	const ShadowCascade& cascade, unsigned int* visible)
+{
+	const XMFLOAT4X4& r = cascade.LightRotation;
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 r11 = _mm_set1_ps(r._11), r21 = _mm_set1_ps(r._21), r31 = _mm_set1_ps(r._31);
+	const __m128 r12 = _mm_set1_ps(r._12), r22 = _mm_set1_ps(r._22), r32 = _mm_set1_ps(r._32);
+	const __m128 r13 = _mm_set1_ps(r._13), r23 = _mm_set1_ps(r._23), r33 = _mm_set1_ps(r._33);
+	const __m128 cx = _mm_set1_ps(cascade.LightCenter.x);
+	const __m128 cy = _mm_set1_ps(cascade.LightCenter.y);
+	const __m128 halfSize = _mm_set1_ps(cascade.HalfSize);
+	const __m128 farZ = _mm_set1_ps(cascade.FarZ);
+
+	unsigned int visibleCount = 0;
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 X = _mm_loadu_ps(&casters[i].Center.x);
+		__m128 Y = _mm_loadu_ps(&casters[i + 1].Center.x);
+		__m128 Z = _mm_loadu_ps(&casters[i + 2].Center.x);
+		__m128 R = _mm_loadu_ps(&casters[i + 3].Center.x);
+		_MM_TRANSPOSE4_PS(X, Y, Z, R);
+
+		__m128 lx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(X, r11), _mm_mul_ps(Y, r21)), _mm_mul_ps(Z, r31));
+		__m128 ly = _mm_add_ps(_mm_add_ps(_mm_mul_ps(X, r12), _mm_mul_ps(Y, r22)), _mm_mul_ps(Z, r32));
+		__m128 lz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(X, r13), _mm_mul_ps(Y, r23)), _mm_mul_ps(Z, r33));
+
+		__m128 reach = _mm_add_ps(halfSize, R);
+		__m128 inside = _mm_and_ps(
+			_mm_cmple_ps(_mm_and_ps(_mm_sub_ps(lx, cx), signMask), reach),
+			_mm_cmple_ps(_mm_and_ps(_mm_sub_ps(ly, cy), signMask), reach));
+		inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_sub_ps(lz, R), farZ));
+
+		int mask = _mm_movemask_ps(inside);
+		while (mask)
+		{
+			unsigned int lane = 0;
+			while (!(mask & (1 << lane))) lane++;
+			visible[visibleCount++] = i + lane;
+			mask &= mask - 1;
+		}
+	}
+
+	// Leftovers, same test
+	for (; i < count; i++)
+	{
+		const ShadowCaster& s = casters[i];
+		float x = s.Center.x * r._11 + s.Center.y * r._21 + s.Center.z * r._31;
+		float y = s.Center.x * r._12 + s.Center.y * r._22 + s.Center.z * r._32;
+		float z = s.Center.x * r._13 + s.Center.y * r._23 + s.Center.z * r._33;
+
+		float reach = cascade.HalfSize + s.Radius;
+		if (fabsf(x - cascade.LightCenter.x) <= reach && fabsf(y - cascade.LightCenter.y) <= reach &&
+			z - s.Radius <= cascade.FarZ)
+			visible[visibleCount++] = i;
+	}
+	return visibleCount;
+}
+
+static float RandomRange(float lo, float hi)
+{
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// Random camera somewhere over the scene, looking anywhere but straight up/down
+static XMFLOAT4X4 RandomInvView(float spread)
+{
+	XMVECTOR pos = XMVectorSet(RandomRange(-spread, spread), RandomRange(0, 10), RandomRange(-spread, spread), 1);
+	XMVECTOR dir = XMVector3Normalize(XMVectorSet(RandomRange(-1, 1), RandomRange(-0.8f, 0.8f), RandomRange(-1, 1), 0));
+	XMFLOAT4X4 invView;
+	XMStoreFloat4x4(&invView, XMMatrixInverse(0, XMMatrixLookToLH(pos, dir, XMVectorSet(0, 1, 0, 0))));
+	return invView;
+}
+
+static XMFLOAT3 ToShadowClip(const ShadowCascade& c, XMVECTOR world)
+{
+	XMFLOAT3 p;
+	XMStoreFloat3(&p, XMVector3TransformCoord(world, XMLoadFloat4x4(&c.ViewProj)));
+	return p;
+}
+
+// --------------------------------------------------------
+// The cascade "unit tests", run at debug startup:
+//  - splits start at the near plane, end at the shadow
+//    distance and only ever grow
+//  - every corner of every slice lands inside its map
+//  - a fixed world point sits at the same spot inside its
+//    texel however the camera moves or turns (no crawling)
+//  - texel sizes don't change when the camera turns
+//  - culling never drops a caster that touches the map
+// --------------------------------------------------------
+void ShadowCascadeReport()
+{
+	const float zNear = 0.1f;
+	const float shadowDistance = 60.0f;
+	const float tanY = tanf(0.125f * 3.1415926535f);
+	const float tanX = tanY * 16.0f / 9.0f;
+	const unsigned int resolution = 2048;
+	const float casterDepth = 20.0f;
+	const XMFLOAT3 lightDir(1, -1, 0);
+
+	printf("\nShadow cascades (%d x %ux%u, lambda 0.75, out to %.0f)\n", SHADOW_CASCADES, resolution, resolution, shadowDistance);
+
+	float splits[SHADOW_CASCADES + 1];
+	ShadowComputeSplits(zNear, shadowDistance, 0.75f, splits);
+	bool splitsOk = splits[0] == zNear && splits[SHADOW_CASCADES] == shadowDistance;
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+		splitsOk = splitsOk && splits[i + 1] > splits[i];
+	printf("  splits:");
+	for (int i = 0; i <= SHADOW_CASCADES; i++) printf(" %.2f", splits[i]);
+	printf("  %s\n", CheckResult(splitsOk));
+
+	srand(2468);
+	const unsigned int cameras = 500;
+	unsigned int cornersOut = 0;
+	float worstCrawl = 0;
+	bool texelsFixed = true;
+
+	// Reference cascades and a point inside each
+	XMFLOAT4X4 firstInvView = RandomInvView(0);
+	ShadowCascade reference[SHADOW_CASCADES];
+	XMVECTOR probe[SHADOW_CASCADES];
+	float probeFrac[SHADOW_CASCADES][2];
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		reference[i] = ShadowFitCascade(firstInvView, tanX, tanY, splits[i], splits[i + 1], lightDir, resolution, casterDepth);
+		float z = 0.5f * (splits[i] + splits[i + 1]);
+		probe[i] = XMVector3TransformCoord(XMVectorSet(0.1f * z, -0.05f * z, z, 1), XMLoadFloat4x4(&firstInvView));
+		XMFLOAT3 p = ToShadowClip(reference[i], probe[i]);
+		probeFrac[i][0] = (p.x * 0.5f + 0.5f) * resolution;
+		probeFrac[i][1] = (0.5f - p.y * 0.5f) * resolution;
+		probeFrac[i][0] -= floorf(probeFrac[i][0]);
+		probeFrac[i][1] -= floorf(probeFrac[i][1]);
+	}
+
+	for (unsigned int cam = 0; cam < cameras; cam++)
+	{
+		XMFLOAT4X4 invView = RandomInvView(20.0f);
+		XMMATRIX toWorld = XMLoadFloat4x4(&invView);
+		for (int i = 0; i < SHADOW_CASCADES; i++)
+		{
+			ShadowCascade c = ShadowFitCascade(invView, tanX, tanY, splits[i], splits[i + 1], lightDir, resolution, casterDepth);
+			texelsFixed = texelsFixed && c.TexelSize == reference[i].TexelSize;
+
+			for (int corner = 0; corner < 8; corner++)
+			{
+				float z = (corner & 4) ? splits[i + 1] : splits[i];
+				float x = (corner & 1) ? tanX * z : -tanX * z;
+				float y = (corner & 2) ? tanY * z : -tanY * z;
+				XMFLOAT3 p = ToShadowClip(c, XMVector3TransformCoord(XMVectorSet(x, y, z, 1), toWorld));
+				if (fabsf(p.x) > 1.0001f || fabsf(p.y) > 1.0001f || p.z < -0.0001f || p.z > 1.0001f)
+					cornersOut++;
+			}
+
+			XMFLOAT3 p = ToShadowClip(c, probe[i]);
+			float texel[2] = { (p.x * 0.5f + 0.5f) * resolution, (0.5f - p.y * 0.5f) * resolution };
+			for (int a = 0; a < 2; a++)
+			{
+				float d = fabsf((texel[a] - floorf(texel[a])) - probeFrac[i][a]);
+				worstCrawl = std::max(worstCrawl, std::min(d, 1.0f - d));
+			}
+		}
+	}
+
+	printf("  texel size:");
+	for (int i = 0; i < SHADOW_CASCADES; i++) printf(" %.4f", reference[i].TexelSize);
+	printf("  %s under rotation\n", texelsFixed ? "fixed" : "CHANGES");
+	printf("  slice corners outside their map: %u of %u  %s\n", cornersOut, cameras * SHADOW_CASCADES * 8,
+		CheckResult(cornersOut == 0));
+	printf("  sub-texel drift of a fixed point over %u camera moves: %.5f texels  %s\n", cameras, worstCrawl,
+		CheckResult(worstCrawl < 0.01f));
+
+	// Culling has to keep every caster that reaches the map's
+	// footprint, checked by pushing points on each sphere
+	// through the cascade's matrix
+	std::vector<ShadowCaster> casters(20000);
+	for (auto& s : casters)
+	{
+		s.Center = XMFLOAT3(RandomRange(-150, 150), RandomRange(-20, 40), RandomRange(-150, 150));
+		s.Radius = RandomRange(0.1f, 4.0f);
+	}
+
+	unsigned int missed = 0;
+	unsigned int kept = 0;
+	std::vector<unsigned int> visible(casters.size());
+	std::vector<bool> isVisible(casters.size());
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		unsigned int count = ShadowCullCasters(casters.data(), (unsigned int)casters.size(), reference[i], visible.data());
+		kept += count;
+		std::fill(isVisible.begin(), isVisible.end(), false);
+		for (unsigned int v = 0; v < count; v++) isVisible[visible[v]] = true;
+
+		for (size_t s = 0; s < casters.size(); s++)
+		{
+			if (isVisible[s]) continue;
+			XMVECTOR center = XMLoadFloat3(&casters[s].Center);
+			for (int d = 0; d < 27; d++)
+			{
+				XMVECTOR offset = XMVectorSet((float)(d % 3 - 1), (float)(d / 3 % 3 - 1), (float)(d / 9 - 1), 0);
+				if (d != 13) offset = XMVector3Normalize(offset);
+				XMFLOAT3 p = ToShadowClip(reference[i], center + offset * casters[s].Radius);
+				if (fabsf(p.x) <= 1 && fabsf(p.y) <= 1 && p.z <= 1)
+				{
+					missed++;
+					break;
+				}
+			}
+		}
+	}
+	printf("  caster culling: %u of %u kept over %d cascades, %u wrongly dropped  %s\n",
+		kept, (unsigned int)casters.size() * SHADOW_CASCADES, SHADOW_CASCADES, missed, CheckResult(missed == 0));
+}
+
+void ShadowCullBenchmark(unsigned int casterCount, unsigned int frames)
+{
+	srand(1357);
+	std::vector<ShadowCaster> casters(casterCount);
+	for (auto& s : casters)
+	{
+		s.Center = XMFLOAT3(RandomRange(-500, 500), RandomRange(0, 20), RandomRange(-500, 500));
+		s.Radius = RandomRange(0.5f, 3.0f);
+	}
+
+	float splits[SHADOW_CASCADES + 1];
+	ShadowComputeSplits(0.1f, 60.0f, 0.75f, splits);
+	float tanY = tanf(0.125f * 3.1415926535f);
+	float tanX = tanY * 16.0f / 9.0f;
+
+	std::vector<unsigned int> visible[SHADOW_CASCADES];
+	for (auto& v : visible) v.resize(casterCount);
+	unsigned int counts[SHADOW_CASCADES] = {};
+
+	unsigned __int64 start = Profiler::Now();
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		// New camera every frame, like fitting would see
+		XMFLOAT4X4 invView = RandomInvView(100.0f);
+		for (int i = 0; i < SHADOW_CASCADES; i++)
+		{
+			ShadowCascade c = ShadowFitCascade(invView, tanX, tanY, splits[i], splits[i + 1], XMFLOAT3(1, -1, 0), 2048, 20.0f);
+			counts[i] = ShadowCullCasters(casters.data(), casterCount, c, visible[i].data());
+		}
+	}
+	double ms = Profiler::TicksToNs(Profiler::Now() - start) / 1e6 / frames;
+
+	printf("\nShadow caster culling, %u casters x %d cascades: %.3fms per frame\n", casterCount, SHADOW_CASCADES, ms);
+	printf("  casters kept (last frame):");
+	for (int i = 0; i < SHADOW_CASCADES; i++) printf(" %u", counts[i]);
+	printf("\n");
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "Light.h"
+
+// --------------------------------------------------------
+// Cascaded shadow map math
+//
+// The view frustum, out to the shadow distance, is cut into
+// SHADOW_CASCADES slices spaced between uniform and
+// logarithmic.  Each slice gets its own orthographic map
+// from the directional light's point of view:
+//
+// - The slice is wrapped in a bounding sphere, which is the
+//   same size however the camera turns, so a cascade's texel
+//   size never changes
+// - The sphere's center is snapped to whole texels in light
+//   space, so moving the camera slides the map by whole
+//   texels and shadow edges don't crawl
+// - Depth covers the sphere plus casterDepth towards the
+//   light.  Casters closer to the light than that are
+//   flattened onto the near plane (depth clip is off while
+//   the maps are drawn), so they still cast.
+//
+// No device is needed here - ShadowMaps draws the cascades,
+// and Shadows.hlsli samples them.
+// --------------------------------------------------------
+
+#define SHADOW_CASCADES 4
+
+struct ShadowCascade
+{
+	XMFLOAT4X4 ViewProj;       // World -> shadow clip space (not transposed)
+	XMFLOAT4X4 LightRotation;  // World -> light space, no translation
+	XMFLOAT3 LightCenter;      // Snapped sphere center, in light space
+	float HalfSize;            // Half the map's width in world units
+	float NearZ;               // Light space depth range
+	float FarZ;
+	float TexelSize;           // World units per shadow map texel
+	float SplitNear;           // View depths this cascade is used for
+	float SplitFar;
+};
+
+// Bounding sphere of something that casts a shadow
+struct ShadowCaster
+{
+	XMFLOAT3 Center;
+	float Radius;
+};
+
+// Fills splits with SHADOW_CASCADES + 1 view depths, from
+// zNear to shadowDistance
+// - lambda 0 is uniform spacing, 1 is logarithmic
+void ShadowComputeSplits(float zNear, float shadowDistance, float lambda, float* splits);
+
+// Fits one cascade to the view depths [splitNear, splitFar]
+// - invView is view -> world (not transposed), tanX and tanY
+//   are the frustum's slopes
+ShadowCascade ShadowFitCascade(const XMFLOAT4X4& invView, float tanX, float tanY,
+	float splitNear, float splitFar, XMFLOAT3 lightDirection, unsigned int resolution, float casterDepth);
+
+// Writes the indices of the casters that can throw a shadow
+// into the cascade to visible, returns how many there are
+unsigned int ShadowCullCasters(const ShadowCaster* casters, unsigned int count,
+	const ShadowCascade& cascade, unsigned int* visible);
+
+// Checks the split, fitting and culling math and prints the results
+void ShadowCascadeReport();
+
+// Times culling casterCount casters against every cascade
+void ShadowCullBenchmark(unsigned int casterCount, unsigned int frames);
@@ -0,0 +1,10 @@
+// --------------------------------------------------------
+// Resets a shadow atlas tile to the far plane: a fullscreen
+// triangle at depth 1, drawn into the tile's viewport with
+// depth testing set to always pass
+// --------------------------------------------------------
+float4 main(uint id : SV_VertexID) : SV_POSITION
+{
+	float2 uv = float2((id << 1) & 2, id & 2);
+	return float4(uv.x * 2 - 1, uv.y * -2 + 1, 1, 1);
+}
@@ -0,0 +1,19 @@
+// One matrix per draw, written by ShadowMaps
+cbuffer externalData : register(b0)
+{
+	matrix worldViewProj;
+};
+
+// Only the position stream (Mesh::GetPositionBuffer)
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+};
+
+// --------------------------------------------------------
+// Shadow map depth, no pixel shader bound
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+	return mul(float4(input.position, 1.0f), worldViewProj);
+}
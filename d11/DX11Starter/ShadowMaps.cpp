@@ -0,0 +1,276 @@
+#include "ShadowMaps.h"
+#include <cstring>
+#include <cmath>
+
+// Split spacing, 0 = uniform, 1 = logarithmic
+#define SHADOW_SPLIT_LAMBDA 0.75f
+// How far past a cascade's sphere (towards the light) casters are kept in depth
+#define SHADOW_CASTER_DEPTH 20.0f
+
+ShadowMaps::ShadowMaps(ID3D11Device* device, ID3D11DeviceContext* context, unsigned int resolution)
+{
+	this->context = context;
+	this->resolution = resolution;
+
+	// One slice per cascade, depth target and texture
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = resolution;
+	td.Height = resolution;
+	td.MipLevels = 1;
+	td.ArraySize = SHADOW_CASCADES;
+	td.Format = DXGI_FORMAT_R32_TYPELESS;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&td, 0, &texture);
+
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.MipSlice = 0;
+		dsvDesc.Texture2DArray.FirstArraySlice = i;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(texture, &dsvDesc, &dsvs[i]);
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = SHADOW_CASCADES;
+	device->CreateShaderResourceView(texture, &srvDesc, &srv);
+
+	// Bilinear depth comparison, anything off the map is lit
+	D3D11_SAMPLER_DESC sd = {};
+	sd.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+	sd.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+	sd.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+	sd.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+	sd.BorderColor[0] = sd.BorderColor[1] = sd.BorderColor[2] = sd.BorderColor[3] = 1.0f;
+	sd.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+	sd.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&sd, &sampler);
+
+	// No depth clip: casters between the light and the near
+	// plane are flattened onto it instead of disappearing
+	D3D11_RASTERIZER_DESC rd = {};
+	rd.FillMode = D3D11_FILL_SOLID;
+	rd.CullMode = D3D11_CULL_BACK;
+	rd.SlopeScaledDepthBias = 2.0f;
+	rd.DepthClipEnable = false;
+	device->CreateRasterizerState(&rd, &rasterState);
+
+	depthVS = new SimpleVertexShader(device, context);
+	depthVS->LoadShaderFile(L"ShadowDepthVS.cso");
+
+	// worldViewProj, rewritten before every draw
+	D3D11_BUFFER_DESC bd = {};
+	bd.ByteWidth = sizeof(XMFLOAT4X4);
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		device->CreateDeferredContext(0, &deferredContexts[i]);
+		device->CreateBuffer(&bd, 0, &objectBuffers[i]);
+		visibleCount[i] = 0;
+		commandLists[i] = 0;
+	}
+
+	// Cascade 0 is recorded on the thread calling Render
+	frameEntities = 0;
+	frame = 0;
+	recording = 0;
+	stopping = false;
+	for (int i = 1; i < SHADOW_CASCADES; i++)
+		workers.emplace_back(&ShadowMaps::WorkerLoop, this, i);
+}
+
+ShadowMaps::~ShadowMaps()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& w : workers)
+		w.join();
+
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		if (dsvs[i]) dsvs[i]->Release();
+		if (deferredContexts[i]) deferredContexts[i]->Release();
+		if (objectBuffers[i]) objectBuffers[i]->Release();
+	}
+	if (srv) srv->Release();
+	if (texture) texture->Release();
+	if (sampler) sampler->Release();
+	if (rasterState) rasterState->Release();
+	delete depthVS;
+}
+
+void ShadowMaps::Update(const std::vector<Entity*>& entities, const XMFLOAT4X4& view, float fovY, float aspect,
+	float zNear, float shadowDistance, XMFLOAT3 lightDirection)
+{
+	casters.resize(entities.size());
+	for (size_t i = 0; i < entities.size(); i++)
+		entities[i]->GetBoundingSphere(&casters[i].Center, &casters[i].Radius);
+
+	XMFLOAT4X4 invView;
+	XMStoreFloat4x4(&invView, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
+	float tanY = tanf(fovY * 0.5f);
+	float tanX = tanY * aspect;
+
+	float splits[SHADOW_CASCADES + 1];
+	ShadowComputeSplits(zNear, shadowDistance, SHADOW_SPLIT_LAMBDA, splits);
+
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		cascades[i] = ShadowFitCascade(invView, tanX, tanY, splits[i], splits[i + 1],
+			lightDirection, resolution, SHADOW_CASTER_DEPTH);
+
+		visible[i].resize(casters.size());
+		visibleCount[i] = ShadowCullCasters(casters.data(), (unsigned int)casters.size(), cascades[i], visible[i].data());
+	}
+}
+
+// --------------------------------------------------------
+// Runs on a worker thread - only touches this cascade's
+// deferred context and constant buffer
+// --------------------------------------------------------
+void ShadowMaps::RecordCascade(int cascade, const std::vector<Entity*>& entities, ID3D11CommandList** commandList)
+{
+	ID3D11DeviceContext* dc = deferredContexts[cascade];
+	ID3D11Buffer* objectBuffer = objectBuffers[cascade];
+
+	dc->ClearDepthStencilView(dsvs[cascade], D3D11_CLEAR_DEPTH, 1.0f, 0);
+	dc->OMSetRenderTargets(0, 0, dsvs[cascade]);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)resolution;
+	viewport.Height = (float)resolution;
+	viewport.MaxDepth = 1.0f;
+	dc->RSSetViewports(1, &viewport);
+	dc->RSSetState(rasterState);
+
+	dc->IASetInputLayout(depthVS->GetInputLayout());
+	dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	dc->VSSetShader(depthVS->GetDirectXShader(), 0, 0);
+	dc->VSSetConstantBuffers(0, 1, &objectBuffer);
+	dc->PSSetShader(0, 0, 0);
+
+	XMMATRIX viewProj = XMLoadFloat4x4(&cascades[cascade].ViewProj);
+	UINT stride = sizeof(XMFLOAT3);
+	UINT offset = 0;
+	for (unsigned int v = 0; v < visibleCount[cascade]; v++)
+	{
+		Entity* e = entities[visible[cascade][v]];
+		Mesh* mesh = e->GetMesh();
+
+		// Entity matrices are stored transposed for HLSL
+		XMFLOAT4X4 world = e->GetMatrix();
+		XMFLOAT4X4 worldViewProj;
+		XMStoreFloat4x4(&worldViewProj,
+			XMMatrixTranspose(XMMatrixTranspose(XMLoadFloat4x4(&world)) * viewProj));
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (FAILED(dc->Map(objectBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			continue;
+		memcpy(mapped.pData, &worldViewProj, sizeof(worldViewProj));
+		dc->Unmap(objectBuffer, 0);
+
+		ID3D11Buffer* positions = mesh->GetPositionBuffer();
+		dc->IASetVertexBuffers(0, 1, &positions, &stride, &offset);
+		dc->IASetIndexBuffer(mesh->GetIndexBuffer(), DXGI_FORMAT_R32_UINT, 0);
+		dc->DrawIndexed(mesh->GetIndexCount(), 0, 0);
+	}
+
+	dc->FinishCommandList(FALSE, commandList);
+}
+
+// --------------------------------------------------------
+// Records the cascades in parallel (this thread takes the
+// first one, the workers the rest), then submits them in
+// order.  The immediate context's state is put back afterwards.
+// --------------------------------------------------------
+void ShadowMaps::Render(const std::vector<Entity*>& entities)
+{
+	// Last frame's lit shaders may still have the map bound
+	ID3D11ShaderResourceView* none = 0;
+	context->PSSetShaderResources(SHADOW_MAP_SLOT, 1, &none);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		frameEntities = &entities;
+		recording = (unsigned int)workers.size();
+		frame++;
+	}
+	wake.notify_all();
+	RecordCascade(0, entities, &commandLists[0]);
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [this]() { return recording == 0; });
+		frameEntities = 0;
+	}
+
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		if (!commandLists[i]) continue;
+		context->ExecuteCommandList(commandLists[i], TRUE);
+		commandLists[i]->Release();
+		commandLists[i] = 0;
+	}
+}
+
+// --------------------------------------------------------
+// One per cascade past the first, for the ShadowMaps' life:
+// records its cascade once for every frame Render starts
+// --------------------------------------------------------
+void ShadowMaps::WorkerLoop(int cascade)
+{
+	unsigned int recorded = 0;
+	for (;;)
+	{
+		const std::vector<Entity*>* entities;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this, recorded]() { return stopping || frame != recorded; });
+			if (stopping) break;
+			recorded = frame;
+			entities = frameEntities;
+		}
+
+		RecordCascade(cascade, *entities, &commandLists[cascade]);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			recording--;
+		}
+		done.notify_one();
+	}
+}
+
+void ShadowMaps::Bind(SimplePixelShader* ps)
+{
+	XMFLOAT4X4 viewProj[SHADOW_CASCADES];
+	float ends[SHADOW_CASCADES];
+	float texels[SHADOW_CASCADES];
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		XMStoreFloat4x4(&viewProj[i], XMMatrixTranspose(XMLoadFloat4x4(&cascades[i].ViewProj)));
+		ends[i] = cascades[i].SplitFar;
+		texels[i] = cascades[i].TexelSize;
+	}
+
+	ps->SetShaderResourceView("ShadowMap", srv);
+	ps->SetSamplerState("ShadowSampler", sampler);
+	ps->SetData("shadowViewProj", viewProj, sizeof(viewProj));
+	ps->SetData("cascadeEnds", ends, sizeof(ends));
+	ps->SetData("cascadeTexelSizes", texels, sizeof(texels));
+	ps->SetFloat("shadowMapTexel", 1.0f / resolution);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "SimpleShader.h"
+#include "Entity.h"
+#include "ShadowCascades.h"
+
+// --------------------------------------------------------
+// Cascaded shadow maps for the directional light
+//
+// - One Texture2DArray, a slice per cascade, drawn from the
+//   meshes' position-only streams with no pixel shader
+// - Each cascade only draws the entities whose bounding
+//   sphere reaches it (see ShadowCullCasters)
+// - Every cascade is recorded into its own deferred context:
+//   the first on the calling thread, the others on worker
+//   threads started with the ShadowMaps, one per cascade.
+//   The command lists are played back on the immediate
+//   context in cascade order
+// - Lit pixel shaders include Shadows.hlsli, and Bind() sets
+//   its map, sampler and matrices
+// --------------------------------------------------------
+
+#define SHADOW_MAP_SIZE 2048
+// Keep in sync with Shadows.hlsli
+#define SHADOW_MAP_SLOT 6
+
+class ShadowMaps
+{
+public:
+	ShadowMaps(ID3D11Device* device, ID3D11DeviceContext* context, unsigned int resolution = SHADOW_MAP_SIZE);
+	~ShadowMaps();
+
+	// Fits the cascades to this frame's camera and culls the casters
+	// - view is the world -> view matrix (not transposed)
+	void Update(const std::vector<Entity*>& entities, const XMFLOAT4X4& view, float fovY, float aspect,
+		float zNear, float shadowDistance, XMFLOAT3 lightDirection);
+
+	// Draws every cascade (same entities as the last Update)
+	void Render(const std::vector<Entity*>& entities);
+
+	// Sets the map and cascade constants on a lit pixel shader
+	// (copied by its next CopyAllBufferData)
+	void Bind(SimplePixelShader* ps);
+
+	ID3D11ShaderResourceView* GetSRV() { return srv; }
+	unsigned int GetResolution() { return resolution; }
+	const ShadowCascade& GetCascade(int cascade) { return cascades[cascade]; }
+	unsigned int GetCasterCount(int cascade) { return visibleCount[cascade]; }
+
+private:
+	ID3D11DeviceContext* context;
+	unsigned int resolution;
+
+	ID3D11Texture2D* texture;
+	ID3D11DepthStencilView* dsvs[SHADOW_CASCADES];
+	ID3D11ShaderResourceView* srv;
+	ID3D11SamplerState* sampler;		// Comparison, for PCF
+	ID3D11RasterizerState* rasterState;	// Slope bias, no depth clip
+
+	// Only used for its shader and input layout - SimpleShader
+	// sets constants through the immediate context
+	SimpleVertexShader* depthVS;
+
+	// Per cascade recording state
+	ID3D11DeviceContext* deferredContexts[SHADOW_CASCADES];
+	ID3D11Buffer* objectBuffers[SHADOW_CASCADES];
+
+	ShadowCascade cascades[SHADOW_CASCADES];
+	std::vector<ShadowCaster> casters;
+	std::vector<unsigned int> visible[SHADOW_CASCADES];
+	unsigned int visibleCount[SHADOW_CASCADES];
+
+	// Cascade workers - Render hands them the frame and waits
+	// for all of them, guarded by lock
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::vector<Entity*>* frameEntities;
+	ID3D11CommandList* commandLists[SHADOW_CASCADES];
+	unsigned int frame;
+	unsigned int recording;
+	bool stopping;
+	std::vector<std::thread> workers;
+
+	void RecordCascade(int cascade, const std::vector<Entity*>& entities, ID3D11CommandList** commandList);
+	void WorkerLoop(int cascade);
+};
@@ -0,0 +1,48 @@
+//cascaded shadow maps for the directional light
+//(see ShadowCascades.h for how the cascades are fit)
+#ifndef SHADOWS
+#define SHADOWS
+
+#define SHADOW_CASCADES 4
+
+cbuffer shadowData : register(b2)
+{
+	matrix shadowViewProj[SHADOW_CASCADES]; //world --> shadow clip space
+	float4 cascadeEnds;                     //view depth where each cascade stops
+	float4 cascadeTexelSizes;               //world units per texel
+	float shadowMapTexel;                   //1 / resolution
+};
+
+Texture2DArray ShadowMap : register(t6);   //SHADOW_MAP_SLOT
+SamplerComparisonState ShadowSampler : register(s1);
+
+//1 = lit, 0 = fully in shadow
+//N is the surface normal, the lookup moves along it by a
+//texel or so to keep surfaces from shadowing themselves
+float ShadowFactor(float3 worldPos, float3 N, float viewDepth)
+{
+	//first cascade that reaches this far
+	int cascade = (int)dot(float4(viewDepth >= cascadeEnds), 1);
+	if (cascade >= SHADOW_CASCADES)
+		return 1;
+
+	float3 pos = worldPos + N * cascadeTexelSizes[cascade] * 1.5;
+	float4 shadowPos = mul(float4(pos, 1), shadowViewProj[cascade]);
+	float2 uv = shadowPos.xy * float2(0.5, -0.5) + 0.5;
+
+	//3x3 bilinear comparisons (a 4x4 texel footprint)
+	float lit = 0;
+	[unroll]
+	for (int y = -1; y <= 1; y++)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; x++)
+		{
+			float2 offset = float2(x, y) * shadowMapTexel;
+			lit += ShadowMap.SampleCmpLevelZero(ShadowSampler, float3(uv + offset, cascade), shadowPos.z);
+		}
+	}
+	return lit / 9;
+}
+
+#endif
@@ -0,0 +1,230 @@
+#include "SimInput.h"
+#include "Camera.h"
+#include "Check.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+FixedStepClock::FixedStepClock(float step, int maxTicksPerFrame)
+{
+	this->step = step;
+	this->maxTicksPerFrame = maxTicksPerFrame;
+	accumulator = 0.0;
+	simTime = 0.0;
+}
+
+// --------------------------------------------------------
+// If a frame takes too long (breakpoint, window drag, slow GPU)
+// we'd try to catch up with more and more ticks each frame and
+// never recover.  So the accumulator is clamped and the lost
+// time is simply dropped.
+// --------------------------------------------------------
+int FixedStepClock::Advance(double deltaTime, ISimulation* sim)
+{
+	accumulator += deltaTime;
+
+	double maxAccumulated = (double)step * maxTicksPerFrame;
+	if (accumulator > maxAccumulated)
+		accumulator = maxAccumulated;
+
+	int ticks = 0;
+	while (accumulator >= step)
+	{
+		sim->Update(sim->SampleInput(), step, simTime);
+		simTime += step;
+		accumulator -= step;
+		ticks++;
+	}
+	return ticks;
+}
+
+bool SimInputRecording::Next(SimInput* input)
+{
+	if (next >= ticks.size())
+		return false;
+	*input = ticks[next++];
+	return true;
+}
+
+
+// --------------------------------------------------------
+// Report
+// --------------------------------------------------------
+
+// Same numbers on every platform, unlike rand()
+static float ReplayRandom(unsigned int& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) / 16777216.0f;
+}
+
+// Everything the camera's simulation keeps, compared bit for bit
+struct ReplayState
+{
+	XMFLOAT3 Position;
+	XMFLOAT4X4 View;
+};
+
+static ReplayState ReplayCameraState(Camera& cam)
+{
+	// Interpolate() leaves a blended view behind, so rebuild
+	// the one for the last tick
+	cam.Update();
+	ReplayState s;
+	s.Position = cam.getCamPos();
+	s.View = cam.getView();
+	return s;
+}
+
+// --------------------------------------------------------
+// The game's tick (Game::Update) on its own: a camera fed
+// from a recording.  Ticks past the end of the recording do
+// nothing, so every run simulates exactly the same ticks.
+// --------------------------------------------------------
+class ReplaySimulation : public ISimulation
+{
+public:
+	ReplaySimulation(SimInputRecording* recording)
+		: cam(1280, 720, 0.1f, 100.0f, CAMERA_DEPTH_REVERSED_INFINITE)
+	{
+		this->recording = recording;
+		finished = false;
+		recording->Rewind();
+		cam.Start();
+		cam.SaveState();
+	}
+
+	SimInput SampleInput()
+	{
+		SimInput input = {};
+		if (!recording->Next(&input))
+			finished = true;
+		return input;
+	}
+
+	void Update(const SimInput& input, float deltaTime, double totalTime)
+	{
+		if (finished) return;
+		const float moveSpeed = 3.0f, climbSpeed = 0.6f; // Game.h
+		cam.SaveState();
+		cam.Simulate(input, deltaTime, moveSpeed, climbSpeed);
+	}
+
+	bool IsFinished() { return finished; }
+	Camera& GetCamera() { return cam; }
+
+private:
+	SimInputRecording* recording;
+	bool finished;
+	Camera cam;
+};
+
+// Plays the recording into a fresh camera through the same
+// clock DXCore::TickSimulation uses, drawing at the given
+// frame times (seconds, cycled) like Game::Draw.  Stops once
+// the recording runs out.
+static ReplayState Replay(SimInputRecording& recording, const std::vector<double>& frameTimes,
+	unsigned int* frames, unsigned int* mostTicks)
+{
+	ReplaySimulation sim(&recording);
+	FixedStepClock clock(1.0f / 60.0f, 5); // DXCore's defaults
+
+	*frames = 0;
+	*mostTicks = 0;
+	while (!sim.IsFinished())
+	{
+		unsigned int ticks = clock.Advance(frameTimes[*frames % frameTimes.size()], &sim);
+		(*frames)++;
+		if (ticks > *mostTicks) *mostTicks = ticks;
+		sim.GetCamera().Interpolate(clock.GetAlpha());
+	}
+	return ReplayCameraState(sim.GetCamera());
+}
+
+// Checks every tick starts a whole number of steps in
+class TickCounter : public ISimulation
+{
+public:
+	TickCounter(float step) { this->step = step; ticks = 0; worstError = 0; }
+
+	SimInput SampleInput() { SimInput none = {}; return none; }
+
+	void Update(const SimInput& input, float deltaTime, double totalTime)
+	{
+		double error = fabs(totalTime - ticks * (double)step);
+		if (error > worstError) worstError = error;
+		ticks++;
+	}
+
+	float step;
+	unsigned long long ticks;
+	double worstError;
+};
+
+void SimReplayReport()
+{
+	const unsigned int tickCount = 1200; // 20 seconds at 60 ticks/s
+	printf("\nInput replay (%u ticks at 60/s)\n", tickCount);
+
+	// Buttons held for a while then changed, mouse turning in
+	// short bursts
+	SimInputRecording recording;
+	unsigned int seed = 3;
+	SimInput held = {};
+	for (unsigned int t = 0; t < tickCount; t++)
+	{
+		if (t % 25 == 0)
+			held.Buttons = (unsigned int)(ReplayRandom(seed) * 64.0f); // Any of the six
+		SimInput input = held;
+		bool turning = (t / 40) % 3 == 0;
+		input.TurnX = turning ? (ReplayRandom(seed) - 0.5f) * 0.02f : 0.0f;
+		input.TurnY = turning ? (ReplayRandom(seed) - 0.5f) * 0.05f : 0.0f;
+		recording.Add(input);
+	}
+
+	struct Rate
+	{
+		const char* Name;
+		std::vector<double> FrameTimes;
+	};
+	std::vector<Rate> rates;
+	rates.push_back({ "60 fps", { 1.0 / 60.0 } });
+	rates.push_back({ "30 fps", { 1.0 / 30.0 } });
+	rates.push_back({ "144 fps", { 1.0 / 144.0 } });
+	rates.push_back({ "240 fps", { 1.0 / 240.0 } });
+	Rate jitter = { "jittered 4-40 ms", {} };
+	for (int i = 0; i < 97; i++) jitter.FrameTimes.push_back(0.004 + 0.036 * ReplayRandom(seed));
+	rates.push_back(jitter);
+	// Past the 5 tick limit: the clock drops time, but every
+	// recorded tick still gets played
+	rates.push_back({ "hitches (250 ms every 20 frames)", { 0.25, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016,
+		0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016, 0.016 } });
+
+	unsigned int frames, mostTicks;
+	ReplayState reference = Replay(recording, rates[0].FrameTimes, &frames, &mostTicks);
+	Camera start(1280, 720, 0.1f, 100.0f, CAMERA_DEPTH_REVERSED_INFINITE);
+	start.Start();
+	XMFLOAT3 from = start.getCamPos();
+	float dx = reference.Position.x - from.x, dy = reference.Position.y - from.y, dz = reference.Position.z - from.z;
+	printf("  recording moves the camera %.2f units  %s\n", sqrtf(dx * dx + dy * dy + dz * dz),
+		CheckResult(dx * dx + dy * dy + dz * dz > 1.0f));
+
+	for (size_t r = 0; r < rates.size(); r++)
+	{
+		ReplayState s = Replay(recording, rates[r].FrameTimes, &frames, &mostTicks);
+		bool same = !memcmp(&s.Position, &reference.Position, sizeof(s.Position)) &&
+			!memcmp(&s.View, &reference.View, sizeof(s.View));
+		printf("  %-34s %5u frames, up to %u ticks in one, same state as 60 fps  %s\n", rates[r].Name, frames,
+			mostTicks, CheckResult(same));
+	}
+
+	// Hours in, sim time has to stay as exact as it was on the
+	// first tick or a long session's replay drifts
+	const double hours = 4.0;
+	FixedStepClock clock(1.0f / 60.0f, 5);
+	TickCounter counter(clock.GetStep());
+	for (double t = 0; t < hours * 3600.0; t += 1.0 / 144.0)
+		clock.Advance(1.0 / 144.0, &counter);
+	printf("  %.0f hours at 144 fps: %llu ticks, sim time off by %.3g s at worst  %s\n", hours, counter.ticks,
+		counter.worstError, CheckResult(counter.worstError < 1e-6));
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <vector>
+
+// --------------------------------------------------------
+// What the simulation reads, one snapshot per fixed tick
+//
+// - DXCore asks for a SimInput right before each Update() tick,
+//   and Update() reads nothing else (no GetAsyncKeyState, no
+//   mouse messages), so the same snapshots always give the
+//   same simulation, however fast frames are being drawn
+// - Mouse movement is summed between ticks and handed to the
+//   next one, instead of turning the camera as it arrives
+// - SimInputRecording keeps the snapshots of a run so it can
+//   be fed back in, tick for tick
+// --------------------------------------------------------
+
+// Held buttons, one bit each
+enum SimButton
+{
+	SIM_FORWARD = 1 << 0,
+	SIM_BACK    = 1 << 1,
+	SIM_LEFT    = 1 << 2,
+	SIM_RIGHT   = 1 << 3,
+	SIM_UP      = 1 << 4,
+	SIM_DOWN    = 1 << 5,
+};
+
+struct SimInput
+{
+	unsigned int Buttons;	// SimButton bits
+	float TurnX;			// Pitch to add this tick (radians)
+	float TurnY;			// Yaw to add this tick (radians)
+};
+
+// --------------------------------------------------------
+// Whatever a FixedStepClock drives: DXCore in the game, a
+// bare camera in the replay check
+// --------------------------------------------------------
+class ISimulation
+{
+public:
+	virtual ~ISimulation() { }
+
+	// The input for the next Update() tick
+	virtual SimInput SampleInput() = 0;
+	virtual void Update(const SimInput& input, float deltaTime, double totalTime) = 0;
+};
+
+// --------------------------------------------------------
+// Fixed timestep clock - frame time goes in, whole ticks
+// come out, and the leftover is how far drawing should blend
+// between the last two ticks
+//
+// Sim time is kept in double: a float total stops holding a
+// 60hz step exactly after a few hours, and replays would drift
+// --------------------------------------------------------
+class FixedStepClock
+{
+public:
+	FixedStepClock(float step, int maxTicksPerFrame);
+
+	void SetStep(float step) { this->step = step; }
+	float GetStep() { return step; }
+
+	// Adds one frame's time, then calls sim's Update() once per
+	// whole step that has built up, each with its own
+	// SampleInput() snapshot.  Returns how many ticks ran.
+	int Advance(double deltaTime, ISimulation* sim);
+
+	// How far (0-1) we are between the last two ticks
+	float GetAlpha() { return (float)(accumulator / step); }
+
+	// Sim time the next tick starts at
+	double GetSimTime() { return simTime; }
+
+private:
+	float step;				// Seconds per tick
+	int maxTicksPerFrame;	// Spiral-of-death protection
+	double accumulator;
+	double simTime;
+};
+
+// --------------------------------------------------------
+// A run's snapshots, in tick order
+// --------------------------------------------------------
+class SimInputRecording
+{
+public:
+	SimInputRecording() { next = 0; }
+
+	void Clear() { ticks.clear(); next = 0; }
+	void Add(const SimInput& input) { ticks.push_back(input); }
+
+	// Back to the first tick
+	void Rewind() { next = 0; }
+	// The next tick's snapshot, false once they've all been read
+	bool Next(SimInput* input);
+
+	unsigned int GetTickCount() { return (unsigned int)ticks.size(); }
+
+private:
+	std::vector<SimInput> ticks;
+	unsigned int next;
+};
+
+// Records a made up input stream, then replays it into the
+// camera at several frame rates (steady, jittered, with
+// hitches past the tick limit) and checks every run ends up
+// in exactly the same state
+void SimReplayReport();
@@ -1,4 +1,5 @@
 #include "SimpleShader.h"
+#include "Profiler.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
@@ -116,6 +117,8 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		switch (resourceDesc.Type)
 		{
 		case D3D_SIT_TEXTURE: // A texture resource
+		case D3D_SIT_STRUCTURED: // Structured and raw buffers are SRVs too
+		case D3D_SIT_BYTEADDRESS:
 		{
 			// Create the SRV wrapper
 			SimpleSRV* srv = new SimpleSRV();
@@ -171,6 +174,8 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		newBuffDesc.MiscFlags = 0;
 		newBuffDesc.StructureByteStride = 0;
 		device->CreateBuffer(&newBuffDesc, 0, &constantBuffers[b].ConstantBuffer);
+		constantBuffers[b].External = 0;
+		constantBuffers[b].Dirty = true;
 
 		// Set up the data buffer for this constant buffer
 		constantBuffers[b].Size = bufferDesc.Size;
@@ -273,16 +278,22 @@ void ISimpleShader::SetShader()
 // --------------------------------------------------------
 void ISimpleShader::CopyAllBufferData()
 {
+	PROFILE_ZONE("Shader::CopyAllBufferData");
+
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy the ones that changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		if (!constantBuffers[i].Dirty || constantBuffers[i].External)
+			continue;
+
 		// Copy the entire local data buffer
 		deviceContext->UpdateSubresource(
 			constantBuffers[i].ConstantBuffer, 0, 0,
 			constantBuffers[i].LocalDataBuffer, 0, 0);
+		constantBuffers[i].Dirty = false;
 	}
 }
 
@@ -314,6 +325,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	deviceContext->UpdateSubresource(
 		cb->ConstantBuffer, 0, 0, 
 		cb->LocalDataBuffer, 0, 0);
+	cb->Dirty = false;
 }
 
 // --------------------------------------------------------
@@ -336,6 +348,7 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	deviceContext->UpdateSubresource(
 		cb->ConstantBuffer, 0, 0, 
 		cb->LocalDataBuffer, 0, 0);
+	cb->Dirty = false;
 }
 
 
@@ -351,21 +364,44 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 // --------------------------------------------------------
 bool ISimpleShader::SetData(std::string name, const void* data, unsigned int size)
 {
+	PROFILE_ZONE("Shader::SetData");
+
 	// Look for the variable and verify
 	SimpleShaderVariable* var = FindVariable(name, size);
 	if (var == 0)
 		return false;
 
-	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
+	// Set the data in the local data buffer, if it's different
+	SimpleConstantBuffer* cb = &constantBuffers[var->ConstantBufferIndex];
+	if (memcmp(cb->LocalDataBuffer + var->ByteOffset, data, size) != 0)
+	{
+		memcpy(cb->LocalDataBuffer + var->ByteOffset, data, size);
+		cb->Dirty = true;
+	}
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Binds an outside buffer in place of one of the shader's
+// constant buffers, from the next SetShader() on
+//
+// name   - The name of the constant buffer
+// buffer - At least as big as the shader's, or 0 to go back
+//          to the shader's own
+//
+// Returns false if the buffer doesn't exist in the shader
+// --------------------------------------------------------
+bool ISimpleShader::SetConstantBuffer(std::string name, ID3D11Buffer* buffer)
+{
+	SimpleConstantBuffer* cb = FindConstantBuffer(name);
+	if (!cb) return false;
+
+	cb->External = buffer;
+	return true;
+}
+
 // --------------------------------------------------------
 // Sets INTEGER data
 // --------------------------------------------------------
@@ -764,7 +800,7 @@ void SimpleVertexShader::SetShaderAndCBs()
 		deviceContext->VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			constantBuffers[i].External ? &constantBuffers[i].External : &constantBuffers[i].ConstantBuffer);
 	}
 }
 
@@ -885,7 +921,7 @@ void SimplePixelShader::SetShaderAndCBs()
 		deviceContext->PSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			constantBuffers[i].External ? &constantBuffers[i].External : &constantBuffers[i].ConstantBuffer);
 	}
 }
 
@@ -899,6 +935,8 @@ void SimplePixelShader::SetShaderAndCBs()
 // --------------------------------------------------------
 bool SimplePixelShader::SetShaderResourceView(std::string name, ID3D11ShaderResourceView* srv)
 {
+	PROFILE_ZONE("Shader::SetShaderResourceView");
+
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
 	if (srvInfo == 0)
@@ -1008,7 +1046,7 @@ void SimpleDomainShader::SetShaderAndCBs()
 		deviceContext->DSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			constantBuffers[i].External ? &constantBuffers[i].External : &constantBuffers[i].ConstantBuffer);
 	}
 }
 
@@ -1130,7 +1168,7 @@ void SimpleHullShader::SetShaderAndCBs()
 		deviceContext->HSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			constantBuffers[i].External ? &constantBuffers[i].External : &constantBuffers[i].ConstantBuffer);
 	}
 }
 
@@ -1374,7 +1412,7 @@ void SimpleGeometryShader::SetShaderAndCBs()
 		deviceContext->GSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			constantBuffers[i].External ? &constantBuffers[i].External : &constantBuffers[i].ConstantBuffer);
 	}
 }
 
@@ -1559,7 +1597,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 		deviceContext->CSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
-			&constantBuffers[i].ConstantBuffer);
+			constantBuffers[i].External ? &constantBuffers[i].External : &constantBuffers[i].ConstantBuffer);
 	}
 }
 
@@ -32,6 +32,8 @@ struct SimpleConstantBuffer
 	unsigned int Size;
 	unsigned int BindIndex;
 	ID3D11Buffer* ConstantBuffer;
+	ID3D11Buffer* External;		// Bound instead, if set (SetConstantBuffer)
+	bool Dirty;					// Local data changed since the last copy
 	unsigned char* LocalDataBuffer;
 	std::vector<SimpleShaderVariable> Variables;
 };
@@ -70,12 +72,18 @@ public:
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
 
-	// Activating the shader and copying data
+	// Activating the shader and copying data.  CopyAllBufferData
+	// skips buffers whose local data hasn't changed.
 	void SetShader();
 	void CopyAllBufferData();
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
 
+	// Binds buffer in place of the shader's own copy of a constant
+	// buffer (from the next SetShader), e.g. a material's block that
+	// is uploaded once.  0 goes back to the shader's own.
+	bool SetConstantBuffer(std::string name, ID3D11Buffer* buffer);
+
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
 
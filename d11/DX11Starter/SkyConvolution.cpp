@@ -0,0 +1,1023 @@
+#include "SkyConvolution.h"
+#include "Check.h"
+#include "TextureCooker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <emmintrin.h>
+
+static const float PI = 3.14159265358979f;
+
+// --------------------------------------------------------
+// Texel geometry
+// --------------------------------------------------------
+SkyCube SkyMakeCube(unsigned int size)
+{
+	SkyCube cube;
+	cube.Size = size;
+	cube.Texels.assign((size_t)size * size * 6 * 3, 0.0f);
+	return cube;
+}
+
+void SkyTexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size, float dir[3])
+{
+	// -1..1 across the face, v down like the rows
+	float u = (x + 0.5f) / size * 2 - 1;
+	float v = (y + 0.5f) / size * 2 - 1;
+	switch (face)
+	{
+	case 0: dir[0] = 1; dir[1] = -v; dir[2] = -u; break;
+	case 1: dir[0] = -1; dir[1] = -v; dir[2] = u; break;
+	case 2: dir[0] = u; dir[1] = 1; dir[2] = v; break;
+	case 3: dir[0] = u; dir[1] = -1; dir[2] = -v; break;
+	case 4: dir[0] = u; dir[1] = -v; dir[2] = 1; break;
+	default: dir[0] = -u; dir[1] = -v; dir[2] = -1; break;
+	}
+	float len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	dir[0] /= len;
+	dir[1] /= len;
+	dir[2] /= len;
+}
+
+// Solid angle of the face from its center to (x, y)
+static float AreaElement(float x, float y)
+{
+	return atan2f(x * y, sqrtf(x * x + y * y + 1));
+}
+
+float SkyTexelSolidAngle(unsigned int x, unsigned int y, unsigned int size)
+{
+	float x0 = (float)x / size * 2 - 1, x1 = (float)(x + 1) / size * 2 - 1;
+	float y0 = (float)y / size * 2 - 1, y1 = (float)(y + 1) / size * 2 - 1;
+	return AreaElement(x0, y0) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x1, y1);
+}
+
+SkyCube SkyDownsample(const SkyCube& cube)
+{
+	SkyCube half = SkyMakeCube(std::max(cube.Size / 2, 1u));
+	for (unsigned int f = 0; f < 6; f++)
+		for (unsigned int y = 0; y < half.Size; y++)
+			for (unsigned int x = 0; x < half.Size; x++)
+			{
+				float* out = SkyTexel(half, f, x, y);
+				for (unsigned int s = 0; s < 4; s++)
+				{
+					const float* in = SkyTexel(cube, f, std::min(x * 2 + (s & 1), cube.Size - 1),
+						std::min(y * 2 + (s >> 1), cube.Size - 1));
+					for (int c = 0; c < 3; c++) out[c] += in[c] * 0.25f;
+				}
+			}
+	return half;
+}
+
+static SkyCube DownsampleTo(const SkyCube& cube, unsigned int size)
+{
+	if (cube.Size <= size)
+		return cube;
+	SkyCube smaller = SkyDownsample(cube);
+	while (smaller.Size > size)
+		smaller = SkyDownsample(smaller);
+	return smaller;
+}
+
+// --------------------------------------------------------
+// Convolution
+// --------------------------------------------------------
+
+// Every texel of a cube, flattened: direction, solid angle
+// and color, so the inner loops are one straight pass.
+// Padded to a multiple of 4 with texels of no solid angle.
+struct SkySamples
+{
+	std::vector<float> Dir[3];
+	std::vector<float> SolidAngle;
+	std::vector<float> Color[3];
+};
+
+static SkySamples Flatten(const SkyCube& cube)
+{
+	SkySamples s;
+	size_t count = (size_t)cube.Size * cube.Size * 6;
+	size_t padded = (count + 3) & ~(size_t)3;
+	for (int c = 0; c < 3; c++)
+	{
+		s.Dir[c].reserve(padded);
+		s.Color[c].reserve(padded);
+	}
+	s.SolidAngle.reserve(padded);
+	for (unsigned int f = 0; f < 6; f++)
+		for (unsigned int y = 0; y < cube.Size; y++)
+			for (unsigned int x = 0; x < cube.Size; x++)
+			{
+				float dir[3];
+				SkyTexelDirection(f, x, y, cube.Size, dir);
+				const float* color = SkyTexel(cube, f, x, y);
+				for (int c = 0; c < 3; c++)
+				{
+					s.Dir[c].push_back(dir[c]);
+					s.Color[c].push_back(color[c]);
+				}
+				s.SolidAngle.push_back(SkyTexelSolidAngle(x, y, cube.Size));
+			}
+	for (size_t i = count; i < padded; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			s.Dir[c].push_back(0);
+			s.Color[c].push_back(0);
+		}
+		s.SolidAngle.push_back(0);
+	}
+	return s;
+}
+
+static float HorizontalSum(__m128 v)
+{
+	float f[4];
+	_mm_storeu_ps(f, v);
+	return f[0] + f[1] + f[2] + f[3];
+}
+
+static unsigned int ThreadCount(unsigned int requested, unsigned int work)
+{
+	if (requested == 0)
+		requested = std::max(std::thread::hardware_concurrency(), 1u);
+	return std::max(std::min(requested, work), 1u);
+}
+
+// count items in equal chunks over threadCount threads (from
+// ThreadCount), the last one on this thread.  fn gets
+// (begin, end, thread).
+template <typename ChunkFunction>
+static void ParallelFor(unsigned int count, unsigned int threadCount, ChunkFunction fn)
+{
+	std::vector<std::thread> workers;
+	unsigned int per = (count + threadCount - 1) / threadCount;
+	for (unsigned int t = 0; t + 1 < threadCount; t++)
+		workers.emplace_back(fn, std::min(t * per, count), std::min((t + 1) * per, count), t);
+	fn(std::min((threadCount - 1) * per, count), count, threadCount - 1);
+	for (auto& w : workers)
+		w.join();
+}
+
+// Rows of every face (6 x size of them)
+template <typename RowFunction>
+static void ForEachRow(unsigned int size, unsigned int threadCount, RowFunction row)
+{
+	unsigned int rows = size * 6;
+	ParallelFor(rows, ThreadCount(threadCount, rows), [&](unsigned int begin, unsigned int end, unsigned int)
+	{
+		for (unsigned int r = begin; r < end; r++)
+			row(r / size, r % size);
+	});
+}
+
+// Sum of color * weight(cosine to dir) * solid angle over every
+// sample, 4 at a time, and the sum of the weights
+template <typename Weight>
+static void Convolve(const SkySamples& samples, const float dir[3], Weight weight, float sum[3], float* weights)
+{
+	__m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+	__m128 r = _mm_setzero_ps(), g = _mm_setzero_ps(), b = _mm_setzero_ps(), total = _mm_setzero_ps();
+	size_t count = samples.SolidAngle.size();
+	for (size_t i = 0; i < count; i += 4)
+	{
+		__m128 cosine = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(dx, _mm_loadu_ps(&samples.Dir[0][i])),
+			_mm_mul_ps(dy, _mm_loadu_ps(&samples.Dir[1][i]))),
+			_mm_mul_ps(dz, _mm_loadu_ps(&samples.Dir[2][i])));
+		__m128 w = _mm_mul_ps(weight(cosine), _mm_loadu_ps(&samples.SolidAngle[i]));
+		w = _mm_and_ps(w, _mm_cmpgt_ps(cosine, _mm_setzero_ps()));	// Facing away counts for nothing
+		r = _mm_add_ps(r, _mm_mul_ps(w, _mm_loadu_ps(&samples.Color[0][i])));
+		g = _mm_add_ps(g, _mm_mul_ps(w, _mm_loadu_ps(&samples.Color[1][i])));
+		b = _mm_add_ps(b, _mm_mul_ps(w, _mm_loadu_ps(&samples.Color[2][i])));
+		total = _mm_add_ps(total, w);
+	}
+	sum[0] = HorizontalSum(r);
+	sum[1] = HorizontalSum(g);
+	sum[2] = HorizontalSum(b);
+	*weights = HorizontalSum(total);
+}
+
+SkyCube SkyIrradiance(const SkyCube& sky, unsigned int size, unsigned int threadCount)
+{
+	SkySamples samples = Flatten(DownsampleTo(sky, SKY_IRRADIANCE_SOURCE_SIZE));
+	SkyCube out = SkyMakeCube(size);
+
+	ForEachRow(size, threadCount, [&](unsigned int face, unsigned int y)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			float n[3], sum[3], weights;
+			SkyTexelDirection(face, x, y, size, n);
+			Convolve(samples, n, [](__m128 cosine) { return cosine; }, sum, &weights);
+			float* texel = SkyTexel(out, face, x, y);
+			for (int c = 0; c < 3; c++) texel[c] = sum[c] / PI;
+		}
+	});
+	return out;
+}
+
+// The 9 real SH basis functions, for 4 directions at once
+static void SHBasis(__m128 x, __m128 y, __m128 z, __m128 basis[9])
+{
+	basis[0] = _mm_set1_ps(0.282095f);
+	basis[1] = _mm_mul_ps(_mm_set1_ps(0.488603f), y);
+	basis[2] = _mm_mul_ps(_mm_set1_ps(0.488603f), z);
+	basis[3] = _mm_mul_ps(_mm_set1_ps(0.488603f), x);
+	basis[4] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(x, y));
+	basis[5] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(y, z));
+	basis[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3), _mm_mul_ps(z, z)), _mm_set1_ps(1)));
+	basis[7] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(x, z));
+	basis[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+}
+
+SkySH9 SkyProjectSH(const SkyCube& sky, unsigned int threadCount)
+{
+	// Solid angles are the same on every face
+	unsigned int size = sky.Size;
+	std::vector<float> solidAngles((size_t)size * size);
+	for (unsigned int y = 0; y < size; y++)
+		for (unsigned int x = 0; x < size; x++)
+			solidAngles[(size_t)y * size + x] = SkyTexelSolidAngle(x, y, size);
+
+	// Rows over threads, each with its own sums
+	unsigned int rows = size * 6;
+	threadCount = ThreadCount(threadCount, rows);
+	std::vector<float> partial((size_t)threadCount * 27, 0.0f);
+	ParallelFor(rows, threadCount, [&](unsigned int begin, unsigned int end, unsigned int thread)
+	{
+		__m128 sums[27];
+		for (int i = 0; i < 27; i++) sums[i] = _mm_setzero_ps();
+
+		for (unsigned int r = begin; r < end; r++)
+		{
+			unsigned int face = r / size, y = r % size;
+			for (unsigned int x = 0; x < size; x += 4)
+			{
+				// 4 texels of the row, missing ones weigh nothing
+				float lanes[7][4] = {};
+				for (unsigned int l = 0; l < 4 && x + l < size; l++)
+				{
+					float dir[3];
+					SkyTexelDirection(face, x + l, y, size, dir);
+					const float* color = SkyTexel(sky, face, x + l, y);
+					float w = solidAngles[(size_t)y * size + x + l];
+					for (int c = 0; c < 3; c++)
+					{
+						lanes[c][l] = dir[c];
+						lanes[3 + c][l] = color[c] * w;
+					}
+				}
+
+				__m128 basis[9];
+				SHBasis(_mm_loadu_ps(lanes[0]), _mm_loadu_ps(lanes[1]), _mm_loadu_ps(lanes[2]), basis);
+				for (int c = 0; c < 3; c++)
+				{
+					__m128 weighted = _mm_loadu_ps(lanes[3 + c]);
+					for (int i = 0; i < 9; i++)
+						sums[i * 3 + c] = _mm_add_ps(sums[i * 3 + c], _mm_mul_ps(basis[i], weighted));
+				}
+			}
+		}
+		for (int i = 0; i < 27; i++)
+			partial[(size_t)thread * 27 + i] = HorizontalSum(sums[i]);
+	});
+
+	// Cosine lobe per band (pi, 2pi/3, pi/4), over pi
+	const float band[9] = { 1, 2.0f / 3, 2.0f / 3, 2.0f / 3, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	SkySH9 sh = {};
+	for (unsigned int t = 0; t < threadCount; t++)
+		for (int i = 0; i < 9; i++)
+			for (int c = 0; c < 3; c++)
+				sh.Coeffs[i][c] += partial[(size_t)t * 27 + i * 3 + c] * band[i];
+	return sh;
+}
+
+void SkyEvalSH(const SkySH9& sh, const float n[3], float rgb[3])
+{
+	__m128 basis[9];
+	SHBasis(_mm_set1_ps(n[0]), _mm_set1_ps(n[1]), _mm_set1_ps(n[2]), basis);
+	for (int c = 0; c < 3; c++)
+	{
+		rgb[c] = 0;
+		for (int i = 0; i < 9; i++)
+			rgb[c] += sh.Coeffs[i][c] * _mm_cvtss_f32(basis[i]);
+	}
+}
+
+// GGX lobe with N = V = R: D(h) N.L, h halfway between R and
+// the sample, so N.H^2 = (1 + N.L) / 2.  D's constant factor
+// cancels in the normalization.
+static __m128 GGXWeight(__m128 cosine, __m128 alpha2)
+{
+	__m128 nDotH2 = _mm_mul_ps(_mm_add_ps(cosine, _mm_set1_ps(1)), _mm_set1_ps(0.5f));
+	__m128 t = _mm_add_ps(_mm_mul_ps(nDotH2, _mm_sub_ps(alpha2, _mm_set1_ps(1))), _mm_set1_ps(1));
+	return _mm_div_ps(cosine, _mm_mul_ps(t, t));
+}
+
+static float GGXWeight(float cosine, float alpha2)
+{
+	float nDotH2 = (cosine + 1) * 0.5f;
+	float t = nDotH2 * (alpha2 - 1) + 1;
+	return cosine / (t * t);
+}
+
+static float MipAlpha2(unsigned int mip, unsigned int mipCount)
+{
+	float roughness = (float)mip / (mipCount - 1);
+	float alpha = roughness * roughness;
+	return alpha * alpha;
+}
+
+std::vector<SkyCube> SkyPrefilter(const SkyCube& sky, unsigned int size, unsigned int mipCount, unsigned int threadCount)
+{
+	std::vector<SkyCube> mips;
+	mips.push_back(DownsampleTo(sky, size));
+
+	// The sky at every size the lobes are summed over
+	std::vector<SkyCube> sources;
+	sources.push_back(DownsampleTo(mips[0], SKY_SPECULAR_SOURCE_SIZE));
+	while (sources.back().Size > 1)
+		sources.push_back(SkyDownsample(sources.back()));
+
+	for (unsigned int m = 1; m < mipCount && mips.back().Size > 1; m++)
+	{
+		unsigned int mipSize = mips.back().Size / 2;
+		__m128 alpha2 = _mm_set1_ps(MipAlpha2(m, mipCount));
+
+		// Twice the mip's resolution (where there is one), so
+		// even the sharpest lobe spans a few texels, and never
+		// under 16 so the widest still sees enough of the sky
+		const SkyCube* source = &sources[0];
+		for (auto& s : sources)
+			if (s.Size >= std::max(mipSize * 2, 16u))
+				source = &s;
+		SkySamples samples = Flatten(*source);
+
+		SkyCube out = SkyMakeCube(mipSize);
+		ForEachRow(mipSize, threadCount, [&](unsigned int face, unsigned int y)
+		{
+			for (unsigned int x = 0; x < mipSize; x++)
+			{
+				float r[3], sum[3], weights;
+				SkyTexelDirection(face, x, y, mipSize, r);
+				Convolve(samples, r, [&](__m128 cosine) { return GGXWeight(cosine, alpha2); }, sum, &weights);
+				float* texel = SkyTexel(out, face, x, y);
+				for (int c = 0; c < 3; c++) texel[c] = weights > 0 ? sum[c] / weights : 0;
+			}
+		});
+		mips.push_back(out);
+	}
+	return mips;
+}
+
+// Hammersley point i of count
+static void Hammersley(unsigned int i, unsigned int count, float* u, float* v)
+{
+	unsigned int bits = i;
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+	bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+	bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+	*u = (float)i / count;
+	*v = bits * 2.3283064365386963e-10f;
+}
+
+// Half vector on the GGX lobe around +Z (y is never needed:
+// V lies in the xz plane)
+static void SampleGGX(float u, float v, float alpha, float* hx, float* hz)
+{
+	float phi = 2 * PI * u;
+	float cosTheta = sqrtf((1 - v) / (1 + (alpha * alpha - 1) * v));
+	float sinTheta = sqrtf(1 - cosTheta * cosTheta);
+	*hx = sinTheta * cosf(phi);
+	*hz = cosTheta;
+}
+
+std::vector<float> SkyBRDF(unsigned int size, unsigned int samples, unsigned int threadCount)
+{
+	std::vector<float> table((size_t)size * size * 2);
+	unsigned int padded = (samples + 3) & ~3u;
+
+	ParallelFor(size, ThreadCount(threadCount, size), [&](unsigned int begin, unsigned int end, unsigned int)
+	{
+		std::vector<float> hx(padded, 0.0f), hz(padded, 1.0f), valid(padded, 0.0f);
+		for (unsigned int y = begin; y < end; y++)
+		{
+			// The row's half vectors, the same for every N.V
+			float roughness = (y + 0.5f) / size;
+			float alpha = roughness * roughness;
+			for (unsigned int i = 0; i < samples; i++)
+			{
+				float u, v;
+				Hammersley(i, samples, &u, &v);
+				SampleGGX(u, v, alpha, &hx[i], &hz[i]);
+				valid[i] = 1;
+			}
+			__m128 k = _mm_set1_ps(alpha * 0.5f);		// Smith, k for image based lighting
+			__m128 oneMinusK = _mm_set1_ps(1 - alpha * 0.5f);
+			__m128 one = _mm_set1_ps(1), zero = _mm_setzero_ps(), two = _mm_set1_ps(2);
+
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float nDotV = (x + 0.5f) / size;
+				__m128 vx = _mm_set1_ps(sqrtf(1 - nDotV * nDotV)), vz = _mm_set1_ps(nDotV);
+				__m128 gV = _mm_div_ps(vz, _mm_add_ps(_mm_mul_ps(vz, oneMinusK), k));
+				__m128 a = zero, b = zero;
+				for (unsigned int i = 0; i < padded; i += 4)
+				{
+					__m128 h0 = _mm_loadu_ps(&hx[i]), h2 = _mm_loadu_ps(&hz[i]);
+					__m128 vDotH = _mm_add_ps(_mm_mul_ps(vx, h0), _mm_mul_ps(vz, h2));
+					__m128 nDotL = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, vDotH), h2), vz);
+					__m128 use = _mm_and_ps(_mm_cmpgt_ps(nDotL, zero), _mm_cmpgt_ps(_mm_loadu_ps(&valid[i]), zero));
+					nDotL = _mm_max_ps(nDotL, zero);
+					vDotH = _mm_max_ps(vDotH, zero);
+
+					__m128 gL = _mm_div_ps(nDotL, _mm_add_ps(_mm_mul_ps(nDotL, oneMinusK), k));
+					__m128 gVis = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(gV, gL), vDotH), _mm_mul_ps(h2, vz));
+					gVis = _mm_and_ps(gVis, use);
+					__m128 f = _mm_sub_ps(one, vDotH);
+					__m128 f2 = _mm_mul_ps(f, f);
+					__m128 fc = _mm_mul_ps(_mm_mul_ps(f2, f2), f);
+					a = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(one, fc), gVis));
+					b = _mm_add_ps(b, _mm_mul_ps(fc, gVis));
+				}
+				float* out = &table[((size_t)y * size + x) * 2];
+				out[0] = HorizontalSum(a) / samples;
+				out[1] = HorizontalSum(b) / samples;
+			}
+		}
+	});
+	return table;
+}
+
+// --------------------------------------------------------
+// References - the same integrals, plainly
+// --------------------------------------------------------
+SkyCube SkyIrradianceReference(const SkyCube& sky, unsigned int size)
+{
+	SkySamples samples = Flatten(sky);
+	SkyCube out = SkyMakeCube(size);
+	for (unsigned int f = 0; f < 6; f++)
+		for (unsigned int y = 0; y < size; y++)
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float n[3], sum[3] = {};
+				SkyTexelDirection(f, x, y, size, n);
+				for (size_t i = 0; i < samples.SolidAngle.size(); i++)
+				{
+					float cosine = n[0] * samples.Dir[0][i] + n[1] * samples.Dir[1][i] + n[2] * samples.Dir[2][i];
+					if (cosine <= 0)
+						continue;
+					for (int c = 0; c < 3; c++) sum[c] += samples.Color[c][i] * cosine * samples.SolidAngle[i];
+				}
+				float* texel = SkyTexel(out, f, x, y);
+				for (int c = 0; c < 3; c++) texel[c] = sum[c] / PI;
+			}
+	return out;
+}
+
+std::vector<SkyCube> SkyPrefilterReference(const SkyCube& sky, unsigned int size, unsigned int mipCount)
+{
+	std::vector<SkyCube> mips;
+	mips.push_back(DownsampleTo(sky, size));
+	SkySamples samples = Flatten(sky);
+
+	for (unsigned int m = 1; m < mipCount && mips.back().Size > 1; m++)
+	{
+		unsigned int mipSize = mips.back().Size / 2;
+		float alpha2 = MipAlpha2(m, mipCount);
+		SkyCube out = SkyMakeCube(mipSize);
+		for (unsigned int f = 0; f < 6; f++)
+			for (unsigned int y = 0; y < mipSize; y++)
+				for (unsigned int x = 0; x < mipSize; x++)
+				{
+					float r[3], sum[3] = {}, weights = 0;
+					SkyTexelDirection(f, x, y, mipSize, r);
+					for (size_t i = 0; i < samples.SolidAngle.size(); i++)
+					{
+						float cosine = r[0] * samples.Dir[0][i] + r[1] * samples.Dir[1][i] + r[2] * samples.Dir[2][i];
+						if (cosine <= 0)
+							continue;
+						float w = GGXWeight(cosine, alpha2) * samples.SolidAngle[i];
+						for (int c = 0; c < 3; c++) sum[c] += samples.Color[c][i] * w;
+						weights += w;
+					}
+					float* texel = SkyTexel(out, f, x, y);
+					for (int c = 0; c < 3; c++) texel[c] = weights > 0 ? sum[c] / weights : 0;
+				}
+		mips.push_back(out);
+	}
+	return mips;
+}
+
+void SkyBRDFReference(float NdotV, float roughness, unsigned int samples, float* scale, float* bias)
+{
+	float alpha = roughness * roughness, k = alpha * 0.5f;
+	float vx = sqrtf(1 - NdotV * NdotV), vz = NdotV;
+	double a = 0, b = 0;
+	for (unsigned int i = 0; i < samples; i++)
+	{
+		float u, v, hx, hz;
+		Hammersley(i, samples, &u, &v);
+		SampleGGX(u, v, alpha, &hx, &hz);
+		float vDotH = vx * hx + vz * hz;
+		float nDotL = 2 * vDotH * hz - vz;
+		if (nDotL <= 0)
+			continue;
+		float g = (NdotV / (NdotV * (1 - k) + k)) * (nDotL / (nDotL * (1 - k) + k));
+		float gVis = g * std::max(vDotH, 0.0f) / (hz * NdotV);
+		float fc = powf(1 - std::max(vDotH, 0.0f), 5);
+		a += (1 - fc) * gVis;
+		b += fc * gVis;
+	}
+	*scale = (float)(a / samples);
+	*bias = (float)(b / samples);
+}
+
+// --------------------------------------------------------
+// DDS
+// --------------------------------------------------------
+enum SkyFormat
+{
+	SKY_UNKNOWN,
+	SKY_RGBA8,
+	SKY_BGRA8,
+	SKY_RGBA16F,
+	SKY_RGBA32F,
+	SKY_BC1,
+	SKY_BC7
+};
+
+static unsigned int Read32(const unsigned char* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+static float HalfToFloat(unsigned short h)
+{
+	unsigned int sign = (h >> 15) & 1, exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+	float value;
+	if (exponent == 0)
+		value = ldexpf((float)mantissa, -24);
+	else if (exponent == 31)
+		value = mantissa ? NAN : INFINITY;
+	else
+		value = ldexpf((float)(mantissa | 0x400), (int)exponent - 25);
+	return sign ? -value : value;
+}
+
+// Round to nearest, clamped to the largest half
+static unsigned short FloatToHalf(float f)
+{
+	unsigned int bits;
+	memcpy(&bits, &f, 4);
+	unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+	float a = fabsf(f);
+	if (!(a < 65504.0f))
+		return sign | (a != a ? 0x7e00 : 0x7bff);
+	if (a < 6.1035156e-05f)
+		return sign | (unsigned short)(a / 5.9604645e-08f + 0.5f);	// Denormal
+	int exponent;
+	float mantissa = frexpf(a, &exponent);		// 0.5..1
+	unsigned int m = (unsigned int)((mantissa * 2 - 1) * 1024 + 0.5f);
+	if (m == 1024) { m = 0; exponent++; }
+	return sign | (unsigned short)((exponent + 14) << 10) | (unsigned short)m;
+}
+
+static float SRGBToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+bool SkyReadDDS(const unsigned char* data, size_t bytes, SkyCube* cube)
+{
+	if (bytes < 128 || Read32(data) != 0x20534444)
+		return false;
+
+	unsigned int height = Read32(data + 12), width = Read32(data + 16);
+	unsigned int mipCount = std::max(Read32(data + 28), 1u);
+	unsigned int pfFlags = Read32(data + 80), fourCC = Read32(data + 84);
+	unsigned int bitCount = Read32(data + 88), redMask = Read32(data + 92);
+	unsigned int caps2 = Read32(data + 112);
+	size_t offset = 128;
+
+	SkyFormat format = SKY_UNKNOWN;
+	bool srgb = false;
+	bool cubeMap = (caps2 & 0xFE00) == 0xFE00;		// All six faces
+	if ((pfFlags & 0x4) && fourCC == 0x30315844)	// "DX10"
+	{
+		if (bytes < 148)
+			return false;
+		unsigned int dxgi = Read32(data + 128), miscFlag = Read32(data + 136);
+		cubeMap = (miscFlag & 0x4) != 0;
+		offset = 148;
+		switch (dxgi)
+		{
+		case 2: format = SKY_RGBA32F; break;
+		case 10: format = SKY_RGBA16F; break;
+		case 28: format = SKY_RGBA8; break;
+		case 29: format = SKY_RGBA8; srgb = true; break;
+		case 71: format = SKY_BC1; break;
+		case 72: format = SKY_BC1; srgb = true; break;
+		case 87: format = SKY_BGRA8; break;
+		case 91: format = SKY_BGRA8; srgb = true; break;
+		case 98: format = SKY_BC7; break;
+		case 99: format = SKY_BC7; srgb = true; break;
+		}
+	}
+	else if (pfFlags & 0x4)
+	{
+		if (fourCC == 0x31545844) format = SKY_BC1;		// "DXT1"
+		else if (fourCC == 113) format = SKY_RGBA16F;	// D3DFMT_A16B16G16R16F
+		else if (fourCC == 116) format = SKY_RGBA32F;	// D3DFMT_A32B32G32R32F
+	}
+	else if (bitCount == 32)
+		format = redMask == 0xff ? SKY_RGBA8 : redMask == 0xff0000 ? SKY_BGRA8 : SKY_UNKNOWN;
+
+	if (format == SKY_UNKNOWN || !cubeMap || width != height || width == 0)
+		return false;
+
+	// Bytes in each mip of a face (faces are stored whole, mips and all)
+	auto levelBytes = [&](unsigned int level)
+	{
+		size_t s = std::max(width >> level, 1u);
+		switch (format)
+		{
+		case SKY_BC1: return ((s + 3) / 4) * ((s + 3) / 4) * 8;
+		case SKY_BC7: return ((s + 3) / 4) * ((s + 3) / 4) * 16;
+		case SKY_RGBA16F: return s * s * 8;
+		case SKY_RGBA32F: return s * s * 16;
+		default: return s * s * 4;
+		}
+	};
+	size_t faceBytes = 0;
+	for (unsigned int m = 0; m < mipCount; m++)
+		faceBytes += levelBytes(m);
+	if (offset + faceBytes * 6 > bytes)
+		return false;
+
+	*cube = SkyMakeCube(width);
+	size_t texels = (size_t)width * width;
+	for (unsigned int f = 0; f < 6; f++)
+	{
+		const unsigned char* face = data + offset + faceBytes * f;
+		float* out = SkyTexel(*cube, f, 0, 0);
+
+		CookImage decoded;
+		if (format == SKY_BC1 || format == SKY_BC7)
+		{
+			CookDecompress(face, width, width, format == SKY_BC1 ? COOK_BC1 : COOK_BC7, &decoded);
+			face = decoded.Pixels.data();
+		}
+
+		for (size_t i = 0; i < texels; i++)
+		{
+			float rgb[3];
+			switch (format)
+			{
+			case SKY_RGBA32F:
+				memcpy(rgb, face + i * 16, 12);
+				break;
+			case SKY_RGBA16F:
+				for (int c = 0; c < 3; c++)
+					rgb[c] = HalfToFloat((unsigned short)(face[i * 8 + c * 2] | face[i * 8 + c * 2 + 1] << 8));
+				break;
+			case SKY_BGRA8:
+				for (int c = 0; c < 3; c++) rgb[c] = face[i * 4 + 2 - c] / 255.0f;
+				break;
+			default:
+				for (int c = 0; c < 3; c++) rgb[c] = face[i * 4 + c] / 255.0f;
+				break;
+			}
+			for (int c = 0; c < 3; c++)
+				out[i * 3 + c] = srgb ? SRGBToLinear(rgb[c]) : rgb[c];
+		}
+	}
+	return true;
+}
+
+static void Put32(std::vector<unsigned char>* out, unsigned int value)
+{
+	for (int i = 0; i < 4; i++) out->push_back((value >> (i * 8)) & 0xff);
+}
+
+void SkyWriteDDS(const std::vector<SkyCube>& mips, std::vector<unsigned char>* dds)
+{
+	unsigned int size = mips[0].Size;
+	dds->clear();
+	Put32(dds, 0x20534444);						// "DDS "
+	Put32(dds, 124);							// dwSize
+	Put32(dds, 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000);	// CAPS | HEIGHT | WIDTH | PITCH | PIXELFORMAT | MIPMAPCOUNT
+	Put32(dds, size);
+	Put32(dds, size);
+	Put32(dds, size * 8);						// dwPitchOrLinearSize
+	Put32(dds, 0);								// dwDepth
+	Put32(dds, (unsigned int)mips.size());
+	for (int i = 0; i < 11; i++) Put32(dds, 0);	// dwReserved1
+
+	Put32(dds, 32);								// ddspf.dwSize
+	Put32(dds, 0x4);							// DDPF_FOURCC
+	Put32(dds, 0x30315844);						// "DX10"
+	for (int i = 0; i < 5; i++) Put32(dds, 0);	// bit count and masks
+
+	Put32(dds, 0x1000 | 0x400000 | 0x8);		// TEXTURE | MIPMAP | COMPLEX
+	Put32(dds, 0xFE00);							// CUBEMAP + all six faces
+	for (int i = 0; i < 3; i++) Put32(dds, 0);	// dwCaps3, dwCaps4, dwReserved2
+
+	Put32(dds, 10);								// DXGI_FORMAT_R16G16B16A16_FLOAT
+	Put32(dds, 3);								// D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	Put32(dds, 0x4);							// D3D11_RESOURCE_MISC_TEXTURECUBE
+	Put32(dds, 1);								// One cube
+	Put32(dds, 0);								// miscFlags2
+
+	// Face by face, each with its whole chain
+	for (unsigned int f = 0; f < 6; f++)
+		for (const SkyCube& mip : mips)
+		{
+			const float* texels = SkyTexel(mip, f, 0, 0);
+			for (size_t i = 0; i < (size_t)mip.Size * mip.Size; i++)
+			{
+				unsigned short h[4] = { FloatToHalf(texels[i * 3]), FloatToHalf(texels[i * 3 + 1]),
+					FloatToHalf(texels[i * 3 + 2]), 0x3c00 };	// Alpha 1
+				for (int c = 0; c < 4; c++)
+				{
+					dds->push_back(h[c] & 0xff);
+					dds->push_back(h[c] >> 8);
+				}
+			}
+		}
+}
+
+// --------------------------------------------------------
+// Report
+// --------------------------------------------------------
+
+// Night-ish sky: dark gradient, a brighter band near the
+// horizon and a few hundred hard points of light
+static SkyCube MakeSky(unsigned int size)
+{
+	SkyCube sky = SkyMakeCube(size);
+	unsigned int seed = 12345;
+	auto random = [&]() { seed = seed * 1664525 + 1013904223; return (seed >> 8) / 16777216.0f; };
+	for (unsigned int f = 0; f < 6; f++)
+		for (unsigned int y = 0; y < size; y++)
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float d[3];
+				SkyTexelDirection(f, x, y, size, d);
+				float up = std::max(d[1], 0.0f);
+				float glow = expf(-fabsf(d[1]) * 8);
+				float* t = SkyTexel(sky, f, x, y);
+				t[0] = 0.02f + 0.05f * glow;
+				t[1] = 0.03f + 0.04f * glow;
+				t[2] = 0.08f + 0.1f * (1 - up);
+				if (d[1] > 0 && random() < 0.002f)
+					t[0] = t[1] = t[2] = 1;
+			}
+	return sky;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SkyConvolutionReport(unsigned int size)
+{
+	printf("\nSky convolution\n");
+
+	// Texels cover the sphere exactly once
+	{
+		double total = 0;
+		for (unsigned int y = 0; y < 16; y++)
+			for (unsigned int x = 0; x < 16; x++)
+				total += SkyTexelSolidAngle(x, y, 16) * 6.0;
+		float dir[3];
+		bool axes = true;
+		const float expected[6][3] = { {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1} };
+		for (unsigned int f = 0; f < 6; f++)
+		{
+			// Center of a 1x1 face is its axis
+			SkyTexelDirection(f, 0, 0, 1, dir);
+			for (int c = 0; c < 3; c++) axes = axes && fabsf(dir[c] - expected[f][c]) < 1e-5f;
+		}
+		bool ok = fabs(total - 4 * PI) < 1e-3 && axes;
+		printf("  solid angles add to %.4f (4 pi = %.4f), face centers on their axes  %s\n", total, 4 * PI, CheckResult(ok));
+	}
+
+	// A constant sky stays constant through both
+	{
+		SkyCube flat = SkyMakeCube(32);
+		for (size_t i = 0; i < flat.Texels.size(); i++) flat.Texels[i] = (i % 3 + 1) * 0.25f;
+		SkyCube irradiance = SkyIrradiance(flat, 8, 0);
+		std::vector<SkyCube> specular = SkyPrefilter(flat, 32, 5, 0);
+		SkySH9 sh = SkyProjectSH(flat, 0);
+		float worst = 0;
+		for (size_t i = 0; i < irradiance.Texels.size(); i++)
+			worst = std::max(worst, fabsf(irradiance.Texels[i] - (i % 3 + 1) * 0.25f));
+		for (unsigned int f = 0; f < 6; f++)
+		{
+			float n[3], rgb[3];
+			SkyTexelDirection(f, 3, 5, 8, n);
+			SkyEvalSH(sh, n, rgb);
+			for (int c = 0; c < 3; c++) worst = std::max(worst, fabsf(rgb[c] - (c + 1) * 0.25f));
+		}
+		for (auto& mip : specular)
+			for (size_t i = 0; i < mip.Texels.size(); i++)
+				worst = std::max(worst, fabsf(mip.Texels[i] - (i % 3 + 1) * 0.25f));
+		printf("  constant sky: worst error %.5f over irradiance, SH and %u specular mips  %s\n", worst,
+			(unsigned int)specular.size(), CheckResult(worst < 0.002f));
+	}
+
+	// Upper hemisphere white, lower black: facing up sees all
+	// of it (1), sideways half (0.5), down nothing
+	{
+		SkyCube half = SkyMakeCube(64);
+		for (unsigned int f = 0; f < 6; f++)
+			for (unsigned int y = 0; y < 64; y++)
+				for (unsigned int x = 0; x < 64; x++)
+				{
+					float d[3];
+					SkyTexelDirection(f, x, y, 64, d);
+					float* t = SkyTexel(half, f, x, y);
+					t[0] = t[1] = t[2] = d[1] > 0 ? 1.0f : 0.0f;
+				}
+		SkyCube irradiance = SkyIrradiance(half, 1, 0);
+		float up = SkyTexel(irradiance, 2, 0, 0)[0];
+		float side = SkyTexel(irradiance, 0, 0, 0)[0];
+		float down = SkyTexel(irradiance, 3, 0, 0)[0];
+		bool ok = fabsf(up - 1) < 0.01f && fabsf(side - 0.5f) < 0.01f && down < 0.01f;
+		printf("  half lit sky: up %.3f, side %.3f, down %.3f  %s\n", up, side, down, CheckResult(ok));
+
+		// 9 coefficients can't make the step at the horizon, but
+		// should land within a few percent of the white sky
+		SkySH9 sh = SkyProjectSH(half, 0);
+		const float n[3][3] = { { 0, 1, 0 }, { 1, 0, 0 }, { 0, -1, 0 } };
+		float rgb[3][3];
+		for (int i = 0; i < 3; i++) SkyEvalSH(sh, n[i], rgb[i]);
+		ok = fabsf(rgb[0][0] - 1) < 0.05f && fabsf(rgb[1][0] - 0.5f) < 0.01f && fabsf(rgb[2][0]) < 0.05f;
+		printf("  half lit sky, SH: up %.3f, side %.3f, down %.3f  %s\n", rgb[0][0], rgb[1][0], rgb[2][0], CheckResult(ok));
+	}
+
+	// Rougher mips only blur: no texel gets brighter than the
+	// sky, and the brightest texel doesn't grow from mip to mip.
+	// Texel centers move between mips though (a 1x1 face looks
+	// straight down its axis, a 2x2 one 35 degrees off it), so a
+	// smaller mip can land nearer a smooth maximum - allow 1%.
+	SkyCube sky = MakeSky(size);
+	{
+		std::vector<SkyCube> specular = SkyPrefilter(sky, std::min(size, 64u), 6, 0);
+		float skyPeak = *std::max_element(specular[0].Texels.begin(), specular[0].Texels.end());
+		bool ok = true;
+		float lastPeak = skyPeak;
+		for (auto& mip : specular)
+		{
+			float peak = *std::max_element(mip.Texels.begin(), mip.Texels.end());
+			ok = ok && peak <= skyPeak && peak <= lastPeak * 1.01f;
+			lastPeak = peak;
+		}
+		printf("  specular mips: %u, %ux%u down to %ux%u, peaks %.3f down to %.3f, never rise  %s\n",
+			(unsigned int)specular.size(), specular[0].Size, specular[0].Size, specular.back().Size,
+			specular.back().Size, skyPeak, lastPeak, CheckResult(ok));
+	}
+
+	// Through a DDS and back
+	{
+		SkyCube irradiance = SkyIrradiance(sky, 16, 0);
+		std::vector<unsigned char> dds;
+		SkyWriteDDS({ irradiance }, &dds);
+		SkyCube back;
+		bool read = SkyReadDDS(dds.data(), dds.size(), &back);
+		float worst = 0;
+		for (size_t i = 0; read && i < back.Texels.size(); i++)
+			worst = std::max(worst, fabsf(back.Texels[i] - irradiance.Texels[i]) / std::max(irradiance.Texels[i], 1e-3f));
+		bool ok = read && back.Size == 16 && dds.size() == 148 + (size_t)16 * 16 * 6 * 8 && worst < 1e-3f;
+		printf("  DDS: %u bytes, RGBA16F cube, worst relative error %.5f  %s\n", (unsigned int)dds.size(), worst,
+			CheckResult(ok));
+	}
+
+	// The fast versions against the plain ones
+	{
+		SkyCube small = MakeSky(64);
+		SkyCube fast = SkyIrradiance(small, 8, 0);
+		SkyCube reference = SkyIrradianceReference(small, 8);
+		SkySH9 sh = SkyProjectSH(small, 0);
+		float worst = 0, shWorst = 0;
+		double shTotal = 0;
+		for (unsigned int f = 0; f < 6; f++)
+			for (unsigned int y = 0; y < 8; y++)
+				for (unsigned int x = 0; x < 8; x++)
+				{
+					float n[3], rgb[3];
+					SkyTexelDirection(f, x, y, 8, n);
+					SkyEvalSH(sh, n, rgb);
+					for (int c = 0; c < 3; c++)
+					{
+						float expected = SkyTexel(reference, f, x, y)[c];
+						worst = std::max(worst, fabsf(SkyTexel(fast, f, x, y)[c] - expected) / expected);
+						float error = fabsf(rgb[c] - expected) / expected;
+						shWorst = std::max(shWorst, error);
+						shTotal += error;
+					}
+				}
+		float shAverage = (float)(shTotal / (8 * 8 * 6 * 3));
+		printf("  irradiance vs reference: worst relative error %.4f  %s\n", worst, CheckResult(worst < 0.01f));
+		printf("  SH vs reference: worst relative error %.4f, average %.4f  %s\n", shWorst, shAverage,
+			CheckResult(shWorst < 0.1f && shAverage < 0.03f));
+	}
+	// The fast version sums over the sky at twice the mip's size,
+	// the reference over all of it.  Mip 1's lobe is about as
+	// narrow as the fast version's source texels, so where a
+	// one texel star sits inside one of them moves the texels
+	// right by it by up to ~13%; from mip 2 on the lobes are
+	// wide enough that it averages out to a couple of percent.
+	{
+		SkyCube source = MakeSky(128);
+		std::vector<SkyCube> fast = SkyPrefilter(source, 32, 6, 0);
+		std::vector<SkyCube> reference = SkyPrefilterReference(source, 32, 6);
+		bool ok = fast.size() == reference.size();
+		printf("  specular vs reference (128x128 sky, 32x32, average / worst relative error, mips 1 on):\n   ");
+		for (size_t m = 1; ok && m < fast.size(); m++)
+		{
+			float worst = 0;
+			double total = 0;
+			for (size_t i = 0; i < fast[m].Texels.size(); i++)
+			{
+				float error = fabsf(fast[m].Texels[i] - reference[m].Texels[i]) / reference[m].Texels[i];
+				worst = std::max(worst, error);
+				total += error;
+			}
+			float average = (float)(total / fast[m].Texels.size());
+			ok = ok && average < 0.005f && worst < (m == 1 ? 0.15f : 0.02f);
+			printf(" %.3f / %.3f", average, worst);
+		}
+		printf("  %s\n", CheckResult(ok));
+	}
+
+	// The BRDF table: fast matches plain, and scale + bias never
+	// reflect more than comes in
+	{
+		const unsigned int tableSize = 32;
+		std::vector<float> table = SkyBRDF(tableSize, SKY_BRDF_SAMPLES, 0);
+		float worst = 0, most = 0;
+		for (unsigned int y = 0; y < tableSize; y++)
+			for (unsigned int x = 0; x < tableSize; x++)
+			{
+				float scale, bias;
+				SkyBRDFReference((x + 0.5f) / tableSize, (y + 0.5f) / tableSize, SKY_BRDF_SAMPLES, &scale, &bias);
+				const float* texel = &table[((size_t)y * tableSize + x) * 2];
+				worst = std::max(worst, std::max(fabsf(texel[0] - scale), fabsf(texel[1] - bias)));
+				most = std::max(most, texel[0] + texel[1]);
+			}
+		// Smooth and head on, everything comes back
+		const float* smooth = &table[((size_t)0 * tableSize + tableSize - 1) * 2];
+		bool ok = worst < 1e-3f && most < 1.01f && smooth[0] + smooth[1] > 0.95f;
+		printf("  BRDF %ux%u: worst difference from reference %.5f, scale + bias at most %.3f, smooth head on %.3f  %s\n",
+			tableSize, tableSize, worst, most, smooth[0] + smooth[1], CheckResult(ok));
+	}
+
+	// Timings by sky face size: SH, 32x32 irradiance and a 6 mip
+	// specular cube the sky's size, 1 thread vs every core; SIMD
+	// against the plain loops over the same texels
+	unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+	printf("  timings in ms, 1 thread / %u:\n", cores);
+	printf("    sky        SH              irradiance         specular          SIMD speedup\n");
+	for (unsigned int faceSize : { 32u, 64u, 128u, 256u })
+	{
+		if (faceSize > size)
+			break;
+		SkyCube timed = faceSize == size ? sky : MakeSky(faceSize);
+		double times[3][2];
+		for (int t = 0; t < 2; t++)
+		{
+			unsigned int threads = t == 0 ? 1 : cores;
+			auto start = std::chrono::steady_clock::now();
+			SkyProjectSH(timed, threads);
+			times[0][t] = SecondsSince(start);
+			start = std::chrono::steady_clock::now();
+			SkyIrradiance(timed, 32, threads);
+			times[1][t] = SecondsSince(start);
+			start = std::chrono::steady_clock::now();
+			SkyPrefilter(timed, faceSize, 6, threads);
+			times[2][t] = SecondsSince(start);
+		}
+
+		SkyCube source = DownsampleTo(timed, SKY_IRRADIANCE_SOURCE_SIZE);
+		auto start = std::chrono::steady_clock::now();
+		SkyIrradiance(source, 16, 1);
+		double simd = SecondsSince(start);
+		start = std::chrono::steady_clock::now();
+		SkyIrradianceReference(source, 16);
+		double plain = SecondsSince(start);
+
+		printf("    %3ux%-3u  %7.2f / %-7.2f %7.1f / %-7.1f %8.1f / %-8.1f %5.1fx\n", faceSize, faceSize,
+			times[0][0] * 1000, times[0][1] * 1000, times[1][0] * 1000, times[1][1] * 1000,
+			times[2][0] * 1000, times[2][1] * 1000, plain / simd);
+	}
+}
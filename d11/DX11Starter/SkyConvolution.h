@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// --------------------------------------------------------
+// Sky convolution for image based lighting: sky cube map ->
+// diffuse irradiance (a cube, or 9 spherical harmonics) +
+// specular cube whose mips are the sky blurred by rougher
+// and rougher reflections + the split sum BRDF table
+//
+// - Irradiance: every texel is the cosine weighted average
+//   of the whole sky around its normal (divided by pi, so a
+//   white surface under a constant sky comes out the sky's
+//   color).  The sky is box filtered down first, nothing
+//   that small changes the result.
+// - SH: the sky projected on the first 9 real spherical
+//   harmonics and convolved with the same cosine lobe - 27
+//   floats a shader can evaluate with no texture at all.
+// - Specular: mip 0 is the sky, mip m the GGX lobe with
+//   roughness m / (mips - 1), taking N = V = R.  Every texel
+//   of a smaller copy of the sky is weighted by D(h) N.L,
+//   which is what importance sampling converges to, so there
+//   is no noise.  Cost is texels out x texels in.
+// - BRDF: scale and bias on F0 for the split sum, by N.V and
+//   roughness, from Hammersley points on the GGX lobe
+// - The heavy loops go 4 texels / samples at a time (SSE2) and
+//   spread rows over threads.  The *Reference versions are the
+//   plain loops over the full size sky, for checking them.
+// - Faces are in D3D order (+X -X +Y -Y +Z -Z), texels RGB
+//   floats.  Values are what a shader would sample from the
+//   source (UNORM stays as is, _SRGB formats come linear).
+//
+// Plain C++ (and SSE2) with no device or OS calls, so it builds and runs
+// anywhere - see Tools/SkyConvolution for the command line.
+// --------------------------------------------------------
+
+// Irradiance is summed over the sky downsampled to this
+#define SKY_IRRADIANCE_SOURCE_SIZE 32
+
+// Specular lobes are summed over the sky downsampled to at
+// most this (else twice the mip being made, 16 at the least)
+#define SKY_SPECULAR_SOURCE_SIZE 64
+
+// BRDF table samples per texel
+#define SKY_BRDF_SAMPLES 256
+
+// Six square faces, RGB per texel, face by face, rows top to bottom
+struct SkyCube
+{
+	unsigned int Size;
+	std::vector<float> Texels;
+};
+
+SkyCube SkyMakeCube(unsigned int size);
+inline float* SkyTexel(SkyCube& cube, unsigned int face, unsigned int x, unsigned int y)
+{
+	return &cube.Texels[(((size_t)face * cube.Size + y) * cube.Size + x) * 3];
+}
+inline const float* SkyTexel(const SkyCube& cube, unsigned int face, unsigned int x, unsigned int y)
+{
+	return &cube.Texels[(((size_t)face * cube.Size + y) * cube.Size + x) * 3];
+}
+
+// Unit direction through the center of a texel
+void SkyTexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size, float dir[3]);
+
+// Solid angle a texel covers (all of them add up to 4 pi)
+float SkyTexelSolidAngle(unsigned int x, unsigned int y, unsigned int size);
+
+// 2x2 box, faces filtered separately
+SkyCube SkyDownsample(const SkyCube& cube);
+
+// Irradiance spherical harmonics, RGB per coefficient, already
+// convolved and divided by pi: SkyEvalSH gives what
+// SkyIrradiance would have for that normal
+struct SkySH9
+{
+	float Coeffs[9][3];
+};
+
+// All of these spread rows of output texels over threadCount
+// threads (0 = one per core)
+SkyCube SkyIrradiance(const SkyCube& sky, unsigned int size, unsigned int threadCount);
+SkySH9 SkyProjectSH(const SkyCube& sky, unsigned int threadCount);
+std::vector<SkyCube> SkyPrefilter(const SkyCube& sky, unsigned int size, unsigned int mipCount, unsigned int threadCount);
+
+// size x size (scale, bias) pairs, N.V across, roughness down
+std::vector<float> SkyBRDF(unsigned int size, unsigned int samples, unsigned int threadCount);
+
+void SkyEvalSH(const SkySH9& sh, const float n[3], float rgb[3]);
+
+// One thread, no SIMD, nothing downsampled
+SkyCube SkyIrradianceReference(const SkyCube& sky, unsigned int size);
+std::vector<SkyCube> SkyPrefilterReference(const SkyCube& sky, unsigned int size, unsigned int mipCount);
+void SkyBRDFReference(float NdotV, float roughness, unsigned int samples, float* scale, float* bias);
+
+// Mip 0 of a cube map DDS: RGBA8 / BGRA8 (UNORM or _SRGB),
+// RGBA16F, RGBA32F, BC1 or BC7, legacy or DX10 header
+bool SkyReadDDS(const unsigned char* data, size_t bytes, SkyCube* cube);
+
+// Cube map DDS, R16G16B16A16_FLOAT, every mip given
+void SkyWriteDDS(const std::vector<SkyCube>& mips, std::vector<unsigned char>* dds);
+
+// Checks texel geometry and the convolutions against skies with
+// known answers and the reference versions, then times them on
+// generated skies of a few face sizes, 1 thread vs every core
+void SkyConvolutionReport(unsigned int size);
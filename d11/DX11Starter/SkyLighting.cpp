@@ -0,0 +1,158 @@
+#include "SkyLighting.h"
+#include "Profiler.h"
+#include "pch.h"
+#include <fstream>
+#include <vector>
+
+// SH basis constant of band 0: a constant sky's irradiance is
+// Coeffs[0] times this
+static const float SH_Y00 = 0.282095f;
+
+static float Luminance(float r, float g, float b)
+{
+	return r * 0.2126f + g * 0.7152f + b * 0.0722f;
+}
+
+SkyLighting::SkyLighting(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->device = device;
+	this->context = context;
+	sh = {};
+	intensity = 1;
+	specularSRV = 0;
+	specularMips = 0;
+	loadDone = false;
+
+	// The BRDF table doesn't depend on the sky, so it's made
+	// right away
+	std::vector<float> table = SkyBRDF(SKY_LIGHTING_BRDF_SIZE, SKY_BRDF_SAMPLES, 0);
+
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = SKY_LIGHTING_BRDF_SIZE;
+	td.Height = SKY_LIGHTING_BRDF_SIZE;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_R32G32_FLOAT;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_IMMUTABLE;
+	td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = table.data();
+	data.SysMemPitch = SKY_LIGHTING_BRDF_SIZE * sizeof(float) * 2;
+	device->CreateTexture2D(&td, &data, &brdfTexture);
+	device->CreateShaderResourceView(brdfTexture, 0, &brdfSRV);
+
+	// Clamped so the table's edges don't wrap around
+	D3D11_SAMPLER_DESC sd = {};
+	sd.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sd.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&sd, &sampler);
+}
+
+SkyLighting::~SkyLighting()
+{
+	if (loader.joinable()) loader.join();
+	if (specularSRV) specularSRV->Release();
+	if (brdfSRV) brdfSRV->Release();
+	if (brdfTexture) brdfTexture->Release();
+	if (sampler) sampler->Release();
+}
+
+void SkyLighting::Load(const std::wstring& path, const XMFLOAT4& ambient)
+{
+	// One load at a time - wait out (and drop) one in flight
+	if (loader.joinable()) loader.join();
+
+	// Until there's a sky, a flat one the ambient color
+	sh = {};
+	sh.Coeffs[0][0] = ambient.x / SH_Y00;
+	sh.Coeffs[0][1] = ambient.y / SH_Y00;
+	sh.Coeffs[0][2] = ambient.z / SH_Y00;
+	intensity = 1;
+	if (specularSRV) specularSRV->Release();
+	specularSRV = 0;
+	specularMips = 0;
+
+	loadDone = false;
+	loader = std::thread([this, path, ambient]()
+	{
+		Convolve(path, ambient, &loaded);
+		loadDone.store(true, std::memory_order_release);
+	});
+}
+
+bool SkyLighting::Update()
+{
+	if (!loader.joinable() || !loadDone.load(std::memory_order_acquire))
+		return false;
+	loader.join();
+	if (!loaded.Succeeded)
+		return false;
+
+	PROFILE_ZONE("SkyLighting::Update");
+	sh = loaded.SH;
+	intensity = loaded.Intensity;
+
+	// Through a DDS so the loader makes the cube and its mips
+	// in one go
+	if (SUCCEEDED(CreateDDSTextureFromMemory(device, loaded.SpecularDDS.data(), loaded.SpecularDDS.size(), 0,
+		&specularSRV)))
+		specularMips = loaded.SpecularMips;
+	loaded.SpecularDDS.clear();
+	return true;
+}
+
+// --------------------------------------------------------
+// Worker thread: everything but the texture - reads the
+// file, projects it to SH and prefilters the specular cube
+// --------------------------------------------------------
+void SkyLighting::Convolve(const std::wstring& path, const XMFLOAT4& ambient, Convolved* result)
+{
+	PROFILE_ZONE("SkyLighting::Convolve");
+	result->Succeeded = false;
+
+	std::vector<unsigned char> bytes;
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		std::streamsize size = file ? (std::streamsize)file.tellg() : 0;
+		if (size <= 0)
+			return;
+		file.seekg(0);
+		bytes.resize((size_t)size);
+		if (!file.read((char*)bytes.data(), size))
+			return;
+	}
+
+	SkyCube sky;
+	if (!SkyReadDDS(bytes.data(), bytes.size(), &sky))
+		return;
+
+	// Average irradiance over every normal is band 0's share
+	SkySH9 skySH = SkyProjectSH(sky, 0);
+	float average = Luminance(skySH.Coeffs[0][0], skySH.Coeffs[0][1], skySH.Coeffs[0][2]) * SH_Y00;
+	if (average <= 0)
+		return;
+	result->SH = skySH;
+	result->Intensity = Luminance(ambient.x, ambient.y, ambient.z) / average;
+
+	std::vector<SkyCube> mips = SkyPrefilter(sky, SKY_LIGHTING_SPECULAR_SIZE, SKY_LIGHTING_SPECULAR_MIPS, 0);
+	SkyWriteDDS(mips, &result->SpecularDDS);
+	result->SpecularMips = (unsigned int)mips.size();
+	result->Succeeded = true;
+}
+
+void SkyLighting::Bind(SimplePixelShader* ps)
+{
+	XMFLOAT4 coeffs[9];
+	for (int i = 0; i < 9; i++)
+		coeffs[i] = XMFLOAT4(sh.Coeffs[i][0], sh.Coeffs[i][1], sh.Coeffs[i][2], 0);
+	ps->SetData("skySH", coeffs, sizeof(coeffs));
+	ps->SetFloat("skyIntensity", intensity);
+	ps->SetFloat("skySpecularMips", (float)specularMips);
+	ps->SetShaderResourceView("SkySpecular", specularSRV);
+	ps->SetShaderResourceView("SkyBRDF", brdfSRV);
+	ps->SetSamplerState("SkySampler", sampler);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "SimpleShader.h"
+#include "SkyConvolution.h"
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Image based lighting from the sky cube map
+//
+// - Diffuse: the sky's 9 irradiance SH coefficients, in the
+//   lit shaders' constants in place of the flat ambient color
+// - Specular: a GGX prefiltered cube (roughness across the
+//   mips) and the split sum BRDF table, both made once by
+//   SkyConvolution - the sky's on a worker thread, so startup
+//   doesn't wait on it, with the flat ambient until it's done
+// - The sky is scaled so its average irradiance is as bright
+//   as the ambient color it replaces, so the scene keeps its
+//   exposure whatever the sky file's values
+// - Lit pixel shaders get SkyLighting.hlsli; Bind() sets its
+//   constants, textures and sampler
+// --------------------------------------------------------
+
+// Prefiltered specular cube size and mips (the last is the
+// roughest lobe)
+#define SKY_LIGHTING_SPECULAR_SIZE 64
+#define SKY_LIGHTING_SPECULAR_MIPS 6
+
+// BRDF table size, N.V x roughness
+#define SKY_LIGHTING_BRDF_SIZE 32
+
+class SkyLighting
+{
+public:
+	SkyLighting(ID3D11Device* device, ID3D11DeviceContext* context);
+	~SkyLighting();
+
+	// Starts reading a sky cube map DDS and convolving it, scaled
+	// to the ambient color's brightness, on a worker thread.
+	// Until Update() picks it up (or if it can't be read) the
+	// sky is that flat color, with no specular.
+	void Load(const std::wstring& path, const XMFLOAT4& ambient);
+
+	// Main thread, once per frame - swaps in a finished load's SH
+	// and makes its specular cube.  True on the frame it does.
+	bool Update();
+	bool IsLoading() { return loader.joinable(); }
+
+	// Sets the SH, intensity, specular cube, BRDF table and
+	// sampler on a lit pixel shader
+	void Bind(SimplePixelShader* ps);
+
+	const SkySH9& GetSH() { return sh; }
+	float GetIntensity() { return intensity; }
+
+private:
+	// What the worker hands back: the SH and intensity, and the
+	// prefiltered cube as a DDS file
+	struct Convolved
+	{
+		bool Succeeded;
+		SkySH9 SH;
+		float Intensity;
+		std::vector<unsigned char> SpecularDDS;
+		unsigned int SpecularMips;
+	};
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+
+	SkySH9 sh;
+	float intensity;
+
+	ID3D11ShaderResourceView* specularSRV;   // 0 until a sky is loaded
+	unsigned int specularMips;
+	ID3D11Texture2D* brdfTexture;
+	ID3D11ShaderResourceView* brdfSRV;
+	ID3D11SamplerState* sampler;             // Trilinear, clamped
+
+	std::thread loader;                      // Running (or finished, not yet picked up)
+	std::atomic<bool> loadDone;
+	Convolved loaded;                        // The worker's until loadDone
+
+	static void Convolve(const std::wstring& path, const XMFLOAT4& ambient, Convolved* result);
+};
@@ -0,0 +1,55 @@
+//image based lighting from the sky
+//(see SkyLighting.h for how the SH, cube and table are made)
+#ifndef SKY_LIGHTING
+#define SKY_LIGHTING
+
+//reflectance head on of everything in the scene (dielectrics)
+#define SKY_F0 0.04
+
+cbuffer skyLightingData : register(b5)
+{
+	float4 skySH[9];         //irradiance SH, rgb per coefficient (SkySH9)
+	float skyIntensity;      //scales the sky to the scene's ambient
+	float skySpecularMips;   //mips in SkySpecular, 0 = no cube yet
+	float2 skyPad;
+};
+
+TextureCube SkySpecular : register(t11);    //GGX prefiltered, roughness across the mips
+Texture2D<float2> SkyBRDF : register(t12);  //scale, bias on F0 by N.V and roughness
+SamplerState SkySampler : register(s4);
+
+//light from the whole sky on a surface facing N
+float3 SkyDiffuse(float3 N)
+{
+	float3 c = skySH[0].rgb * 0.282095;
+	c += skySH[1].rgb * (0.488603 * N.y);
+	c += skySH[2].rgb * (0.488603 * N.z);
+	c += skySH[3].rgb * (0.488603 * N.x);
+	c += skySH[4].rgb * (1.092548 * N.x * N.y);
+	c += skySH[5].rgb * (1.092548 * N.y * N.z);
+	c += skySH[6].rgb * (0.315392 * (3 * N.z * N.z - 1));
+	c += skySH[7].rgb * (1.092548 * N.x * N.z);
+	c += skySH[8].rgb * (0.546274 * (N.x * N.x - N.y * N.y));
+	return max(c, 0) * skyIntensity;
+}
+
+//the sky's reflection, split sum: the cube's mip for the
+//roughness times the BRDF table's scale and bias on F0.
+//shininess is the phong exponent the other lights use
+//(0 = no highlight), turned into GGX roughness.
+float3 SkySpecularLight(float3 N, float3 V, float shininess)
+{
+	if (skySpecularMips <= 0 || shininess <= 0)
+		return 0;
+
+	float alpha = sqrt(2 / (shininess + 2));
+	float roughness = sqrt(alpha);
+	float NdotV = saturate(dot(N, V));
+	float3 R = reflect(-V, N);
+
+	float3 prefiltered = SkySpecular.SampleLevel(SkySampler, R, roughness * (skySpecularMips - 1)).rgb;
+	float2 brdf = SkyBRDF.SampleLevel(SkySampler, float2(NdotV, roughness), 0);
+	return prefiltered * (SKY_F0 * brdf.x + brdf.y) * skyIntensity;
+}
+
+#endif
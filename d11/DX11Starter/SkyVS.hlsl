@@ -1,19 +1,8 @@
-
 // Constant Buffer for external (C++) data
 cbuffer externalData : register(b0)
 {
-	matrix world;
-	matrix view;
-	matrix projection;
-};
-
-// Struct representing a single vertex worth of data
-struct VertexShaderInput
-{
-	float3 position		: POSITION;
-	float2 uv			: TEXCOORD;
-	float3 normal		: NORMAL;
-	float3 tangent		: TANGENT;
+	matrix invView;          //view --> world, only the rotation is used
+	float4 projParams;       //1 / proj._11, 1 / proj._22, far depth (0 with reversed z)
 };
 
 // Out of the vertex shader (and eventually input to the PS)
@@ -21,35 +10,29 @@ struct VertexToPixel
 {
 	float4 position		: SV_POSITION;
 	float3 uvw			: TEXCOORD0;
-	float depth         : DEPTH;        //depth in view space
 };
 
 // --------------------------------------------------------
-// The entry point (main method) for our vertex shader
+// Fullscreen triangle, no vertex buffer (Draw(3, 0)) - each
+// corner carries the world space direction of its view ray
 // --------------------------------------------------------
-VertexToPixel main(VertexShaderInput input)
+VertexToPixel main(uint id : SV_VertexID)
 {
 	// Set up output
 	VertexToPixel output;
 
-	// The view matrix without translations
-	matrix viewNoMovement = view;
-	viewNoMovement._41 = 0;
-	viewNoMovement._42 = 0;
-	viewNoMovement._43 = 0;
-
-	// Calculate output position
-	matrix vp = mul(viewNoMovement, projection);
-	output.position = mul(float4(input.position, 1.0f), vp);
-
-	// Ensure the vertex's depth is going to be 1.0 exactly
-	output.position.z = output.position.w;
+	// Same triangle as PostProcessVS
+	float2 uv = float2((id << 1) & 2, id & 2);
+	float2 ndc = float2(uv.x * 2 - 1, uv.y * -2 + 1);
 
-	output.depth = mul(float4(input.position, 1.0f), mul(world, view)).z;
+	// The far depth exactly, so anything drawn before rejects it
+	output.position = float4(ndc, projParams.z, 1);
 
-	// Send down the direction to this vertex from the origin
-	// (which happens to just be it's raw position)
-	output.uvw = input.position;
+	// The view ray through this corner, interpolated linearly
+	// across the screen (the pixel shader doesn't normalize,
+	// the cube lookup doesn't care about length)
+	float3 viewRay = float3(ndc.x * projParams.x, ndc.y * projParams.y, 1);
+	output.uvw = mul(viewRay, (float3x3)invView);
 
 	return output;
-}
\ No newline at end of file
+}
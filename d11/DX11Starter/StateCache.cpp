@@ -0,0 +1,475 @@
+#include "StateCache.h"
+#include "Check.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+unsigned long long StateHash(const void* data, size_t bytes)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Depth stencil and blend descriptors have padding after their
+// UINT8 members - copied field by field into zeroed memory so
+// whatever was in the caller's padding doesn't change the key
+static D3D11_DEPTH_STENCIL_DESC CanonicalDepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	D3D11_DEPTH_STENCIL_DESC key;
+	memset(&key, 0, sizeof(key));
+	key.DepthEnable = desc.DepthEnable;
+	key.DepthWriteMask = desc.DepthWriteMask;
+	key.DepthFunc = desc.DepthFunc;
+	key.StencilEnable = desc.StencilEnable;
+	key.StencilReadMask = desc.StencilReadMask;
+	key.StencilWriteMask = desc.StencilWriteMask;
+	key.FrontFace = desc.FrontFace;
+	key.BackFace = desc.BackFace;
+	return key;
+}
+
+static D3D11_BLEND_DESC CanonicalBlend(const D3D11_BLEND_DESC& desc)
+{
+	D3D11_BLEND_DESC key;
+	memset(&key, 0, sizeof(key));
+	key.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+	key.IndependentBlendEnable = desc.IndependentBlendEnable;
+	for (int i = 0; i < 8; i++)
+	{
+		const D3D11_RENDER_TARGET_BLEND_DESC& rt = desc.RenderTarget[i];
+		key.RenderTarget[i].BlendEnable = rt.BlendEnable;
+		key.RenderTarget[i].SrcBlend = rt.SrcBlend;
+		key.RenderTarget[i].DestBlend = rt.DestBlend;
+		key.RenderTarget[i].BlendOp = rt.BlendOp;
+		key.RenderTarget[i].SrcBlendAlpha = rt.SrcBlendAlpha;
+		key.RenderTarget[i].DestBlendAlpha = rt.DestBlendAlpha;
+		key.RenderTarget[i].BlendOpAlpha = rt.BlendOpAlpha;
+		key.RenderTarget[i].RenderTargetWriteMask = rt.RenderTargetWriteMask;
+	}
+	return key;
+}
+
+
+// --------------------------------------------------------
+// D3D11 backend
+// --------------------------------------------------------
+D3D11StateBackend::D3D11StateBackend(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+D3D11StateBackend::~D3D11StateBackend()
+{
+	for (auto& s : samplers) if (s) s->Release();
+	for (auto& s : rasterizers) if (s) s->Release();
+	for (auto& s : depthStencils) if (s) s->Release();
+	for (auto& s : blends) if (s) s->Release();
+}
+
+int D3D11StateBackend::CreateSampler(const D3D11_SAMPLER_DESC& desc)
+{
+	ID3D11SamplerState* state = 0;
+	device->CreateSamplerState(&desc, &state);
+	samplers.push_back(state);
+	return (int)samplers.size() - 1;
+}
+
+int D3D11StateBackend::CreateRasterizer(const D3D11_RASTERIZER_DESC& desc)
+{
+	ID3D11RasterizerState* state = 0;
+	device->CreateRasterizerState(&desc, &state);
+	rasterizers.push_back(state);
+	return (int)rasterizers.size() - 1;
+}
+
+int D3D11StateBackend::CreateDepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	ID3D11DepthStencilState* state = 0;
+	device->CreateDepthStencilState(&desc, &state);
+	depthStencils.push_back(state);
+	return (int)depthStencils.size() - 1;
+}
+
+int D3D11StateBackend::CreateBlend(const D3D11_BLEND_DESC& desc)
+{
+	ID3D11BlendState* state = 0;
+	device->CreateBlendState(&desc, &state);
+	blends.push_back(state);
+	return (int)blends.size() - 1;
+}
+
+void D3D11StateBackend::SetRasterizer(int id)
+{
+	context->RSSetState(id < 0 ? 0 : rasterizers[id]);
+}
+
+void D3D11StateBackend::SetDepthStencil(int id, unsigned int stencilRef)
+{
+	context->OMSetDepthStencilState(id < 0 ? 0 : depthStencils[id], stencilRef);
+}
+
+void D3D11StateBackend::SetBlend(int id)
+{
+	context->OMSetBlendState(id < 0 ? 0 : blends[id], 0, 0xFFFFFFFF);
+}
+
+
+// --------------------------------------------------------
+// Recording backend
+// --------------------------------------------------------
+RecordingStateBackend::RecordingStateBackend()
+{
+	for (int k = 0; k < STATE_KIND_COUNT; k++)
+	{
+		created[k] = 0;
+		sets[k] = 0;
+		bound[k] = -1;
+	}
+}
+
+
+// --------------------------------------------------------
+// Cache
+// --------------------------------------------------------
+StateCache::StateCache(IStateBackend* backend)
+{
+	this->backend = backend;
+
+	// Slot 0 of every list is D3D11's default
+	for (int k = 0; k < STATE_KIND_COUNT; k++)
+		states[k].push_back({ 0, std::vector<unsigned char>(), -1 });
+	pipelines.push_back({ STATE_DEFAULT, STATE_DEFAULT, STATE_DEFAULT, 0 });
+
+	requestCount = 0;
+	applyCount = 0;
+	setCount = 0;
+	skipCount = 0;
+	Invalidate();
+}
+
+StateCache::~StateCache()
+{
+	delete backend;
+}
+
+StateID StateCache::Find(StateKind kind, const void* desc, size_t bytes, unsigned long long hash)
+{
+	requestCount++;
+	const std::vector<State>& list = states[kind];
+	for (size_t i = 1; i < list.size(); i++)
+		if (list[i].Hash == hash && list[i].Desc.size() == bytes && memcmp(list[i].Desc.data(), desc, bytes) == 0)
+			return (StateID)i;
+	return -1;
+}
+
+StateID StateCache::Add(StateKind kind, const void* desc, size_t bytes, unsigned long long hash, int backendID)
+{
+	const unsigned char* p = (const unsigned char*)desc;
+	states[kind].push_back({ hash, std::vector<unsigned char>(p, p + bytes), backendID });
+	return (StateID)states[kind].size() - 1;
+}
+
+StateID StateCache::Sampler(const D3D11_SAMPLER_DESC& desc)
+{
+	unsigned long long hash = StateHash(&desc, sizeof(desc));
+	StateID id = Find(STATE_SAMPLER, &desc, sizeof(desc), hash);
+	if (id >= 0) return id;
+	return Add(STATE_SAMPLER, &desc, sizeof(desc), hash, backend->CreateSampler(desc));
+}
+
+StateID StateCache::Rasterizer(const D3D11_RASTERIZER_DESC& desc)
+{
+	unsigned long long hash = StateHash(&desc, sizeof(desc));
+	StateID id = Find(STATE_RASTERIZER, &desc, sizeof(desc), hash);
+	if (id >= 0) return id;
+	return Add(STATE_RASTERIZER, &desc, sizeof(desc), hash, backend->CreateRasterizer(desc));
+}
+
+StateID StateCache::DepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	D3D11_DEPTH_STENCIL_DESC key = CanonicalDepthStencil(desc);
+	unsigned long long hash = StateHash(&key, sizeof(key));
+	StateID id = Find(STATE_DEPTH_STENCIL, &key, sizeof(key), hash);
+	if (id >= 0) return id;
+	return Add(STATE_DEPTH_STENCIL, &key, sizeof(key), hash, backend->CreateDepthStencil(key));
+}
+
+StateID StateCache::Blend(const D3D11_BLEND_DESC& desc)
+{
+	D3D11_BLEND_DESC key = CanonicalBlend(desc);
+	unsigned long long hash = StateHash(&key, sizeof(key));
+	StateID id = Find(STATE_BLEND, &key, sizeof(key), hash);
+	if (id >= 0) return id;
+	return Add(STATE_BLEND, &key, sizeof(key), hash, backend->CreateBlend(key));
+}
+
+PipelineID StateCache::Pipeline(StateID rasterizer, StateID depthStencil, StateID blend, unsigned int stencilRef)
+{
+	for (size_t i = 0; i < pipelines.size(); i++)
+	{
+		const PipelineState& p = pipelines[i];
+		if (p.Rasterizer == rasterizer && p.DepthStencil == depthStencil && p.Blend == blend && p.StencilRef == stencilRef)
+			return (PipelineID)i;
+	}
+	pipelines.push_back({ rasterizer, depthStencil, blend, stencilRef });
+	return (PipelineID)pipelines.size() - 1;
+}
+
+void StateCache::Apply(PipelineID pipeline)
+{
+	const PipelineState& p = pipelines[pipeline];
+	applyCount++;
+
+	if (!boundKnown || p.Rasterizer != bound.Rasterizer)
+	{
+		backend->SetRasterizer(states[STATE_RASTERIZER][p.Rasterizer].BackendID);
+		setCount++;
+	}
+	else skipCount++;
+
+	if (!boundKnown || p.DepthStencil != bound.DepthStencil || p.StencilRef != bound.StencilRef)
+	{
+		backend->SetDepthStencil(states[STATE_DEPTH_STENCIL][p.DepthStencil].BackendID, p.StencilRef);
+		setCount++;
+	}
+	else skipCount++;
+
+	if (!boundKnown || p.Blend != bound.Blend)
+	{
+		backend->SetBlend(states[STATE_BLEND][p.Blend].BackendID);
+		setCount++;
+	}
+	else skipCount++;
+
+	bound = p;
+	boundKnown = true;
+}
+
+void StateCache::Invalidate()
+{
+	boundKnown = false;
+	bound = pipelines[PIPELINE_DEFAULT];
+}
+
+ID3D11SamplerState* StateCache::GetSampler(StateID sampler)
+{
+	int id = states[STATE_SAMPLER][sampler].BackendID;
+	return id < 0 ? 0 : backend->GetSampler(id);
+}
+
+
+// --------------------------------------------------------
+// Report
+// --------------------------------------------------------
+void StateCacheReport()
+{
+	printf("\nState cache\n");
+
+	// Hash: same bytes same hash, one bit off a different one
+	{
+		D3D11_SAMPLER_DESC a = {};
+		a.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		D3D11_SAMPLER_DESC b = a;
+		D3D11_SAMPLER_DESC c = a;
+		c.MaxAnisotropy = 1;
+		bool ok = StateHash(&a, sizeof(a)) == StateHash(&b, sizeof(b)) && StateHash(&a, sizeof(a)) != StateHash(&c, sizeof(c));
+		printf("  hash: equal descriptors match, different ones don't  %s\n", CheckResult(ok));
+	}
+
+	// Dedup: the game's samplers (wrap, border, clamp), asked for
+	// by more than one owner
+	{
+		RecordingStateBackend* backend = new RecordingStateBackend();
+		StateCache cache(backend);
+
+		D3D11_SAMPLER_DESC wrap = {};
+		wrap.AddressU = wrap.AddressV = wrap.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+		wrap.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		wrap.MaxLOD = D3D11_FLOAT32_MAX;
+		D3D11_SAMPLER_DESC border = wrap;
+		border.AddressU = border.AddressV = border.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+		D3D11_SAMPLER_DESC clamp = wrap;
+		clamp.AddressU = clamp.AddressV = clamp.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+
+		StateID w0 = cache.Sampler(wrap);
+		StateID b0 = cache.Sampler(border);
+		StateID c0 = cache.Sampler(clamp);
+		StateID w1 = cache.Sampler(wrap);
+		StateID c1 = cache.Sampler(clamp);
+		bool ok = w0 == w1 && c0 == c1 && w0 != b0 && b0 != c0 && w0 != c0 && w0 != STATE_DEFAULT;
+		ok = ok && backend->GetCreateCount(STATE_SAMPLER) == 3 && cache.GetStateCount(STATE_SAMPLER) == 3;
+		printf("  samplers: %u asked for, %u created  %s\n", cache.GetRequestCount(),
+			backend->GetCreateCount(STATE_SAMPLER), CheckResult(ok));
+
+		// Garbage in the padding of the caller's descriptor
+		D3D11_DEPTH_STENCIL_DESC clean = {};
+		clean.DepthEnable = true;
+		clean.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		clean.DepthFunc = D3D11_COMPARISON_EQUAL;
+		D3D11_DEPTH_STENCIL_DESC dirty;
+		memset(&dirty, 0xCD, sizeof(dirty));
+		dirty.DepthEnable = true;
+		dirty.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		dirty.DepthFunc = D3D11_COMPARISON_EQUAL;
+		dirty.StencilEnable = false;
+		dirty.StencilReadMask = 0;
+		dirty.StencilWriteMask = 0;
+		dirty.FrontFace = clean.FrontFace;
+		dirty.BackFace = clean.BackFace;
+
+		D3D11_BLEND_DESC add = {};
+		add.RenderTarget[0].BlendEnable = true;
+		add.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+		add.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+		add.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+		add.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+		add.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+		add.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+		add.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+		D3D11_BLEND_DESC addDirty;
+		memset(&addDirty, 0xCD, sizeof(addDirty));
+		addDirty.AlphaToCoverageEnable = false;
+		addDirty.IndependentBlendEnable = false;
+		for (int i = 0; i < 8; i++)
+		{
+			const D3D11_RENDER_TARGET_BLEND_DESC& rt = add.RenderTarget[i];
+			addDirty.RenderTarget[i].BlendEnable = rt.BlendEnable;
+			addDirty.RenderTarget[i].SrcBlend = rt.SrcBlend;
+			addDirty.RenderTarget[i].DestBlend = rt.DestBlend;
+			addDirty.RenderTarget[i].BlendOp = rt.BlendOp;
+			addDirty.RenderTarget[i].SrcBlendAlpha = rt.SrcBlendAlpha;
+			addDirty.RenderTarget[i].DestBlendAlpha = rt.DestBlendAlpha;
+			addDirty.RenderTarget[i].BlendOpAlpha = rt.BlendOpAlpha;
+			addDirty.RenderTarget[i].RenderTargetWriteMask = rt.RenderTargetWriteMask;
+		}
+		ok = cache.DepthStencil(clean) == cache.DepthStencil(dirty) && cache.Blend(add) == cache.Blend(addDirty);
+		ok = ok && backend->GetCreateCount(STATE_DEPTH_STENCIL) == 1 && backend->GetCreateCount(STATE_BLEND) == 1;
+		printf("  padding bytes ignored by the key  %s\n", CheckResult(ok));
+
+		// Pipelines: same parts same id, all defaults is PIPELINE_DEFAULT
+		StateID equal = cache.DepthStencil(clean);
+		PipelineID p0 = cache.Pipeline(STATE_DEFAULT, equal);
+		PipelineID p1 = cache.Pipeline(STATE_DEFAULT, equal);
+		PipelineID p2 = cache.Pipeline(STATE_DEFAULT, equal, STATE_DEFAULT, 1);
+		ok = p0 == p1 && p0 != p2 && p0 != PIPELINE_DEFAULT && cache.Pipeline(0, 0, 0) == PIPELINE_DEFAULT;
+		printf("  pipelines: %u registered  %s\n", cache.GetPipelineCount(), CheckResult(ok));
+
+		// Apply: everything after an Invalidate, nothing when it's
+		// already bound, and what's bound is what was asked for
+		cache.Apply(p0);
+		unsigned int first = backend->GetSetCount();
+		cache.Apply(p0);
+		unsigned int again = backend->GetSetCount() - first;
+		cache.Apply(PIPELINE_DEFAULT);
+		unsigned int back = backend->GetSetCount() - first - again;
+		ok = first == 3 && again == 0 && back == 1 && backend->GetBound(STATE_DEPTH_STENCIL) == -1;
+		printf("  apply: %u sets, then %u, then %u back to the defaults  %s\n", first, again, back, CheckResult(ok));
+	}
+
+	// One forward frame of this game with the depth pre-pass
+	// (reversed z): the pre-pass testing GREATER, 8 opaque draws
+	// testing EQUAL, then the sky's fullscreen triangle testing
+	// GREATER_EQUAL, then back to the defaults for the post
+	// process passes.  Setting every state per draw, as a
+	// queue without the cache would, against Apply.
+	{
+		RecordingStateBackend* backend = new RecordingStateBackend();
+		StateCache cache(backend);
+
+		D3D11_DEPTH_STENCIL_DESC prepassDepth = {};
+		prepassDepth.DepthEnable = true;
+		prepassDepth.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+		prepassDepth.DepthFunc = D3D11_COMPARISON_GREATER;
+		D3D11_DEPTH_STENCIL_DESC skyDepth = {};
+		skyDepth.DepthEnable = true;
+		skyDepth.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		skyDepth.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
+		D3D11_DEPTH_STENCIL_DESC equalDepth = {};
+		equalDepth.DepthEnable = true;
+		equalDepth.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		equalDepth.DepthFunc = D3D11_COMPARISON_EQUAL;
+
+		PipelineID prepass = cache.Pipeline(STATE_DEFAULT, cache.DepthStencil(prepassDepth));
+		PipelineID opaque = cache.Pipeline(STATE_DEFAULT, cache.DepthStencil(equalDepth));
+		PipelineID sky = cache.Pipeline(STATE_DEFAULT, cache.DepthStencil(skyDepth));
+
+		std::vector<PipelineID> frame;
+		frame.push_back(prepass);		// Depth pre-pass
+		for (int i = 0; i < 8; i++) frame.push_back(opaque);
+		frame.push_back(sky);
+		for (int i = 0; i < 12; i++) frame.push_back(PIPELINE_DEFAULT);	// Bloom, blend, DoF
+
+		unsigned int naive = (unsigned int)frame.size() * 3;
+		cache.Invalidate();
+		for (auto& p : frame) cache.Apply(p);
+		printf("  game frame: %u draws, %u state sets without the cache, %u with it (%u skipped)\n",
+			(unsigned int)frame.size(), naive, backend->GetSetCount(), cache.GetSkipCount());
+	}
+
+	// A longer queue over a handful of pipelines, in submission
+	// order and sorted by pipeline id
+	{
+		RecordingStateBackend* backend = new RecordingStateBackend();
+		StateCache cache(backend);
+
+		D3D11_RASTERIZER_DESC rd = {};
+		rd.FillMode = D3D11_FILL_SOLID;
+		rd.DepthClipEnable = true;
+		rd.CullMode = D3D11_CULL_BACK;
+		StateID back = cache.Rasterizer(rd);
+		rd.CullMode = D3D11_CULL_NONE;
+		StateID none = cache.Rasterizer(rd);
+		D3D11_DEPTH_STENCIL_DESC dd = {};
+		dd.DepthEnable = true;
+		dd.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		dd.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+		StateID test = cache.DepthStencil(dd);
+		D3D11_BLEND_DESC bd = {};
+		bd.RenderTarget[0].BlendEnable = true;
+		bd.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+		bd.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+		bd.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+		bd.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+		bd.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+		bd.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+		bd.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+		StateID alpha = cache.Blend(bd);
+
+		PipelineID kinds[4] = {
+			cache.Pipeline(back, STATE_DEFAULT),
+			cache.Pipeline(none, STATE_DEFAULT),
+			cache.Pipeline(back, test, alpha),
+			cache.Pipeline(none, test, alpha) };
+
+		// Mostly opaque, a few two sided and transparent draws mixed in
+		std::mt19937 rng(45);
+		std::vector<PipelineID> queue;
+		for (int i = 0; i < 2000; i++)
+		{
+			unsigned int r = rng() % 100;
+			queue.push_back(kinds[r < 70 ? 0 : r < 85 ? 1 : r < 95 ? 2 : 3]);
+		}
+
+		cache.Invalidate();
+		for (auto& p : queue) cache.Apply(p);
+		unsigned int unsorted = backend->GetSetCount();
+
+		std::vector<PipelineID> sorted = queue;
+		std::sort(sorted.begin(), sorted.end());
+		cache.Invalidate();
+		for (auto& p : sorted) cache.Apply(p);
+		unsigned int sortedSets = backend->GetSetCount() - unsorted;
+
+		bool ok = backend->GetBound(STATE_RASTERIZER) == 1 && backend->GetBound(STATE_BLEND) == 0;
+		printf("  queue: %u draws, %u state sets without the cache, %u with it, %u sorted by pipeline  %s\n",
+			(unsigned int)queue.size(), (unsigned int)queue.size() * 3, unsorted, sortedSets, CheckResult(ok));
+	}
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Cache of immutable pipeline state objects
+//
+// - Sampler, rasterizer, depth stencil and blend states are
+//   keyed by a hash of their descriptor.  Asking for the same
+//   descriptor twice gives back the same state, so there's
+//   one object per distinct setting no matter who asks.
+// - A pipeline is a rasterizer + depth stencil + blend
+//   state, registered once and referred to by a small id.
+//   Apply() only sets the parts that differ from what the
+//   last Apply() left bound, so a run of draws with the same
+//   pipeline costs one set.
+// - Code that changes these states behind the cache's back
+//   has to put the defaults back (or call Invalidate), or
+//   Apply() will skip sets it needed.
+// - Real states come from an IStateBackend, so the dedup and
+//   bind counting can run headless (see RecordingStateBackend)
+// --------------------------------------------------------
+
+// A state of one kind.  0 is D3D11's default (a null state).
+typedef int StateID;
+#define STATE_DEFAULT 0
+
+// Rasterizer + depth stencil + blend.  0 is all defaults.
+typedef int PipelineID;
+#define PIPELINE_DEFAULT 0
+
+enum StateKind
+{
+	STATE_SAMPLER,
+	STATE_RASTERIZER,
+	STATE_DEPTH_STENCIL,
+	STATE_BLEND,
+	STATE_KIND_COUNT
+};
+
+// FNV-1a over raw bytes
+unsigned long long StateHash(const void* data, size_t bytes);
+
+// --------------------------------------------------------
+// Where real states come from.  Ids are the backend's own,
+// one list per kind, and -1 sets the default.
+// --------------------------------------------------------
+class IStateBackend
+{
+public:
+	virtual ~IStateBackend() {}
+
+	virtual int CreateSampler(const D3D11_SAMPLER_DESC& desc) = 0;
+	virtual int CreateRasterizer(const D3D11_RASTERIZER_DESC& desc) = 0;
+	virtual int CreateDepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc) = 0;
+	virtual int CreateBlend(const D3D11_BLEND_DESC& desc) = 0;
+
+	virtual void SetRasterizer(int id) = 0;
+	virtual void SetDepthStencil(int id, unsigned int stencilRef) = 0;
+	virtual void SetBlend(int id) = 0;
+
+	// For SimpleShader's SetSamplerState (null without a GPU)
+	virtual ID3D11SamplerState* GetSampler(int id) = 0;
+};
+
+// --------------------------------------------------------
+// D3D11 state objects, set on the immediate context
+// --------------------------------------------------------
+class D3D11StateBackend : public IStateBackend
+{
+public:
+	D3D11StateBackend(ID3D11Device* device, ID3D11DeviceContext* context);
+	~D3D11StateBackend();
+
+	int CreateSampler(const D3D11_SAMPLER_DESC& desc);
+	int CreateRasterizer(const D3D11_RASTERIZER_DESC& desc);
+	int CreateDepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc);
+	int CreateBlend(const D3D11_BLEND_DESC& desc);
+
+	void SetRasterizer(int id);
+	void SetDepthStencil(int id, unsigned int stencilRef);
+	void SetBlend(int id);
+
+	ID3D11SamplerState* GetSampler(int id) { return samplers[id]; }
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	std::vector<ID3D11SamplerState*> samplers;
+	std::vector<ID3D11RasterizerState*> rasterizers;
+	std::vector<ID3D11DepthStencilState*> depthStencils;
+	std::vector<ID3D11BlendState*> blends;
+};
+
+// --------------------------------------------------------
+// No GPU at all - counts creates and sets, and remembers
+// what's bound.  Used to report bind counts without a device.
+// --------------------------------------------------------
+class RecordingStateBackend : public IStateBackend
+{
+public:
+	RecordingStateBackend();
+
+	int CreateSampler(const D3D11_SAMPLER_DESC& desc) { return Create(STATE_SAMPLER); }
+	int CreateRasterizer(const D3D11_RASTERIZER_DESC& desc) { return Create(STATE_RASTERIZER); }
+	int CreateDepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc) { return Create(STATE_DEPTH_STENCIL); }
+	int CreateBlend(const D3D11_BLEND_DESC& desc) { return Create(STATE_BLEND); }
+
+	void SetRasterizer(int id) { Set(STATE_RASTERIZER, id); }
+	void SetDepthStencil(int id, unsigned int stencilRef) { Set(STATE_DEPTH_STENCIL, id); }
+	void SetBlend(int id) { Set(STATE_BLEND, id); }
+
+	ID3D11SamplerState* GetSampler(int id) { return 0; }
+
+	unsigned int GetCreateCount(StateKind kind) { return created[kind]; }
+	unsigned int GetSetCount(StateKind kind) { return sets[kind]; }
+	unsigned int GetSetCount() { return sets[STATE_RASTERIZER] + sets[STATE_DEPTH_STENCIL] + sets[STATE_BLEND]; }
+	int GetBound(StateKind kind) { return bound[kind]; }
+
+private:
+	unsigned int created[STATE_KIND_COUNT];
+	unsigned int sets[STATE_KIND_COUNT];
+	int bound[STATE_KIND_COUNT];
+
+	int Create(StateKind kind) { return (int)created[kind]++; }
+	void Set(StateKind kind, int id) { sets[kind]++; bound[kind] = id; }
+};
+
+// --------------------------------------------------------
+// The cache itself
+// --------------------------------------------------------
+class StateCache
+{
+public:
+	// Takes ownership of the backend
+	StateCache(IStateBackend* backend);
+	~StateCache();
+
+	// The shared state for desc, created the first time
+	StateID Sampler(const D3D11_SAMPLER_DESC& desc);
+	StateID Rasterizer(const D3D11_RASTERIZER_DESC& desc);
+	StateID DepthStencil(const D3D11_DEPTH_STENCIL_DESC& desc);
+	StateID Blend(const D3D11_BLEND_DESC& desc);
+
+	// Registered once, the same id for the same combination
+	PipelineID Pipeline(StateID rasterizer, StateID depthStencil, StateID blend = STATE_DEFAULT,
+		unsigned int stencilRef = 0);
+
+	// Sets whatever differs from the last Apply
+	void Apply(PipelineID pipeline);
+
+	// Forget what's bound, the next Apply sets everything
+	void Invalidate();
+
+	ID3D11SamplerState* GetSampler(StateID sampler);
+
+	// Stats
+	unsigned int GetStateCount(StateKind kind) { return (unsigned int)states[kind].size() - 1; }
+	unsigned int GetPipelineCount() { return (unsigned int)pipelines.size(); }
+	unsigned int GetRequestCount() { return requestCount; }    // Descriptors asked for
+	unsigned int GetApplyCount() { return applyCount; }
+	unsigned int GetSetCount() { return setCount; }            // States actually set by Apply
+	unsigned int GetSkipCount() { return skipCount; }          // States Apply didn't need to set
+
+private:
+	struct State
+	{
+		unsigned long long Hash;
+		std::vector<unsigned char> Desc;
+		int BackendID;
+	};
+
+	struct PipelineState
+	{
+		StateID Rasterizer;
+		StateID DepthStencil;
+		StateID Blend;
+		unsigned int StencilRef;
+	};
+
+	IStateBackend* backend;
+	std::vector<State> states[STATE_KIND_COUNT];   // [0] is the default
+	std::vector<PipelineState> pipelines;          // [0] is the default
+	PipelineState bound;
+	bool boundKnown;
+
+	unsigned int requestCount;
+	unsigned int applyCount;
+	unsigned int setCount;
+	unsigned int skipCount;
+
+	// Existing state with the same bytes, or -1
+	StateID Find(StateKind kind, const void* desc, size_t bytes, unsigned long long hash);
+	StateID Add(StateKind kind, const void* desc, size_t bytes, unsigned long long hash, int backendID);
+};
+
+// Hash and dedup checks, then a frame of this game's draws and
+// a longer shuffled queue through the recording backend -
+// prints how many state sets the cache saves
+void StateCacheReport();
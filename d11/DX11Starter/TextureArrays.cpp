@@ -0,0 +1,413 @@
+#include "TextureArrays.h"
+#include "Check.h"
+#include <cstdio>
+#include <random>
+#include <algorithm>
+
+// Bytes of one level, block compressed formats by 4x4 block
+static unsigned long long LevelBytes(DXGI_FORMAT format, unsigned int width, unsigned int height)
+{
+	unsigned long long blocks = (unsigned long long)((width + 3) / 4) * ((height + 3) / 4);
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+		return blocks * 8;
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return blocks * 16;
+	default:
+		return (unsigned long long)width * height * 4;
+	}
+}
+
+static unsigned long long SliceBytes(const TextureArrayKey& key)
+{
+	unsigned long long total = 0;
+	for (unsigned int m = 0; m < key.MipCount; m++)
+	{
+		unsigned int w = key.Width >> m, h = key.Height >> m;
+		total += LevelBytes(key.Format, w ? w : 1, h ? h : 1);
+	}
+	return total;
+}
+
+
+// --------------------------------------------------------
+// Packer
+// --------------------------------------------------------
+TextureArrayPacker::TextureArrayPacker(unsigned int maxSlices)
+{
+	this->maxSlices = maxSlices;
+}
+
+TextureArraySlot TextureArrayPacker::Add(const TextureArrayKey& key)
+{
+	for (size_t i = 0; i < arrays.size(); i++)
+	{
+		Array& a = arrays[i];
+		if (!(a.Key == key))
+			continue;
+
+		// Reuse a hole before growing
+		if (!a.FreeSlices.empty())
+		{
+			auto lowest = std::min_element(a.FreeSlices.begin(), a.FreeSlices.end());
+			TextureArraySlot slot = { (int)i, (int)*lowest };
+			a.FreeSlices.erase(lowest);
+			return slot;
+		}
+		if (a.Slices < maxSlices)
+		{
+			TextureArraySlot slot = { (int)i, (int)a.Slices };
+			a.Slices++;
+			return slot;
+		}
+	}
+
+	Array a;
+	a.Key = key;
+	a.Slices = 1;
+	arrays.push_back(a);
+	TextureArraySlot slot = { (int)arrays.size() - 1, 0 };
+	return slot;
+}
+
+void TextureArrayPacker::Remove(const TextureArraySlot& slot)
+{
+	if (slot.Array < 0) return;
+	arrays[slot.Array].FreeSlices.push_back((unsigned int)slot.Slice);
+}
+
+
+// --------------------------------------------------------
+// GPU arrays
+// --------------------------------------------------------
+TextureArrays::TextureArrays(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+	this->device = device;
+	this->context = context;
+	bytes = 0;
+	bindCount = 0;
+	skipCount = 0;
+}
+
+TextureArrays::~TextureArrays()
+{
+	for (auto& a : gpuArrays)
+	{
+		if (a.SRV) a.SRV->Release();
+		if (a.Texture) a.Texture->Release();
+	}
+}
+
+// --------------------------------------------------------
+// Makes room for slices in an array, copying what it had
+// into the bigger texture
+// --------------------------------------------------------
+bool TextureArrays::Grow(int array, unsigned int slices)
+{
+	GPUArray& a = gpuArrays[array];
+	if (a.Capacity >= slices)
+		return true;
+
+	unsigned int capacity = a.Capacity > 0 ? a.Capacity : TEXTURE_ARRAY_INITIAL_SLICES;
+	while (capacity < slices)
+		capacity *= 2;
+	if (capacity > TEXTURE_ARRAY_MAX_SLICES)
+		capacity = TEXTURE_ARRAY_MAX_SLICES;
+
+	const TextureArrayKey& key = packer.GetKey(array);
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = key.Width;
+	td.Height = key.Height;
+	td.MipLevels = key.MipCount;
+	td.ArraySize = capacity;
+	td.Format = key.Format;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ID3D11Texture2D* texture = 0;
+	if (FAILED(device->CreateTexture2D(&td, 0, &texture)))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = key.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = key.MipCount;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = capacity;
+	ID3D11ShaderResourceView* srv = 0;
+	if (FAILED(device->CreateShaderResourceView(texture, &srvDesc, &srv)))
+	{
+		texture->Release();
+		return false;
+	}
+
+	// Subresource = mip + slice * mip count, in both textures
+	for (unsigned int s = 0; s < a.Capacity; s++)
+		for (unsigned int m = 0; m < key.MipCount; m++)
+			context->CopySubresourceRegion(texture, m + s * key.MipCount, 0, 0, 0, a.Texture, m + s * key.MipCount, 0);
+
+	if (a.SRV) a.SRV->Release();
+	if (a.Texture) a.Texture->Release();
+	bytes += SliceBytes(key) * (capacity - a.Capacity);
+	a.Texture = texture;
+	a.SRV = srv;
+	a.Capacity = capacity;
+
+	// Whatever register had the old SRV needs the new one
+	for (auto& b : bound)
+		if (b == array) b = -2;
+	return true;
+}
+
+TextureArraySlot TextureArrays::Place(int texture, ID3D11ShaderResourceView* srv, unsigned int firstMip)
+{
+	TextureArraySlot none = { -1, -1 };
+	if (!srv)
+		return none;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	srv->GetDesc(&srvDesc);
+	if (srvDesc.ViewDimension != D3D11_SRV_DIMENSION_TEXTURE2D)
+		return none;
+
+	ID3D11Resource* resource = 0;
+	srv->GetResource(&resource);
+	ID3D11Texture2D* source = (ID3D11Texture2D*)resource;
+	D3D11_TEXTURE2D_DESC sd;
+	source->GetDesc(&sd);
+
+	// First time: a slice in an array of its full size
+	auto it = placed.find(texture);
+	if (it == placed.end())
+	{
+		TextureArrayKey key = { sd.Width << firstMip, sd.Height << firstMip, sd.MipLevels + firstMip, sd.Format };
+		Placed p = { packer.Add(key), firstMip };
+		if (gpuArrays.size() < packer.GetArrayCount())
+			gpuArrays.push_back({ 0, 0, 0 });
+		if (!Grow(p.Slot.Array, packer.GetSliceCount(p.Slot.Array)))
+		{
+			packer.Remove(p.Slot);
+			resource->Release();
+			return none;
+		}
+		it = placed.insert({ texture, p }).first;
+	}
+
+	// Every level that matches its level in the array - a source
+	// in another format or size (it changed on disk) is skipped
+	Placed& p = it->second;
+	const TextureArrayKey& key = packer.GetKey(p.Slot.Array);
+	unsigned int finest = key.MipCount;
+	for (unsigned int m = 0; m < sd.MipLevels && firstMip + m < key.MipCount; m++)
+	{
+		unsigned int level = firstMip + m;
+		unsigned int w = key.Width >> level, h = key.Height >> level;
+		unsigned int sw = sd.Width >> m, sh = sd.Height >> m;
+		if (sd.Format != key.Format || (w ? w : 1) != (sw ? sw : 1) || (h ? h : 1) != (sh ? sh : 1))
+			continue;
+
+		context->CopySubresourceRegion(gpuArrays[p.Slot.Array].Texture, level + p.Slot.Slice * key.MipCount, 0, 0, 0,
+			source, m, 0);
+		if (level < finest) finest = level;
+	}
+	resource->Release();
+
+	if (finest < key.MipCount)
+		p.FirstMip = finest;
+	return p.Slot;
+}
+
+void TextureArrays::Remove(int texture)
+{
+	auto it = placed.find(texture);
+	if (it == placed.end())
+		return;
+	packer.Remove(it->second.Slot);
+	placed.erase(it);
+}
+
+TextureArraySlot TextureArrays::GetSlot(int texture)
+{
+	auto it = placed.find(texture);
+	if (it == placed.end())
+	{
+		TextureArraySlot none = { -1, -1 };
+		return none;
+	}
+	return it->second.Slot;
+}
+
+unsigned int TextureArrays::GetFirstMip(int texture)
+{
+	auto it = placed.find(texture);
+	return it == placed.end() ? 0 : it->second.FirstMip;
+}
+
+void TextureArrays::Bind(SimplePixelShader* ps, const std::string& name, int array)
+{
+	const SimpleSRV* info = ps->GetShaderResourceViewInfo(name);
+	if (info == 0 || array < 0)
+		return;
+
+	if (bound.size() <= info->BindIndex)
+		bound.resize(info->BindIndex + 1, -2);
+	if (bound[info->BindIndex] == array)
+	{
+		skipCount++;
+		return;
+	}
+
+	ps->SetShaderResourceView(name, gpuArrays[array].SRV);
+	bound[info->BindIndex] = array;
+	bindCount++;
+}
+
+void TextureArrays::Invalidate()
+{
+	for (auto& b : bound)
+		b = -2;
+}
+
+
+// --------------------------------------------------------
+// Report
+// --------------------------------------------------------
+
+// SRV binds for a list of draws, each sampling a diffuse and a
+// normal texture (-1 = none).  Before: both bound every draw,
+// like Material::Bind used to.  After: an array is only bound
+// when the register doesn't already have it.
+static void CountBinds(const std::vector<TextureArraySlot>& slots,
+	const std::vector<std::pair<int, int>>& draws, unsigned int* before, unsigned int* after)
+{
+	int bound[2] = { -2, -2 };
+	*before = 0;
+	*after = 0;
+	for (auto& d : draws)
+	{
+		int textures[2] = { d.first, d.second };
+		for (int r = 0; r < 2; r++)
+		{
+			(*before)++;
+			if (textures[r] < 0)
+				continue;
+			int array = slots[textures[r]].Array;
+			if (bound[r] != array)
+			{
+				bound[r] = array;
+				(*after)++;
+			}
+		}
+	}
+}
+
+void TextureArrayReport()
+{
+	printf("\nTexture arrays\n");
+
+	// Keys: matching textures share, anything different doesn't
+	{
+		TextureArrayPacker packer;
+		TextureArrayKey color1k = { 1024, 1024, 11, DXGI_FORMAT_BC7_UNORM };
+		TextureArrayKey normal1k = { 1024, 1024, 11, DXGI_FORMAT_BC5_UNORM };
+		TextureArrayKey color512 = { 512, 512, 10, DXGI_FORMAT_BC7_UNORM };
+		TextureArrayKey color1kNoMips = { 1024, 1024, 1, DXGI_FORMAT_BC7_UNORM };
+
+		TextureArraySlot a = packer.Add(color1k);
+		TextureArraySlot b = packer.Add(normal1k);
+		TextureArraySlot c = packer.Add(color1k);
+		TextureArraySlot d = packer.Add(color512);
+		TextureArraySlot e = packer.Add(color1kNoMips);
+		TextureArraySlot f = packer.Add(color1k);
+		bool ok = a.Array == c.Array && c.Array == f.Array && a.Slice == 0 && c.Slice == 1 && f.Slice == 2;
+		ok = ok && b.Array != a.Array && d.Array != a.Array && e.Array != a.Array && d.Array != b.Array;
+		ok = ok && packer.GetArrayCount() == 4 && packer.GetUsedCount(a.Array) == 3;
+		printf("  keys: 6 textures in %u arrays  %s\n", packer.GetArrayCount(), CheckResult(ok));
+
+		// A freed slice is the next one used, before the array grows
+		packer.Remove(c);
+		TextureArraySlot g = packer.Add(color1k);
+		ok = g.Array == a.Array && g.Slice == c.Slice && packer.GetSliceCount(a.Array) == 3;
+		printf("  freed slice %d reused  %s\n", c.Slice, CheckResult(ok));
+	}
+
+	// Full arrays: the next texture with the key starts another
+	{
+		TextureArrayPacker packer(4);
+		TextureArrayKey key = { 256, 256, 9, DXGI_FORMAT_R8G8B8A8_UNORM };
+		bool ok = true;
+		for (int i = 0; i < 10; i++)
+		{
+			TextureArraySlot s = packer.Add(key);
+			ok = ok && s.Array == i / 4 && s.Slice == i % 4;
+		}
+		ok = ok && packer.GetArrayCount() == 3 && packer.GetUsedCount(2) == 2;
+		printf("  overflow: 10 textures, 4 slices each, %u arrays  %s\n", packer.GetArrayCount(), CheckResult(ok));
+	}
+
+	// This game's forward pass: the rock twice (color + normal),
+	// four unlit markers, the virtual textured ground and the
+	// trees with the floor texture
+	{
+		TextureArrayPacker packer;
+		std::vector<TextureArraySlot> slots;
+		TextureArrayKey color = { 1024, 1024, 11, DXGI_FORMAT_BC7_UNORM };
+		TextureArrayKey normal = { 1024, 1024, 11, DXGI_FORMAT_BC5_UNORM };
+		slots.push_back(packer.Add(color));		// 0 rock
+		slots.push_back(packer.Add(normal));	// 1 rock normal
+		slots.push_back(packer.Add(color));		// 2 floor
+
+		std::vector<std::pair<int, int>> draws = {
+			{ 0, 1 }, { 0, 1 }, { -1, -1 }, { -1, -1 }, { -1, -1 }, { -1, -1 }, { -1, -1 }, { 2, -1 } };
+		unsigned int before, after;
+		CountBinds(slots, draws, &before, &after);
+		printf("  game frame: %u draws, %u SRV binds per texture, %u with arrays\n",
+			(unsigned int)draws.size(), before, after);
+	}
+
+	// A bigger scene: 400 draws over 60 materials, textures in
+	// three sizes
+	{
+		TextureArrayPacker packer;
+		std::vector<TextureArraySlot> slots;
+		std::mt19937 rng(46);
+		const unsigned int sizes[3] = { 512, 1024, 2048 };
+		std::vector<std::pair<int, int>> materials;
+		for (int m = 0; m < 60; m++)
+		{
+			unsigned int size = sizes[rng() % 3];
+			unsigned int mips = 1;
+			while ((size >> mips) > 0) mips++;
+			TextureArrayKey color = { size, size, mips, DXGI_FORMAT_BC7_UNORM };
+			TextureArrayKey normal = { size, size, mips, DXGI_FORMAT_BC5_UNORM };
+			slots.push_back(packer.Add(color));
+			slots.push_back(packer.Add(normal));
+			materials.push_back({ (int)slots.size() - 2, (int)slots.size() - 1 });
+		}
+
+		std::vector<std::pair<int, int>> draws;
+		for (int i = 0; i < 400; i++)
+			draws.push_back(materials[rng() % materials.size()]);
+		unsigned int before, after, sortedAfter;
+		CountBinds(slots, draws, &before, &after);
+
+		// Sorted by array, the way a queue would batch them
+		std::sort(draws.begin(), draws.end(), [&](const std::pair<int, int>& x, const std::pair<int, int>& y)
+			{
+				return slots[x.first].Array != slots[y.first].Array ? slots[x.first].Array < slots[y.first].Array
+					: slots[x.second].Array < slots[y.second].Array;
+			});
+		CountBinds(slots, draws, &before, &sortedAfter);
+		printf("  scene: %u draws, %u textures in %u arrays, %u SRV binds per texture, %u with arrays, %u sorted by array\n",
+			(unsigned int)draws.size(), (unsigned int)slots.size(), packer.GetArrayCount(), before, after, sortedAfter);
+	}
+}
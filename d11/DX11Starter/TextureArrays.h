@@ -0,0 +1,144 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// Texture arrays instead of one SRV per material texture
+//
+// - Textures with the same size, format and mip count share
+//   a Texture2DArray, one slice each.  Materials keep the
+//   slice in their constant block, so every material whose
+//   textures landed in the same arrays draws with the same
+//   SRVs bound - and only a change of array costs a bind.
+// - TextureArrayPacker decides the slices, no device needed.
+//   TextureArrays copies the streamer's textures in.
+// - A streamed texture is copied in from the mip it's
+//   resident at.  The finer levels of its slice are stale, so
+//   the shader clamps to that mip (TextureArrays.hlsli).
+// --------------------------------------------------------
+
+// Slices per array before the next texture with that key
+// starts another one
+#define TEXTURE_ARRAY_MAX_SLICES 256
+
+// Slices a new GPU array starts with, doubled as it fills
+#define TEXTURE_ARRAY_INITIAL_SLICES 4
+
+// What a texture has to match to share an array
+struct TextureArrayKey
+{
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int MipCount;
+	DXGI_FORMAT Format;
+
+	bool operator==(const TextureArrayKey& other) const
+	{
+		return Width == other.Width && Height == other.Height && MipCount == other.MipCount && Format == other.Format;
+	}
+};
+
+// Where a texture lives.  Array -1 = nowhere (not loaded yet).
+struct TextureArraySlot
+{
+	int Array;
+	int Slice;
+};
+
+// --------------------------------------------------------
+// Which array and slice each texture goes in
+// --------------------------------------------------------
+class TextureArrayPacker
+{
+public:
+	TextureArrayPacker(unsigned int maxSlices = TEXTURE_ARRAY_MAX_SLICES);
+
+	// The lowest free slice of the first array with this key,
+	// or slice 0 of a new array
+	TextureArraySlot Add(const TextureArrayKey& key);
+	void Remove(const TextureArraySlot& slot);
+
+	unsigned int GetArrayCount() { return (unsigned int)arrays.size(); }
+	const TextureArrayKey& GetKey(int array) { return arrays[array].Key; }
+	unsigned int GetSliceCount(int array) { return arrays[array].Slices; }	// Highest slice ever used + 1
+	unsigned int GetUsedCount(int array) { return arrays[array].Slices - (unsigned int)arrays[array].FreeSlices.size(); }
+
+private:
+	struct Array
+	{
+		TextureArrayKey Key;
+		unsigned int Slices;
+		std::vector<unsigned int> FreeSlices;
+	};
+
+	unsigned int maxSlices;
+	std::vector<Array> arrays;
+};
+
+// --------------------------------------------------------
+// The GPU arrays, and which one each SRV register holds
+// --------------------------------------------------------
+class TextureArrays
+{
+public:
+	TextureArrays(ID3D11Device* device, ID3D11DeviceContext* context);
+	~TextureArrays();
+
+	// Copies the texture behind srv into its slice, packing it
+	// the first time.  texture is the caller's id for it, srv's
+	// top level is firstMip of the full texture.
+	TextureArraySlot Place(int texture, ID3D11ShaderResourceView* srv, unsigned int firstMip);
+	void Remove(int texture);
+
+	TextureArraySlot GetSlot(int texture);
+	unsigned int GetFirstMip(int texture);	// Finest level in the slice that isn't stale
+	ID3D11ShaderResourceView* GetSRV(int array) { return gpuArrays[array].SRV; }
+
+	// Binds an array to a shader's Texture2DArray, unless that
+	// register already has it
+	void Bind(SimplePixelShader* ps, const std::string& name, int array);
+
+	// Something else bound SRVs - the next Bind of each register sets it
+	void Invalidate();
+
+	// Stats
+	unsigned int GetArrayCount() { return packer.GetArrayCount(); }
+	unsigned long long GetBytes() { return bytes; }
+	unsigned int GetBindCount() { return bindCount; }
+	unsigned int GetSkipCount() { return skipCount; }
+
+private:
+	struct GPUArray
+	{
+		ID3D11Texture2D* Texture;
+		ID3D11ShaderResourceView* SRV;
+		unsigned int Capacity;
+	};
+
+	struct Placed
+	{
+		TextureArraySlot Slot;
+		unsigned int FirstMip;
+	};
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	TextureArrayPacker packer;
+	std::vector<GPUArray> gpuArrays;
+	std::unordered_map<int, Placed> placed;
+	std::vector<int> bound;		// Array in each SRV register, -2 if unknown
+
+	unsigned long long bytes;
+	unsigned int bindCount;
+	unsigned int skipCount;
+
+	bool Grow(int array, unsigned int slices);
+};
+
+// Packs a few texture sets, checks slices and keys, then counts
+// SRV binds for this game's materials and a bigger scene, one
+// SRV per texture per draw against the arrays
+void TextureArrayReport();
@@ -0,0 +1,23 @@
+//material textures live in Texture2DArrays, one slice each
+//(see TextureArrays.h for how they're packed)
+#ifndef TEXTURE_ARRAYS
+#define TEXTURE_ARRAYS
+
+//a slice's levels finer than minMip are stale (the texture is
+//streamed out past them), so the lod never goes below it
+float4 SampleSlice(Texture2DArray t, SamplerState s, float2 uv, int slice, float minMip)
+{
+	float lod = max(t.CalculateLevelOfDetail(s, uv), minMip);
+	return t.SampleLevel(s, float3(uv, slice), lod);
+}
+
+//tangent space normal from a BC5 slice, z rebuilt
+float3 SampleNormalSlice(Texture2DArray t, SamplerState s, float2 uv, int slice, float minMip)
+{
+	float3 n;
+	n.xy = SampleSlice(t, s, uv, slice, minMip).rg * 2 - 1;
+	n.z = sqrt(saturate(1 - dot(n.xy, n.xy)));
+	return n;
+}
+
+#endif
@@ -0,0 +1,936 @@
+#include "TextureCooker.h"
+#include "Check.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// --------------------------------------------------------
+// Mips
+// --------------------------------------------------------
+static float srgbToLinear[256];
+
+static void BuildSRGBTable()
+{
+	for (int i = 0; i < 256; i++)
+	{
+		float c = i / 255.0f;
+		srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+}
+
+static unsigned char LinearToSRGB(float l)
+{
+	float s = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+	s = std::min(std::max(s, 0.0f), 1.0f);
+	return (unsigned char)(s * 255.0f + 0.5f);
+}
+
+static unsigned char ToByte(float v)
+{
+	return (unsigned char)std::min(std::max(v + 0.5f, 0.0f), 255.0f);
+}
+
+// 2x2 box, repeating the last row/column of odd sized images
+static CookImage Downsample(const CookImage& src, bool normalMap)
+{
+	CookImage dst;
+	dst.Width = std::max(src.Width / 2, 1u);
+	dst.Height = std::max(src.Height / 2, 1u);
+	dst.Pixels.resize((size_t)dst.Width * dst.Height * 4);
+
+	for (unsigned int y = 0; y < dst.Height; y++)
+	{
+		for (unsigned int x = 0; x < dst.Width; x++)
+		{
+			float sum[4] = {};
+			for (unsigned int s = 0; s < 4; s++)
+			{
+				unsigned int sx = std::min(x * 2 + (s & 1), src.Width - 1);
+				unsigned int sy = std::min(y * 2 + (s >> 1), src.Height - 1);
+				const unsigned char* p = &src.Pixels[((size_t)sy * src.Width + sx) * 4];
+				for (int c = 0; c < 3; c++)
+					sum[c] += normalMap ? p[c] / 127.5f - 1.0f : srgbToLinear[p[c]];
+				sum[3] += p[3];
+			}
+
+			unsigned char* out = &dst.Pixels[((size_t)y * dst.Width + x) * 4];
+			if (normalMap)
+			{
+				float len = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+				if (len < 1e-6f) { sum[0] = sum[1] = 0; sum[2] = len = 1; }
+				for (int c = 0; c < 3; c++)
+					out[c] = ToByte((sum[c] / len * 0.5f + 0.5f) * 255.0f);
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+					out[c] = LinearToSRGB(sum[c] * 0.25f);
+			}
+			out[3] = ToByte(sum[3] * 0.25f);
+		}
+	}
+	return dst;
+}
+
+std::vector<CookImage> CookBuildMips(const CookImage& source, bool normalMap)
+{
+	if (srgbToLinear[255] == 0) BuildSRGBTable();
+
+	std::vector<CookImage> mips(1, source);
+	while (mips.back().Width > 1 || mips.back().Height > 1)
+		mips.push_back(Downsample(mips.back(), normalMap));
+	return mips;
+}
+
+// --------------------------------------------------------
+// Shared block helpers
+// --------------------------------------------------------
+
+// 4x4 RGBA block, edges padded
+static void FetchBlock(const CookImage& image, unsigned int bx, unsigned int by, unsigned char* block)
+{
+	for (unsigned int y = 0; y < 4; y++)
+	{
+		unsigned int sy = std::min(by * 4 + y, image.Height - 1);
+		for (unsigned int x = 0; x < 4; x++)
+		{
+			unsigned int sx = std::min(bx * 4 + x, image.Width - 1);
+			memcpy(&block[(y * 4 + x) * 4], &image.Pixels[((size_t)sy * image.Width + sx) * 4], 4);
+		}
+	}
+}
+
+// Main axis of the pixels (power iteration on the covariance),
+// returns false for a flat block
+static bool PrincipalAxis(const float* px, int channels, float* mean, float* axis)
+{
+	for (int c = 0; c < channels; c++)
+	{
+		mean[c] = 0;
+		for (int i = 0; i < 16; i++) mean[c] += px[i * channels + c];
+		mean[c] /= 16;
+	}
+
+	float cov[4][4] = {};
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				cov[a][b] += (px[i * channels + a] - mean[a]) * (px[i * channels + b] - mean[b]);
+
+	// Start from the widest channel
+	int widest = 0;
+	for (int c = 1; c < channels; c++)
+		if (cov[c][c] > cov[widest][widest]) widest = c;
+	if (cov[widest][widest] < 1e-3f)
+		return false;
+
+	for (int c = 0; c < channels; c++) axis[c] = c == widest ? 1.0f : 0.0f;
+	for (int iter = 0; iter < 8; iter++)
+	{
+		float next[4] = {};
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				next[a] += cov[a][b] * axis[b];
+		float len = 0;
+		for (int c = 0; c < channels; c++) len += next[c] * next[c];
+		len = sqrtf(len);
+		if (len < 1e-9f) return false;
+		for (int c = 0; c < channels; c++) axis[c] = next[c] / len;
+	}
+	return true;
+}
+
+// Endpoints at the ends of the pixels' spread along the axis
+static void AxisEndpoints(const float* px, int channels, const float* mean, const float* axis, float* a, float* b)
+{
+	float tMin = 1e9f, tMax = -1e9f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0;
+		for (int c = 0; c < channels; c++) t += (px[i * channels + c] - mean[c]) * axis[c];
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	for (int c = 0; c < channels; c++)
+	{
+		a[c] = mean[c] + axis[c] * tMax;
+		b[c] = mean[c] + axis[c] * tMin;
+	}
+}
+
+// Least squares endpoints for fixed weights (0 = a, 1 = b),
+// leaves a and b alone if the weights are all the same
+static void RefineEndpoints(const float* px, int channels, const float* weights, float* a, float* b)
+{
+	float aa = 0, ab = 0, bb = 0;
+	float pa[4] = {}, pb[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float wb = weights[i], wa = 1.0f - wb;
+		aa += wa * wa;
+		ab += wa * wb;
+		bb += wb * wb;
+		for (int c = 0; c < channels; c++)
+		{
+			pa[c] += wa * px[i * channels + c];
+			pb[c] += wb * px[i * channels + c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+		return;
+	for (int c = 0; c < channels; c++)
+	{
+		a[c] = std::min(std::max((bb * pa[c] - ab * pb[c]) / det, 0.0f), 255.0f);
+		b[c] = std::min(std::max((aa * pb[c] - ab * pa[c]) / det, 0.0f), 255.0f);
+	}
+}
+
+// --------------------------------------------------------
+// BC1
+// --------------------------------------------------------
+static unsigned short Pack565(const float* rgb)
+{
+	int r = (int)(std::min(std::max(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(std::min(std::max(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(std::min(std::max(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)(r << 11 | g << 5 | b);
+}
+
+static void Unpack565(unsigned short c, float* rgb)
+{
+	int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+	rgb[0] = (float)(r << 3 | r >> 2);
+	rgb[1] = (float)(g << 2 | g >> 4);
+	rgb[2] = (float)(b << 3 | b >> 2);
+}
+
+// Index order is c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+static const float bc1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// Four color mode palette (c0 > c1), or three colors and
+// black when c0 <= c1
+static void BC1Palette(unsigned short c0, unsigned short c1, float palette[4][3])
+{
+	Unpack565(c0, palette[0]);
+	Unpack565(c1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		if (c0 > c1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3.0f;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+static float BC1Fit(const float px[16][3], unsigned short c0, unsigned short c1, unsigned char* indices)
+{
+	float palette[4][3];
+	BC1Palette(c0, c1, palette);
+	float error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = 1e30f;
+		for (int k = 0; k < 4; k++)
+		{
+			float d = 0;
+			for (int c = 0; c < 3; c++) d += (px[i][c] - palette[k][c]) * (px[i][c] - palette[k][c]);
+			if (d < best) { best = d; indices[i] = (unsigned char)k; }
+		}
+		error += best;
+	}
+	return error;
+}
+
+static void EncodeBC1Block(const unsigned char* block, unsigned char* out)
+{
+	float px[16][3];
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			px[i][c] = block[i * 4 + c];
+
+	float mean[3], axis[3], a[3], b[3];
+	if (!PrincipalAxis(&px[0][0], 3, mean, axis))
+	{
+		for (int c = 0; c < 3; c++) a[c] = b[c] = mean[c];
+	}
+	else
+		AxisEndpoints(&px[0][0], 3, mean, axis, a, b);
+
+	unsigned short best0 = 0, best1 = 0;
+	unsigned char bestIndices[16] = {};
+	float bestError = 1e30f;
+	for (int iter = 0; iter < 3; iter++)
+	{
+		unsigned short c0 = Pack565(a), c1 = Pack565(b);
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+			std::swap(a, b);
+		}
+
+		unsigned char indices[16];
+		float error;
+		if (c0 == c1)
+		{
+			// One color: three color mode, every pixel index 0
+			memset(indices, 0, sizeof(indices));
+			float color[3];
+			Unpack565(c0, color);
+			error = 0;
+			for (int i = 0; i < 16; i++)
+				for (int c = 0; c < 3; c++) error += (px[i][c] - color[c]) * (px[i][c] - color[c]);
+		}
+		else
+			error = BC1Fit(px, c0, c1, indices);
+
+		if (error < bestError)
+		{
+			bestError = error;
+			best0 = c0;
+			best1 = c1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+		if (c0 == c1)
+			break;
+
+		float weights[16];
+		for (int i = 0; i < 16; i++) weights[i] = bc1Weights[indices[i]];
+		RefineEndpoints(&px[0][0], 3, weights, a, b);
+	}
+
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; i++) bits |= (unsigned int)bestIndices[i] << (i * 2);
+	out[0] = best0 & 0xff; out[1] = best0 >> 8;
+	out[2] = best1 & 0xff; out[3] = best1 >> 8;
+	for (int i = 0; i < 4; i++) out[4 + i] = (bits >> (i * 8)) & 0xff;
+}
+
+static void DecodeBC1Block(const unsigned char* in, unsigned char* block)
+{
+	unsigned short c0 = (unsigned short)(in[0] | in[1] << 8);
+	unsigned short c1 = (unsigned short)(in[2] | in[3] << 8);
+	unsigned int bits = in[4] | in[5] << 8 | in[6] << 16 | (unsigned int)in[7] << 24;
+	float palette[4][3];
+	BC1Palette(c0, c1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		int k = (bits >> (i * 2)) & 3;
+		for (int c = 0; c < 3; c++) block[i * 4 + c] = ToByte(palette[k][c]);
+		block[i * 4 + 3] = (c0 <= c1 && k == 3) ? 0 : 255;
+	}
+}
+
+// --------------------------------------------------------
+// BC4 (one channel) - BC5 is two of these
+// --------------------------------------------------------
+
+// Eight value mode (e0 > e1): e0, e1, then six steps from e0 to e1
+static void BC4Palette(int e0, int e1, float* palette)
+{
+	palette[0] = (float)e0;
+	palette[1] = (float)e1;
+	if (e0 > e1)
+	{
+		for (int j = 1; j <= 6; j++) palette[1 + j] = ((7 - j) * e0 + j * e1) / 7.0f;
+	}
+	else
+	{
+		for (int j = 1; j <= 4; j++) palette[1 + j] = ((5 - j) * e0 + j * e1) / 5.0f;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static const float bc4Weights[8] = { 0, 1, 1 / 7.0f, 2 / 7.0f, 3 / 7.0f, 4 / 7.0f, 5 / 7.0f, 6 / 7.0f };
+
+static float BC4Fit(const float* values, int e0, int e1, unsigned char* indices)
+{
+	float palette[8];
+	BC4Palette(e0, e1, palette);
+	float error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = 1e30f;
+		for (int k = 0; k < 8; k++)
+		{
+			float d = (values[i] - palette[k]) * (values[i] - palette[k]);
+			if (d < best) { best = d; indices[i] = (unsigned char)k; }
+		}
+		error += best;
+	}
+	return error;
+}
+
+static void EncodeBC4Block(const unsigned char* block, int channel, unsigned char* out)
+{
+	float values[16];
+	float lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		values[i] = block[i * 4 + channel];
+		lo = std::min(lo, values[i]);
+		hi = std::max(hi, values[i]);
+	}
+
+	int best0 = (int)hi, best1 = (int)lo;
+	unsigned char bestIndices[16] = {};
+	float bestError = 1e30f;
+	if (hi > lo)
+	{
+		float a = hi, b = lo;
+		for (int iter = 0; iter < 3; iter++)
+		{
+			int e0 = (int)(a + 0.5f), e1 = (int)(b + 0.5f);
+			if (e0 <= e1)
+			{
+				if (e1 < 255) e0 = e1 + 1;
+				else e1 = e0 - 1;
+			}
+
+			unsigned char indices[16];
+			float error = BC4Fit(values, e0, e1, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				best0 = e0;
+				best1 = e1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			float weights[16];
+			for (int i = 0; i < 16; i++) weights[i] = bc4Weights[indices[i]];
+			RefineEndpoints(values, 1, weights, &a, &b);
+		}
+	}
+
+	out[0] = (unsigned char)best0;
+	out[1] = (unsigned char)best1;
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++) bits |= (unsigned long long)bestIndices[i] << (i * 3);
+	for (int i = 0; i < 6; i++) out[2 + i] = (bits >> (i * 8)) & 0xff;
+}
+
+static void DecodeBC4Block(const unsigned char* in, int channel, unsigned char* block)
+{
+	float palette[8];
+	BC4Palette(in[0], in[1], palette);
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; i++) bits |= (unsigned long long)in[2 + i] << (i * 8);
+	for (int i = 0; i < 16; i++)
+		block[i * 4 + channel] = ToByte(palette[(bits >> (i * 3)) & 7]);
+}
+
+// --------------------------------------------------------
+// BC7, mode 6 only: one subset, RGBA endpoints of 7 bits plus
+// a shared low bit (p-bit) each, 4 bit indices
+// --------------------------------------------------------
+static const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static void PutBits(unsigned char* out, unsigned int* pos, unsigned int value, int bits)
+{
+	for (int i = 0; i < bits; i++, (*pos)++)
+		if (value >> i & 1) out[*pos >> 3] |= 1 << (*pos & 7);
+}
+
+static unsigned int GetBits(const unsigned char* in, unsigned int* pos, int bits)
+{
+	unsigned int value = 0;
+	for (int i = 0; i < bits; i++, (*pos)++)
+		value |= (unsigned int)(in[*pos >> 3] >> (*pos & 7) & 1) << i;
+	return value;
+}
+
+static float BC7Fit(const float px[16][4], const int* e0, const int* e1, unsigned char* indices)
+{
+	float palette[16][4];
+	for (int k = 0; k < 16; k++)
+		for (int c = 0; c < 4; c++)
+			palette[k][c] = (float)(((64 - bc7Weights[k]) * e0[c] + bc7Weights[k] * e1[c] + 32) >> 6);
+
+	float error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = 1e30f;
+		for (int k = 0; k < 16; k++)
+		{
+			float d = 0;
+			for (int c = 0; c < 4; c++) d += (px[i][c] - palette[k][c]) * (px[i][c] - palette[k][c]);
+			if (d < best) { best = d; indices[i] = (unsigned char)k; }
+		}
+		error += best;
+	}
+	return error;
+}
+
+static void EncodeBC7Block(const unsigned char* block, unsigned char* out)
+{
+	float px[16][4];
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 4; c++)
+			px[i][c] = block[i * 4 + c];
+
+	float mean[4], axis[4], a[4], b[4];
+	if (!PrincipalAxis(&px[0][0], 4, mean, axis))
+	{
+		for (int c = 0; c < 4; c++) a[c] = b[c] = mean[c];
+	}
+	else
+		AxisEndpoints(&px[0][0], 4, mean, axis, a, b);
+
+	int bestQ0[4] = {}, bestQ1[4] = {}, bestP0 = 0, bestP1 = 0;
+	unsigned char bestIndices[16] = {};
+	float bestError = 1e30f;
+	for (int iter = 0; iter < 3; iter++)
+	{
+		// Each p-bit pair, endpoints rounded to what it allows
+		unsigned char iterIndices[16];
+		float iterError = 1e30f;
+		for (int p = 0; p < 4; p++)
+		{
+			int p0 = p & 1, p1 = p >> 1;
+			int q0[4], q1[4], e0[4], e1[4];
+			for (int c = 0; c < 4; c++)
+			{
+				q0[c] = std::min(std::max((int)floorf((a[c] - p0) * 0.5f + 0.5f), 0), 127);
+				q1[c] = std::min(std::max((int)floorf((b[c] - p1) * 0.5f + 0.5f), 0), 127);
+				e0[c] = q0[c] << 1 | p0;
+				e1[c] = q1[c] << 1 | p1;
+			}
+
+			unsigned char indices[16];
+			float error = BC7Fit(px, e0, e1, indices);
+			if (error < iterError)
+			{
+				iterError = error;
+				memcpy(iterIndices, indices, sizeof(indices));
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(bestQ0, q0, sizeof(q0));
+				memcpy(bestQ1, q1, sizeof(q1));
+				bestP0 = p0;
+				bestP1 = p1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		}
+		if (bestError == 0)
+			break;
+
+		float weights[16];
+		for (int i = 0; i < 16; i++) weights[i] = bc7Weights[iterIndices[i]] / 64.0f;
+		RefineEndpoints(&px[0][0], 4, weights, a, b);
+	}
+
+	// The first index is stored with 3 bits, so its top bit must be 0
+	if (bestIndices[0] & 8)
+	{
+		std::swap(bestQ0, bestQ1);
+		std::swap(bestP0, bestP1);
+		for (int i = 0; i < 16; i++) bestIndices[i] = 15 - bestIndices[i];
+	}
+
+	memset(out, 0, 16);
+	unsigned int pos = 0;
+	PutBits(out, &pos, 1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		PutBits(out, &pos, bestQ0[c], 7);
+		PutBits(out, &pos, bestQ1[c], 7);
+	}
+	PutBits(out, &pos, bestP0, 1);
+	PutBits(out, &pos, bestP1, 1);
+	PutBits(out, &pos, bestIndices[0], 3);
+	for (int i = 1; i < 16; i++)
+		PutBits(out, &pos, bestIndices[i], 4);
+}
+
+// Mode 6 only - anything else decodes to zero
+static void DecodeBC7Block(const unsigned char* in, unsigned char* block)
+{
+	unsigned int pos = 0;
+	if (GetBits(in, &pos, 7) != 1 << 6)
+	{
+		memset(block, 0, 64);
+		return;
+	}
+
+	int q0[4], q1[4];
+	for (int c = 0; c < 4; c++)
+	{
+		q0[c] = GetBits(in, &pos, 7);
+		q1[c] = GetBits(in, &pos, 7);
+	}
+	int p0 = GetBits(in, &pos, 1), p1 = GetBits(in, &pos, 1);
+	for (int i = 0; i < 16; i++)
+	{
+		int k = GetBits(in, &pos, i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = q0[c] << 1 | p0, e1 = q1[c] << 1 | p1;
+			block[i * 4 + c] = (unsigned char)(((64 - bc7Weights[k]) * e0 + bc7Weights[k] * e1 + 32) >> 6);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Whole images
+// --------------------------------------------------------
+unsigned int CookBlockBytes(CookFormat format)
+{
+	return format == COOK_BC1 ? 8 : 16;
+}
+
+unsigned int CookDXGIFormat(CookFormat format)
+{
+	switch (format)
+	{
+	case COOK_BC1: return 71;	// DXGI_FORMAT_BC1_UNORM
+	case COOK_BC5: return 83;	// DXGI_FORMAT_BC5_UNORM
+	default: return 98;			// DXGI_FORMAT_BC7_UNORM
+	}
+}
+
+static void EncodeBlock(const unsigned char* block, CookFormat format, unsigned char* out)
+{
+	switch (format)
+	{
+	case COOK_BC1:
+		EncodeBC1Block(block, out);
+		break;
+	case COOK_BC5:
+		EncodeBC4Block(block, 0, out);
+		EncodeBC4Block(block, 1, out + 8);
+		break;
+	default:
+		EncodeBC7Block(block, out);
+		break;
+	}
+}
+
+void CookCompress(const CookImage& image, CookFormat format, unsigned int threadCount, std::vector<unsigned char>* blocks)
+{
+	unsigned int blocksX = (image.Width + 3) / 4;
+	unsigned int blocksY = (image.Height + 3) / 4;
+	unsigned int blockBytes = CookBlockBytes(format);
+	blocks->resize((size_t)blocksX * blocksY * blockBytes);
+	unsigned char* data = blocks->data();
+
+	auto encodeRows = [&](unsigned int begin, unsigned int end)
+	{
+		unsigned char block[64];
+		for (unsigned int by = begin; by < end; by++)
+			for (unsigned int bx = 0; bx < blocksX; bx++)
+			{
+				FetchBlock(image, bx, by, block);
+				EncodeBlock(block, format, &data[((size_t)by * blocksX + bx) * blockBytes]);
+			}
+	};
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	threadCount = std::min(threadCount, blocksY);
+
+	// Rows of blocks in equal chunks, the last one on this thread
+	std::vector<std::thread> workers;
+	unsigned int rowsPer = (blocksY + threadCount - 1) / threadCount;
+	for (unsigned int t = 0; t + 1 < threadCount; t++)
+		workers.emplace_back(encodeRows, t * rowsPer, std::min((t + 1) * rowsPer, blocksY));
+	encodeRows(std::min((threadCount - 1) * rowsPer, blocksY), blocksY);
+	for (auto& w : workers)
+		w.join();
+}
+
+void CookDecompress(const unsigned char* blocks, unsigned int width, unsigned int height, CookFormat format, CookImage* image)
+{
+	image->Width = width;
+	image->Height = height;
+	image->Pixels.resize((size_t)width * height * 4);
+
+	unsigned int blocksX = (width + 3) / 4;
+	unsigned int blocksY = (height + 3) / 4;
+	unsigned int blockBytes = CookBlockBytes(format);
+	unsigned char block[64];
+	for (unsigned int by = 0; by < blocksY; by++)
+	{
+		for (unsigned int bx = 0; bx < blocksX; bx++)
+		{
+			const unsigned char* in = &blocks[((size_t)by * blocksX + bx) * blockBytes];
+			switch (format)
+			{
+			case COOK_BC1:
+				DecodeBC1Block(in, block);
+				break;
+			case COOK_BC5:
+				for (int i = 0; i < 16; i++) { block[i * 4 + 2] = 0; block[i * 4 + 3] = 255; }
+				DecodeBC4Block(in, 0, block);
+				DecodeBC4Block(in + 8, 1, block);
+				break;
+			default:
+				DecodeBC7Block(in, block);
+				break;
+			}
+
+			for (unsigned int y = 0; y < 4 && by * 4 + y < height; y++)
+				for (unsigned int x = 0; x < 4 && bx * 4 + x < width; x++)
+					memcpy(&image->Pixels[(((size_t)by * 4 + y) * width + bx * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+		}
+	}
+}
+
+static void Put32(std::vector<unsigned char>* out, unsigned int value)
+{
+	for (int i = 0; i < 4; i++) out->push_back((value >> (i * 8)) & 0xff);
+}
+
+// --------------------------------------------------------
+// DDS_HEADER with a 'DX10' pixel format, then
+// DDS_HEADER_DXT10, then every mip's blocks
+// --------------------------------------------------------
+void CookDDS(const CookImage& source, CookFormat format, unsigned int threadCount, std::vector<unsigned char>* dds)
+{
+	std::vector<CookImage> mips = CookBuildMips(source, format == COOK_BC5);
+	std::vector<std::vector<unsigned char>> blocks(mips.size());
+	for (size_t m = 0; m < mips.size(); m++)
+		CookCompress(mips[m], format, threadCount, &blocks[m]);
+
+	dds->clear();
+	Put32(dds, 0x20534444);						// "DDS "
+	Put32(dds, 124);							// dwSize
+	Put32(dds, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);	// CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+	Put32(dds, source.Height);
+	Put32(dds, source.Width);
+	Put32(dds, (unsigned int)blocks[0].size());	// dwPitchOrLinearSize
+	Put32(dds, 0);								// dwDepth
+	Put32(dds, (unsigned int)mips.size());
+	for (int i = 0; i < 11; i++) Put32(dds, 0);	// dwReserved1
+
+	Put32(dds, 32);								// ddspf.dwSize
+	Put32(dds, 0x4);							// DDPF_FOURCC
+	Put32(dds, 0x30315844);						// "DX10"
+	for (int i = 0; i < 5; i++) Put32(dds, 0);	// bit count and masks
+
+	Put32(dds, 0x1000 | 0x400000 | 0x8);		// TEXTURE | MIPMAP | COMPLEX
+	for (int i = 0; i < 4; i++) Put32(dds, 0);	// dwCaps2-4, dwReserved2
+
+	Put32(dds, CookDXGIFormat(format));
+	Put32(dds, 3);								// D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	Put32(dds, 0);								// miscFlag
+	Put32(dds, 1);								// arraySize
+	Put32(dds, 0);								// miscFlags2
+
+	for (auto& b : blocks)
+		dds->insert(dds->end(), b.begin(), b.end());
+}
+
+double CookPSNR(const CookImage& a, const CookImage& b, int channels)
+{
+	double sum = 0;
+	size_t count = (size_t)a.Width * a.Height;
+	for (size_t i = 0; i < count; i++)
+		for (int c = 0; c < channels; c++)
+		{
+			double d = (double)a.Pixels[i * 4 + c] - b.Pixels[i * 4 + c];
+			sum += d * d;
+		}
+	double mse = sum / (count * channels);
+	return mse <= 0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+// --------------------------------------------------------
+// The cooker "unit tests" and measurements
+// --------------------------------------------------------
+
+// Smooth value noise, 0 to 1
+static float Hash(int x, int y, int seed)
+{
+	unsigned int h = (unsigned int)(x * 374761393 + y * 668265263 + seed * 2246822519u);
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return ((h ^ (h >> 16)) & 0xffff) / 65535.0f;
+}
+
+static float ValueNoise(float x, float y, int seed)
+{
+	int ix = (int)floorf(x), iy = (int)floorf(y);
+	float fx = x - ix, fy = y - iy;
+	fx = fx * fx * (3 - 2 * fx);
+	fy = fy * fy * (3 - 2 * fy);
+	float top = Hash(ix, iy, seed) + (Hash(ix + 1, iy, seed) - Hash(ix, iy, seed)) * fx;
+	float bottom = Hash(ix, iy + 1, seed) + (Hash(ix + 1, iy + 1, seed) - Hash(ix, iy + 1, seed)) * fx;
+	return top + (bottom - top) * fy;
+}
+
+static float Fractal(float x, float y, int seed)
+{
+	float sum = 0, amplitude = 0.5f;
+	for (int o = 0; o < 5; o++, x *= 2, y *= 2, amplitude *= 0.5f)
+		sum += ValueNoise(x, y, seed + o) * amplitude;
+	return sum;
+}
+
+// Rock-ish color: noisy tints with cracks
+static CookImage MakeColorImage(unsigned int size)
+{
+	CookImage image = { size, size, {} };
+	image.Pixels.resize((size_t)size * size * 4);
+	for (unsigned int y = 0; y < size; y++)
+		for (unsigned int x = 0; x < size; x++)
+		{
+			float u = x * 16.0f / size, v = y * 16.0f / size;
+			float base = Fractal(u, v, 1);
+			float tint = Fractal(u * 0.5f, v * 0.5f, 7);
+			float crack = fabsf(ValueNoise(u * 2, v * 2, 13) - 0.5f) < 0.02f ? 0.35f : 1.0f;
+			unsigned char* p = &image.Pixels[((size_t)y * size + x) * 4];
+			p[0] = ToByte((90 + 120 * base + 40 * tint) * crack);
+			p[1] = ToByte((80 + 110 * base) * crack);
+			p[2] = ToByte((70 + 90 * base - 30 * tint) * crack);
+			p[3] = 255;
+		}
+	return image;
+}
+
+// Normals of a noisy height field
+static CookImage MakeNormalImage(unsigned int size)
+{
+	CookImage image = { size, size, {} };
+	image.Pixels.resize((size_t)size * size * 4);
+	auto height = [&](int x, int y) { return Fractal(x * 16.0f / size, y * 16.0f / size, 21) * 12.0f; };
+	for (unsigned int y = 0; y < size; y++)
+		for (unsigned int x = 0; x < size; x++)
+		{
+			float dx = height(x + 1, y) - height(x - 1, y);
+			float dy = height(x, y + 1) - height(x, y - 1);
+			float len = sqrtf(dx * dx + dy * dy + 1);
+			unsigned char* p = &image.Pixels[((size_t)y * size + x) * 4];
+			p[0] = ToByte((-dx / len * 0.5f + 0.5f) * 255);
+			p[1] = ToByte((-dy / len * 0.5f + 0.5f) * 255);
+			p[2] = ToByte((1 / len * 0.5f + 0.5f) * 255);
+			p[3] = 255;
+		}
+	return image;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TextureCookerReport(unsigned int size)
+{
+	printf("\nTexture cooker\n");
+
+	// Color mips average light, not sRGB values: black and
+	// white makes 188, not 128
+	{
+		CookImage checker = { 2, 2, { 0,0,0,255, 255,255,255,255, 255,255,255,255, 0,0,0,255 } };
+		std::vector<CookImage> mips = CookBuildMips(checker, false);
+		int value = mips[1].Pixels[0];
+		printf("  gamma correct mips: black/white averages to %d (expect 188)  %s\n", value,
+			CheckResult(abs(value - 188) <= 1));
+	}
+
+	// Normal mips stay unit length
+	{
+		CookImage normals = { 2, 2, { 255,128,128,255, 128,128,255,255, 128,255,128,255, 0,128,128,255 } };
+		std::vector<CookImage> mips = CookBuildMips(normals, true);
+		float len = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			float n = mips[1].Pixels[c] / 127.5f - 1.0f;
+			len += n * n;
+		}
+		len = sqrtf(len);
+		printf("  normal mips renormalized: length %.3f  %s\n", len, CheckResult(fabsf(len - 1) < 0.02f));
+	}
+
+	// Chain length and odd sizes
+	{
+		CookImage odd = { 37, 5, {} };
+		odd.Pixels.assign(37 * 5 * 4, 200);
+		std::vector<CookImage> mips = CookBuildMips(odd, false);
+		bool ok = mips.size() == 6 && mips.back().Width == 1 && mips.back().Height == 1 && mips[1].Width == 18 && mips[1].Height == 2;
+		printf("  37x5 chain: %u mips down to %ux%u  %s\n", (unsigned int)mips.size(),
+			mips.back().Width, mips.back().Height, CheckResult(ok));
+	}
+
+	// Flat blocks come back (nearly) exact
+	{
+		CookImage flat = { 4, 4, {} };
+		for (int i = 0; i < 16; i++)
+		{
+			unsigned char p[4] = { 37, 200, 91, 255 };
+			flat.Pixels.insert(flat.Pixels.end(), p, p + 4);
+		}
+		const char* names[3] = { "BC1", "BC5", "BC7" };
+		const int tolerance[3] = { 4, 0, 1 };
+		const int channels[3] = { 3, 2, 3 };
+		bool ok = true;
+		printf("  flat block worst error:");
+		for (int f = 0; f < 3; f++)
+		{
+			std::vector<unsigned char> blocks;
+			CookImage back;
+			CookCompress(flat, (CookFormat)f, 1, &blocks);
+			CookDecompress(blocks.data(), 4, 4, (CookFormat)f, &back);
+			int worst = 0;
+			for (int i = 0; i < 16; i++)
+				for (int c = 0; c < channels[f]; c++)
+					worst = std::max(worst, abs(back.Pixels[i * 4 + c] - flat.Pixels[i * 4 + c]));
+			ok = ok && worst <= tolerance[f];
+			printf(" %s %d", names[f], worst);
+		}
+		printf("  %s\n", CheckResult(ok));
+	}
+
+	// DDS layout
+	{
+		CookImage image = MakeColorImage(64);
+		std::vector<unsigned char> dds;
+		CookDDS(image, COOK_BC7, 0, &dds);
+		size_t expected = 148;
+		for (unsigned int s = 64; s >= 1; s /= 2)
+			expected += (size_t)((s + 3) / 4) * ((s + 3) / 4) * 16;
+		auto read32 = [&](size_t offset) { return dds[offset] | dds[offset + 1] << 8 | dds[offset + 2] << 16 | (unsigned int)dds[offset + 3] << 24; };
+		bool ok = dds.size() == expected && read32(0) == 0x20534444 && read32(28) == 7 && read32(84) == 0x30315844 && read32(128) == 98;
+		printf("  DDS: %u bytes, 7 mips, DX10 header  %s\n", (unsigned int)dds.size(), CheckResult(ok));
+	}
+
+	// Throughput and quality on full size images
+	CookImage color = MakeColorImage(size);
+	CookImage normal = MakeNormalImage(size);
+	unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+	printf("  %ux%u, mip 0 only, 1 thread vs %u:\n", size, size, cores);
+
+	struct Case { const char* name; CookFormat format; const CookImage* image; int channels; };
+	const Case cases[3] = {
+		{ "BC1 color ", COOK_BC1, &color, 3 },
+		{ "BC7 color ", COOK_BC7, &color, 3 },
+		{ "BC5 normal", COOK_BC5, &normal, 2 } };
+	for (const Case& c : cases)
+	{
+		std::vector<unsigned char> blocks;
+		auto start = std::chrono::steady_clock::now();
+		CookCompress(*c.image, c.format, 1, &blocks);
+		double single = SecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		CookCompress(*c.image, c.format, cores, &blocks);
+		double threaded = SecondsSince(start);
+
+		CookImage back;
+		CookDecompress(blocks.data(), size, size, c.format, &back);
+		double mpix = (double)size * size / 1e6;
+		printf("    %s  %6.1f / %6.1f Mpix/s  PSNR %.2f dB\n", c.name, mpix / single, mpix / threaded,
+			CookPSNR(*c.image, back, c.channels));
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <string>
+
+// --------------------------------------------------------
+// Offline texture cooking: source image -> mip chain ->
+// block compressed DDS that CreateDDSTextureFromFile (and the
+// texture streamer) load directly
+//
+// - BC1: 4bpp RGB, for color maps where size matters most
+// - BC7: 8bpp RGBA, for color maps where quality matters
+//   (this encoder only uses mode 6 - one subset, 7 bit
+//   endpoints - which holds up well on natural textures)
+// - BC5: 8bpp two channel, for tangent space normal maps.
+//   Shaders rebuild z from x and y.
+//
+// Color mips are filtered in linear light and stored back as
+// sRGB (the formats stay UNORM, so shaders see exactly what
+// they saw from the source images).  Normal map mips are
+// averaged as vectors and renormalized.
+//
+// Plain C++ with no device or OS calls, so it builds and runs
+// anywhere - see Tools/TextureCooker for the command line.
+// --------------------------------------------------------
+
+enum CookFormat
+{
+	COOK_BC1,
+	COOK_BC5,
+	COOK_BC7
+};
+
+// RGBA8 pixels, rows top to bottom
+struct CookImage
+{
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<unsigned char> Pixels;
+};
+
+// Full chain down to 1x1, source first
+std::vector<CookImage> CookBuildMips(const CookImage& source, bool normalMap);
+
+// Bytes per 4x4 block, and the DXGI_FORMAT the DDS is tagged with
+unsigned int CookBlockBytes(CookFormat format);
+unsigned int CookDXGIFormat(CookFormat format);
+
+// Compresses one image, rows of blocks split over threadCount threads
+// (0 = one per core).  Edges are padded by repeating the last pixel.
+void CookCompress(const CookImage& image, CookFormat format, unsigned int threadCount, std::vector<unsigned char>* blocks);
+
+// Back to RGBA8, for checking what the GPU will see
+// (BC5 comes back as x, y, 0, 255)
+void CookDecompress(const unsigned char* blocks, unsigned int width, unsigned int height, CookFormat format, CookImage* image);
+
+// Mips + compression + DDS (with a DX10 header) in one go
+void CookDDS(const CookImage& source, CookFormat format, unsigned int threadCount, std::vector<unsigned char>* dds);
+
+// Over the first channels channels (3 = RGB)
+double CookPSNR(const CookImage& a, const CookImage& b, int channels);
+
+// Checks mips, blocks and the DDS header, then measures encoder
+// throughput and PSNR on generated color and normal maps
+void TextureCookerReport(unsigned int size);
@@ -0,0 +1,377 @@
+#include "TextureResidency.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+unsigned int TextureMipCount(unsigned int width, unsigned int height)
+{
+	unsigned int size = width > height ? width : height;
+	unsigned int count = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		count++;
+	}
+	return count;
+}
+
+unsigned long long TextureChainBytes(unsigned int width, unsigned int height, unsigned long long level0Bytes,
+	unsigned int firstMip)
+{
+	// Every level a quarter of the one above (block formats
+	// round the small ones up, which this leaves out)
+	unsigned long long bytes = 0;
+	unsigned int count = TextureMipCount(width, height);
+	for (unsigned int m = firstMip; m < count; m++)
+	{
+		unsigned long long level = level0Bytes >> (2 * m);
+		bytes += level > 0 ? level : 1;
+	}
+	return bytes;
+}
+
+unsigned int TextureScreenMip(unsigned int size, float screenPixels)
+{
+	if (screenPixels <= 1.0f)
+		return TextureMipCount(size, size) - 1;
+	float mip = log2f((float)size / screenPixels);
+	return mip > 0 ? (unsigned int)mip : 0;
+}
+
+// --------------------------------------------------------
+// TextureResidency
+// --------------------------------------------------------
+TextureResidency::TextureResidency(unsigned long long budget, unsigned long long streamInBudget)
+{
+	this->budget = budget;
+	this->streamInBudget = streamInBudget;
+	frame = 1;
+	residentBytes = peakBytes = 0;
+	frameStreamInBytes = 0;
+	frameDroppedMips = frameLaggingMips = 0;
+	droppedMips = 0;
+	dropFrames = 0;
+	evictionCount = 0;
+}
+
+int TextureResidency::Add(unsigned int width, unsigned int height, unsigned long long level0Bytes, unsigned int mip)
+{
+	Texture t;
+	t.Live = true;
+	t.Width = width;
+	t.Height = height;
+	t.Level0Bytes = level0Bytes;
+	t.MipCount = TextureMipCount(width, height);
+	t.Tail = 0;
+	while (t.Tail + 1 < t.MipCount && std::max(width >> t.Tail, height >> t.Tail) > TEXTURE_RESIDENCY_TAIL)
+		t.Tail++;
+	t.Resident = t.Target = t.Wanted = std::min(mip, t.Tail);
+	t.RequestFrame = 0;
+	t.LastUsed = frame;
+
+	int id;
+	if (!freeIDs.empty())
+	{
+		id = freeIDs.back();
+		freeIDs.pop_back();
+		textures[id] = t;
+	}
+	else
+	{
+		textures.push_back(t);
+		id = (int)textures.size() - 1;
+	}
+
+	residentBytes += GetBytes(id, t.Resident);
+	peakBytes = std::max(peakBytes, residentBytes);
+	return id;
+}
+
+void TextureResidency::Remove(int texture)
+{
+	Texture& t = textures[texture];
+	residentBytes -= GetBytes(texture, t.Resident);
+	t.Live = false;
+	freeIDs.push_back(texture);
+}
+
+unsigned long long TextureResidency::GetBytes(int texture, unsigned int mip)
+{
+	const Texture& t = textures[texture];
+	return TextureChainBytes(t.Width, t.Height, t.Level0Bytes, mip);
+}
+
+void TextureResidency::Request(int texture, unsigned int mip)
+{
+	Texture& t = textures[texture];
+	mip = std::min(mip, t.Tail);
+	if (!Requested(t) || mip < t.Wanted)
+		t.Wanted = mip;
+	t.RequestFrame = frame;
+	t.LastUsed = frame;
+}
+
+void TextureResidency::Update(std::vector<TextureMipChange>* changes)
+{
+	Update(streamInBudget, changes);
+}
+
+void TextureResidency::Update(unsigned long long streamInBytes, std::vector<TextureMipChange>* changes)
+{
+	// What everything would like: its wanted mip if it's in
+	// view, otherwise whatever it has now
+	unsigned long long total = 0;
+	for (int i = 0; i < (int)textures.size(); i++)
+	{
+		Texture& t = textures[i];
+		if (!t.Live) continue;
+		t.Target = Requested(t) ? t.Wanted : t.Resident;
+		total += GetBytes(i, t.Target);
+	}
+
+	// Over budget: least recently used out of view first...
+	if (total > budget)
+	{
+		order.clear();
+		for (int i = 0; i < (int)textures.size(); i++)
+			if (textures[i].Live && !Requested(textures[i]) && textures[i].Target < textures[i].Tail)
+				order.push_back(i);
+		std::sort(order.begin(), order.end(), [this](int a, int b)
+		{
+			return textures[a].LastUsed != textures[b].LastUsed ? textures[a].LastUsed < textures[b].LastUsed : a < b;
+		});
+		for (int i : order)
+		{
+			if (total <= budget) break;
+			Texture& t = textures[i];
+			total -= GetBytes(i, t.Target) - GetBytes(i, t.Tail);
+			t.Target = t.Tail;
+			evictionCount++;
+		}
+	}
+
+	// ...then a mip at a time off whichever texture in view
+	// has the biggest top level
+	while (total > budget)
+	{
+		int best = -1;
+		unsigned long long bestBytes = 0;
+		for (int i = 0; i < (int)textures.size(); i++)
+		{
+			Texture& t = textures[i];
+			if (!t.Live || !Requested(t) || t.Target >= t.Tail) continue;
+			unsigned long long level = GetBytes(i, t.Target) - GetBytes(i, t.Target + 1);
+			if (level > bestBytes)
+			{
+				best = i;
+				bestBytes = level;
+			}
+		}
+		if (best < 0) break;	// Tails alone are over budget
+		textures[best].Target++;
+		total -= bestBytes;
+	}
+
+	// Stream outs first, so the memory is free before anything
+	// comes in
+	order.clear();
+	for (int i = 0; i < (int)textures.size(); i++)
+	{
+		Texture& t = textures[i];
+		if (!t.Live) continue;
+		if (t.Target > t.Resident)
+		{
+			changes->push_back({ i, t.Resident, t.Target });
+			residentBytes -= GetBytes(i, t.Resident) - GetBytes(i, t.Target);
+			t.Resident = t.Target;
+		}
+		else if (t.Target < t.Resident)
+			order.push_back(i);
+	}
+
+	// Stream ins, blurriest first, while the per frame bytes last
+	std::sort(order.begin(), order.end(), [this](int a, int b)
+	{
+		unsigned int gapA = textures[a].Resident - textures[a].Target;
+		unsigned int gapB = textures[b].Resident - textures[b].Target;
+		return gapA != gapB ? gapA > gapB : a < b;
+	});
+	frameStreamInBytes = 0;
+	for (int i : order)
+	{
+		Texture& t = textures[i];
+		unsigned long long bytes = GetBytes(i, t.Target);
+		if (frameStreamInBytes > 0 && frameStreamInBytes + bytes > streamInBytes)
+			continue;
+		changes->push_back({ i, t.Resident, t.Target });
+		residentBytes += bytes - GetBytes(i, t.Resident);
+		t.Resident = t.Target;
+		frameStreamInBytes += bytes;
+	}
+	peakBytes = std::max(peakBytes, residentBytes);
+
+	frameDroppedMips = frameLaggingMips = 0;
+	for (auto& t : textures)
+	{
+		if (!t.Live || !Requested(t)) continue;
+		frameDroppedMips += t.Target - t.Wanted;
+		frameLaggingMips += t.Resident - t.Target;
+	}
+	droppedMips += frameDroppedMips;
+	if (frameDroppedMips > 0) dropFrames++;
+
+	frame++;
+}
+
+void TextureResidency::Revert(const TextureMipChange& change)
+{
+	residentBytes -= GetBytes(change.Texture, change.To);
+	residentBytes += GetBytes(change.Texture, change.From);
+	textures[change.Texture].Resident = change.From;
+}
+
+// --------------------------------------------------------
+// The residency "unit test", run at debug startup: a camera
+// flies down a road lined with objects, each using one of a
+// set of shared textures, then stops.  Every frame:
+//  - resident bytes stay under the budget
+//  - no more than the stream in budget comes in (unless it's
+//    a single texture)
+//  - textures in view only give up mips once every texture
+//    out of view is down to its tail
+//  - out of view textures leave least recently used first
+// Once the camera stops everything settles at its target.
+// --------------------------------------------------------
+struct ResidencyObject
+{
+	float X, Z;
+	float Radius;
+	int Texture;
+};
+
+void TextureResidencyReport()
+{
+	printf("\nTexture residency (tail %u)\n", TEXTURE_RESIDENCY_TAIL);
+
+	// Helpers
+	{
+		bool ok =
+			TextureMipCount(1024, 1024) == 11 && TextureMipCount(2048, 512) == 12 && TextureMipCount(1, 1) == 1 &&
+			TextureChainBytes(4, 4, 64, 0) == 64 + 16 + 4 &&
+			TextureScreenMip(1024, 1024) == 0 && TextureScreenMip(1024, 2000) == 0 &&
+			TextureScreenMip(1024, 256) == 2 && TextureScreenMip(1024, 200) == 2 && TextureScreenMip(1024, 0) == 10;
+		printf("  mip counts, chain bytes, screen mips: %s\n", CheckResult(ok));
+	}
+
+	// 60 textures of 512, 1024 and 2048 (RGBA8), shared by 300
+	// objects along a 400 unit road
+	const unsigned int textureCount = 60, objectCount = 300;
+	const unsigned int sizes[3] = { 512, 1024, 2048 };
+	std::vector<ResidencyObject> objects;
+	srand(1357);
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		ResidencyObject o;
+		o.X = (rand() % 2 ? 1.0f : -1.0f) * (3.0f + (rand() % 1000) / 100.0f);
+		o.Z = (rand() % 40000) / 100.0f;
+		o.Radius = 0.5f + (rand() % 250) / 100.0f;
+		o.Texture = rand() % textureCount;
+		objects.push_back(o);
+	}
+
+	// 1280x720, 45 degree fov.  600 frames down the road, then
+	// 120 standing still.
+	const float screenHeight = 720.0f;
+	const float focal = 1.0f / tanf(0.125f * 3.1415926535f);
+	const float cosHalfFov = cosf(0.4f * 3.1415926535f);		// Generous, for the wider horizontal fov
+	const unsigned int moving = 600, still = 120;
+	const unsigned long long streamIn = 8ull << 20;
+
+	const unsigned long long budgets[3] = { 1024ull << 20, 64ull << 20, 24ull << 20 };
+	for (unsigned long long budget : budgets)
+	{
+		TextureResidency residency(budget, streamIn);
+		std::vector<int> ids(textureCount);
+		for (unsigned int i = 0; i < textureCount; i++)
+		{
+			unsigned int size = sizes[i % 3];
+			ids[i] = residency.Add(size, size, (unsigned long long)size * size * 4, TextureMipCount(size, size));
+		}
+
+		std::vector<unsigned int> lastSeen(textureCount, 0);
+		std::vector<TextureMipChange> changes;
+		bool budgetOk = true, streamOk = true, lruOk = true, bookkeepingOk = true;
+		unsigned long long streamedIn = 0;
+		unsigned int maxLagging = 0;
+
+		for (unsigned int f = 1; f <= moving + still; f++)
+		{
+			float camZ = -20.0f + 420.0f * std::min(f, moving) / moving;
+
+			std::vector<bool> seen(textureCount, false);
+			for (auto& o : objects)
+			{
+				float dx = o.X, dz = o.Z - camZ;
+				float dist = sqrtf(dx * dx + dz * dz);
+				if (dist > 150.0f || dz < dist * cosHalfFov) continue;
+				float pixels = o.Radius * 2 / std::max(dist - o.Radius, 0.1f) * focal * screenHeight * 0.5f;
+				residency.Request(ids[o.Texture], TextureScreenMip(sizes[o.Texture % 3], pixels));
+				seen[o.Texture] = true;
+			}
+			for (unsigned int i = 0; i < textureCount; i++)
+				if (seen[i]) lastSeen[i] = f;
+
+			changes.clear();
+			residency.Update(&changes);
+
+			// Tails alone fit every budget here
+			if (residency.GetResidentBytes() > budget) budgetOk = false;
+
+			unsigned long long bytesIn = 0;
+			unsigned int ins = 0;
+			for (auto& c : changes)
+				if (c.To < c.From)
+				{
+					bytesIn += residency.GetBytes(c.Texture, c.To);
+					ins++;
+				}
+			if (bytesIn != residency.GetFrameStreamInBytes() || (ins > 1 && bytesIn > streamIn)) streamOk = false;
+			streamedIn += bytesIn;
+
+			unsigned long long sum = 0;
+			for (unsigned int i = 0; i < textureCount; i++)
+				sum += residency.GetBytes(ids[i], residency.GetResidentMip(ids[i]));
+			if (sum != residency.GetResidentBytes()) bookkeepingOk = false;
+
+			// Nothing out of view above its tail while something in
+			// view is held back, and everything streamed out this
+			// frame was seen no later than what out of view stayed
+			unsigned int newestEvicted = 0, oldestKept = ~0u;
+			for (auto& c : changes)
+			{
+				unsigned int i = (unsigned int)(std::find(ids.begin(), ids.end(), c.Texture) - ids.begin());
+				if (c.To > c.From && !seen[i]) newestEvicted = std::max(newestEvicted, lastSeen[i]);
+			}
+			for (unsigned int i = 0; i < textureCount; i++)
+			{
+				if (seen[i] || residency.GetResidentMip(ids[i]) >= residency.GetTailMip(ids[i])) continue;
+				oldestKept = std::min(oldestKept, lastSeen[i]);
+				if (residency.GetFrameDroppedMips() > 0) lruOk = false;
+			}
+			if (newestEvicted > oldestKept) lruOk = false;
+
+			if (f > moving) maxLagging = residency.GetFrameLaggingMips();
+		}
+
+		bool settled = maxLagging == 0;
+		bool dropsOk = budget < (1024ull << 20) || residency.GetDroppedMips() == 0;
+		printf("  budget %4lluMB: peak %5.1fMB, %llu mips dropped over %u of %u frames, %u evictions, %.0fMB streamed in\n",
+			budget >> 20, residency.GetPeakBytes() / (1024.0 * 1024.0), residency.GetDroppedMips(), residency.GetDropFrames(),
+			moving + still, residency.GetEvictionCount(), streamedIn / (1024.0 * 1024.0));
+		printf("    budget %s, stream in limit %s, LRU order %s, bookkeeping %s, settled %s%s\n",
+			CheckResult(budgetOk), CheckResult(streamOk), CheckResult(lruOk),
+			CheckResult(bookkeepingOk), CheckResult(settled), dropsOk ? "" : ", drops with no pressure FAILED");
+	}
+}
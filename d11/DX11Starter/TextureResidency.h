@@ -0,0 +1,131 @@
+#pragma once
+#include <vector>
+
+// --------------------------------------------------------
+// Texture residency under a memory budget
+//
+// Every texture has a resident mip - the finest level on the
+// GPU, with the rest of the chain below it.  Each frame:
+//
+// - Request() says which mip a texture is wanted at, from how
+//   big it looks on screen (TextureScreenMip).  Textures
+//   nobody asks for keep what they have, as a cache.
+// - If the wanted mips don't fit the budget, the least
+//   recently used textures are streamed out to their tail
+//   first, then the textures in view give up mips, the one
+//   with the biggest top level first, until they do.
+// - Streaming out only ever frees memory.  Streaming in
+//   uploads the texture again, so it's limited to a number of
+//   bytes per frame, the blurriest textures first.
+//
+// The last TEXTURE_RESIDENCY_TAIL sized mips never leave, so
+// there's always something to draw.  No device is needed here
+// - TextureStreamer turns the changes into uploads.
+// --------------------------------------------------------
+
+// Mips this size (the larger side) and smaller are never streamed out
+#define TEXTURE_RESIDENCY_TAIL 64
+
+// A texture's resident mip moving.  To < From = streamed in.
+struct TextureMipChange
+{
+	int Texture;
+	unsigned int From;
+	unsigned int To;
+};
+
+// Levels down to 1x1
+unsigned int TextureMipCount(unsigned int width, unsigned int height);
+
+// Bytes of firstMip and everything below it, for a texture
+// whose top level is level0Bytes
+unsigned long long TextureChainBytes(unsigned int width, unsigned int height, unsigned long long level0Bytes,
+	unsigned int firstMip);
+
+// Finest mip worth having for a texture size texels across,
+// when that covers screenPixels pixels
+unsigned int TextureScreenMip(unsigned int size, float screenPixels);
+
+class TextureResidency
+{
+public:
+	// budget: resident bytes.  streamInBudget: default bytes
+	// streamed in per Update (one texture always goes).
+	TextureResidency(unsigned long long budget, unsigned long long streamInBudget);
+
+	// A new texture, resident at mip to begin with (no coarser
+	// than its tail).  Returns its id - ids of removed textures
+	// are used again.
+	int Add(unsigned int width, unsigned int height, unsigned long long level0Bytes, unsigned int mip);
+	void Remove(int texture);
+
+	// Wanted this frame at mip (or finer, if asked again)
+	void Request(int texture, unsigned int mip);
+
+	// Ends the frame: fits the budget, then appends the
+	// textures whose resident mip changed, streamed out first
+	void Update(std::vector<TextureMipChange>* changes);
+	void Update(unsigned long long streamInBytes, std::vector<TextureMipChange>* changes);
+
+	// Puts a change back, if the upload behind it failed
+	void Revert(const TextureMipChange& change);
+
+	void SetBudget(unsigned long long bytes) { budget = bytes; }
+	unsigned long long GetBudget() { return budget; }
+
+	unsigned int GetResidentMip(int texture) { return textures[texture].Resident; }
+	unsigned int GetWantedMip(int texture) { return textures[texture].Wanted; }	// Last time it was requested
+	unsigned int GetTailMip(int texture) { return textures[texture].Tail; }
+	unsigned int GetMipCount(int texture) { return textures[texture].MipCount; }
+	unsigned long long GetBytes(int texture, unsigned int mip);
+
+	// Stats
+	unsigned long long GetResidentBytes() { return residentBytes; }
+	unsigned long long GetPeakBytes() { return peakBytes; }
+	unsigned long long GetFrameStreamInBytes() { return frameStreamInBytes; }
+	unsigned int GetFrameDroppedMips() { return frameDroppedMips; }		// Wanted levels held back by the budget
+	unsigned int GetFrameLaggingMips() { return frameLaggingMips; }		// Wanted levels still waiting to stream in
+	unsigned long long GetDroppedMips() { return droppedMips; }			// Summed over every frame
+	unsigned int GetDropFrames() { return dropFrames; }					// Frames with any dropped
+	unsigned int GetEvictionCount() { return evictionCount; }			// Streamed out to the tail by the LRU
+
+private:
+	struct Texture
+	{
+		bool Live;
+		unsigned int Width;
+		unsigned int Height;
+		unsigned long long Level0Bytes;
+		unsigned int MipCount;
+		unsigned int Tail;			// Coarsest level that's ever streamed
+		unsigned int Resident;
+		unsigned int Target;		// Where this Update wants it
+		unsigned int Wanted;
+		unsigned int RequestFrame;	// Frame of the last Request
+		unsigned int LastUsed;
+	};
+
+	std::vector<Texture> textures;
+	std::vector<int> freeIDs;
+	std::vector<int> order;		// Scratch
+
+	unsigned long long budget;
+	unsigned long long streamInBudget;
+	unsigned int frame;
+
+	unsigned long long residentBytes;
+	unsigned long long peakBytes;
+	unsigned long long frameStreamInBytes;
+	unsigned int frameDroppedMips;
+	unsigned int frameLaggingMips;
+	unsigned long long droppedMips;
+	unsigned int dropFrames;
+	unsigned int evictionCount;
+
+	bool Requested(const Texture& t) { return t.RequestFrame == frame; }
+};
+
+// A scripted camera flying past a field of textured objects,
+// at a few budgets - checks the budget, the stream in limit
+// and LRU order every frame and prints peak memory and drops
+void TextureResidencyReport();
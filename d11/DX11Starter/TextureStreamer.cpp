@@ -0,0 +1,593 @@
+#include "TextureStreamer.h"
+#include "Check.h"
+#include "Profiler.h"
+#include <chrono>
+#include <cstdio>
+
+// --------------------------------------------------------
+// TextureStreamer
+//
+// Only the queueing and budgeting lives here - the D3D11 and
+// WIC side is in D3D11TextureBackend.cpp
+// --------------------------------------------------------
+TextureStreamer::TextureStreamer(ITextureBackend* backend, unsigned int threadCount, unsigned long long uploadBudget,
+	unsigned long long memoryBudget)
+	: residency(memoryBudget, uploadBudget)
+{
+	this->backend = backend;
+	this->uploadBudget = uploadBudget;
+	stopping = false;
+	readNs = decodeNs = uploadNs = 0;
+	pendingCount = failedCount = 0;
+	frameUploadBytes = peakFrameUploadBytes = 0;
+
+	for (int i = 0; i < TEXTURE_PLACEHOLDER_COUNT; i++)
+		placeholders[i] = backend->CreatePlaceholder((TexturePlaceholder)i);
+
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back(&TextureStreamer::WorkerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Anything not started yet is dropped
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		jobs.clear();
+	}
+	wake.notify_all();
+	for (auto& w : workers)
+		w.join();
+
+	for (auto& t : textures)
+		if (t.BackendID >= 0) backend->DestroyTexture(t.BackendID);
+	for (int i = 0; i < TEXTURE_PLACEHOLDER_COUNT; i++)
+		if (placeholders[i] >= 0) backend->DestroyTexture(placeholders[i]);
+	delete backend;
+}
+
+TextureHandle TextureStreamer::Load(const std::wstring& path, TexturePlaceholder placeholder,
+	std::function<void(ID3D11ShaderResourceView*)> onReady)
+{
+	auto found = byPath.find(path);
+	if (found != byPath.end())
+	{
+		Texture& t = textures[found->second];
+		t.RefCount++;
+		if (onReady)
+		{
+			t.OnReady.push_back(onReady);
+			if (t.BackendID >= 0)
+				onReady(backend->GetSRV(t.BackendID));
+		}
+		return found->second;
+	}
+
+	Texture t;
+	t.Path = path;
+	t.Placeholder = placeholder;
+	if (onReady)
+		t.OnReady.push_back(onReady);
+	t.RefCount = 1;
+	t.BackendID = -1;
+	t.Failed = false;
+	t.Residency = -1;
+	t.Source.Width = t.Source.Height = 0;
+	t.Source.Container = false;
+	textures.push_back(t);
+	pendingCount++;
+
+	TextureHandle handle = (TextureHandle)textures.size() - 1;
+	byPath[path] = handle;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back({ handle, path });
+	}
+	wake.notify_one();
+	return handle;
+}
+
+void TextureStreamer::Release(TextureHandle texture)
+{
+	Texture& t = textures[texture];
+	if (t.RefCount == 0 || --t.RefCount > 0)
+		return;
+
+	// Still loading - Update drops it when it arrives
+	byPath.erase(t.Path);
+	t.OnReady.clear();
+	if (t.BackendID >= 0)
+		backend->DestroyTexture(t.BackendID);
+	t.BackendID = -1;
+	if (t.Residency >= 0)
+		residency.Remove(t.Residency);
+	t.Residency = -1;
+	t.Source = DecodedTexture();
+}
+
+void TextureStreamer::RequestScreenSize(TextureHandle texture, float screenPixels)
+{
+	const Texture& t = textures[texture];
+	if (t.Residency < 0)
+		return;
+	unsigned int size = t.Source.Width > t.Source.Height ? t.Source.Width : t.Source.Height;
+	residency.Request(t.Residency, TextureScreenMip(size, screenPixels));
+}
+
+unsigned int TextureStreamer::GetResidentMip(TextureHandle texture)
+{
+	const Texture& t = textures[texture];
+	return t.Residency >= 0 ? residency.GetResidentMip(t.Residency) : 0;
+}
+
+// Same name with a .dds extension
+static std::wstring CookedPath(const std::wstring& path)
+{
+	size_t dot = path.find_last_of(L'.');
+	size_t slash = path.find_last_of(L"/\\");
+	if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash))
+		return path + L".dds";
+	return path.substr(0, dot) + L".dds";
+}
+
+// --------------------------------------------------------
+// Reads and decodes jobs until the streamer goes away.  The
+// backend calls run outside the lock.
+// --------------------------------------------------------
+void TextureStreamer::WorkerLoop()
+{
+	backend->WorkerStart();
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+			if (stopping) break;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		Finished f;
+		f.Texture = job.Texture;
+		f.Decoded.Width = f.Decoded.Height = 0;
+		f.Decoded.Container = false;
+
+		// The cooked DDS (see Tools/TextureCooker) when there is
+		// one, otherwise the source image
+		std::wstring path = CookedPath(job.Path);
+		std::vector<unsigned char> file;
+		unsigned __int64 start = Profiler::Now();
+		f.Ok = backend->ReadFile(path, &file);
+		if (!f.Ok && path != job.Path)
+		{
+			path = job.Path;
+			f.Ok = backend->ReadFile(path, &file);
+		}
+		unsigned __int64 read = Profiler::Now();
+		if (f.Ok)
+			f.Ok = backend->Decode(path, file, &f.Decoded);
+		unsigned __int64 decoded = Profiler::Now();
+
+		std::lock_guard<std::mutex> guard(lock);
+		readNs += Profiler::TicksToNs(read - start);
+		decodeNs += Profiler::TicksToNs(decoded - read);
+		finished.push_back(std::move(f));
+	}
+	backend->WorkerStop();
+}
+
+// --------------------------------------------------------
+// Replaces a texture's GPU copy and tells everyone holding
+// its SRV
+// --------------------------------------------------------
+bool TextureStreamer::Upload(TextureHandle texture, const DecodedTexture& decoded, unsigned int firstMip)
+{
+	unsigned __int64 start = Profiler::Now();
+	int id = backend->Upload(decoded, firstMip);
+	uploadNs += Profiler::TicksToNs(Profiler::Now() - start);
+	if (id < 0)
+		return false;
+
+	Texture& t = textures[texture];
+	if (t.BackendID >= 0)
+		backend->DestroyTexture(t.BackendID);
+	t.BackendID = id;
+	for (size_t i = 0; i < t.OnReady.size(); i++)
+		t.OnReady[i](backend->GetSRV(id));
+	return true;
+}
+
+// --------------------------------------------------------
+// Uploads what the workers finished, oldest first, until the
+// next one would go over the budget.  The first upload of a
+// frame always goes, so a texture bigger than the whole
+// budget still gets in.  Then mips stream in and out with
+// what's left of the budget.
+// --------------------------------------------------------
+void TextureStreamer::Update()
+{
+	PROFILE_ZONE("TextureStreamer::Update");
+
+	frameUploadBytes = 0;
+	unsigned int uploads = 0;
+	for (;;)
+	{
+		Finished f;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (finished.empty())
+				break;
+			unsigned long long bytes = finished.front().Decoded.Data.size();
+			if (uploads > 0 && frameUploadBytes + bytes > uploadBudget)
+				break;
+			f = std::move(finished.front());
+			finished.pop_front();
+		}
+
+		Texture& t = textures[f.Texture];
+		pendingCount--;
+		if (t.RefCount == 0)
+			continue;	// Released while it loaded
+
+		unsigned long long bytes = f.Decoded.Data.size();
+		if (!f.Ok || !Upload(f.Texture, f.Decoded, 0))
+		{
+			t.Failed = true;
+			failedCount++;
+			continue;
+		}
+
+		// 2D textures with mips to spare stream from here on,
+		// starting out whole
+		unsigned int w = f.Decoded.Width, h = f.Decoded.Height;
+		if (t.Placeholder != TEXTURE_PLACEHOLDER_BLACK_CUBE && (w > TEXTURE_RESIDENCY_TAIL || h > TEXTURE_RESIDENCY_TAIL))
+		{
+			// A container's top level is about 3/4 of the file
+			unsigned long long level0 = f.Decoded.Container ? bytes * 3 / 4 : (unsigned long long)w * h * 4;
+			t.Residency = residency.Add(w, h, level0, 0);
+			if (residencyOwner.size() <= (size_t)t.Residency)
+				residencyOwner.resize(t.Residency + 1);
+			residencyOwner[t.Residency] = f.Texture;
+			t.Source = std::move(f.Decoded);
+		}
+
+		frameUploadBytes += bytes;
+		uploads++;
+	}
+
+	mipChanges.clear();
+	residency.Update(frameUploadBytes < uploadBudget ? uploadBudget - frameUploadBytes : 0, &mipChanges);
+	for (auto& c : mipChanges)
+	{
+		TextureHandle texture = residencyOwner[c.Texture];
+		if (!Upload(texture, textures[texture].Source, c.To))
+		{
+			residency.Revert(c);
+			continue;
+		}
+		frameUploadBytes += residency.GetBytes(c.Texture, c.To);
+	}
+
+	if (frameUploadBytes > peakFrameUploadBytes)
+		peakFrameUploadBytes = frameUploadBytes;
+}
+
+ID3D11ShaderResourceView* TextureStreamer::GetSRV(TextureHandle texture)
+{
+	const Texture& t = textures[texture];
+	return backend->GetSRV(t.BackendID >= 0 ? t.BackendID : placeholders[t.Placeholder]);
+}
+
+double TextureStreamer::GetReadMs()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return readNs / 1e6;
+}
+
+double TextureStreamer::GetDecodeMs()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return decodeNs / 1e6;
+}
+
+// --------------------------------------------------------
+// SyntheticTextureBackend
+// --------------------------------------------------------
+static void BusyWait(double ms)
+{
+	unsigned __int64 start = Profiler::Now();
+	while (Profiler::TicksToNs(Profiler::Now() - start) < ms * 1e6);
+}
+
+SyntheticTextureBackend::SyntheticTextureBackend(unsigned int size, double readMs, double decodeMs, double uploadMsPerMB)
+{
+	this->size = size;
+	this->readMs = readMs;
+	this->decodeMs = decodeMs;
+	this->uploadMsPerMB = uploadMsPerMB;
+	nextID = 0;
+	liveCount = 0;
+}
+
+bool SyntheticTextureBackend::ReadFile(const std::wstring& path, std::vector<unsigned char>* bytes)
+{
+	if (path.find(L"missing") != std::wstring::npos)
+		return false;
+	BusyWait(readMs);
+	bytes->assign(64, 0);
+	return true;
+}
+
+bool SyntheticTextureBackend::Decode(const std::wstring& path, std::vector<unsigned char>& file, DecodedTexture* texture)
+{
+	BusyWait(decodeMs);
+	texture->Width = size;
+	texture->Height = size;
+	texture->Container = false;
+	texture->Data.assign((size_t)size * size * 4, 128);
+	return true;
+}
+
+int SyntheticTextureBackend::CreatePlaceholder(TexturePlaceholder kind)
+{
+	liveCount++;
+	return nextID++;
+}
+
+int SyntheticTextureBackend::Upload(const DecodedTexture& texture, unsigned int firstMip)
+{
+	BusyWait(uploadMsPerMB * (texture.Data.size() >> (2 * firstMip)) / (1024.0 * 1024.0));
+	liveCount++;
+	return nextID++;
+}
+
+// --------------------------------------------------------
+// The streamer "unit tests", run at debug startup:
+//  - textures show their placeholder until they're uploaded,
+//    then the real texture, and onReady runs once, on the
+//    main thread
+//  - no frame uploads more than the budget, unless it's a
+//    single texture bigger than the budget
+//  - failed loads keep the placeholder and skip onReady
+//  - the streamer can be destroyed with work still queued
+// --------------------------------------------------------
+static void RunUntilLoaded(TextureStreamer* streamer, unsigned long long budget, unsigned int* frames, bool* overBudget)
+{
+	*frames = 0;
+	*overBudget = false;
+	while (streamer->GetPendingCount() > 0)
+	{
+		streamer->Update();
+		if (streamer->GetFrameUploadBytes() > 0) (*frames)++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	*overBudget = streamer->GetPeakFrameUploadBytes() > budget;
+}
+
+void TextureStreamerReport()
+{
+	printf("\nTexture streamer\n");
+	std::thread::id mainThread = std::this_thread::get_id();
+
+	// Placeholders, callbacks and failures
+	{
+		TextureStreamer streamer(new SyntheticTextureBackend(64, 0.1, 0.5, 1.0), 2);
+		unsigned int calls = 0;
+		bool offThread = false;
+		auto onReady = [&](ID3D11ShaderResourceView*)
+		{
+			calls++;
+			offThread = offThread || std::this_thread::get_id() != mainThread;
+		};
+
+		TextureHandle color = streamer.Load(L"color.png", TEXTURE_PLACEHOLDER_GRAY, onReady);
+		TextureHandle normal = streamer.Load(L"normal.png", TEXTURE_PLACEHOLDER_NORMAL, onReady);
+		TextureHandle sky = streamer.Load(L"sky.dds", TEXTURE_PLACEHOLDER_BLACK_CUBE, onReady);
+		TextureHandle missing = streamer.Load(L"missing.png", TEXTURE_PLACEHOLDER_GRAY, onReady);
+		TextureHandle color2 = streamer.Load(L"color2.png", TEXTURE_PLACEHOLDER_GRAY, onReady);
+
+		ID3D11ShaderResourceView* gray = streamer.GetSRV(color);
+		bool placeholdersOk = !streamer.IsReady(color) && streamer.GetSRV(color2) == gray && streamer.GetSRV(missing) == gray &&
+			streamer.GetSRV(normal) != gray && streamer.GetSRV(sky) != gray && streamer.GetSRV(sky) != streamer.GetSRV(normal);
+
+		unsigned int frames;
+		bool overBudget;
+		RunUntilLoaded(&streamer, TEXTURE_UPLOAD_BUDGET, &frames, &overBudget);
+
+		bool loadedOk = streamer.IsReady(color) && streamer.IsReady(normal) && streamer.IsReady(sky) && streamer.IsReady(color2) &&
+			streamer.GetSRV(color) != gray && streamer.GetSRV(color) != streamer.GetSRV(color2);
+		bool failedOk = streamer.IsFailed(missing) && !streamer.IsReady(missing) && streamer.GetSRV(missing) == gray &&
+			streamer.GetFailedCount() == 1;
+
+		printf("  placeholders until loaded: %s\n", CheckResult(placeholdersOk));
+		printf("  loaded textures replace them: %s\n", CheckResult(loadedOk));
+		printf("  onReady: %u calls for 4 textures, %s  %s\n", calls, offThread ? "OFF the main thread" : "all on the main thread",
+			CheckResult(calls == 4 && !offThread));
+		printf("  missing file keeps its placeholder: %s\n", CheckResult(failedOk));
+	}
+
+	// Budget: 40 textures of 256KB through a 1MB budget
+	{
+		const unsigned long long budget = 1024 * 1024;
+		TextureStreamer streamer(new SyntheticTextureBackend(256, 0.0, 0.2, 0.0), 4, budget);
+		for (int i = 0; i < 40; i++)
+			streamer.Load(L"tile" + std::to_wstring(i) + L".png", TEXTURE_PLACEHOLDER_GRAY);
+
+		// Let the workers get ahead so the budget is what limits each frame
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		unsigned int frames;
+		bool overBudget;
+		RunUntilLoaded(&streamer, budget, &frames, &overBudget);
+		printf("  40 x 256KB with a 1MB budget: %u frames, peak %lluKB per frame  %s\n", frames,
+			streamer.GetPeakFrameUploadBytes() / 1024, CheckResult(!overBudget && frames >= 10));
+	}
+
+	// A texture bigger than the budget still goes, one per frame
+	{
+		const unsigned long long budget = 64 * 1024;
+		TextureStreamer streamer(new SyntheticTextureBackend(256, 0.0, 0.2, 0.0), 2, budget);
+		for (int i = 0; i < 4; i++)
+			streamer.Load(L"big" + std::to_wstring(i) + L".png", TEXTURE_PLACEHOLDER_GRAY);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		unsigned int frames;
+		bool overBudget;
+		RunUntilLoaded(&streamer, budget, &frames, &overBudget);
+		unsigned long long single = 256 * 256 * 4;
+		printf("  4 x 256KB with a 64KB budget: %u frames, peak %lluKB per frame  %s\n", frames,
+			streamer.GetPeakFrameUploadBytes() / 1024, CheckResult(frames == 4 && streamer.GetPeakFrameUploadBytes() == single));
+	}
+
+	// One path loaded twice is one texture, until both let go
+	{
+		SyntheticTextureBackend* backend = new SyntheticTextureBackend(128, 0.0, 0.2, 0.0);
+		TextureStreamer streamer(backend, 2);
+		unsigned int calls = 0;
+		TextureHandle a = streamer.Load(L"shared.png", TEXTURE_PLACEHOLDER_GRAY, [&](ID3D11ShaderResourceView*) { calls++; });
+		TextureHandle b = streamer.Load(L"shared.png", TEXTURE_PLACEHOLDER_GRAY, [&](ID3D11ShaderResourceView*) { calls++; });
+		TextureHandle c = streamer.Load(L"other.png", TEXTURE_PLACEHOLDER_GRAY);
+
+		unsigned int frames;
+		bool overBudget;
+		RunUntilLoaded(&streamer, TEXTURE_UPLOAD_BUDGET, &frames, &overBudget);
+		unsigned int live = backend->GetLiveCount();
+		bool sharedOk = a == b && a != c && calls == 2 && live == TEXTURE_PLACEHOLDER_COUNT + 2;
+
+		// A late load of a loaded path gets its callback straight away
+		TextureHandle d = streamer.Load(L"shared.png", TEXTURE_PLACEHOLDER_GRAY, [&](ID3D11ShaderResourceView*) { calls++; });
+		bool lateOk = d == a && calls == 3;
+
+		streamer.Release(a);
+		streamer.Release(b);
+		bool keptOk = streamer.IsReady(a) && backend->GetLiveCount() == live;
+		streamer.Release(d);
+		bool freedOk = !streamer.IsReady(a) && backend->GetLiveCount() == live - 1;
+		bool reloadOk = streamer.Load(L"shared.png", TEXTURE_PLACEHOLDER_GRAY) != a;
+
+		printf("  one path, one texture: %s, late loads called back %s, kept until the last release %s, then freed %s\n",
+			CheckResult(sharedOk), CheckResult(lateOk), CheckResult(keptOk),
+			CheckResult(freedOk && reloadOk));
+	}
+
+	// Mips: out when a texture looks small, back in when it
+	// doesn't, and the least recently used out when memory is
+	// short (four 256x256 textures, room for three)
+	{
+		const unsigned int size = 256;
+		unsigned long long whole = TextureChainBytes(size, size, size * size * 4, 0);
+		TextureStreamer streamer(new SyntheticTextureBackend(size, 0.0, 0.2, 0.0), 2, TEXTURE_UPLOAD_BUDGET, whole * 3 + whole / 2);
+		unsigned int calls = 0;
+		TextureHandle t[4];
+		for (int i = 0; i < 4; i++)
+			t[i] = streamer.Load(L"mips" + std::to_wstring(i) + L".png", TEXTURE_PLACEHOLDER_GRAY,
+				[&](ID3D11ShaderResourceView*) { calls++; });
+
+		unsigned int frames;
+		bool overBudget;
+		RunUntilLoaded(&streamer, TEXTURE_UPLOAD_BUDGET, &frames, &overBudget);
+		TextureResidency& residency = streamer.GetResidency();
+		unsigned int evicted = 0;
+		for (int i = 0; i < 4; i++)
+			if (streamer.GetResidentMip(t[i]) > 0) evicted++;
+		bool lruOk = evicted == 1 && residency.GetResidentBytes() <= residency.GetBudget();
+
+		// In view from here on: one still whole texture small on
+		// screen, the rest full size
+		int small = 0;
+		while (small < 3 && streamer.GetResidentMip(t[small]) > 0) small++;
+		unsigned int before = calls;
+		ID3D11ShaderResourceView* wholeSRV = streamer.GetSRV(t[small]);
+		for (int i = 0; i < 4; i++) streamer.RequestScreenSize(t[i], i == small ? size / 8.0f : (float)size);
+		streamer.Update();
+		unsigned int tail = residency.GetTailMip(0);
+		bool outOk = streamer.GetResidentMip(t[small]) == tail && streamer.GetSRV(t[small]) != wholeSRV && calls > before;
+
+		for (int i = 0; i < 4; i++) streamer.RequestScreenSize(t[i], (float)size);
+		streamer.Update();
+		unsigned int dropped = 0;
+		for (int i = 0; i < 4; i++) dropped += streamer.GetResidentMip(t[i]);
+		bool budgetOk = dropped > 0 && residency.GetResidentBytes() <= residency.GetBudget() && residency.GetFrameDroppedMips() == dropped;
+
+		printf("  mip streaming: LRU out when short %s, out when small (mip %u) %s, in view over budget drops %u mips %s\n",
+			CheckResult(lruOk), tail, CheckResult(outOk), dropped, CheckResult(budgetOk));
+	}
+
+	// Shutting down with most of the work still queued
+	{
+		unsigned __int64 start = Profiler::Now();
+		{
+			TextureStreamer streamer(new SyntheticTextureBackend(64, 0.0, 2.0, 0.0), 2);
+			for (int i = 0; i < 500; i++)
+				streamer.Load(L"queued" + std::to_wstring(i) + L".png", TEXTURE_PLACEHOLDER_GRAY);
+		}
+		double ms = Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+		printf("  destroyed with 500 loads queued: %.1fms  %s\n", ms, CheckResult(ms < 100));
+	}
+}
+
+// --------------------------------------------------------
+// Loading everything on the main thread before the first
+// frame (what Game::Init used to do) against streaming it
+// --------------------------------------------------------
+void TextureStreamerBenchmark(unsigned int textureCount)
+{
+	const unsigned int size = 512;
+	const double readMs = 0.25, decodeMs = 2.0, uploadMsPerMB = 0.25;
+
+	// Blocking: read, decode and upload one after another
+	double blockingMs;
+	{
+		SyntheticTextureBackend backend(size, readMs, decodeMs, uploadMsPerMB);
+		unsigned __int64 start = Profiler::Now();
+		for (unsigned int i = 0; i < textureCount; i++)
+		{
+			std::vector<unsigned char> file;
+			DecodedTexture decoded;
+			backend.ReadFile(L"texture.jpg", &file);
+			backend.Decode(L"texture.jpg", file, &decoded);
+			backend.Upload(decoded, 0);
+		}
+		blockingMs = Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+	}
+
+	// Streaming: first frame right after queueing, then frames
+	// back to back until everything is in
+	double firstFrameMs, residentMs;
+	unsigned int frames = 0;
+	unsigned int threads;
+	unsigned long long peak;
+	{
+		unsigned __int64 start = Profiler::Now();
+		TextureStreamer streamer(new SyntheticTextureBackend(size, readMs, decodeMs, uploadMsPerMB), 0,
+			TEXTURE_UPLOAD_BUDGET, ~0ull);
+		for (unsigned int i = 0; i < textureCount; i++)
+			streamer.Load(L"texture" + std::to_wstring(i) + L".jpg", TEXTURE_PLACEHOLDER_GRAY);
+		streamer.Update();
+		firstFrameMs = Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+
+		frames = 1;
+		while (streamer.GetPendingCount() > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			streamer.Update();
+			frames++;
+		}
+		residentMs = Profiler::TicksToNs(Profiler::Now() - start) / 1e6;
+		peak = streamer.GetPeakFrameUploadBytes();
+		threads = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1;
+	}
+
+	printf("\nTexture loading, %u textures of %ux%u (%.2fms read, %.2fms decode each)\n",
+		textureCount, size, size, readMs, decodeMs);
+	printf("  blocking:  first frame after %.1fms\n", blockingMs);
+	printf("  streaming: first frame after %.1fms, all resident after %.1fms over %u frames (%u workers)\n",
+		firstFrameMs, residentMs, frames, threads);
+	printf("  peak upload %.1fMB in one frame (budget %.1fMB)\n", peak / (1024.0 * 1024.0),
+		TEXTURE_UPLOAD_BUDGET / (1024.0 * 1024.0));
+}
@@ -0,0 +1,260 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include "TextureResidency.h"
+
+// --------------------------------------------------------
+// Asynchronous texture loading
+//
+// - Load() returns straight away with a handle whose SRV is a
+//   1x1 placeholder
+// - A pool of worker threads reads and decodes the files
+// - Update(), once per frame on the main thread, uploads
+//   finished textures, oldest first, up to a budget of bytes
+//   per frame, then calls their onReady
+// - Loads of the same path share one texture, counted by
+//   reference, until the last Release()
+// - 2D textures are kept decoded in memory and stream mips
+//   in and out under a memory budget - TextureResidency
+//   decides from RequestScreenSize() and least recent use
+// - Files, decoding and GPU textures all go through an
+//   ITextureBackend, so the queueing and budgeting can run
+//   headless (see SyntheticTextureBackend)
+// --------------------------------------------------------
+
+// Bytes uploaded per frame before the rest waits (one texture
+// always goes, however big, so nothing waits forever)
+#define TEXTURE_UPLOAD_BUDGET (4 * 1024 * 1024)
+
+// Bytes of streamed textures resident at once
+#define TEXTURE_MEMORY_BUDGET (256ull * 1024 * 1024)
+
+enum TexturePlaceholder
+{
+	TEXTURE_PLACEHOLDER_GRAY,		// Mid gray, for color maps
+	TEXTURE_PLACEHOLDER_NORMAL,		// Flat tangent space normal
+	TEXTURE_PLACEHOLDER_BLACK_CUBE,	// Black cube map, for skies
+	TEXTURE_PLACEHOLDER_COUNT
+};
+
+// What a worker hands back to the main thread
+struct DecodedTexture
+{
+	unsigned int Width;					// 0 if a container's size isn't known
+	unsigned int Height;
+	bool Container;						// Data is a whole file the backend uploads as is (DDS)
+	std::vector<unsigned char> Data;	// RGBA8 rows, or the file
+};
+
+// --------------------------------------------------------
+// Where files and textures come from
+// --------------------------------------------------------
+class ITextureBackend
+{
+public:
+	virtual ~ITextureBackend() {}
+
+	// Worker threads - called by every worker as it starts and stops
+	virtual void WorkerStart() {}
+	virtual void WorkerStop() {}
+
+	// Worker threads - must be safe to call from several at once
+	virtual bool ReadFile(const std::wstring& path, std::vector<unsigned char>* bytes) = 0;
+	virtual bool Decode(const std::wstring& path, std::vector<unsigned char>& file, DecodedTexture* texture) = 0;
+
+	// Main thread.  Ids are -1 on failure.  Upload leaves out
+	// the levels finer than firstMip (they're streamed out).
+	virtual int CreatePlaceholder(TexturePlaceholder kind) = 0;
+	virtual int Upload(const DecodedTexture& texture, unsigned int firstMip) = 0;
+	virtual void DestroyTexture(int id) = 0;
+	virtual ID3D11ShaderResourceView* GetSRV(int id) = 0;
+};
+
+// --------------------------------------------------------
+// Files from disk, decoded with WIC (DDS files are uploaded
+// whole by DirectXTK).  Color textures get a full mip chain.
+// --------------------------------------------------------
+class D3D11TextureBackend : public ITextureBackend
+{
+public:
+	D3D11TextureBackend(ID3D11Device* device, ID3D11DeviceContext* context);
+	~D3D11TextureBackend();
+
+	void WorkerStart();
+	void WorkerStop();
+	bool ReadFile(const std::wstring& path, std::vector<unsigned char>* bytes);
+	bool Decode(const std::wstring& path, std::vector<unsigned char>& file, DecodedTexture* texture);
+
+	int CreatePlaceholder(TexturePlaceholder kind);
+	int Upload(const DecodedTexture& texture, unsigned int firstMip);
+	void DestroyTexture(int id);
+	ID3D11ShaderResourceView* GetSRV(int id);
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	std::vector<ID3D11ShaderResourceView*> srvs;
+	std::vector<int> freeIDs;
+
+	int AddSRV(ID3D11ShaderResourceView* srv);
+};
+
+// --------------------------------------------------------
+// No files and no GPU - every path "decodes" to a square
+// texture after a set amount of busy work.  SRVs are made up
+// ids (never dereference them).  Used to test and time the
+// streamer without a device.
+// --------------------------------------------------------
+class SyntheticTextureBackend : public ITextureBackend
+{
+public:
+	// Paths containing "missing" fail to read
+	SyntheticTextureBackend(unsigned int size, double readMs, double decodeMs, double uploadMsPerMB);
+
+	bool ReadFile(const std::wstring& path, std::vector<unsigned char>* bytes);
+	bool Decode(const std::wstring& path, std::vector<unsigned char>& file, DecodedTexture* texture);
+
+	int CreatePlaceholder(TexturePlaceholder kind);
+	int Upload(const DecodedTexture& texture, unsigned int firstMip);
+	void DestroyTexture(int id) { liveCount--; }
+	ID3D11ShaderResourceView* GetSRV(int id) { return (ID3D11ShaderResourceView*)(size_t)(id + 1); }
+
+	unsigned int GetLiveCount() { return liveCount; }
+
+private:
+	unsigned int size;
+	double readMs;
+	double decodeMs;
+	double uploadMsPerMB;
+	int nextID;
+	unsigned int liveCount;
+};
+
+typedef int TextureHandle;
+#define TEXTURE_INVALID_HANDLE -1
+
+// --------------------------------------------------------
+// The streamer itself
+// --------------------------------------------------------
+class TextureStreamer
+{
+public:
+	// Takes ownership of the backend.  threadCount 0 = one per
+	// core, less the main thread.
+	TextureStreamer(ITextureBackend* backend, unsigned int threadCount = 0,
+		unsigned long long uploadBudget = TEXTURE_UPLOAD_BUDGET,
+		unsigned long long memoryBudget = TEXTURE_MEMORY_BUDGET);
+	~TextureStreamer();
+
+	// Starts loading a file, or adds a reference to it if it's
+	// already loaded or loading.  Until it's uploaded, GetSRV
+	// gives the placeholder.  onReady is called from Update
+	// with the real SRV, and again each time streaming changes
+	// it (never if the load fails).
+	TextureHandle Load(const std::wstring& path, TexturePlaceholder placeholder,
+		std::function<void(ID3D11ShaderResourceView*)> onReady = nullptr);
+
+	// Drops a reference.  The last one frees the texture, and
+	// its onReady callbacks.  Handles aren't used again.
+	void Release(TextureHandle texture);
+
+	// The texture covers this many pixels on screen this frame
+	// (the largest of several calls counts).  Textures nobody
+	// asks about keep what they have until memory runs short.
+	void RequestScreenSize(TextureHandle texture, float screenPixels);
+
+	// Main thread, once per frame: uploads finished loads,
+	// then streams mips in and out
+	void Update();
+
+	ID3D11ShaderResourceView* GetSRV(TextureHandle texture);
+	bool IsReady(TextureHandle texture) { return textures[texture].BackendID >= 0; }
+	bool IsFailed(TextureHandle texture) { return textures[texture].Failed; }
+
+	void SetUploadBudget(unsigned long long bytes) { uploadBudget = bytes; }
+	void SetMemoryBudget(unsigned long long bytes) { residency.SetBudget(bytes); }
+
+	// Finest mip on the GPU, 0 for textures that don't stream
+	unsigned int GetResidentMip(TextureHandle texture);
+	TextureResidency& GetResidency() { return residency; }
+
+	// Stats
+	unsigned int GetPendingCount() { return pendingCount; }				// Not uploaded or failed yet
+	unsigned int GetFailedCount() { return failedCount; }
+	unsigned long long GetFrameUploadBytes() { return frameUploadBytes; }	// Last Update
+	unsigned long long GetPeakFrameUploadBytes() { return peakFrameUploadBytes; }
+	double GetReadMs();		// Summed over all workers
+	double GetDecodeMs();
+	double GetUploadMs() { return uploadNs / 1e6; }
+
+private:
+	struct Texture
+	{
+		std::wstring Path;
+		TexturePlaceholder Placeholder;
+		std::vector<std::function<void(ID3D11ShaderResourceView*)>> OnReady;
+		unsigned int RefCount;
+		int BackendID;		// -1 until uploaded
+		bool Failed;
+		int Residency;		// TextureResidency id, -1 if it doesn't stream
+		DecodedTexture Source;	// Kept to stream mips back in
+	};
+
+	struct Job
+	{
+		TextureHandle Texture;
+		std::wstring Path;
+	};
+
+	// A worker's result, waiting for the main thread
+	struct Finished
+	{
+		TextureHandle Texture;
+		bool Ok;
+		DecodedTexture Decoded;
+	};
+
+	ITextureBackend* backend;
+	std::vector<Texture> textures;
+	std::unordered_map<std::wstring, TextureHandle> byPath;
+	int placeholders[TEXTURE_PLACEHOLDER_COUNT];
+
+	TextureResidency residency;
+	std::vector<TextureHandle> residencyOwner;	// Handle of each residency id
+	std::vector<TextureMipChange> mipChanges;
+
+	// Worker side, guarded by lock
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	std::deque<Finished> finished;
+	bool stopping;
+	double readNs;
+	double decodeNs;
+	std::vector<std::thread> workers;
+
+	unsigned long long uploadBudget;
+	unsigned int pendingCount;
+	unsigned int failedCount;
+	unsigned long long frameUploadBytes;
+	unsigned long long peakFrameUploadBytes;
+	double uploadNs;
+
+	void WorkerLoop();
+	bool Upload(TextureHandle texture, const DecodedTexture& decoded, unsigned int firstMip);
+};
+
+// Checks placeholders, the per frame budget, callbacks, failed
+// loads, shared paths and mip streaming, and prints the results
+void TextureStreamerReport();
+
+// Time to first frame and until everything is resident for
+// textureCount textures, loading them all up front vs streaming
+void TextureStreamerBenchmark(unsigned int textureCount);
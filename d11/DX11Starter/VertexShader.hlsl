@@ -78,7 +78,10 @@ VertexToPixel main( VertexShaderInput input )
 	//
 	// The result is essentially the position (XY) of the vertex on our 2D 
 	// screen and the distance (Z) from the camera (the "depth" of the pixel)
-	output.position = mul(float4(input.position, 1.0f), worldViewProj);
+	//precise: DepthOnlyVS must produce the exact same value for
+	//the EQUAL depth test after the pre-pass
+	precise float4 position = mul(float4(input.position, 1.0f), worldViewProj);
+	output.position = position;
 
 	output.worldPos = mul(float4(input.position, 1.0f), world).xyz;
 
@@ -0,0 +1,22 @@
+// Struct representing the data we expect to receive from earlier pipeline stages
+// - Should match the output of our corresponding vertex shader
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv           : TEXCOORD;
+	float3 normal       : NORMAL;
+	float3 tangent      : TANGENT;
+	float3 worldPos     : POSITION;
+	float depth         : DEPTH;        //depth in view space
+};
+
+#include "VirtualTexture.hlsli"
+
+// --------------------------------------------------------
+// The virtual texture page each pixel wants, into the small
+// R32_UINT feedback target (0 where nothing is drawn)
+// --------------------------------------------------------
+uint main(VertexToPixel input) : SV_TARGET
+{
+	return VirtualFeedback(input.uv);
+}
@@ -0,0 +1,63 @@
+//virtual texture sampling and feedback
+//(see VirtualTextureCache.h for pages, slots and the page table)
+#ifndef VIRTUAL_TEXTURE
+#define VIRTUAL_TEXTURE
+
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4
+#define VT_TILE_STRIDE 136
+
+cbuffer virtualTextureData : register(b3)
+{
+	float2 vtTiles;          //mip 0 size in pages
+	float2 vtPhysicalSize;   //cache texture size in texels
+	float vtMipCount;
+	float vtFeedbackBias;    //-log2(divisor) in the feedback pass, 0 otherwise
+};
+
+Texture2D<uint4> VirtualPageTable : register(t9);   //VT_PAGE_TABLE_SLOT
+Texture2D VirtualPhysical : register(t10);          //VT_PHYSICAL_SLOT
+SamplerState VirtualSampler : register(s3);
+
+//mip the hardware would pick if the whole texture were resident
+float VirtualMip(float2 uv)
+{
+	float2 dx = ddx(uv) * vtTiles * VT_TILE_SIZE;
+	float2 dy = ddy(uv) * vtTiles * VT_TILE_SIZE;
+	return 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+}
+
+//size of a mip in pages
+float2 VirtualTiles(uint mip)
+{
+	return max(floor(vtTiles / exp2(mip)), 1);
+}
+
+//the page this pixel wants, packed like VTPackPage
+uint VirtualFeedback(float2 uv)
+{
+	uint mip = (uint)clamp(VirtualMip(uv) + vtFeedbackBias, 0, vtMipCount - 1);
+	float2 tiles = VirtualTiles(mip);
+	uint2 page = (uint2)clamp(uv * tiles, 0, tiles - 1);
+	return 0x80000000 | (mip << 26) | (page.y << 13) | page.x;
+}
+
+//the finest resident page covering uv, bilinear inside it
+//(the page border covers the filter at its edges)
+float4 VirtualSample(float2 uv)
+{
+	uint mip = (uint)clamp(VirtualMip(uv), 0, vtMipCount - 1);
+	float2 tiles = VirtualTiles(mip);
+	uint4 entry = VirtualPageTable.Load(int3(clamp(uv * tiles, 0, tiles - 1), mip));
+	if (entry.a == 0)
+		return float4(0.5, 0.5, 0.5, 1);    //nothing loaded yet
+
+	//the resident page may be coarser than the one we wanted
+	float2 residentTiles = VirtualTiles(entry.z);
+	float2 pagePos = clamp(uv * residentTiles, 0, residentTiles);
+	float2 inPage = pagePos - min(floor(pagePos), residentTiles - 1);
+	float2 texel = entry.xy * VT_TILE_STRIDE + VT_TILE_BORDER + inPage * VT_TILE_SIZE;
+	return VirtualPhysical.SampleLevel(VirtualSampler, texel / vtPhysicalSize, 0);
+}
+
+#endif
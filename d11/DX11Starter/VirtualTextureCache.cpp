@@ -0,0 +1,831 @@
+#include "VirtualTextureCache.h"
+#include "Check.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// --------------------------------------------------------
+// Layout
+// --------------------------------------------------------
+VTLayout VTMakeLayout(unsigned int tilesX, unsigned int tilesY)
+{
+	VTLayout layout = { tilesX, tilesY, 1 };
+	while ((std::max(tilesX, tilesY) >> (layout.MipCount - 1)) > 1)
+		layout.MipCount++;
+	return layout;
+}
+
+unsigned int VTLayout::PageCount() const
+{
+	unsigned int count = 0;
+	for (unsigned int m = 0; m < MipCount; m++)
+		count += MipTilesX(m) * MipTilesY(m);
+	return count;
+}
+
+unsigned int VTLayout::PageIndex(unsigned int page) const
+{
+	unsigned int mip = VTPageMip(page);
+	unsigned int index = 0;
+	for (unsigned int m = 0; m < mip; m++)
+		index += MipTilesX(m) * MipTilesY(m);
+	return index + VTPageY(page) * MipTilesX(mip) + VTPageX(page);
+}
+
+// --------------------------------------------------------
+// ProceduralTileSource
+// --------------------------------------------------------
+ProceduralTileSource::ProceduralTileSource(unsigned int tilesX, unsigned int tilesY, unsigned int seed)
+{
+	layout = VTMakeLayout(tilesX, tilesY);
+	this->seed = seed;
+}
+
+static float Hash(int x, int y, unsigned int seed)
+{
+	unsigned int h = (unsigned int)x * 374761393u + (unsigned int)y * 668265263u + seed * 2246822519u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return ((h ^ (h >> 16)) & 0xffff) / 65535.0f;
+}
+
+static float ValueNoise(float x, float y, unsigned int seed)
+{
+	float fx = floorf(x), fy = floorf(y);
+	int ix = (int)fx, iy = (int)fy;
+	fx = x - fx;
+	fy = y - fy;
+	fx = fx * fx * (3 - 2 * fx);
+	fy = fy * fy * (3 - 2 * fy);
+	float a = Hash(ix, iy, seed), b = Hash(ix + 1, iy, seed);
+	float c = Hash(ix, iy + 1, seed), d = Hash(ix + 1, iy + 1, seed);
+	return a + (b - a) * fx + (c - a) * fy + (a - b - c + d) * fx * fy;
+}
+
+static float SmoothStep(float edge0, float edge1, float x)
+{
+	float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+	return t * t * (3 - 2 * t);
+}
+
+// Largest features are this many mip 0 texels across
+#define TERRAIN_FEATURE_SIZE 8192.0f
+#define TERRAIN_OCTAVES 13
+
+bool ProceduralTileSource::ReadTile(unsigned int page, std::vector<unsigned char>* texels)
+{
+	unsigned int mip = VTPageMip(page);
+	if (mip >= layout.MipCount)
+		return false;
+	float scale = (float)(1 << mip);
+
+	// Octaves whose wavelength is under two texels of this mip
+	// would only alias
+	int octaves = 0;
+	while (octaves < TERRAIN_OCTAVES && TERRAIN_FEATURE_SIZE / (1 << octaves) >= 2 * scale)
+		octaves++;
+
+	texels->resize(VT_TILE_STRIDE * VT_TILE_STRIDE * 4);
+	unsigned char* out = texels->data();
+	for (int py = 0; py < VT_TILE_STRIDE; py++)
+	{
+		for (int px = 0; px < VT_TILE_STRIDE; px++, out += 4)
+		{
+			// Position in mip 0 texels
+			float vx = ((int)(VTPageX(page) * VT_TILE_SIZE) + px - VT_TILE_BORDER + 0.5f) * scale;
+			float vy = ((int)(VTPageY(page) * VT_TILE_SIZE) + py - VT_TILE_BORDER + 0.5f) * scale;
+
+			// Broad shapes pick the band, the rest shades it
+			float height = 0, detail = 0, amplitude = 0.5f;
+			float frequency = 1.0f / TERRAIN_FEATURE_SIZE;
+			for (int o = 0; o < octaves; o++, amplitude *= 0.5f, frequency *= 2)
+			{
+				float n = ValueNoise(vx * frequency, vy * frequency, seed + o) * amplitude;
+				if (o < 5) height += n;
+				else detail += n;
+			}
+			if (octaves <= 5) detail = 0.03f;	// The average of what's left out
+
+			const float grass[3] = { 70, 100, 40 };
+			const float dirt[3] = { 115, 90, 60 };
+			const float rock[3] = { 120, 115, 110 };
+			const float snow[3] = { 235, 235, 240 };
+			float toDirt = SmoothStep(0.40f, 0.46f, height);
+			float toRock = SmoothStep(0.55f, 0.62f, height);
+			float toSnow = SmoothStep(0.72f, 0.76f, height);
+			float shade = 0.75f + detail * 8.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				float v = grass[c] + (dirt[c] - grass[c]) * toDirt;
+				v += (rock[c] - v) * toRock;
+				v += (snow[c] - v) * toSnow;
+				out[c] = (unsigned char)std::min(std::max(v * shade, 0.0f), 255.0f);
+			}
+			out[3] = 255;
+		}
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// VirtualTextureFile
+// --------------------------------------------------------
+VirtualTextureFile::VirtualTextureFile()
+{
+	layout = VTMakeLayout(1, 1);
+}
+
+bool VirtualTextureFile::Open(const std::string& path)
+{
+	file.open(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	VTFileHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+		header.Magic != VT_FILE_MAGIC ||
+		header.TileSize != VT_TILE_SIZE ||
+		header.Border != VT_TILE_BORDER ||
+		header.Format != 0)
+		return false;
+
+	layout = VTMakeLayout(header.TilesX, header.TilesY);
+	if (layout.MipCount != header.MipCount || layout.PageCount() != header.PageCount)
+		return false;
+
+	table.resize(header.PageCount);
+	return (bool)file.read((char*)table.data(), table.size() * sizeof(Entry));
+}
+
+bool VirtualTextureFile::ReadTile(unsigned int page, std::vector<unsigned char>* texels)
+{
+	unsigned int index = layout.PageIndex(page);
+	if (VTPageMip(page) >= layout.MipCount || index >= table.size() ||
+		table[index].Bytes != VT_TILE_STRIDE * VT_TILE_STRIDE * 4)
+		return false;
+
+	texels->resize(table[index].Bytes);
+	std::lock_guard<std::mutex> guard(lock);
+	file.clear();
+	file.seekg((std::streamoff)table[index].Offset);
+	return (bool)file.read((char*)texels->data(), table[index].Bytes);
+}
+
+bool VirtualTextureFile::Write(const std::string& path, IVirtualTileSource* source)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+		return false;
+
+	VTLayout layout = source->GetLayout();
+	VTFileHeader header = { VT_FILE_MAGIC, VT_TILE_SIZE, VT_TILE_BORDER,
+		layout.TilesX, layout.TilesY, layout.MipCount, layout.PageCount(), 0 };
+	out.write((const char*)&header, sizeof(header));
+
+	const unsigned int tileBytes = VT_TILE_STRIDE * VT_TILE_STRIDE * 4;
+	unsigned long long offset = sizeof(header) + (unsigned long long)header.PageCount * sizeof(Entry);
+	for (unsigned int i = 0; i < header.PageCount; i++, offset += tileBytes)
+	{
+		Entry entry = { offset, tileBytes, 0 };
+		out.write((const char*)&entry, sizeof(entry));
+	}
+
+	std::vector<unsigned char> texels;
+	for (unsigned int m = 0; m < layout.MipCount; m++)
+		for (unsigned int y = 0; y < layout.MipTilesY(m); y++)
+			for (unsigned int x = 0; x < layout.MipTilesX(m); x++)
+			{
+				if (!source->ReadTile(VTPackPage(m, x, y), &texels) || texels.size() != tileBytes)
+					return false;
+				out.write((const char*)texels.data(), tileBytes);
+			}
+	return (bool)out;
+}
+
+// --------------------------------------------------------
+// VirtualTileLoader
+// --------------------------------------------------------
+VirtualTileLoader::VirtualTileLoader(IVirtualTileSource* source, unsigned int threadCount)
+{
+	this->source = source;
+	busy = 0;
+	stopping = false;
+
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back(&VirtualTileLoader::WorkerLoop, this);
+}
+
+VirtualTileLoader::~VirtualTileLoader()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& w : workers)
+		w.join();
+}
+
+void VirtualTileLoader::Request(const std::vector<unsigned int>& pages)
+{
+	if (pages.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.insert(jobs.end(), pages.begin(), pages.end());
+	}
+	wake.notify_all();
+}
+
+void VirtualTileLoader::Collect(unsigned int maxTiles, std::vector<VirtualTile>* tiles)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	for (unsigned int i = 0; i < maxTiles && !finished.empty(); i++)
+	{
+		tiles->push_back(std::move(finished.front()));
+		finished.pop_front();
+	}
+}
+
+void VirtualTileLoader::WaitIdle()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return jobs.empty() && busy == 0; });
+}
+
+void VirtualTileLoader::WorkerLoop()
+{
+	for (;;)
+	{
+		VirtualTile tile;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this]() { return stopping || !jobs.empty(); });
+			if (stopping) break;
+			tile.Page = jobs.front();
+			jobs.pop_front();
+			busy++;
+		}
+
+		tile.Ok = source->ReadTile(tile.Page, &tile.Texels);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			finished.push_back(std::move(tile));
+			busy--;
+		}
+		idle.notify_all();
+	}
+}
+
+// --------------------------------------------------------
+// VirtualTextureCache
+// --------------------------------------------------------
+#define PAGE_ENTRY_RESIDENT 0xff000000u
+
+VirtualTextureCache::VirtualTextureCache(const VTLayout& layout, unsigned int slotsX, unsigned int slotsY, unsigned int pinnedMips)
+{
+	this->layout = layout;
+	this->slotsX = slotsX;
+	this->slotsY = slotsY;
+	firstPinnedMip = layout.MipCount - std::min(pinnedMips, layout.MipCount);
+	frame = 0;
+	frameRequested = frameMissing = 0;
+	evictionCount = droppedCount = 0;
+
+	slots.resize(slotsX * slotsY);
+	for (int s = (int)slots.size() - 1; s >= 0; s--)
+	{
+		slots[s].Page = VT_PAGE_NONE;
+		slots[s].LastUsed = 0;
+		slots[s].Pinned = false;
+		freeSlots.push_back(s);
+	}
+
+	pageTable.resize(layout.MipCount);
+	dirty.resize(layout.MipCount);
+	for (unsigned int m = 0; m < layout.MipCount; m++)
+		pageTable[m].assign(layout.MipTilesX(m) * layout.MipTilesY(m), 0);
+	ClearDirty();
+}
+
+void VirtualTextureCache::RequestPinnedPages(std::vector<unsigned int>* requests)
+{
+	for (unsigned int m = layout.MipCount; m-- > firstPinnedMip; )
+		for (unsigned int y = 0; y < layout.MipTilesY(m); y++)
+			for (unsigned int x = 0; x < layout.MipTilesX(m); x++)
+			{
+				unsigned int page = VTPackPage(m, x, y);
+				if (!IsResident(page) && pending.insert(page).second)
+					requests->push_back(page);
+			}
+}
+
+void VirtualTextureCache::Touch(int slot)
+{
+	slots[slot].LastUsed = frame;
+	if (!slots[slot].Pinned)
+		lru.splice(lru.begin(), lru, slots[slot].Lru);
+}
+
+void VirtualTextureCache::ProcessFeedback(const unsigned int* feedback, unsigned int count, std::vector<unsigned int>* requests)
+{
+	frame++;
+
+	// Distinct pages, dropping anything out of range
+	scratch.clear();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int page = feedback[i];
+		unsigned int mip = VTPageMip(page);
+		if (page == VT_PAGE_NONE || mip >= layout.MipCount ||
+			VTPageX(page) >= layout.MipTilesX(mip) || VTPageY(page) >= layout.MipTilesY(mip))
+			continue;
+		scratch.push_back(page);
+	}
+	std::sort(scratch.begin(), scratch.end());
+	scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+
+	frameRequested = (unsigned int)scratch.size();
+	frameMissing = 0;
+	for (unsigned int page : scratch)
+		if (!IsResident(page)) frameMissing++;
+
+	// Parents too - they're what shows while a page loads, and
+	// what a page falls back to once it's evicted
+	size_t direct = scratch.size();
+	for (size_t i = 0; i < direct; i++)
+	{
+		unsigned int page = scratch[i];
+		unsigned int x = VTPageX(page), y = VTPageY(page);
+		for (unsigned int m = VTPageMip(page) + 1; m < layout.MipCount; m++)
+			scratch.push_back(VTPackPage(m, x >>= 1, y >>= 1));
+	}
+	std::sort(scratch.begin(), scratch.end());
+	scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+
+	std::vector<unsigned int> missing;
+	for (unsigned int page : scratch)
+	{
+		auto found = slotOfPage.find(page);
+		if (found != slotOfPage.end())
+			Touch(found->second);
+		else if (!pending.count(page))
+			missing.push_back(page);
+	}
+
+	// Coarse pages first: they cover the most screen and make
+	// every finer page's wait look better
+	std::stable_sort(missing.begin(), missing.end(),
+		[](unsigned int a, unsigned int b) { return VTPageMip(a) > VTPageMip(b); });
+	for (unsigned int page : missing)
+	{
+		if (pending.size() >= VT_MAX_PENDING)
+			break;
+		pending.insert(page);
+		requests->push_back(page);
+	}
+}
+
+int VirtualTextureCache::Map(unsigned int page, unsigned int* evicted)
+{
+	*evicted = VT_PAGE_NONE;
+	pending.erase(page);
+
+	auto found = slotOfPage.find(page);
+	if (found != slotOfPage.end())
+		return found->second;
+
+	bool pinned = VTPageMip(page) >= firstPinnedMip;
+	int slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		// Least recently used - unless that's still in use this
+		// frame, in which case every slot is and nothing can go
+		if (lru.empty() || (slots[lru.back()].LastUsed == frame && !pinned))
+		{
+			droppedCount++;
+			return -1;
+		}
+		slot = lru.back();
+		lru.pop_back();
+
+		*evicted = slots[slot].Page;
+		SetSubtree(*evicted, 0, true);
+		slotOfPage.erase(*evicted);
+		evictionCount++;
+	}
+
+	slots[slot].Page = page;
+	slots[slot].LastUsed = frame;
+	slots[slot].Pinned = pinned;
+	if (!pinned)
+	{
+		lru.push_front(slot);
+		slots[slot].Lru = lru.begin();
+	}
+	slotOfPage[page] = slot;
+
+	unsigned int entry = (slot % slotsX) | (slot / slotsX) << 8 | VTPageMip(page) << 16 | PAGE_ENTRY_RESIDENT;
+	SetSubtree(page, entry, false);
+	return slot;
+}
+
+void VirtualTextureCache::Cancel(unsigned int page)
+{
+	pending.erase(page);
+}
+
+// --------------------------------------------------------
+// Fixes up every entry under a page, in its own mip and all
+// the finer ones:
+// - Mapping: entries showing a coarser page (or nothing) now
+//   show this one
+// - Evicting: entries showing this page go back to whatever
+//   its parent's entry shows
+// Entries showing a finer resident page are left alone.
+// --------------------------------------------------------
+void VirtualTextureCache::SetSubtree(unsigned int page, unsigned int entry, bool evicting)
+{
+	unsigned int mip = VTPageMip(page);
+	unsigned int x = VTPageX(page), y = VTPageY(page);
+	if (evicting)
+		entry = mip + 1 < layout.MipCount ?
+			pageTable[mip + 1][(y >> 1) * layout.MipTilesX(mip + 1) + (x >> 1)] : 0;
+
+	for (unsigned int k = mip + 1; k-- > 0; )
+	{
+		unsigned int shift = mip - k;
+		unsigned int width = layout.MipTilesX(k);
+		unsigned int x0 = x << shift, x1 = std::min((x + 1) << shift, width);
+		unsigned int y0 = y << shift, y1 = std::min((y + 1) << shift, layout.MipTilesY(k));
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+
+		for (unsigned int ty = y0; ty < y1; ty++)
+		{
+			unsigned int* row = &pageTable[k][ty * width];
+			for (unsigned int tx = x0; tx < x1; tx++)
+			{
+				bool resident = (row[tx] & PAGE_ENTRY_RESIDENT) != 0;
+				unsigned int shown = (row[tx] >> 16) & 0xff;
+				if (evicting ? (resident && shown == mip) : (!resident || shown >= mip))
+					row[tx] = entry;
+			}
+		}
+
+		VTRect& d = dirty[k];
+		d.X0 = std::min(d.X0, x0);
+		d.Y0 = std::min(d.Y0, y0);
+		d.X1 = std::max(d.X1, x1);
+		d.Y1 = std::max(d.Y1, y1);
+	}
+}
+
+bool VirtualTextureCache::GetDirtyRect(unsigned int mip, VTRect* rect)
+{
+	*rect = dirty[mip];
+	return rect->X0 < rect->X1;
+}
+
+void VirtualTextureCache::ClearDirty()
+{
+	for (auto& d : dirty)
+		d = { ~0u, ~0u, 0, 0 };
+}
+
+// --------------------------------------------------------
+// Recorded feedback
+// --------------------------------------------------------
+#define VT_FEEDBACK_MAGIC 0x42465456	// "VTFB"
+
+bool VTAppendFeedback(const std::string& path, const VTFeedbackFrame& frame)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::app);
+	if (!out)
+		return false;
+	if (out.tellp() == 0)
+	{
+		unsigned int magic = VT_FEEDBACK_MAGIC;
+		out.write((const char*)&magic, sizeof(magic));
+	}
+	out.write((const char*)&frame.Width, sizeof(frame.Width));
+	out.write((const char*)&frame.Height, sizeof(frame.Height));
+	out.write((const char*)frame.Pages.data(), frame.Pages.size() * sizeof(unsigned int));
+	return (bool)out;
+}
+
+bool VTLoadFeedback(const std::string& path, std::vector<VTFeedbackFrame>* frames)
+{
+	std::ifstream in(path, std::ios::binary);
+	unsigned int magic = 0;
+	if (!in.read((char*)&magic, sizeof(magic)) || magic != VT_FEEDBACK_MAGIC)
+		return false;
+
+	VTFeedbackFrame frame;
+	while (in.read((char*)&frame.Width, sizeof(frame.Width)) && in.read((char*)&frame.Height, sizeof(frame.Height)))
+	{
+		frame.Pages.resize((size_t)frame.Width * frame.Height);
+		if (!in.read((char*)frame.Pages.data(), frame.Pages.size() * sizeof(unsigned int)))
+			return false;
+		frames->push_back(frame);
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// Report helpers
+// --------------------------------------------------------
+
+// Every texel holds its page, so misplaced tiles show
+class PageIDTileSource : public IVirtualTileSource
+{
+public:
+	PageIDTileSource(const VTLayout& layout) { this->layout = layout; }
+	VTLayout GetLayout() { return layout; }
+	bool ReadTile(unsigned int page, std::vector<unsigned char>* texels)
+	{
+		texels->resize(VT_TILE_STRIDE * VT_TILE_STRIDE * 4);
+		for (size_t i = 0; i < texels->size(); i += 4)
+			memcpy(&(*texels)[i], &page, 4);
+		return true;
+	}
+
+private:
+	VTLayout layout;
+};
+
+// What the feedback pass would write for a camera flying low
+// over a 150x150 ground plane (the game's ground), one sample
+// every 16 pixels of a 1280x720 screen
+static void MakeFlyoverFeedback(const VTLayout& layout, unsigned int frameIndex, unsigned int frameCount, VTFeedbackFrame* frame)
+{
+	const unsigned int screenW = 1280, screenH = 720, step = 16;
+	const float planeSize = 150.0f, height = 6.0f, pitch = 0.45f;
+	const float tanY = tanf(0.5f * 3.14159265f / 3.0f), tanX = tanY * screenW / screenH;
+
+	// Along a curve for most of the recording, then still
+	float t = std::min(frameIndex / (frameCount * 0.85f), 1.0f);
+	float camX = -50 + 100 * t, camZ = -40 + 30 * sinf(3.14159265f * t);
+	float yaw = atan2f(100.0f, 30 * 3.14159265f * cosf(3.14159265f * t));
+
+	float forward[3] = { cosf(pitch) * sinf(yaw), -sinf(pitch), cosf(pitch) * cosf(yaw) };
+	float right[3] = { cosf(yaw), 0, -sinf(yaw) };
+	float up[3] = { sinf(pitch) * sinf(yaw), cosf(pitch), sinf(pitch) * cosf(yaw) };
+
+	// uv where the ray through a screen position meets the plane
+	auto hit = [&](float px, float py, float* u, float* v)
+	{
+		float sx = (px / screenW * 2 - 1) * tanX, sy = (1 - py / screenH * 2) * tanY;
+		float dir[3];
+		for (int c = 0; c < 3; c++) dir[c] = forward[c] + right[c] * sx + up[c] * sy;
+		if (dir[1] > -1e-4f) return false;
+		float dist = height / -dir[1];
+		*u = (camX + dir[0] * dist) / planeSize + 0.5f;
+		*v = (camZ + dir[2] * dist) / planeSize + 0.5f;
+		return true;
+	};
+
+	frame->Width = screenW / step;
+	frame->Height = screenH / step;
+	frame->Pages.assign(frame->Width * frame->Height, VT_PAGE_NONE);
+	float texels = (float)(layout.TilesX * VT_TILE_SIZE);
+	for (unsigned int y = 0; y < frame->Height; y++)
+	{
+		for (unsigned int x = 0; x < frame->Width; x++)
+		{
+			float px = x * step + step * 0.5f, py = y * step + step * 0.5f;
+			float u, v, ux, vx, uy, vy;
+			if (!hit(px, py, &u, &v) || !hit(px + 1, py, &ux, &vx) || !hit(px, py + 1, &uy, &vy) ||
+				u < 0 || u >= 1 || v < 0 || v >= 1)
+				continue;
+
+			// Same mip choice as VirtualMip in VirtualTexture.hlsli
+			float dx = ((ux - u) * (ux - u) + (vx - v) * (vx - v)) * texels * texels;
+			float dy = ((uy - u) * (uy - u) + (vy - v) * (vy - v)) * texels * texels;
+			float mip = 0.5f * log2f(std::max(std::max(dx, dy), 1e-8f));
+			unsigned int m = (unsigned int)std::min(std::max(mip, 0.0f), (float)(layout.MipCount - 1));
+			frame->Pages[y * frame->Width + x] = VTPackPage(m,
+				(unsigned int)(u * layout.MipTilesX(m)), (unsigned int)(v * layout.MipTilesY(m)));
+		}
+	}
+}
+
+// The page table as it should be, rebuilt from scratch:
+// the page's own slot if it's resident, otherwise its parent's
+// entry
+static bool PageTableMatches(VirtualTextureCache* cache, const std::unordered_map<unsigned int, int>& resident)
+{
+	const VTLayout& layout = cache->GetLayout();
+	std::vector<unsigned int> parent, current;
+	for (unsigned int m = layout.MipCount; m-- > 0; )
+	{
+		unsigned int w = layout.MipTilesX(m), h = layout.MipTilesY(m);
+		current.assign(w * h, 0);
+		for (unsigned int y = 0; y < h; y++)
+			for (unsigned int x = 0; x < w; x++)
+			{
+				auto found = resident.find(VTPackPage(m, x, y));
+				if (found != resident.end())
+					current[y * w + x] = (found->second % cache->GetSlotsX()) |
+						(found->second / cache->GetSlotsX()) << 8 | m << 16 | PAGE_ENTRY_RESIDENT;
+				else if (m + 1 < layout.MipCount)
+					current[y * w + x] = parent[(y >> 1) * layout.MipTilesX(m + 1) + (x >> 1)];
+			}
+		if (memcmp(current.data(), cache->GetPageTable(m), current.size() * sizeof(unsigned int)) != 0)
+			return false;
+		parent.swap(current);
+	}
+	return true;
+}
+
+void VirtualTextureReport()
+{
+	printf("\nVirtual texturing\n");
+
+	// Layout
+	{
+		VTLayout layout = VTMakeLayout(512, 512);
+		bool ok = layout.MipCount == 10 && layout.PageCount() == 349525 &&
+			layout.PageIndex(VTPackPage(9, 0, 0)) == 349524 && layout.PageIndex(VTPackPage(1, 0, 0)) == 512 * 512;
+		printf("  512x512 pages: %u mips, %u pages  %s\n", layout.MipCount, layout.PageCount(), CheckResult(ok));
+	}
+
+	// Tile file round trip, and borders that repeat the
+	// neighbouring page
+	{
+		const char* path = "vt_report.vtex";
+		ProceduralTileSource source(4, 4, 7);
+		std::vector<unsigned char> a, b;
+		bool ok = VirtualTextureFile::Write(path, &source);
+		{
+			// Closed again before the remove
+			VirtualTextureFile file;
+			ok = ok && file.Open(path) && file.GetLayout().MipCount == 3;
+			for (unsigned int m = 0; ok && m < 3; m++)
+				for (unsigned int y = 0; y < (4u >> m); y++)
+					for (unsigned int x = 0; x < (4u >> m); x++)
+						ok = ok && source.ReadTile(VTPackPage(m, x, y), &a) && file.ReadTile(VTPackPage(m, x, y), &b) && a == b;
+		}
+
+		bool borders = source.ReadTile(VTPackPage(0, 0, 0), &a) && source.ReadTile(VTPackPage(0, 1, 0), &b);
+		for (int y = 0; borders && y < VT_TILE_STRIDE; y++)
+			for (int i = 0; i < VT_TILE_BORDER * 2; i++)
+				borders = borders && memcmp(&a[(y * VT_TILE_STRIDE + VT_TILE_SIZE + i) * 4], &b[(y * VT_TILE_STRIDE + i) * 4], 4) == 0;
+		remove(path);
+		printf("  tile file round trip (21 pages)  %s, borders match neighbours  %s\n",
+			CheckResult(ok), CheckResult(borders));
+	}
+
+	// Record a fly-over, then replay it from the file
+	const unsigned int frameCount = 240;
+	VTLayout layout = VTMakeLayout(128, 128);
+	std::vector<VTFeedbackFrame> frames;
+	{
+		const char* path = "vt_report_feedback.bin";
+		remove(path);
+		VTFeedbackFrame frame;
+		bool ok = true;
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			MakeFlyoverFeedback(layout, f, frameCount, &frame);
+			ok = ok && VTAppendFeedback(path, frame);
+		}
+		ok = ok && VTLoadFeedback(path, &frames) && frames.size() == frameCount && frames.back().Pages == frame.Pages;
+		remove(path);
+		printf("  recorded %u feedback frames (%ux%u)  %s\n", (unsigned int)frames.size(), frame.Width, frame.Height, CheckResult(ok));
+		if (!ok)
+			return;
+	}
+
+	// Replay with loads landing two frames after they're asked
+	// for, checking everything the cache promises every frame
+	{
+		const unsigned int slotsSide = 16, pinnedMips = 3, latency = 2;
+		VirtualTextureCache cache(layout, slotsSide, slotsSide, pinnedMips);
+		std::unordered_map<unsigned int, int> resident;
+		std::unordered_map<unsigned int, unsigned int> lastSeen;
+		std::vector<std::vector<unsigned int>> inFlight(latency + 1);
+		std::vector<unsigned int> pinned, requests;
+		cache.RequestPinnedPages(&pinned);
+
+		bool tableOk = true, pinnedOk = true, lruOk = true;
+		unsigned int loads = 0, missingSum = 0, requestedSum = 0;
+		double feedbackMs = 0;
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			const VTFeedbackFrame& frame = frames[f];
+			for (unsigned int page : frame.Pages)
+			{
+				if (page == VT_PAGE_NONE) continue;
+				unsigned int x = VTPageX(page), y = VTPageY(page);
+				lastSeen[page] = f;
+				for (unsigned int m = VTPageMip(page) + 1; m < layout.MipCount; m++)
+					lastSeen[VTPackPage(m, x >>= 1, y >>= 1)] = f;
+			}
+
+			requests.clear();
+			if (f == 0) requests = pinned;
+			auto start = std::chrono::steady_clock::now();
+			cache.ProcessFeedback(frame.Pages.data(), (unsigned int)frame.Pages.size(), &requests);
+			feedbackMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			missingSum += cache.GetFrameMissing();
+			requestedSum += cache.GetFrameRequested();
+			inFlight[f % (latency + 1)] = requests;
+
+			// What was asked for latency frames ago arrives now
+			if (f >= latency)
+			{
+				for (unsigned int page : inFlight[(f - latency) % (latency + 1)])
+				{
+					unsigned int evicted;
+					int slot = cache.Map(page, &evicted);
+					if (slot < 0) continue;
+					loads++;
+					if (evicted != VT_PAGE_NONE)
+					{
+						// Nothing left resident may be older than what went
+						for (auto& r : resident)
+							if (r.first != evicted && VTPageMip(r.first) < layout.MipCount - pinnedMips &&
+								lastSeen[r.first] < lastSeen[evicted])
+								lruOk = false;
+						if (lastSeen[evicted] >= f) lruOk = false;
+						resident.erase(evicted);
+					}
+					resident[page] = slot;
+					lastSeen[page] = std::max(lastSeen[page], f);
+				}
+				for (unsigned int page : pinned)
+					pinnedOk = pinnedOk && cache.IsResident(page);
+			}
+			tableOk = tableOk && PageTableMatches(&cache, resident);
+			cache.ClearDirty();
+		}
+
+		// The camera has been still for a while: everything it
+		// looks at should be resident
+		bool settled = cache.GetFrameMissing() == 0;
+		printf("  replay, %u slots, %u frame latency:\n", slotsSide * slotsSide, latency);
+		printf("    page table matches a rebuild every frame  %s\n", CheckResult(tableOk));
+		printf("    pinned mips stay resident  %s\n", CheckResult(pinnedOk));
+		printf("    evictions oldest first, never a page in use  %s\n", CheckResult(lruOk));
+		printf("    all %u pages resident once the camera stops  %s\n", cache.GetFrameRequested(), CheckResult(settled));
+		printf("    %.1f%% of requested pages missing on average, %u loads, %u evictions, %u dropped, %.3f ms per ProcessFeedback\n",
+			100.0 * missingSum / std::max(requestedSum, 1u), loads, cache.GetEvictionCount(), cache.GetDroppedCount(), feedbackMs / frameCount);
+	}
+
+	// Same recording through the real loader threads
+	{
+		PageIDTileSource source(layout);
+		VirtualTextureCache cache(layout, 16, 16, 3);
+		VirtualTileLoader loader(&source, 2);
+		std::vector<unsigned int> requests;
+		std::vector<VirtualTile> tiles;
+		cache.RequestPinnedPages(&requests);
+		loader.Request(requests);
+
+		bool contentOk = true;
+		auto upload = [&](unsigned int maxTiles)
+		{
+			tiles.clear();
+			loader.Collect(maxTiles, &tiles);
+			for (auto& tile : tiles)
+			{
+				unsigned int evicted, texel;
+				memcpy(&texel, tile.Texels.data(), 4);
+				contentOk = contentOk && tile.Ok && texel == tile.Page;
+				if (cache.Map(tile.Page, &evicted) < 0)
+					cache.Cancel(tile.Page);
+			}
+		};
+
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			requests.clear();
+			cache.ProcessFeedback(frames[f].Pages.data(), (unsigned int)frames[f].Pages.size(), &requests);
+			loader.Request(requests);
+			upload(16);
+		}
+		for (int i = 0; i < 20 && (cache.GetFrameMissing() > 0 || cache.GetPendingCount() > 0); i++)
+		{
+			loader.WaitIdle();
+			upload(~0u);
+			requests.clear();
+			cache.ProcessFeedback(frames.back().Pages.data(), (unsigned int)frames.back().Pages.size(), &requests);
+			loader.Request(requests);
+		}
+		printf("  threaded loader: right pages back  %s, everything resident at the end  %s\n",
+			CheckResult(contentOk), CheckResult(cache.GetFrameMissing() == 0));
+	}
+}
@@ -0,0 +1,299 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <list>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// --------------------------------------------------------
+// Virtual texturing, CPU side (see VirtualTexturing for the
+// GPU half)
+//
+// A huge texture is cut into fixed size pages (tiles), with a
+// mip chain of pages on top.  Only the pages the camera needs
+// live on the GPU, in a "physical" cache texture of slots:
+// - A feedback pass writes, per pixel, the page it would like
+//   (VTPackPage, same bits in VirtualTexture.hlsli)
+// - ProcessFeedback() turns that into loads, coarsest first
+// - Loaded pages take a free slot or the least recently used
+//   one, and the page table - one entry per page, per mip -
+//   points every page at the finest resident page covering it
+//
+// Nothing here touches a device, so it runs headless on
+// recorded feedback (VirtualTextureReport).
+// --------------------------------------------------------
+
+// Page content in texels, plus a border on every side so
+// bilinear filtering never reads a neighbouring slot
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4
+#define VT_TILE_STRIDE (VT_TILE_SIZE + 2 * VT_TILE_BORDER)
+
+// Loads in flight at once.  Keeps the loader's queue short, so
+// a fast moving camera doesn't leave it busy with pages it has
+// already left behind.
+#define VT_MAX_PENDING 64
+
+// Packed page: x in bits 0-12, y in 13-25, mip in 26-30, and
+// bit 31 always set so 0 can mean "no page" in the feedback
+#define VT_PAGE_NONE 0u
+inline unsigned int VTPackPage(unsigned int mip, unsigned int x, unsigned int y) { return 0x80000000u | mip << 26 | y << 13 | x; }
+inline unsigned int VTPageMip(unsigned int page) { return (page >> 26) & 31; }
+inline unsigned int VTPageX(unsigned int page) { return page & 0x1fff; }
+inline unsigned int VTPageY(unsigned int page) { return (page >> 13) & 0x1fff; }
+
+// Size of the texture in pages
+struct VTLayout
+{
+	unsigned int TilesX;		// Mip 0
+	unsigned int TilesY;
+	unsigned int MipCount;		// Down to a single page
+
+	unsigned int MipTilesX(unsigned int mip) const { return TilesX >> mip ? TilesX >> mip : 1; }
+	unsigned int MipTilesY(unsigned int mip) const { return TilesY >> mip ? TilesY >> mip : 1; }
+	unsigned int PageCount() const;
+	unsigned int PageIndex(unsigned int page) const;	// 0 to PageCount()-1, mip 0 first
+};
+
+// Full chain for a texture this many pages across
+VTLayout VTMakeLayout(unsigned int tilesX, unsigned int tilesY);
+
+// --------------------------------------------------------
+// Where pages come from.  ReadTile is called from loader
+// threads, several at once, and fills VT_TILE_STRIDE^2 RGBA8
+// texels (border included).
+// --------------------------------------------------------
+class IVirtualTileSource
+{
+public:
+	virtual ~IVirtualTileSource() {}
+	virtual VTLayout GetLayout() = 0;
+	virtual bool ReadTile(unsigned int page, std::vector<unsigned char>* texels) = 0;
+};
+
+// --------------------------------------------------------
+// Terrain made up on the spot - fractal noise in grass, dirt,
+// rock and snow bands.  Coarser mips leave out the octaves
+// they can't show, so every mip matches the one below it.
+// --------------------------------------------------------
+class ProceduralTileSource : public IVirtualTileSource
+{
+public:
+	ProceduralTileSource(unsigned int tilesX, unsigned int tilesY, unsigned int seed);
+
+	VTLayout GetLayout() { return layout; }
+	bool ReadTile(unsigned int page, std::vector<unsigned char>* texels);
+
+private:
+	VTLayout layout;
+	unsigned int seed;
+};
+
+// --------------------------------------------------------
+// Tiled file:
+//   header   - VTFileHeader
+//   table    - PageCount x { 64 bit offset, 32 bit size, pad }
+//   pages    - RGBA8, VT_TILE_STRIDE^2 each, in PageIndex order
+// The table allows pages of different sizes (compressed or
+// missing) later without changing readers.
+// --------------------------------------------------------
+#define VT_FILE_MAGIC 0x31585456	// "VTX1"
+
+struct VTFileHeader
+{
+	unsigned int Magic;
+	unsigned int TileSize;
+	unsigned int Border;
+	unsigned int TilesX;
+	unsigned int TilesY;
+	unsigned int MipCount;
+	unsigned int PageCount;
+	unsigned int Format;		// 0 = RGBA8
+};
+
+class VirtualTextureFile : public IVirtualTileSource
+{
+public:
+	VirtualTextureFile();
+
+	// False if the file is missing or isn't one of ours
+	bool Open(const std::string& path);
+
+	VTLayout GetLayout() { return layout; }
+	bool ReadTile(unsigned int page, std::vector<unsigned char>* texels);
+
+	// Every page of source, in order
+	static bool Write(const std::string& path, IVirtualTileSource* source);
+
+private:
+	struct Entry
+	{
+		unsigned long long Offset;
+		unsigned int Bytes;
+		unsigned int Pad;
+	};
+
+	VTLayout layout;
+	std::vector<Entry> table;
+	std::ifstream file;
+	std::mutex lock;		// One file position shared by every reader
+};
+
+// --------------------------------------------------------
+// Worker threads calling the source.  Pages come back in the
+// order they finish.
+// --------------------------------------------------------
+struct VirtualTile
+{
+	unsigned int Page;
+	bool Ok;
+	std::vector<unsigned char> Texels;
+};
+
+class VirtualTileLoader
+{
+public:
+	// Doesn't own the source.  threadCount 0 = one per core, less
+	// the main thread.
+	VirtualTileLoader(IVirtualTileSource* source, unsigned int threadCount = 0);
+	~VirtualTileLoader();
+
+	// Queued behind anything already asked for
+	void Request(const std::vector<unsigned int>& pages);
+
+	// Up to maxTiles finished pages, oldest first
+	void Collect(unsigned int maxTiles, std::vector<VirtualTile>* tiles);
+
+	// Blocks until nothing is queued or being read (tests)
+	void WaitIdle();
+
+private:
+	IVirtualTileSource* source;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<unsigned int> jobs;
+	std::deque<VirtualTile> finished;
+	unsigned int busy;
+	bool stopping;
+	std::vector<std::thread> workers;
+
+	void WorkerLoop();
+};
+
+struct VTRect
+{
+	unsigned int X0, Y0;	// Inclusive
+	unsigned int X1, Y1;	// Exclusive
+};
+
+// --------------------------------------------------------
+// Residency: which page is in which slot, LRU eviction and
+// the page table
+// --------------------------------------------------------
+class VirtualTextureCache
+{
+public:
+	// The coarsest pinnedMips mips are never evicted - load them
+	// first (RequestPinnedPages) and there's always something to
+	// show.  Needs more slots than there are pinned pages.
+	VirtualTextureCache(const VTLayout& layout, unsigned int slotsX, unsigned int slotsY, unsigned int pinnedMips);
+
+	const VTLayout& GetLayout() { return layout; }
+	unsigned int GetSlotsX() { return slotsX; }
+	unsigned int GetSlotsY() { return slotsY; }
+
+	// Appends every pinned page, coarsest first, and counts them
+	// as in flight (not limited by VT_MAX_PENDING)
+	void RequestPinnedPages(std::vector<unsigned int>* requests);
+
+	// One frame's feedback (VT_PAGE_NONE entries are skipped).
+	// Marks resident pages - and their parents - used this
+	// frame, and appends missing ones to requests, coarsest
+	// first, while fewer than VT_MAX_PENDING are in flight.
+	void ProcessFeedback(const unsigned int* feedback, unsigned int count, std::vector<unsigned int>* requests);
+
+	// A requested page arrived.  Returns its slot (x = slot %
+	// slotsX), or -1 when every slot was used this frame - then
+	// the page is dropped and asked for again.  evicted is the
+	// page that gave up the slot, or VT_PAGE_NONE.
+	int Map(unsigned int page, unsigned int* evicted);
+
+	// A load failed, it may be requested again
+	void Cancel(unsigned int page);
+
+	bool IsResident(unsigned int page) { return slotOfPage.count(page) != 0; }
+
+	// One RGBA8 entry per page: slot x, slot y, mip of the
+	// resident page used, 255 (or 0 when none is resident yet)
+	const unsigned int* GetPageTable(unsigned int mip) { return pageTable[mip].data(); }
+
+	// Entries changed since ClearDirty, false if none
+	bool GetDirtyRect(unsigned int mip, VTRect* rect);
+	void ClearDirty();
+
+	// Stats
+	unsigned int GetResidentCount() { return (unsigned int)slotOfPage.size(); }
+	unsigned int GetPendingCount() { return (unsigned int)pending.size(); }
+	unsigned int GetFrameRequested() { return frameRequested; }	// Distinct pages in the last feedback
+	unsigned int GetFrameMissing() { return frameMissing; }		// ... that weren't resident
+	unsigned int GetEvictionCount() { return evictionCount; }
+	unsigned int GetDroppedCount() { return droppedCount; }
+
+private:
+	struct Slot
+	{
+		unsigned int Page;			// VT_PAGE_NONE when free
+		unsigned int LastUsed;		// Frame
+		bool Pinned;
+		std::list<int>::iterator Lru;
+	};
+
+	VTLayout layout;
+	unsigned int slotsX;
+	unsigned int slotsY;
+	unsigned int firstPinnedMip;
+
+	std::vector<Slot> slots;
+	std::vector<int> freeSlots;
+	std::list<int> lru;			// Unpinned, most recently used first
+	std::unordered_map<unsigned int, int> slotOfPage;
+	std::unordered_set<unsigned int> pending;
+
+	std::vector<std::vector<unsigned int>> pageTable;
+	std::vector<VTRect> dirty;
+
+	std::vector<unsigned int> scratch;
+	unsigned int frame;
+	unsigned int frameRequested;
+	unsigned int frameMissing;
+	unsigned int evictionCount;
+	unsigned int droppedCount;
+
+	void Touch(int slot);
+	void SetSubtree(unsigned int page, unsigned int entry, bool evicting);
+};
+
+// --------------------------------------------------------
+// Recorded feedback: a file of frames, each a width, a height
+// and width * height packed pages
+// --------------------------------------------------------
+struct VTFeedbackFrame
+{
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<unsigned int> Pages;
+};
+
+bool VTAppendFeedback(const std::string& path, const VTFeedbackFrame& frame);
+bool VTLoadFeedback(const std::string& path, std::vector<VTFeedbackFrame>* frames);
+
+// Tile file round trip, then a recorded fly-over replayed
+// through the cache and the loader - page table, pinning, LRU
+// order and residency are checked every frame
+void VirtualTextureReport();
@@ -0,0 +1,257 @@
+#include "VirtualTexturing.h"
+#include "Profiler.h"
+#include <cmath>
+#include <cstring>
+
+VirtualTexturing::VirtualTexturing(ID3D11Device* device, ID3D11DeviceContext* context, IVirtualTileSource* source,
+	unsigned int screenWidth, unsigned int screenHeight)
+{
+	this->device = device;
+	this->context = context;
+	this->source = source;
+
+	VTLayout layout = source->GetLayout();
+	cache = new VirtualTextureCache(layout, VT_PHYSICAL_SLOTS, VT_PHYSICAL_SLOTS, VT_PINNED_MIPS);
+	loader = new VirtualTileLoader(source);
+	pinnedRequested = false;
+
+	// Physical cache - starts out undefined, nothing points at it yet
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = VT_PHYSICAL_SLOTS * VT_TILE_STRIDE;
+	td.Height = VT_PHYSICAL_SLOTS * VT_TILE_STRIDE;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&td, 0, &physical);
+	device->CreateShaderResourceView(physical, 0, &physicalSRV);
+
+	// Page table, all zero (nothing resident) to begin with
+	td.Width = layout.TilesX;
+	td.Height = layout.TilesY;
+	td.MipLevels = layout.MipCount;
+	td.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	std::vector<D3D11_SUBRESOURCE_DATA> initial(layout.MipCount);
+	for (unsigned int m = 0; m < layout.MipCount; m++)
+	{
+		initial[m].pSysMem = cache->GetPageTable(m);
+		initial[m].SysMemPitch = layout.MipTilesX(m) * 4;
+		initial[m].SysMemSlicePitch = 0;
+	}
+	device->CreateTexture2D(&td, initial.data(), &pageTable);
+	device->CreateShaderResourceView(pageTable, 0, &pageTableSRV);
+	cache->ClearDirty();
+
+	D3D11_SAMPLER_DESC sd = {};
+	sd.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sd.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&sd, &sampler);
+
+	feedbackPS = new SimplePixelShader(device, context);
+	feedbackPS->LoadShaderFile(L"VirtualFeedbackPS.cso");
+
+	feedbackTexture = 0;
+	feedbackRTV = 0;
+	feedbackDepth = 0;
+	feedbackDSV = 0;
+	for (auto& s : staging) s = 0;
+	Resize(screenWidth, screenHeight);
+}
+
+VirtualTexturing::~VirtualTexturing()
+{
+	// Loader threads may still be reading from the source
+	delete loader;
+	delete cache;
+	delete source;
+
+	ReleaseFeedbackTargets();
+	if (physicalSRV) physicalSRV->Release();
+	if (physical) physical->Release();
+	if (pageTableSRV) pageTableSRV->Release();
+	if (pageTable) pageTable->Release();
+	if (sampler) sampler->Release();
+	delete feedbackPS;
+}
+
+void VirtualTexturing::Resize(unsigned int screenWidth, unsigned int screenHeight)
+{
+	ReleaseFeedbackTargets();
+	feedbackWidth = screenWidth / VT_FEEDBACK_DIVISOR > 0 ? screenWidth / VT_FEEDBACK_DIVISOR : 1;
+	feedbackHeight = screenHeight / VT_FEEDBACK_DIVISOR > 0 ? screenHeight / VT_FEEDBACK_DIVISOR : 1;
+	CreateFeedbackTargets();
+}
+
+void VirtualTexturing::CreateFeedbackTargets()
+{
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = feedbackWidth;
+	td.Height = feedbackHeight;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_R32_UINT;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_RENDER_TARGET;
+	device->CreateTexture2D(&td, 0, &feedbackTexture);
+	device->CreateRenderTargetView(feedbackTexture, 0, &feedbackRTV);
+
+	td.Format = DXGI_FORMAT_D32_FLOAT;
+	td.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	device->CreateTexture2D(&td, 0, &feedbackDepth);
+	device->CreateDepthStencilView(feedbackDepth, 0, &feedbackDSV);
+
+	td.Format = DXGI_FORMAT_R32_UINT;
+	td.Usage = D3D11_USAGE_STAGING;
+	td.BindFlags = 0;
+	td.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (unsigned int i = 0; i < VT_FEEDBACK_LATENCY; i++)
+	{
+		device->CreateTexture2D(&td, 0, &staging[i]);
+		stagingFull[i] = false;
+	}
+	stagingNext = 0;
+}
+
+void VirtualTexturing::ReleaseFeedbackTargets()
+{
+	if (feedbackRTV) feedbackRTV->Release();
+	if (feedbackTexture) feedbackTexture->Release();
+	if (feedbackDSV) feedbackDSV->Release();
+	if (feedbackDepth) feedbackDepth->Release();
+	for (auto& s : staging)
+	{
+		if (s) s->Release();
+		s = 0;
+	}
+	feedbackRTV = 0;
+	feedbackTexture = 0;
+	feedbackDSV = 0;
+	feedbackDepth = 0;
+}
+
+void VirtualTexturing::Update()
+{
+	PROFILE_ZONE("VirtualTexturing::Update");
+
+	requests.clear();
+	if (!pinnedRequested)
+	{
+		cache->RequestPinnedPages(&requests);
+		pinnedRequested = true;
+	}
+
+	// The oldest copy - skipped (and overwritten next frame) if
+	// the GPU hasn't got to it yet, rather than stalling
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (stagingFull[stagingNext] &&
+		context->Map(staging[stagingNext], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) == S_OK)
+	{
+		feedback.Width = feedbackWidth;
+		feedback.Height = feedbackHeight;
+		feedback.Pages.resize((size_t)feedbackWidth * feedbackHeight);
+		for (unsigned int y = 0; y < feedbackHeight; y++)
+			memcpy(&feedback.Pages[y * feedbackWidth], (unsigned char*)mapped.pData + y * mapped.RowPitch, feedbackWidth * 4);
+		context->Unmap(staging[stagingNext], 0);
+		stagingFull[stagingNext] = false;
+
+		cache->ProcessFeedback(feedback.Pages.data(), (unsigned int)feedback.Pages.size(), &requests);
+		if (!recordPath.empty())
+			VTAppendFeedback(recordPath, feedback);
+	}
+	loader->Request(requests);
+
+	// Finished pages into their slots
+	tiles.clear();
+	loader->Collect(VT_UPLOADS_PER_FRAME, &tiles);
+	for (auto& tile : tiles)
+	{
+		if (!tile.Ok)
+		{
+			cache->Cancel(tile.Page);
+			continue;
+		}
+
+		unsigned int evicted;
+		int slot = cache->Map(tile.Page, &evicted);
+		if (slot < 0)
+			continue;
+
+		D3D11_BOX box;
+		box.left = (slot % VT_PHYSICAL_SLOTS) * VT_TILE_STRIDE;
+		box.top = (slot / VT_PHYSICAL_SLOTS) * VT_TILE_STRIDE;
+		box.right = box.left + VT_TILE_STRIDE;
+		box.bottom = box.top + VT_TILE_STRIDE;
+		box.front = 0;
+		box.back = 1;
+		context->UpdateSubresource(physical, 0, &box, tile.Texels.data(), VT_TILE_STRIDE * 4, 0);
+	}
+
+	// Only the page table entries that changed
+	const VTLayout& layout = cache->GetLayout();
+	for (unsigned int m = 0; m < layout.MipCount; m++)
+	{
+		VTRect rect;
+		if (!cache->GetDirtyRect(m, &rect))
+			continue;
+
+		D3D11_BOX box = { rect.X0, rect.Y0, 0, rect.X1, rect.Y1, 1 };
+		unsigned int pitch = layout.MipTilesX(m);
+		context->UpdateSubresource(pageTable, m, &box, cache->GetPageTable(m) + rect.Y0 * pitch + rect.X0, pitch * 4, 0);
+	}
+	cache->ClearDirty();
+}
+
+void VirtualTexturing::RenderFeedback(const std::vector<Entity*>& entities, const XMFLOAT4X4& view, const XMFLOAT4X4& proj,
+	float farDepth)
+{
+	UINT viewportCount = 1;
+	D3D11_VIEWPORT oldViewport;
+	context->RSGetViewports(&viewportCount, &oldViewport);
+
+	// 0 = no page
+	const float none[4] = { 0, 0, 0, 0 };
+	context->ClearRenderTargetView(feedbackRTV, none);
+	context->ClearDepthStencilView(feedbackDSV, D3D11_CLEAR_DEPTH, farDepth, 0);
+	context->OMSetRenderTargets(1, &feedbackRTV, feedbackDSV);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)feedbackWidth;
+	viewport.Height = (float)feedbackHeight;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+
+	// Derivatives are VT_FEEDBACK_DIVISOR times bigger down here,
+	// so ask for the mip the full size screen would use
+	Bind(feedbackPS);
+	feedbackPS->SetFloat("vtFeedbackBias", -log2f((float)VT_FEEDBACK_DIVISOR));
+	for (auto& e : entities)
+	{
+		e->PrepareShader(view, proj, feedbackPS);
+		e->Draw();
+	}
+
+	context->RSSetViewports(1, &oldViewport);
+	context->CopyResource(staging[stagingNext], feedbackTexture);
+	stagingFull[stagingNext] = true;
+	stagingNext = (stagingNext + 1) % VT_FEEDBACK_LATENCY;
+}
+
+void VirtualTexturing::Bind(SimplePixelShader* ps)
+{
+	const VTLayout& layout = cache->GetLayout();
+	const float tiles[2] = { (float)layout.TilesX, (float)layout.TilesY };
+	const float physicalSize[2] = { (float)(VT_PHYSICAL_SLOTS * VT_TILE_STRIDE), (float)(VT_PHYSICAL_SLOTS * VT_TILE_STRIDE) };
+	ps->SetFloat2("vtTiles", tiles);
+	ps->SetFloat2("vtPhysicalSize", physicalSize);
+	ps->SetFloat("vtMipCount", (float)layout.MipCount);
+	ps->SetFloat("vtFeedbackBias", 0);
+	ps->SetShaderResourceView("VirtualPageTable", pageTableSRV);
+	ps->SetShaderResourceView("VirtualPhysical", physicalSRV);
+	ps->SetSamplerState("VirtualSampler", sampler);
+}
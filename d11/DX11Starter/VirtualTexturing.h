@@ -0,0 +1,106 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+#include <string>
+#include "SimpleShader.h"
+#include "Entity.h"
+#include "VirtualTextureCache.h"
+
+// --------------------------------------------------------
+// Virtual texturing on the GPU
+//
+// - The physical cache is one big RGBA8 texture of page
+//   slots, the page table a R8G8B8A8_UINT texture with a mip
+//   per page mip (VirtualTextureCache keeps both up to date)
+// - RenderFeedback() draws the virtually textured entities
+//   into a small R32_UINT target, one wanted page per pixel.
+//   It's copied to a ring of staging textures and read back a
+//   couple of frames later, so the CPU never waits on it.
+// - Update() reads the feedback, queues loads on the tile
+//   loader's threads and uploads what's finished
+// - Pixel shaders include VirtualTexture.hlsli, and Bind()
+//   sets its textures and constants
+// --------------------------------------------------------
+
+// Keep in sync with VirtualTexture.hlsli
+#define VT_PAGE_TABLE_SLOT 9
+#define VT_PHYSICAL_SLOT 10
+
+#define VT_PHYSICAL_SLOTS 30		// Per side - 30 * 136 = 4080 texels
+#define VT_PINNED_MIPS 4			// Coarsest mips, always resident
+#define VT_FEEDBACK_DIVISOR 8		// Feedback is this much smaller than the screen each way
+#define VT_FEEDBACK_LATENCY 3		// Staging copies in flight
+#define VT_UPLOADS_PER_FRAME 16		// Pages copied to the cache per frame
+
+class VirtualTexturing
+{
+public:
+	// Takes ownership of the source
+	VirtualTexturing(ID3D11Device* device, ID3D11DeviceContext* context, IVirtualTileSource* source,
+		unsigned int screenWidth, unsigned int screenHeight);
+	~VirtualTexturing();
+
+	// The feedback target follows the screen size
+	void Resize(unsigned int screenWidth, unsigned int screenHeight);
+
+	// Reads back the oldest finished feedback, asks for what's
+	// missing and uploads the pages that have loaded.  Once per
+	// frame, before anything samples the virtual texture.
+	void Update();
+
+	// Draws the entities' wanted pages (depth tested only
+	// against each other), then queues the copy for read back.
+	// Depth clears to farDepth and uses whatever depth state is
+	// bound, so it has to match the projection's.
+	void RenderFeedback(const std::vector<Entity*>& entities, const XMFLOAT4X4& view, const XMFLOAT4X4& proj,
+		float farDepth);
+
+	// Sets the page table, cache and constants on a pixel shader
+	// that includes VirtualTexture.hlsli
+	void Bind(SimplePixelShader* ps);
+
+	// Appends every feedback buffer read back to path, for
+	// replaying headless (VTLoadFeedback).  Empty path stops.
+	void RecordFeedback(const std::string& path) { recordPath = path; }
+
+	ID3D11RenderTargetView* GetFeedbackRTV() { return feedbackRTV; }
+	unsigned int GetFeedbackWidth() { return feedbackWidth; }
+	unsigned int GetFeedbackHeight() { return feedbackHeight; }
+	VirtualTextureCache* GetCache() { return cache; }
+
+private:
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+
+	IVirtualTileSource* source;
+	VirtualTextureCache* cache;
+	VirtualTileLoader* loader;
+	bool pinnedRequested;
+
+	// Physical cache and page table
+	ID3D11Texture2D* physical;
+	ID3D11ShaderResourceView* physicalSRV;
+	ID3D11Texture2D* pageTable;
+	ID3D11ShaderResourceView* pageTableSRV;
+	ID3D11SamplerState* sampler;	// Bilinear, clamped - the borders cover the filter
+
+	// Feedback target, its own depth, and the read back ring
+	unsigned int feedbackWidth;
+	unsigned int feedbackHeight;
+	ID3D11Texture2D* feedbackTexture;
+	ID3D11RenderTargetView* feedbackRTV;
+	ID3D11Texture2D* feedbackDepth;
+	ID3D11DepthStencilView* feedbackDSV;
+	ID3D11Texture2D* staging[VT_FEEDBACK_LATENCY];
+	bool stagingFull[VT_FEEDBACK_LATENCY];
+	unsigned int stagingNext;		// Next to copy into, and the oldest one waiting
+	SimplePixelShader* feedbackPS;
+
+	VTFeedbackFrame feedback;
+	std::vector<unsigned int> requests;
+	std::vector<VirtualTile> tiles;
+	std::string recordPath;
+
+	void CreateFeedbackTargets();
+	void ReleaseFeedbackTargets();
+};
@@ -0,0 +1,865 @@
+// --------------------------------------------------------
+// Self-checks and benchmarks for the device-free parts of
+// the renderer
+//
+//   Checks [--list] [--update-golden] [name ...]
+//
+// Runs every check (or just the named ones) and prints each
+// report.  Exits with the number of checks that FAILED, so a
+// script can run it after a build.  Timings only mean
+// something in Release.
+//
+// The image checks compare the CPU references against the
+// stored images in golden\ (run from this folder).
+// --update-golden rewrites them instead - only do that when
+// the reference is meant to change.
+//
+// Build (no project file - the kernels plus what they use):
+//   cl /O2 /EHsc /std:c++17 /I..\..\DX11Starter /I..\..\DirectXTK-master\Inc main.cpp
+//      ..\..\DX11Starter\Profiler.cpp ..\..\DX11Starter\LightClusters.cpp
+//      ..\..\DX11Starter\LightBinning.cpp ..\..\DX11Starter\ShadowCascades.cpp
+//      ..\..\DX11Starter\ShadowAtlas.cpp ..\..\DX11Starter\TextureResidency.cpp
+//      ..\..\DX11Starter\TextureStreamer.cpp ..\..\DX11Starter\TextureCooker.cpp
+//      ..\..\DX11Starter\SkyConvolution.cpp ..\..\DX11Starter\DepthPrecision.cpp
+//      ..\..\DX11Starter\VirtualTextureCache.cpp ..\..\DX11Starter\StateCache.cpp
+//      ..\..\DX11Starter\TextureArrays.cpp ..\..\DX11Starter\SimpleShader.cpp
+//      ..\..\DX11Starter\GBufferKernel.cpp ..\..\DX11Starter\DofKernel.cpp
+//      ..\..\DX11Starter\BloomKernel.cpp ..\..\DX11Starter\GpuProfiler.cpp
+//      ..\..\DX11Starter\SimInput.cpp ..\..\DX11Starter\Camera.cpp
+//      ..\..\DX11Starter\BlurKernel.cpp ..\..\DX11Starter\RenderGraph.cpp
+//      ..\..\DX11Starter\RenderTargetPool.cpp
+// --------------------------------------------------------
+#include "BloomKernel.h"
+#include "BlurKernel.h"
+#include "Check.h"
+#include "DepthPrecision.h"
+#include "DofKernel.h"
+#include "GBufferKernel.h"
+#include "GpuProfiler.h"
+#include "Light.h"
+#include "LightBinning.h"
+#include "LightClusters.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "ShadowAtlas.h"
+#include "ShadowCascades.h"
+#include "SimInput.h"
+#include "SkyConvolution.h"
+#include "StateCache.h"
+#include "TextureArrays.h"
+#include "TextureCooker.h"
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
+#include "VirtualTextureCache.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// The game's planes (Game.h)
+static const float zNear = 0.1f;
+static const float zFar = 100.0f;
+
+static bool updateGolden = false;
+
+// --------------------------------------------------------
+// Golden images, as PFM (RGB floats, rows bottom to top).
+// Alpha isn't stored or compared.
+// --------------------------------------------------------
+static bool WritePFM(const char* path, const float* rgba, int width, int height)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f) return false;
+	fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+	for (int y = height - 1; y >= 0; y--)
+		for (int x = 0; x < width; x++)
+			fwrite(rgba + ((size_t)y * width + x) * 4, sizeof(float), 3, f);
+	fclose(f);
+	return true;
+}
+
+static bool ReadPFM(const char* path, std::vector<float>& rgba, int* width, int* height)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+	char magic[3] = {};
+	float scale = 0;
+	bool ok = fscanf(f, "%2s %d %d %f", magic, width, height, &scale) == 4 && !strcmp(magic, "PF") && scale < 0;
+	fgetc(f); // The one whitespace before the data
+	if (ok)
+	{
+		rgba.assign((size_t)*width * *height * 4, 0.0f);
+		for (int y = *height - 1; y >= 0 && ok; y--)
+			for (int x = 0; x < *width && ok; x++)
+				ok = fread(&rgba[((size_t)y * *width + x) * 4], sizeof(float), 3, f) == 3;
+	}
+	fclose(f);
+	return ok;
+}
+
+// Compares an image against golden\<name>.pfm, or rewrites the
+// file with --update-golden
+static void CheckGolden(const char* name, const float* rgba, int width, int height, float tolerance)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "golden/%s.pfm", name);
+	if (updateGolden)
+	{
+		bool written = WritePFM(path, rgba, width, height);
+		printf("  %s rewritten  %s\n", path, CheckResult(written));
+		return;
+	}
+
+	std::vector<float> golden;
+	int goldenWidth, goldenHeight;
+	if (!ReadPFM(path, golden, &goldenWidth, &goldenHeight))
+	{
+		printf("  %s missing or unreadable (--update-golden writes it)  %s\n", path, CheckResult(false));
+		return;
+	}
+	if (goldenWidth != width || goldenHeight != height)
+	{
+		printf("  %s is %dx%d, expected %dx%d  %s\n", path, goldenWidth, goldenHeight, width, height,
+			CheckResult(false));
+		return;
+	}
+
+	float worst = 0;
+	int worstX = 0, worstY = 0;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			for (int c = 0; c < 3; c++)
+			{
+				size_t i = ((size_t)y * width + x) * 4 + c;
+				float error = fabsf(rgba[i] - golden[i]);
+				if (error != error) error = INFINITY;
+				if (error > worst)
+				{
+					worst = error;
+					worstX = x;
+					worstY = y;
+				}
+			}
+	printf("  matches %s within %g (worst %.3g at %d,%d)  %s\n", path, tolerance, worst, worstX, worstY,
+		CheckResult(worst <= tolerance));
+}
+
+// Same numbers on every platform, unlike rand()
+static float Random(unsigned int& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) / 16777216.0f;
+}
+
+static void Clusters()
+{
+	ClusterBenchmark(4096, 100);
+	ClusterReferenceReport();
+	LightBinningBenchmark();
+}
+
+static void Cascades()
+{
+	ShadowCascadeReport();
+	ShadowCullBenchmark(100000, 20);
+}
+
+static void Atlas()
+{
+	ShadowAtlasReport();
+	ShadowAtlasBenchmark(600);
+}
+
+static void Streamer()
+{
+	TextureStreamerReport();
+	TextureStreamerBenchmark(200);
+}
+
+static void Cooker() { TextureCookerReport(256); }
+static void Sky() { SkyConvolutionReport(128); }
+static void Depth() { DepthPrecisionReport(zNear, zFar); }
+
+// How close the deferred path gets to the forward shaders, with
+// lights like the game's and a sky that's blue above and brown
+// below standing in for the sky map
+static void GBuffer()
+{
+	DirectionalLight light = { XMFLOAT4(0.1f, 0.1f, 0.1f, 1), XMFLOAT4(0.2f, 0.2f, 0.2f, 1), XMFLOAT3(1, -1, 0), 1 };
+	LocalLight lights[] =
+	{
+		{ XMFLOAT4(0.1f, 0.1f, 0.1f, 1), XMFLOAT4(0.4f, 0.478f, 0.98f, 1), XMFLOAT3(0, 0, 0), 0,
+			XMFLOAT3(5, -2, -5), 20, LIGHT_TYPE_POINT, -1, { 0, 0 } },
+		{ XMFLOAT4(0.01f, 0.01f, 0.01f, 1), XMFLOAT4(0.8f, 0.16f, 0.074f, 1), XMFLOAT3(-1, -0.5f, 0), 30,
+			XMFLOAT3(7, 2, 0), 120, LIGHT_TYPE_SPOT, -1, { 0, 0 } },
+		{ XMFLOAT4(0.01f, 0.01f, 0.01f, 1), XMFLOAT4(0.8f, 0.8f, 0.8f, 1), XMFLOAT3(0, -1, 1), 40,
+			XMFLOAT3(0, 30, -30), 100, LIGHT_TYPE_SPOT, -1, { 0, 0 } },
+	};
+
+	SkyCube sky = SkyMakeCube(16);
+	for (unsigned int f = 0; f < 6; f++)
+		for (unsigned int y = 0; y < sky.Size; y++)
+			for (unsigned int x = 0; x < sky.Size; x++)
+			{
+				float dir[3];
+				SkyTexelDirection(f, x, y, sky.Size, dir);
+				float up = dir[1] * 0.5f + 0.5f;
+				float* texel = SkyTexel(sky, f, x, y);
+				texel[0] = 0.3f - 0.2f * up;
+				texel[1] = 0.25f;
+				texel[2] = 0.15f + 0.6f * up;
+			}
+	SkySH9 sh = SkyProjectSH(sky, 0);
+
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, -15, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	GBufferParityReport(light, lights, sizeof(lights) / sizeof(lights[0]), view,
+		0.25f * 3.1415926535f, 16.0f / 9.0f, zNear, zFar, 100000, &sh, 1.0f);
+}
+
+// Largest difference between two RGBA images, alpha included
+static float MaxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+	float worst = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		if (fabsf(a[i] - b[i]) > worst) worst = fabsf(a[i] - b[i]);
+	return worst;
+}
+
+// --------------------------------------------------------
+// Separable gaussian against its golden image and the slow
+// 2D kernel, on made up 64x48 noise with a few bright blocks,
+// at the radius bloom used to blur with.  Also checks the
+// merged bilinear taps give the discrete kernel's result, a
+// flat image stays flat, and the old box reference spreads a
+// single pixel evenly over its square.  Then the 4K benchmark.
+// --------------------------------------------------------
+static void BlurImage()
+{
+	const int width = 64, height = 48, radius = 15;
+	const float sigma = radius * 0.5f;
+	printf("\nSeparable blur reference (%dx%d image, radius %d)\n", width, height, radius);
+
+	std::vector<float> image((size_t)width * height * 4);
+	unsigned int seed = 11;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			float* p = &image[((size_t)y * width + x) * 4];
+			bool block = (x / 8 + y / 8) % 4 == 0;
+			for (int c = 0; c < 4; c++) p[c] = block ? 1.0f : 0.3f * Random(seed);
+		}
+
+	std::vector<float> temp(image.size()), discrete(image.size()), merged(image.size()), full(image.size());
+	BlurReferenceDiscrete(image.data(), temp.data(), width, height, radius, sigma, true);
+	BlurReferenceDiscrete(temp.data(), discrete.data(), width, height, radius, sigma, false);
+	BlurReferenceLinear(image.data(), temp.data(), width, height, radius, sigma, true);
+	BlurReferenceLinear(temp.data(), merged.data(), width, height, radius, sigma, false);
+	BlurReference2D(image.data(), full.data(), width, height, radius, sigma);
+
+	CheckGolden("blur", merged.data(), width, height, 1e-4f);
+	float separableError = MaxDifference(discrete, full);
+	printf("  horizontal + vertical vs. full 2D kernel: off by %.3g  %s\n", separableError,
+		CheckResult(separableError < 1e-5f));
+	float mergedError = MaxDifference(merged, discrete);
+	printf("  bilinear merged taps vs. discrete taps: off by %.3g  %s\n", mergedError, CheckResult(mergedError < 1e-5f));
+
+	std::vector<float> flat(image.size(), 0.5f);
+	BlurReferenceLinear(flat.data(), temp.data(), width, height, radius, sigma, true);
+	BlurReferenceLinear(temp.data(), merged.data(), width, height, radius, sigma, false);
+	float flatError = MaxDifference(merged, flat);
+	printf("  flat image: off by %.3g  %s\n", flatError, CheckResult(flatError < 1e-5f));
+
+	// One lit pixel comes out as a (2r+1)^2 square of 1/(2r+1)^2
+	std::vector<float> impulse(image.size(), 0.0f), box(image.size());
+	const int cx = width / 2, cy = height / 2;
+	for (int c = 0; c < 4; c++) impulse[((size_t)cy * width + cx) * 4 + c] = 1.0f;
+	BlurReferenceBox(impulse.data(), box.data(), width, height, radius);
+	std::vector<float> expected(image.size(), 0.0f);
+	for (int y = cy - radius; y <= cy + radius; y++)
+		for (int x = cx - radius; x <= cx + radius; x++)
+			if (x >= 0 && x < width && y >= 0 && y < height)
+				for (int c = 0; c < 4; c++)
+					expected[((size_t)y * width + x) * 4 + c] = 1.0f / ((2 * radius + 1) * (2 * radius + 1));
+	float boxError = MaxDifference(box, expected);
+	printf("  old box kernel spreads one pixel evenly: off by %.3g  %s\n", boxError, CheckResult(boxError < 1e-6f));
+
+	BlurBenchmark(3840, 2160, radius);
+}
+
+// True when no two of the transients got the same texture
+// while their lifetimes overlap
+static bool SharesOnlyDisjoint(RenderGraph& graph, const std::vector<RGHandle>& transients)
+{
+	for (size_t i = 0; i < transients.size(); i++)
+		for (size_t j = i + 1; j < transients.size(); j++)
+		{
+			RGHandle a = transients[i], b = transients[j];
+			if (graph.GetTextureIndex(a) < 0 || graph.GetTextureIndex(a) != graph.GetTextureIndex(b)) continue;
+			if (graph.GetFirstPass(a) <= graph.GetLastPass(b) && graph.GetFirstPass(b) <= graph.GetLastPass(a))
+				return false;
+		}
+	return true;
+}
+
+// --------------------------------------------------------
+// Transient aliasing in the render graph, on the recording
+// backend.  First three same-size targets in a chain, where
+// only the first and last can share.  Then the game's frame
+// at 1280x720, declared the way Game::BuildFrameGraph, Bloom
+// and DepthOfField declare it (passes only, nothing to run),
+// plus a debug view nobody reads.  Checks the culled pass,
+// the bytes with one texture per transient vs. shared, the
+// pool's peak, and that transients alive at the same time
+// never share a texture.
+// --------------------------------------------------------
+static void Graph()
+{
+	printf("\nRender graph transient aliasing (recording backend)\n");
+	auto nothing = []() {};
+	const unsigned int targetFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	const unsigned int computeFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+
+	{
+		RenderTargetPool pool(new RecordingTargetBackend());
+		RenderGraph graph(&pool);
+		RTDesc desc = { 256, 256, DXGI_FORMAT_R8G8B8A8_UNORM, targetFlags };
+		RGHandle out = graph.Import("Out", desc, 0, 0);
+		RGHandle a, b, c;
+		graph.AddPass("A", [&](RGPassBuilder& p) { a = p.Write(p.Create("A", desc), RG_LOAD_DONTCARE, RG_COVER_FULL); }, nothing);
+		graph.AddPass("B", [&](RGPassBuilder& p) { p.Read(a); b = p.Write(p.Create("B", desc), RG_LOAD_DONTCARE, RG_COVER_FULL); }, nothing);
+		graph.AddPass("C", [&](RGPassBuilder& p) { p.Read(b); c = p.Write(p.Create("C", desc), RG_LOAD_DONTCARE, RG_COVER_FULL); }, nothing);
+		graph.AddPass("Out", [&](RGPassBuilder& p) { p.Read(c); p.Write(out); }, nothing);
+		graph.Compile();
+		bool shared = graph.GetTextureIndex(a) == graph.GetTextureIndex(c);
+		bool apart = graph.GetTextureIndex(b) != graph.GetTextureIndex(a);
+		printf("  chain A -> B -> C: %u textures, A and C share, B doesn't  %s\n", graph.GetTextureCount(),
+			CheckResult(graph.GetTextureCount() == 2 && shared && apart));
+		graph.ExecuteClears();
+	}
+
+	const unsigned int width = 1280, height = 720;
+	RenderTargetPool pool(new RecordingTargetBackend());
+	RenderGraph graph(&pool);
+	std::vector<RGHandle> transients;
+	auto create = [&](RGPassBuilder& p, const char* name, const RTDesc& desc)
+	{
+		RGHandle h = p.Create(name, desc);
+		transients.push_back(h);
+		return h;
+	};
+
+	RTDesc screenDesc = { width, height, DXGI_FORMAT_R8G8B8A8_UNORM, targetFlags };
+	RTDesc depthDesc = { width, height, DXGI_FORMAT_R32_TYPELESS, D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE };
+	RGHandle backBuffer = graph.Import("Back Buffer", screenDesc, 0, 0);
+	RGHandle depth = graph.Import("Depth", depthDesc, 0, 0);
+
+	RGHandle scene, bloomMips[BLOOM_MIP_COUNT], sceneBloom, debugView;
+	graph.AddPass("Scene", [&](RGPassBuilder& p)
+	{
+		scene = p.Write(create(p, "Scene Color", screenDesc), RG_LOAD_CLEAR);
+		p.Write(depth, RG_LOAD_CLEAR);
+	}, nothing);
+	graph.AddPass("Sky", [&](RGPassBuilder& p)
+	{
+		p.Write(scene, RG_LOAD_PRESERVE, RG_COVER_REMAINDER);
+		p.Write(depth, RG_LOAD_PRESERVE);
+	}, nothing);
+	graph.AddPass("Debug View", [&](RGPassBuilder& p)
+	{
+		p.Read(scene);
+		debugView = p.Write(create(p, "Debug View", screenDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+
+	RTDesc mipDesc = { width, height, DXGI_FORMAT_R16G16B16A16_FLOAT, targetFlags };
+	unsigned long long bloomBytes = 0;
+	auto halveMip = [&]()
+	{
+		mipDesc.Width = mipDesc.Width / 2 > 1 ? mipDesc.Width / 2 : 1;
+		mipDesc.Height = mipDesc.Height / 2 > 1 ? mipDesc.Height / 2 : 1;
+		bloomBytes += RTBytes(mipDesc);
+	};
+	graph.AddPass("Bloom Extract", [&](RGPassBuilder& p)
+	{
+		halveMip();
+		p.Read(scene);
+		bloomMips[0] = p.Write(create(p, "Bloom Mip", mipDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+	graph.AddPass("Bloom Downsample", [&](RGPassBuilder& p)
+	{
+		for (int i = 1; i < BLOOM_MIP_COUNT; i++)
+		{
+			halveMip();
+			p.Read(bloomMips[i - 1]);
+			bloomMips[i] = p.Write(create(p, "Bloom Mip", mipDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		}
+	}, nothing);
+	graph.AddPass("Bloom Upsample", [&](RGPassBuilder& p)
+	{
+		for (int i = BLOOM_MIP_COUNT - 1; i > 0; i--)
+		{
+			p.Read(bloomMips[i]);
+			p.Write(bloomMips[i - 1], RG_LOAD_PRESERVE, RG_COVER_FULL);
+		}
+	}, nothing);
+	graph.AddPass("Additive Blend", [&](RGPassBuilder& p)
+	{
+		p.Read(scene);
+		p.Read(bloomMips[0]);
+		sceneBloom = p.Write(create(p, "Scene + Bloom", screenDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+
+	const unsigned int halfWidth = (width + 1) / 2, halfHeight = (height + 1) / 2;
+	RTDesc halfDesc = { halfWidth, halfHeight, DXGI_FORMAT_R16G16B16A16_FLOAT, computeFlags };
+	RTDesc tileDesc = { (halfWidth + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE, (halfHeight + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE,
+		DXGI_FORMAT_R16G16_FLOAT, computeFlags };
+	RGHandle halfColor, tiles, dilated, nearField, farField;
+	graph.AddPass("DoF Prepare", [&](RGPassBuilder& p)
+	{
+		p.Read(sceneBloom);
+		p.Read(depth);
+		halfColor = p.Write(create(p, "DoF Half Color", halfDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+	graph.AddPass("DoF Tile Max", [&](RGPassBuilder& p)
+	{
+		p.Read(halfColor);
+		tiles = p.Write(create(p, "DoF Tiles", tileDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+	graph.AddPass("DoF Dilate", [&](RGPassBuilder& p)
+	{
+		p.Read(tiles);
+		dilated = p.Write(create(p, "DoF Dilated Tiles", tileDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+	graph.AddPass("DoF Gather", [&](RGPassBuilder& p)
+	{
+		p.Read(halfColor);
+		p.Read(dilated);
+		nearField = p.Write(create(p, "DoF Near", halfDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+		farField = p.Write(create(p, "DoF Far", halfDesc), RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+	graph.AddPass("DoF Composite", [&](RGPassBuilder& p)
+	{
+		p.Read(sceneBloom);
+		p.Read(depth);
+		p.Read(nearField);
+		p.Read(farField);
+		p.Write(backBuffer, RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+	graph.Compile();
+
+	// By hand: both full res color targets, the bloom chain, three
+	// half res DoF layers and two tile maps.  Only DoF's half res
+	// color can take over a texture, bloom's top level, which is
+	// done once the blend has read it.
+	unsigned long long expectedUnaliased = 2 * RTBytes(screenDesc) + bloomBytes + 3 * RTBytes(halfDesc) + 2 * RTBytes(tileDesc);
+	unsigned long long expectedAliased = expectedUnaliased - RTBytes(halfDesc);
+	printf("  game frame at %ux%u: %u of %u passes culled  %s\n", width, height, graph.GetCulledPassCount(),
+		graph.GetPassCount(), CheckResult(graph.GetCulledPassCount() == 1 && graph.GetTextureIndex(debugView) < 0));
+	printf("  one texture per transient: %llu bytes (expected %llu)  %s\n", graph.GetUnaliasedBytes(), expectedUnaliased,
+		CheckResult(graph.GetUnaliasedBytes() == expectedUnaliased));
+	printf("  shared: %llu bytes in %u textures (expected %llu)  %s\n", graph.GetAliasedBytes(), graph.GetTextureCount(),
+		expectedAliased, CheckResult(graph.GetAliasedBytes() == expectedAliased));
+	printf("  DoF half res color shares bloom's top level  %s\n",
+		CheckResult(graph.GetTextureIndex(halfColor) == graph.GetTextureIndex(bloomMips[0])));
+	printf("  pool peak %llu bytes, same as shared  %s\n", pool.GetPeakBytes(),
+		CheckResult(pool.GetPeakBytes() == expectedAliased));
+	printf("  transients alive at the same time never share  %s\n", CheckResult(SharesOnlyDisjoint(graph, transients)));
+	graph.ExecuteClears();
+}
+
+// --------------------------------------------------------
+// Render target pool bookkeeping, on the recording backend:
+// reuse, eviction after evictAfterFrames idle frames, scaled
+// targets following Resize, evicted slots handed out again,
+// and Destroy on an already evicted target
+// --------------------------------------------------------
+static void Pool()
+{
+	printf("\nRender target pool (recording backend)\n");
+	const unsigned int evictAfter = 2;
+	const unsigned int flags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	RecordingTargetBackend* backend = new RecordingTargetBackend();
+	RenderTargetPool pool(backend, evictAfter);
+	RTDesc color = { 256, 256, DXGI_FORMAT_R8G8B8A8_UNORM, flags };
+	RTDesc hdr = { 256, 256, DXGI_FORMAT_R16G16B16A16_FLOAT, flags };
+
+	// Same desc after a release gets the same texture back, a
+	// different one (or the same while it's held) gets a new one
+	RTHandle a = pool.Acquire(color);
+	pool.Release(a);
+	RTHandle again = pool.Acquire(color);
+	RTHandle second = pool.Acquire(color);
+	RTHandle other = pool.Acquire(hdr);
+	printf("  acquire/release: %u created, %u reused  %s\n", pool.GetCreateCount(), pool.GetReuseCount(),
+		CheckResult(again == a && second != a && other != a && other != second &&
+			pool.GetCreateCount() == 3 && pool.GetReuseCount() == 1 && backend->GetCreateCount() == 3));
+
+	// Idle targets stay for evictAfter frames, then go
+	pool.Release(a);
+	pool.Release(second);
+	pool.Release(other);
+	for (unsigned int i = 0; i < evictAfter; i++) pool.EndFrame();
+	bool kept = pool.GetTargetCount() == 3 && pool.GetEvictCount() == 0;
+	pool.EndFrame();
+	bool evicted = pool.GetTargetCount() == 0 && pool.GetEvictCount() == 3 && pool.GetLiveBytes() == 0 &&
+		backend->GetLiveBytes() == 0;
+	printf("  idle for %u frames kept, one more evicted (%u evictions)  %s\n", evictAfter, pool.GetEvictCount(),
+		CheckResult(kept && evicted));
+
+	// Evicted slots are reused instead of growing the table
+	RTHandle h0 = pool.Acquire(color), h1 = pool.Acquire(color), h2 = pool.Acquire(hdr);
+	bool slotsReused = h0 <= 2 && h1 <= 2 && h2 <= 2 && h0 != h1 && h0 != h2 && h1 != h2;
+	RTHandle h3 = pool.Acquire(hdr);
+	printf("  evicted slots handed out again, the next new one appended  %s\n",
+		CheckResult(slotsReused && h3 == 3));
+
+	// Scaled targets follow the screen behind the same handle,
+	// idle fixed ones are dropped and held ones kept
+	pool.Release(h1);
+	pool.Resize(1280, 720);
+	RTHandle half = pool.CreateScaled(0.5f, DXGI_FORMAT_R16G16B16A16_FLOAT, flags);
+	RTHandle third = pool.CreateScaled(1.0f / 3.0f, DXGI_FORMAT_R8G8B8A8_UNORM, flags);
+	bool before = pool.GetDesc(half).Width == 640 && pool.GetDesc(half).Height == 360 &&
+		pool.GetDesc(third).Width == 427 && pool.GetDesc(third).Height == 240;
+	pool.Resize(1920, 1080);
+	bool after = pool.GetDesc(half).Width == 960 && pool.GetDesc(half).Height == 540 &&
+		pool.GetDesc(third).Width == 640 && pool.GetDesc(third).Height == 360;
+	unsigned long long liveAfter = RTBytes(color) + 2 * RTBytes(hdr) + RTBytes(pool.GetDesc(half)) +
+		RTBytes(pool.GetDesc(third));
+	printf("  resize 1280x720 -> 1920x1080: half res %ux%u, third res %ux%u  %s\n",
+		pool.GetDesc(half).Width, pool.GetDesc(half).Height, pool.GetDesc(third).Width, pool.GetDesc(third).Height,
+		CheckResult(before && after));
+	printf("  idle fixed target dropped, held ones kept: %u targets, %llu bytes  %s\n", pool.GetTargetCount(),
+		pool.GetLiveBytes(), CheckResult(pool.GetTargetCount() == 5 && pool.GetLiveBytes() == liveAfter &&
+			backend->GetLiveBytes() == liveAfter));
+
+	// Destroy on a target EndFrame already evicted must not put
+	// its slot on the free list a second time, or two new
+	// targets end up behind one handle
+	pool.Destroy(third);
+	pool.Release(h0);
+	for (unsigned int i = 0; i <= evictAfter; i++) pool.EndFrame();
+	pool.Destroy(h0);
+	RTHandle n0 = pool.Acquire(color), n1 = pool.Acquire(hdr), n2 = pool.Acquire(color);
+	printf("  destroy after eviction: new handles %d, %d, %d all different  %s\n", n0, n1, n2,
+		CheckResult(n0 != n1 && n0 != n2 && n1 != n2 && pool.GetDesc(n0) == color && pool.GetDesc(n1) == hdr));
+}
+
+// Lighting covers its target, the sky fills in what geometry
+// left, decals only touch a few pixels of their (cleared) mask
+// and an accumulation target is blended onto from fresh, then
+// a composite reads all of it.  Each target a different pixel
+// size, so the cleared bytes say which ones were cleared.
+static void AddClearPasses(RenderGraph& graph, unsigned int width, unsigned int height)
+{
+	auto nothing = []() {};
+	const unsigned int flags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	const float black[4] = { 0, 0, 0, 1 };
+	RTDesc lightingDesc = { width, height, DXGI_FORMAT_R11G11B10_FLOAT, flags };
+	RTDesc sceneDesc = { width, height, DXGI_FORMAT_R16G16_FLOAT, flags };
+	RTDesc maskDesc = { width, height, DXGI_FORMAT_R8_UNORM, flags };
+	RTDesc accumDesc = { width, height, DXGI_FORMAT_R16G16B16A16_FLOAT, flags };
+	RTDesc outDesc = { width, height, DXGI_FORMAT_R8G8B8A8_UNORM, flags };
+	RGHandle out = graph.Import("Out", outDesc, 0, 0);
+
+	RGHandle lighting, scene, mask, accum;
+	graph.AddPass("Lighting", [&](RGPassBuilder& p)
+	{
+		lighting = p.Write(p.Create("Lighting", lightingDesc, black), RG_LOAD_CLEAR, RG_COVER_FULL);
+	}, nothing);
+	graph.AddPass("Geometry", [&](RGPassBuilder& p)
+	{
+		scene = p.Write(p.Create("Scene", sceneDesc, black), RG_LOAD_CLEAR, RG_COVER_PARTIAL);
+	}, nothing);
+	graph.AddPass("Sky", [&](RGPassBuilder& p) { p.Write(scene, RG_LOAD_PRESERVE, RG_COVER_REMAINDER); }, nothing);
+	graph.AddPass("Decals", [&](RGPassBuilder& p)
+	{
+		mask = p.Write(p.Create("Decal Mask", maskDesc, black), RG_LOAD_CLEAR, RG_COVER_PARTIAL);
+	}, nothing);
+	graph.AddPass("Accumulate", [&](RGPassBuilder& p)
+	{
+		accum = p.Write(p.Create("Accumulation", accumDesc), RG_LOAD_PRESERVE, RG_COVER_PARTIAL);
+	}, nothing);
+	graph.AddPass("Composite", [&](RGPassBuilder& p)
+	{
+		p.Read(lighting);
+		p.Read(scene);
+		p.Read(mask);
+		p.Read(accum);
+		p.Write(out, RG_LOAD_DONTCARE, RG_COVER_FULL);
+	}, nothing);
+}
+
+// --------------------------------------------------------
+// Render graph clear elimination, on the recording backend:
+// the same graph with and without it.  Covered targets lose
+// their clears, ones only partly drawn (or blended onto from
+// fresh) keep them.
+// --------------------------------------------------------
+static void Clears()
+{
+	printf("\nRender graph clear elimination (recording backend)\n");
+	const unsigned int width = 640, height = 360;
+	const unsigned long long pixels = width * height;
+	unsigned long long cleared[2], issued[2];
+	unsigned int clears[2], dropped[2];
+	for (int eliminate = 0; eliminate < 2; eliminate++)
+	{
+		RecordingTargetBackend* backend = new RecordingTargetBackend();
+		RenderTargetPool pool(backend);
+		RenderGraph graph(&pool);
+		graph.SetClearElimination(eliminate == 1);
+		AddClearPasses(graph, width, height);
+		graph.Compile();
+		graph.ExecuteClears();
+		cleared[eliminate] = graph.GetClearedBytes();
+		issued[eliminate] = backend->GetClearedBytes();
+		clears[eliminate] = graph.GetClearCount();
+		dropped[eliminate] = graph.GetDroppedClearCount();
+	}
+
+	// Bytes per pixel: lighting 4, scene 4, mask 1, accumulation 8
+	printf("  without: %u clears, %llu bytes (expected %llu)  %s\n", clears[0], cleared[0], pixels * 17,
+		CheckResult(clears[0] == 4 && dropped[0] == 0 && cleared[0] == pixels * 17 && issued[0] == cleared[0]));
+	printf("  with: %u clears, %llu bytes, %u dropped  %s\n", clears[1], cleared[1], dropped[1],
+		CheckResult(clears[1] == 2 && dropped[1] == 2 && cleared[1] < cleared[0] && issued[1] == cleared[1]));
+	printf("  partly drawn mask and blended accumulation still cleared  %s\n",
+		CheckResult(cleared[1] == pixels * (1 + 8)));
+}
+
+// Sum of one channel over an image
+static double Energy(const std::vector<float>& rgba, int channel)
+{
+	double sum = 0;
+	for (size_t i = channel; i < rgba.size(); i += 4) sum += rgba[i];
+	return sum;
+}
+
+// --------------------------------------------------------
+// Bloom chain against its golden image, on a made up 96x64
+// scene: dim geometry, a few bright geometry patches, small
+// lights and a strip of sky crossing its threshold, stored at
+// 8 bits like the real scene target.  Also checks that a flat
+// image stays flat through the bright pass and that the Karis
+// average holds back a single very bright pixel.
+// --------------------------------------------------------
+static void BloomImage()
+{
+	const int width = 96, height = 64;
+	int halfWidth, halfHeight;
+	BloomLevelSize(width, height, 0, &halfWidth, &halfHeight);
+	printf("\nBloom reference (%dx%d scene, %d levels)\n", width, height, BLOOM_MIP_COUNT);
+
+	std::vector<float> scene((size_t)width * height * 4);
+	unsigned int seed = 1;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			float* p = &scene[((size_t)y * width + x) * 4];
+			if (y < 12)
+			{
+				// Sky, brightening to the right
+				float v = 0.5f + 0.5f * x / (width - 1);
+				p[0] = v; p[1] = v; p[2] = 1.0f; p[3] = 0.5f;
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++) p[c] = 0.6f * Random(seed);
+				p[3] = 1;
+				if ((x / 16 + y / 16) % 3 == 0 && x % 16 < 8)
+					p[0] = p[1] = p[2] = 0.9f;
+			}
+		}
+	const int lights[][2] = { { 20, 40 }, { 50, 30 }, { 80, 55 }, { 5, 60 } };
+	for (auto& l : lights)
+		for (int y = l[1] - 1; y <= l[1] + 1; y++)
+			for (int x = l[0] - 1; x <= l[0] + 1; x++)
+			{
+				float* p = &scene[((size_t)y * width + x) * 4];
+				p[0] = 1; p[1] = 0.8f; p[2] = 0.5f; p[3] = 0;
+			}
+	for (auto& v : scene) v = floorf(v * 255.0f + 0.5f) / 255.0f;
+
+	std::vector<float> bloom((size_t)halfWidth * halfHeight * 4);
+	BloomReference(scene.data(), width, height, bloom.data());
+	CheckGolden("bloom", bloom.data(), halfWidth, halfHeight, 1e-4f);
+
+	// Flat light colored image: the interior (away from the black
+	// border) must come out the same color
+	std::vector<float> flat((size_t)width * height * 4);
+	for (size_t i = 0; i < flat.size(); i += 4)
+	{
+		flat[i] = flat[i + 1] = flat[i + 2] = 0.5f;
+		flat[i + 3] = 0;
+	}
+	std::vector<float> flatOut(bloom.size());
+	BloomReferenceExtract(flat.data(), width, height, flatOut.data());
+	float flatError = 0;
+	for (int y = 2; y < halfHeight - 2; y++)
+		for (int x = 2; x < halfWidth - 2; x++)
+			for (int c = 0; c < 3; c++)
+			{
+				float error = fabsf(flatOut[((size_t)y * halfWidth + x) * 4 + c] - 0.5f);
+				if (error > flatError) flatError = error;
+			}
+	printf("  flat image through the bright pass: off by %.3g  %s\n", flatError, CheckResult(flatError < 1e-5f));
+
+	// One 20x over-bright pixel on black: plain box averages pass
+	// all of it down the chain, the Karis average much less
+	std::vector<float> firefly((size_t)width * height * 4, 0.0f);
+	float* hot = &firefly[((size_t)(height / 2) * width + width / 2) * 4];
+	hot[0] = hot[1] = hot[2] = 20;
+	std::vector<float> plain(bloom.size()), karis(bloom.size());
+	BloomReferenceExtract(firefly.data(), width, height, plain.data(), false);
+	BloomReferenceExtract(firefly.data(), width, height, karis.data(), true);
+	double plainEnergy = Energy(plain, 1), karisEnergy = Energy(karis, 1);
+	printf("  20x firefly energy after the bright pass: plain %.3f, Karis %.3f  %s\n", plainEnergy, karisEnergy,
+		CheckResult(karisEnergy < 0.8 * plainEnergy));
+}
+
+// Spread of one channel over a rectangle of an image
+static double Variance(const std::vector<float>& rgba, int width, int x0, int y0, int x1, int y1, int channel)
+{
+	double sum = 0, sumSquares = 0;
+	int count = 0;
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++)
+		{
+			double v = rgba[((size_t)y * width + x) * 4 + channel];
+			sum += v;
+			sumSquares += v * v;
+			count++;
+		}
+	double mean = sum / count;
+	return sumSquares / count - mean * mean;
+}
+
+// --------------------------------------------------------
+// Depth of field against its golden image, on a made up 96x64
+// scene with the game's focus settings and reversed depth: a
+// noisy far wall, a panel at the focus distance and a post in
+// front of it.  Also checks that a scene sitting entirely at
+// the focus distance comes back unchanged and that the far
+// wall loses contrast.
+// --------------------------------------------------------
+static void DofImage()
+{
+	const int width = 96, height = 64;
+	const DofParams params = { 2.0f, 8.0f, 20.0f, 8.0f }; // Game.h
+	const float depthScale = zNear, depthBias = 0;        // Camera::getDepthParams, reversed
+	printf("\nDepth of field reference (%dx%d scene, focus at %g)\n", width, height, params.FocusDistance);
+
+	std::vector<float> scene((size_t)width * height * 4);
+	std::vector<float> depth((size_t)width * height);
+	unsigned int seed = 7;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			float* p = &scene[((size_t)y * width + x) * 4];
+			float viewZ = 40.0f;
+			for (int c = 0; c < 3; c++) p[c] = Random(seed);
+			if (x >= 40 && x < 72 && y >= 16 && y < 48)
+			{
+				viewZ = params.FocusDistance;
+				p[0] = ((x / 4 + y / 4) & 1) ? 0.9f : 0.1f;
+				p[1] = 0.5f;
+				p[2] = 0.2f;
+			}
+			if (x >= 30 && x < 38)
+			{
+				viewZ = 3.0f;
+				p[0] = 0.2f; p[1] = 0.8f; p[2] = 0.3f;
+			}
+			p[3] = 1;
+			depth[(size_t)y * width + x] = zNear / viewZ;
+		}
+
+	std::vector<float> result(scene.size());
+	DofReference(scene.data(), depth.data(), width, height, depthScale, depthBias, params, result.data());
+	CheckGolden("dof", result.data(), width, height, 1e-4f);
+
+	// The far wall left of the post (clear of it by the largest
+	// blur) should come out smoother than it went in
+	int wallRight = 30 - (int)params.MaxCoC * 2;
+	double before = Variance(scene, width, 0, 0, wallRight, height, 0);
+	double after = Variance(result, width, 0, 0, wallRight, height, 0);
+	printf("  far wall contrast (variance) %.4f -> %.4f  %s\n", before, after, CheckResult(after < 0.5 * before));
+
+	// Everything at the focus distance: nothing should change
+	std::vector<float> focused(depth.size(), zNear / params.FocusDistance);
+	DofReference(scene.data(), focused.data(), width, height, depthScale, depthBias, params, result.data());
+	float worst = 0;
+	for (size_t i = 0; i < scene.size(); i++)
+		if (i % 4 != 3 && fabsf(result[i] - scene[i]) > worst) worst = fabsf(result[i] - scene[i]);
+	printf("  scene all in focus: off by %.3g  %s\n", worst, CheckResult(worst < 1e-5f));
+}
+
+struct Check
+{
+	const char* Name;
+	void (*Run)();
+};
+
+static const Check checks[] =
+{
+	{ "profiler", ProfilerOverheadReport },
+	{ "graph", Graph },
+	{ "pool", Pool },
+	{ "clears", Clears },
+	{ "clusters", Clusters },
+	{ "cascades", Cascades },
+	{ "atlas", Atlas },
+	{ "streamer", Streamer },
+	{ "residency", TextureResidencyReport },
+	{ "cooker", Cooker },
+	{ "sky", Sky },
+	{ "depth", Depth },
+	{ "vt", VirtualTextureReport },
+	{ "states", StateCacheReport },
+	{ "arrays", TextureArrayReport },
+	{ "gbuffer", GBuffer },
+	{ "blur", BlurImage },
+	{ "bloom", BloomImage },
+	{ "dof", DofImage },
+	{ "gpuprofiler", GpuProfilerReport },
+	{ "replay", SimReplayReport },
+};
+
+int main(int argc, char** argv)
+{
+	std::vector<const Check*> run;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--list"))
+		{
+			for (auto& c : checks) printf("%s\n", c.Name);
+			return 0;
+		}
+		if (!strcmp(argv[i], "--update-golden"))
+		{
+			updateGolden = true;
+			continue;
+		}
+		const Check* found = 0;
+		for (auto& c : checks)
+			if (!strcmp(argv[i], c.Name)) found = &c;
+		if (!found)
+		{
+			printf("no check named %s (--list shows them)\n", argv[i]);
+			return 1;
+		}
+		run.push_back(found);
+	}
+	if (run.empty())
+		for (auto& c : checks) run.push_back(&c);
+
+	// Timings and the synthetic backends' busy work count TSC
+	// ticks, which mean nothing until the profiler calibrates
+	Profiler::Init();
+	for (auto c : run) c->Run();
+	Profiler::Shutdown();
+
+	unsigned int failures = CheckFailureCount();
+	printf("\n%u check%s FAILED\n", failures, failures == 1 ? "" : "s");
+	return (int)failures;
+}
@@ -0,0 +1,72 @@
+// --------------------------------------------------------
+// Command line depth precision analysis
+//
+//   DepthPrecision [--near N] [--far F] [distance ...]
+//
+// Prints how wide a depth step is by distance for the
+// standard projection (at far F and 100 F) and the reversed
+// infinite one the game uses, each with a 24 bit and a float
+// depth buffer, and where surfaces 0.1% apart start to
+// z-fight (defaults are the game's, near 0.1 and far 100).
+// Distances given after that get the step for every setup.
+//
+// Build (no project file - it's one source plus the kernel):
+//   cl /O2 /EHsc /std:c++17 /I..\..\DX11Starter main.cpp ..\..\DX11Starter\DepthPrecision.cpp
+//   g++ -O2 -std=c++17 -I../../DX11Starter main.cpp ../../DX11Starter/DepthPrecision.cpp
+// --------------------------------------------------------
+#include "DepthPrecision.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static int Usage()
+{
+	printf("usage: DepthPrecision [--near N] [--far F] [distance ...]\n");
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	float zNear = 0.1f, zFar = 100.0f;
+	std::vector<double> distances;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--near") == 0 && i + 1 < argc) zNear = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--far") == 0 && i + 1 < argc) zFar = (float)atof(argv[++i]);
+		else if (argv[i][0] != '-' && atof(argv[i]) > 0) distances.push_back(atof(argv[i]));
+		else return Usage();
+	}
+	if (zNear <= 0 || zFar <= zNear)
+		return Usage();
+
+	DepthPrecisionReport(zNear, zFar);
+	if (distances.empty())
+		return 0;
+
+	const DepthSetup setups[] =
+	{
+		{ "standard 24 bit", DEPTH_STANDARD, DEPTH_UNORM24, zNear, zFar },
+		{ "standard float", DEPTH_STANDARD, DEPTH_FLOAT32, zNear, zFar },
+		{ "reversed 24 bit", DEPTH_REVERSED_INFINITE, DEPTH_UNORM24, zNear, 0 },
+		{ "reversed float", DEPTH_REVERSED_INFINITE, DEPTH_FLOAT32, zNear, 0 },
+	};
+	printf("\n%-12s", "distance");
+	for (auto& s : setups) printf("  %16s", s.Name);
+	printf("\n");
+	for (auto& d : distances)
+	{
+		printf("%-12g", d);
+		for (auto& s : setups)
+		{
+			double step = DepthResolution(s, d);
+			if (step == 0) printf("  %16s", "clipped");
+			else if (std::isinf(step)) printf("  %16s", "far plane");
+			else printf("  %16.4g", step);
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+// --------------------------------------------------------
+// Command line sky convolution
+//
+//   SkyConvolution [--threads N] [--irradiance N] [--specular N] [--mips N]
+//                  sky.dds irradiance.dds specular.dds
+//   SkyConvolution --report [size]
+//
+// Reads a cube map DDS (Textures/nightSkybox.dds) and writes
+// its diffuse irradiance cube (default 32x32) and prefiltered
+// GGX specular cube (default 128x128, 6 mips), both RGBA16F,
+// with how long each took, and prints its 9 irradiance SH
+// coefficients.  The game makes the same at startup (see
+// SkyLighting.h); this is for looking at them, and timing.
+//
+// Build (no project file - it's one source plus the kernel,
+// which decodes BC1 / BC7 skies through the texture cooker):
+//   cl /O2 /EHsc /std:c++17 /I..\..\DX11Starter main.cpp ..\..\DX11Starter\SkyConvolution.cpp ..\..\DX11Starter\TextureCooker.cpp
+//   g++ -O2 -std=c++17 -pthread -I../../DX11Starter main.cpp ../../DX11Starter/SkyConvolution.cpp ../../DX11Starter/TextureCooker.cpp
+// --------------------------------------------------------
+#include "SkyConvolution.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static bool ReadFile(const char* path, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	data->resize(size > 0 ? (size_t)size : 0);
+	bool ok = size > 0 && fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return ok;
+}
+
+static bool WriteFile(const char* path, const std::vector<unsigned char>& data)
+{
+	FILE* file = fopen(path, "wb");
+	bool ok = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+	if (file) fclose(file);
+	if (!ok) printf("couldn't write %s\n", path);
+	return ok;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int Usage()
+{
+	printf("usage: SkyConvolution [--threads N] [--irradiance N] [--specular N] [--mips N]\n");
+	printf("                      sky.dds irradiance.dds specular.dds\n");
+	printf("       SkyConvolution --report [size]\n");
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int threads = 0, irradianceSize = 32, specularSize = 128, mips = 6;
+	const char* paths[3] = {};
+	int pathCount = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--report") == 0)
+		{
+			SkyConvolutionReport(i + 1 < argc ? (unsigned int)atoi(argv[i + 1]) : 256);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--irradiance") == 0 && i + 1 < argc) irradianceSize = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--specular") == 0 && i + 1 < argc) specularSize = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--mips") == 0 && i + 1 < argc) mips = (unsigned int)atoi(argv[++i]);
+		else if (argv[i][0] != '-' && pathCount < 3) paths[pathCount++] = argv[i];
+		else return Usage();
+	}
+	if (pathCount != 3 || irradianceSize == 0 || specularSize == 0 || mips < 2)
+		return Usage();
+
+	std::vector<unsigned char> file;
+	SkyCube sky;
+	if (!ReadFile(paths[0], &file) || !SkyReadDDS(file.data(), file.size(), &sky))
+	{
+		printf("couldn't read %s (needs a cube map: RGBA8, BGRA8, RGBA16F, RGBA32F, BC1 or BC7)\n", paths[0]);
+		return 1;
+	}
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	printf("%s: %ux%u cube, %u threads\n", paths[0], sky.Size, sky.Size, threads);
+
+	auto start = std::chrono::steady_clock::now();
+	SkyCube irradiance = SkyIrradiance(sky, irradianceSize, threads);
+	double irradianceSeconds = SecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	SkySH9 sh = SkyProjectSH(sky, threads);
+	double shSeconds = SecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	std::vector<SkyCube> specular = SkyPrefilter(sky, specularSize, mips, threads);
+	double specularSeconds = SecondsSince(start);
+
+	std::vector<unsigned char> dds;
+	SkyWriteDDS({ irradiance }, &dds);
+	if (!WriteFile(paths[1], dds))
+		return 1;
+	printf("%s: %ux%u irradiance, %.2f s\n", paths[1], irradiance.Size, irradiance.Size, irradianceSeconds);
+
+	SkyWriteDDS(specular, &dds);
+	if (!WriteFile(paths[2], dds))
+		return 1;
+	printf("%s: %ux%u specular, %u mips, %.2f s\n", paths[2], specular[0].Size, specular[0].Size,
+		(unsigned int)specular.size(), specularSeconds);
+
+	printf("SH, %.2f ms:\n", shSeconds * 1000);
+	for (int i = 0; i < 9; i++)
+		printf("  %d: %9.5f %9.5f %9.5f\n", i, sh.Coeffs[i][0], sh.Coeffs[i][1], sh.Coeffs[i][2]);
+	return 0;
+}
@@ -0,0 +1,193 @@
+// --------------------------------------------------------
+// Command line texture cooker
+//
+//   TextureCooker [--bc1 | --bc5 | --bc7] [--threads N] in out.dds
+//   TextureCooker --report [size]
+//
+// Without a format flag, files with "normal" in the name
+// become BC5 and everything else BC7.  Run it over the
+// Textures folder and the game picks the .dds up instead of
+// the source image.
+//
+// Build (no project file - it's one source plus the cooker):
+//   cl /O2 /EHsc /std:c++17 /I..\..\DX11Starter main.cpp ..\..\DX11Starter\TextureCooker.cpp
+//   g++ -O2 -std=c++17 -pthread -I../../DX11Starter main.cpp ../../DX11Starter/TextureCooker.cpp
+//
+// On Windows any format WIC reads works.  Elsewhere only
+// binary PPM (P6) and PAM (P7, RGB or RGBA) are read - convert
+// with any image tool first.
+// --------------------------------------------------------
+#include "TextureCooker.h"
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs.lib")
+
+static bool ReadImage(const char* path, CookImage* image)
+{
+	wchar_t widePath[MAX_PATH];
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, widePath, MAX_PATH);
+
+	CoInitializeEx(0, COINIT_MULTITHREADED);
+	IWICImagingFactory* factory = 0;
+	IWICBitmapDecoder* decoder = 0;
+	IWICBitmapFrameDecode* frame = 0;
+	IWICFormatConverter* converter = 0;
+	bool ok =
+		SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))) &&
+		SUCCEEDED(factory->CreateDecoderFromFilename(widePath, 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder)) &&
+		SUCCEEDED(decoder->GetFrame(0, &frame)) &&
+		SUCCEEDED(factory->CreateFormatConverter(&converter)) &&
+		SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0, WICBitmapPaletteTypeCustom)) &&
+		SUCCEEDED(converter->GetSize(&image->Width, &image->Height));
+
+	if (ok)
+	{
+		image->Pixels.resize((size_t)image->Width * image->Height * 4);
+		ok = SUCCEEDED(converter->CopyPixels(0, image->Width * 4, (UINT)image->Pixels.size(), image->Pixels.data()));
+	}
+
+	if (converter) converter->Release();
+	if (frame) frame->Release();
+	if (decoder) decoder->Release();
+	if (factory) factory->Release();
+	CoUninitialize();
+	return ok;
+}
+#else
+// Next header number, skipping whitespace and comments
+static bool ReadNumber(FILE* file, unsigned int* value)
+{
+	int c = fgetc(file);
+	while (c == '#' || isspace(c))
+	{
+		if (c == '#')
+			while (c != '\n' && c != EOF) c = fgetc(file);
+		c = fgetc(file);
+	}
+	if (!isdigit(c))
+		return false;
+	*value = 0;
+	for (; isdigit(c); c = fgetc(file))
+		*value = *value * 10 + (c - '0');
+	return true;
+}
+
+// Binary PPM (P6) and PAM (P7), 8 bits per channel
+static bool ReadImage(const char* path, CookImage* image)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	char magic[3] = {};
+	unsigned int channels = 3, maxValue = 0;
+	bool ok = fread(magic, 1, 2, file) == 2;
+	if (ok && strcmp(magic, "P6") == 0)
+	{
+		ok = ReadNumber(file, &image->Width) && ReadNumber(file, &image->Height) && ReadNumber(file, &maxValue);
+	}
+	else if (ok && strcmp(magic, "P7") == 0)
+	{
+		char line[256];
+		image->Width = image->Height = 0;
+		while (fgets(line, sizeof(line), file) && strncmp(line, "ENDHDR", 6) != 0)
+		{
+			sscanf(line, "WIDTH %u", &image->Width);
+			sscanf(line, "HEIGHT %u", &image->Height);
+			sscanf(line, "DEPTH %u", &channels);
+			sscanf(line, "MAXVAL %u", &maxValue);
+		}
+	}
+	else
+		ok = false;
+	ok = ok && maxValue == 255 && (channels == 3 || channels == 4) && image->Width > 0 && image->Height > 0;
+
+	if (ok)
+	{
+		size_t count = (size_t)image->Width * image->Height;
+		std::vector<unsigned char> raw(count * channels);
+		ok = fread(raw.data(), 1, raw.size(), file) == raw.size();
+		image->Pixels.resize(count * 4);
+		for (size_t i = 0; ok && i < count; i++)
+		{
+			for (unsigned int c = 0; c < 3; c++) image->Pixels[i * 4 + c] = raw[i * channels + c];
+			image->Pixels[i * 4 + 3] = channels == 4 ? raw[i * 4 + 3] : 255;
+		}
+	}
+	fclose(file);
+	return ok;
+}
+#endif
+
+static int Usage()
+{
+	printf("usage: TextureCooker [--bc1 | --bc5 | --bc7] [--threads N] in out.dds\n");
+	printf("       TextureCooker --report [size]\n");
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	int format = -1;
+	unsigned int threads = 0;
+	const char* paths[2] = {};
+	int pathCount = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--report") == 0)
+		{
+			TextureCookerReport(i + 1 < argc ? (unsigned int)atoi(argv[i + 1]) : 1024);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--bc1") == 0) format = COOK_BC1;
+		else if (strcmp(argv[i], "--bc5") == 0) format = COOK_BC5;
+		else if (strcmp(argv[i], "--bc7") == 0) format = COOK_BC7;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned int)atoi(argv[++i]);
+		else if (argv[i][0] != '-' && pathCount < 2) paths[pathCount++] = argv[i];
+		else return Usage();
+	}
+	if (pathCount != 2)
+		return Usage();
+
+	if (format < 0)
+	{
+		std::string name = paths[0];
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		format = name.find("normal") != std::string::npos ? COOK_BC5 : COOK_BC7;
+	}
+
+	CookImage image;
+	if (!ReadImage(paths[0], &image))
+	{
+		printf("couldn't read %s\n", paths[0]);
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<unsigned char> dds;
+	CookDDS(image, (CookFormat)format, threads, &dds);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	FILE* out = fopen(paths[1], "wb");
+	if (!out || fwrite(dds.data(), 1, dds.size(), out) != dds.size())
+	{
+		printf("couldn't write %s\n", paths[1]);
+		if (out) fclose(out);
+		return 1;
+	}
+	fclose(out);
+
+	const char* names[3] = { "BC1", "BC5", "BC7" };
+	printf("%s: %ux%u %s, %u bytes, %.2f s\n", paths[1], image.Width, image.Height, names[format], (unsigned int)dds.size(), seconds);
+	return 0;
+}